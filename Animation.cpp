@@ -0,0 +1,316 @@
+#include "Animation.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+
+#define ANIM_BENCH_TICKS 600 // Ten seconds of animation
+
+static_assert(ANIM_CHANNELS == ANIM_LAYERS * ANIM_LAYER_CHANNELS, "Every layer owns ANIM_LAYER_CHANNELS channels");
+
+// Legs: left, right swing. Arm: yaw, hand pull. The drawn bow is the pose
+// the player is modelled in, so it is zero.
+static const float idleTimes[] = { 0.0f, 1.0f };
+static const float idleValues[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+static const float walkTimes[] = { 0.0f, 0.25f, 0.75f, 1.0f };
+static const float walkValues[] = { 0.0f, 0.0f, 15.0f, -15.0f, -15.0f, 15.0f, 0.0f, 0.0f };
+static const float drawTimes[] = { 0.0f, 0.2f, 0.6f };
+static const float drawValues[] = { -10.0f, -0.15f, -4.0f, 0.05f, 0.0f, 0.0f };
+static const float releaseTimes[] = { 0.0f, 0.06f, 0.3f };
+static const float releaseValues[] = { 0.0f, 0.0f, -14.0f, -0.2f, -10.0f, -0.15f };
+static const float cheerTimes[] = { 0.0f, 0.3f, 0.6f, 0.9f, 1.2f };
+static const float cheerValues[] = { 0.0f, 0.0f, 25.0f, -0.1f, 0.0f, 0.0f, -25.0f, -0.1f, 0.0f, 0.0f };
+
+#define CLIP_KEYS(name) sizeof(name##Times) / sizeof(name##Times[0]), name##Times, name##Values
+
+const AnimationClip animationClips[CLIP_COUNT] = {
+	{ "idle", ANIM_LAYER_LEGS, true, CLIP_KEYS(idle) },
+	{ "walk", ANIM_LAYER_LEGS, true, CLIP_KEYS(walk) },
+	{ "draw bow", ANIM_LAYER_ARM, false, CLIP_KEYS(draw) },
+	{ "release", ANIM_LAYER_ARM, false, CLIP_KEYS(release) },
+	{ "cheer", ANIM_LAYER_ARM, true, CLIP_KEYS(cheer) }
+};
+
+// Moves time on a tick, wrapping a looping clip and holding any other at
+// its end. Returns true when it wrapped.
+static inline bool stepTime(const AnimationClip& clip, float& time) {
+	float length = clip.times[clip.keyCount - 1];
+	time += ANIM_TICK;
+	if (time < length) return false;
+	if (!clip.loop) {
+		time = length;
+		return false;
+	}
+	time = fmodf(time - length, length);
+	return true;
+}
+
+// Moves segment forward to the one holding time.
+static inline int seekSegment(const AnimationClip& clip, float time, int segment) {
+	while (segment < clip.keyCount - 2 && time >= clip.times[segment + 1]) segment++;
+	return segment;
+}
+
+// Every channel of the layer at time, which lies in segment.
+static inline void samplePose(const AnimationClip& clip, float time, int segment, float pose[ANIM_LAYER_CHANNELS]) {
+	const float* from = clip.values + segment * ANIM_LAYER_CHANNELS;
+	float t0 = clip.times[segment], t1 = clip.times[segment + 1];
+	float f = time >= t1 ? 1.0f : (time - t0) / (t1 - t0);
+	for (int k = 0; k < ANIM_LAYER_CHANNELS; k++) pose[k] = from[k] + (from[k + ANIM_LAYER_CHANNELS] - from[k]) * f;
+}
+
+// pose becomes the blend of from and pose.
+static inline void blendPose(const float from[ANIM_LAYER_CHANNELS], float blend, float pose[ANIM_LAYER_CHANNELS]) {
+	for (int k = 0; k < ANIM_LAYER_CHANNELS; k++) pose[k] = from[k] + (pose[k] - from[k]) * blend;
+}
+
+static inline float fadeStep(float fade) {
+	return fade > ANIM_TICK ? ANIM_TICK / fade : 1.0f;
+}
+
+AnimationSet::AnimationSet(int characters) : count(characters), pending(0.0f) {
+	const AnimationClipId start[ANIM_LAYERS] = { CLIP_IDLE, CLIP_DRAW_BOW };
+	for (int l = 0; l < ANIM_LAYERS; l++) {
+		const AnimationClip& clip = animationClips[start[l]];
+		// Looping clips start at their first key, the rest at their last.
+		float time = clip.loop ? 0.0f : clip.times[clip.keyCount - 1];
+		int segment = clip.loop ? 0 : clip.keyCount - 2;
+		Layer& layer = layers[l];
+		layer.clip.assign(count, start[l]);
+		layer.segment.assign(count, segment);
+		layer.time.assign(count, time);
+		layer.segmentStart.resize(count);
+		layer.segmentEnd.resize(count);
+		layer.segmentScale.resize(count);
+		for (int k = 0; k < ANIM_LAYER_CHANNELS; k++) {
+			layer.base[k].resize(count);
+			layer.slope[k].resize(count);
+		}
+		layer.fromClip.assign(count, start[l]);
+		layer.fromSegment.assign(count, segment);
+		layer.fromTime.assign(count, time);
+		layer.blend.assign(count, 1.0f);
+		layer.blendStep.assign(count, 1.0f);
+		for (int i = 0; i < count; i++) cacheSegment(layer, i);
+	}
+	for (int c = 0; c < ANIM_CHANNELS; c++) values[c].assign(count, 0.0f);
+	for (int l = 0; l < ANIM_LAYERS; l++) sample(l);
+}
+
+void AnimationSet::play(int character, AnimationClipId clip, float fade) {
+	Layer& layer = layers[animationClips[clip].layer];
+	if (layer.clip[character] == clip) return;
+	if (layer.blend[character] >= 1.0f) layer.fading.push_back(character);
+	layer.fromClip[character] = layer.clip[character];
+	layer.fromSegment[character] = layer.segment[character];
+	layer.fromTime[character] = layer.time[character];
+	layer.clip[character] = clip;
+	layer.segment[character] = 0;
+	layer.time[character] = 0.0f;
+	layer.blend[character] = 0.0f;
+	layer.blendStep[character] = fadeStep(fade);
+	cacheSegment(layer, character);
+}
+
+void AnimationSet::advance(float seconds) {
+	pending += seconds;
+	for (int ticks = 0; pending >= ANIM_TICK && ticks < ANIM_MAX_TICKS; ticks++) {
+		tick();
+		pending -= ANIM_TICK;
+	}
+	if (pending >= ANIM_TICK) pending = 0.0f;
+}
+
+void AnimationSet::cacheSegment(Layer& layer, int i) {
+	const AnimationClip& clip = animationClips[layer.clip[i]];
+	int segment = layer.segment[i];
+	const float* key = clip.values + segment * ANIM_LAYER_CHANNELS;
+	float length = clip.times[clip.keyCount - 1];
+	if (!clip.loop && layer.time[i] >= length) {
+		// Held on the last key for good.
+		layer.segmentStart[i] = length;
+		layer.segmentEnd[i] = HUGE_VALF;
+		layer.segmentScale[i] = 0.0f;
+		for (int k = 0; k < ANIM_LAYER_CHANNELS; k++) {
+			layer.base[k][i] = key[k + ANIM_LAYER_CHANNELS];
+			layer.slope[k][i] = 0.0f;
+		}
+		return;
+	}
+	layer.segmentStart[i] = clip.times[segment];
+	layer.segmentEnd[i] = clip.times[segment + 1];
+	layer.segmentScale[i] = 1.0f / (clip.times[segment + 1] - clip.times[segment]);
+	for (int k = 0; k < ANIM_LAYER_CHANNELS; k++) {
+		layer.base[k][i] = key[k];
+		layer.slope[k][i] = key[k + ANIM_LAYER_CHANNELS] - key[k];
+	}
+}
+
+// Only called when a tick carries time past the end of its segment, which
+// is a few times a second per character.
+void AnimationSet::nextSegment(Layer& layer, int i) {
+	const AnimationClip& clip = animationClips[layer.clip[i]];
+	float length = clip.times[clip.keyCount - 1];
+	float& time = layer.time[i];
+	if (time >= length) {
+		if (clip.loop) {
+			time = fmodf(time - length, length);
+			layer.segment[i] = 0;
+		}
+		else {
+			time = length;
+		}
+	}
+	layer.segment[i] = seekSegment(clip, time, layer.segment[i]);
+	cacheSegment(layer, i);
+}
+
+void AnimationSet::sample(int l) {
+	const Layer& layer = layers[l];
+	const float* time = &layer.time[0];
+	const float* start = &layer.segmentStart[0];
+	const float* scale = &layer.segmentScale[0];
+	for (int k = 0; k < ANIM_LAYER_CHANNELS; k++) {
+		float* out = &values[l * ANIM_LAYER_CHANNELS + k][0];
+		const float* base = &layer.base[k][0];
+		const float* slope = &layer.slope[k][0];
+		for (int i = 0; i < count; i++) out[i] = base[i] + slope[i] * ((time[i] - start[i]) * scale[i]);
+	}
+}
+
+void AnimationSet::tick() {
+	if (count == 0) return;
+	for (int l = 0; l < ANIM_LAYERS; l++) {
+		Layer& layer = layers[l];
+		float* time = &layer.time[0];
+		const float* end = &layer.segmentEnd[0];
+		for (int i = 0; i < count; i++) time[i] += ANIM_TICK;
+		for (int i = 0; i < count; i++) {
+			if (time[i] >= end[i]) nextSegment(layer, i);
+		}
+		sample(l);
+
+		// Characters part way through a fade mix in the clip they left.
+		for (size_t n = 0; n < layer.fading.size(); ) {
+			int i = layer.fading[n];
+			const AnimationClip& from = animationClips[layer.fromClip[i]];
+			if (stepTime(from, layer.fromTime[i])) layer.fromSegment[i] = 0;
+			layer.fromSegment[i] = seekSegment(from, layer.fromTime[i], layer.fromSegment[i]);
+			layer.blend[i] = fminf(1.0f, layer.blend[i] + layer.blendStep[i]);
+			float fromPose[ANIM_LAYER_CHANNELS], pose[ANIM_LAYER_CHANNELS];
+			samplePose(from, layer.fromTime[i], layer.fromSegment[i], fromPose);
+			for (int k = 0; k < ANIM_LAYER_CHANNELS; k++) pose[k] = values[l * ANIM_LAYER_CHANNELS + k][i];
+			blendPose(fromPose, layer.blend[i], pose);
+			for (int k = 0; k < ANIM_LAYER_CHANNELS; k++) values[l * ANIM_LAYER_CHANNELS + k][i] = pose[k];
+			if (layer.blend[i] < 1.0f) {
+				n++;
+			}
+			else {
+				layer.fading[n] = layer.fading.back();
+				layer.fading.pop_back();
+			}
+		}
+	}
+}
+
+// The usual way to write the same thing, which the benchmark measures
+// AnimationSet against: each character's state kept together, and the key
+// segment searched for from the first key on every tick.
+struct ArcherAnimation {
+	struct {
+		int clip, fromClip;
+		float time, fromTime, blend, blendStep;
+	} layers[ANIM_LAYERS];
+	float values[ANIM_CHANNELS];
+};
+
+static void playArcher(ArcherAnimation& archer, AnimationClipId clip, float fade) {
+	auto& layer = archer.layers[animationClips[clip].layer];
+	if (layer.clip == clip) return;
+	layer.fromClip = layer.clip;
+	layer.fromTime = layer.time;
+	layer.clip = clip;
+	layer.time = 0.0f;
+	layer.blend = 0.0f;
+	layer.blendStep = fadeStep(fade);
+}
+
+static void tickArcher(ArcherAnimation& archer) {
+	for (int l = 0; l < ANIM_LAYERS; l++) {
+		auto& layer = archer.layers[l];
+		const AnimationClip& clip = animationClips[layer.clip];
+		const AnimationClip& from = animationClips[layer.fromClip];
+		stepTime(clip, layer.time);
+		int segment = seekSegment(clip, layer.time, 0);
+		int fromSegment = 0;
+		if (layer.blend < 1.0f) {
+			stepTime(from, layer.fromTime);
+			fromSegment = seekSegment(from, layer.fromTime, 0);
+			layer.blend = fminf(1.0f, layer.blend + layer.blendStep);
+		}
+		float* pose = archer.values + l * ANIM_LAYER_CHANNELS;
+		samplePose(clip, layer.time, segment, pose);
+		if (layer.blend < 1.0f) {
+			float fromPose[ANIM_LAYER_CHANNELS];
+			samplePose(from, layer.fromTime, fromSegment, fromPose);
+			blendPose(fromPose, layer.blend, pose);
+		}
+	}
+}
+
+// What archer does at tick: every second and a half it starts or stops
+// walking, and every two and a half it looses an arrow and draws the next.
+// Spread by archer so they are all out of step.
+template <class Play>
+static void benchmarkActions(int tick, int archer, Play play) {
+	int walk = tick + archer * 37;
+	if (walk % 90 == 0) play(archer, (walk / 90 + archer) % 2 ? CLIP_WALK : CLIP_IDLE, 0.2f);
+	int shot = (tick + archer * 13) % 150;
+	if (shot == 0) play(archer, CLIP_RELEASE, 0.0f);
+	else if (shot == 40) play(archer, CLIP_DRAW_BOW, 0.1f);
+}
+
+void benchmarkAnimation(int archers) {
+	AnimationSet set(archers);
+	std::vector<ArcherAnimation> separate(archers);
+	for (int i = 0; i < archers; i++) {
+		ArcherAnimation& archer = separate[i];
+		for (int l = 0; l < ANIM_LAYERS; l++) {
+			// Match AnimationSet's start: idle, and the draw held at its end.
+			const AnimationClip& clip = animationClips[l == ANIM_LAYER_LEGS ? CLIP_IDLE : CLIP_DRAW_BOW];
+			archer.layers[l].clip = archer.layers[l].fromClip = l == ANIM_LAYER_LEGS ? CLIP_IDLE : CLIP_DRAW_BOW;
+			archer.layers[l].time = archer.layers[l].fromTime = clip.loop ? 0.0f : clip.times[clip.keyCount - 1];
+			archer.layers[l].blend = archer.layers[l].blendStep = 1.0f;
+		}
+	}
+
+	// Only the ticks are timed; the clips each archer is asked to play are the
+	// same for both.
+	std::chrono::steady_clock::duration setTime(0), separateTime(0);
+	for (int tick = 0; tick < ANIM_BENCH_TICKS; tick++) {
+		for (int i = 0; i < archers; i++) {
+			benchmarkActions(tick, i, [&](int archer, AnimationClipId clip, float fade) { set.play(archer, clip, fade); });
+			benchmarkActions(tick, i, [&](int archer, AnimationClipId clip, float fade) { playArcher(separate[archer], clip, fade); });
+		}
+		auto start = std::chrono::steady_clock::now();
+		set.tick();
+		auto middle = std::chrono::steady_clock::now();
+		for (int i = 0; i < archers; i++) tickArcher(separate[i]);
+		auto end = std::chrono::steady_clock::now();
+		setTime += middle - start;
+		separateTime += end - middle;
+	}
+
+	float difference = 0.0f;
+	for (int c = 0; c < ANIM_CHANNELS; c++) {
+		for (int i = 0; i < archers; i++) difference = fmaxf(difference, fabsf(set.channel((AnimationChannel)c)[i] - separate[i].values[c]));
+	}
+	double setUs = std::chrono::duration<double, std::micro>(setTime).count() / ANIM_BENCH_TICKS;
+	double separateUs = std::chrono::duration<double, std::micro>(separateTime).count() / ANIM_BENCH_TICKS;
+	printf("[anim] %d archers, %d ticks of %.1f ms, %d channels each\n", archers, ANIM_BENCH_TICKS, ANIM_TICK * 1000.0f, ANIM_CHANNELS);
+	printf("[anim] batched:    %.1f us per tick, %.1f ns per archer, %.1f%% of a tick\n",
+		setUs, setUs * 1000.0 / archers, setUs / (ANIM_TICK * 1e6) * 100.0);
+	printf("[anim] per archer: %.1f us per tick, %.1f ns per archer (%.1fx the batch)\n",
+		separateUs, separateUs * 1000.0 / archers, setUs > 0 ? separateUs / setUs : 0.0);
+	printf("[anim] largest difference %g\n", difference);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+
+// Keyframed clips played on many characters at once. A character has two
+// layers, the legs and the drawing arm, each playing one clip and
+// cross-fading to the next when it changes. Time moves in fixed ticks, so a
+// clip looks the same at any frame rate. Each layer remembers the key
+// segment it is in, and a tick only ever moves it forward, so sampling never
+// searches the keys. The state of every character is kept in arrays, one
+// per field, and a tick walks each array from start to end.
+
+#define ANIM_TICK (1.0f / 60.0f) // Seconds
+#define ANIM_MAX_TICKS 15 // Per advance()
+#define ANIM_LAYER_CHANNELS 2
+
+// What the clips drive: the legs' swing and, for the drawing arm, the yaw
+// and the hand's pull added to the arm's modelled pose. Degrees, except the
+// hand, which is in the body's units.
+enum AnimationChannel {
+	ANIM_LEFT_LEG,
+	ANIM_RIGHT_LEG,
+	ANIM_DRAW_ARM,
+	ANIM_DRAW_HAND,
+	ANIM_CHANNELS
+};
+
+// Layer l owns channels l * ANIM_LAYER_CHANNELS on.
+enum AnimationLayer {
+	ANIM_LAYER_LEGS,
+	ANIM_LAYER_ARM,
+	ANIM_LAYERS
+};
+
+enum AnimationClipId {
+	CLIP_IDLE,
+	CLIP_WALK,
+	CLIP_DRAW_BOW, // From the release's end back to full draw, then holds
+	CLIP_RELEASE,  // Lets go and holds the follow-through
+	CLIP_CHEER,    // Waves the bow from side to side, for the crowd
+	CLIP_COUNT
+};
+
+struct AnimationClip {
+	const char* name;
+	AnimationLayer layer;
+	bool loop; // Otherwise it holds its last key
+	int keyCount;
+	const float* times;  // Ascending from 0; the last is the clip's length
+	const float* values; // ANIM_LAYER_CHANNELS per key
+};
+
+extern const AnimationClip animationClips[CLIP_COUNT];
+
+class AnimationSet {
+public:
+	// Every character starts idle with the bow drawn.
+	explicit AnimationSet(int characters);
+
+	// Starts the clip from its first key on its layer, fading out what the
+	// layer showed over fade seconds. A fade still running is cut short.
+	// Asking for the clip the layer already plays does nothing.
+	void play(int character, AnimationClipId clip, float fade);
+	// Runs the ticks seconds holds and keeps the remainder for next time. A
+	// long stall runs at most ANIM_MAX_TICKS and drops the rest.
+	void advance(float seconds);
+	void tick();
+
+	int size() const { return count; }
+	// The channel's value for each character, as of the last tick.
+	const float* channel(AnimationChannel c) const { return &values[c][0]; }
+
+private:
+	// One entry per character in each.
+	struct Layer {
+		std::vector<int> clip, segment;
+		std::vector<float> time;
+		// The segment time is in, kept so that a tick inside it reads no keys:
+		// where it starts and ends, one over its length, and each channel's
+		// value at its start and change across it.
+		std::vector<float> segmentStart, segmentEnd, segmentScale;
+		std::vector<float> base[ANIM_LAYER_CHANNELS], slope[ANIM_LAYER_CHANNELS];
+		std::vector<int> fromClip, fromSegment; // What is fading out
+		std::vector<float> fromTime;
+		std::vector<float> blend;     // Share of clip in the pose; 1 once the fade is done
+		std::vector<float> blendStep; // Added each tick
+		std::vector<int> fading;      // The characters whose blend is below 1
+	};
+
+	void cacheSegment(Layer& layer, int character);
+	void nextSegment(Layer& layer, int character);
+	void sample(int layer); // Writes the layer's channels from the cached segments
+
+	int count;
+	float pending; // Seconds not yet ticked
+	Layer layers[ANIM_LAYERS];
+	std::vector<float> values[ANIM_CHANNELS];
+};
+
+// Ticks archers characters through a mix of clips and fades and prints the
+// time per tick, against per-character state that searches the keys.
+void benchmarkAnimation(int archers);
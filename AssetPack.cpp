@@ -0,0 +1,298 @@
+#include "AssetPack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define MAX_ASSET_NAME 260
+#define ASSET_ALIGNMENT 16
+
+static const unsigned char* packData = 0;
+static unsigned int packSize = 0;
+static const AssetPackEntry* packEntries = 0;
+static unsigned int packEntryCount = 0;
+
+#ifdef _WIN32
+static HANDLE packFile = INVALID_HANDLE_VALUE;
+static HANDLE packMapping = 0;
+#endif
+
+// Lower case, forward slashes, no leading "./". Returns the length, or -1 if too long.
+static int normalizeAssetName(const char* name, char* out) {
+	if (name[0] == '.' && (name[1] == '/' || name[1] == '\\')) name += 2;
+	int n = 0;
+	for (; name[n]; n++) {
+		if (n >= MAX_ASSET_NAME - 1) return -1;
+		char c = name[n];
+		if (c == '\\') c = '/';
+		if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+		out[n] = c;
+	}
+	out[n] = 0;
+	return n;
+}
+
+// 64-bit FNV-1a
+static unsigned long long hashAssetName(const char* name, int length) {
+	unsigned long long hash = 14695981039346656037ULL;
+	for (int i = 0; i < length; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool mapPackFile(const char* path) {
+#ifdef _WIN32
+	packFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, 0);
+	if (packFile == INVALID_HANDLE_VALUE) return false;
+	packSize = GetFileSize(packFile, 0);
+	packMapping = CreateFileMappingA(packFile, 0, PAGE_READONLY, 0, 0, 0);
+	if (packMapping) {
+		packData = (const unsigned char*)MapViewOfFile(packMapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!packData) {
+		if (packMapping) CloseHandle(packMapping);
+		CloseHandle(packFile);
+		packMapping = 0;
+		packFile = INVALID_HANDLE_VALUE;
+		return false;
+	}
+	return true;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* mapped = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping keeps the file alive
+	if (mapped == MAP_FAILED) return false;
+	packData = (const unsigned char*)mapped;
+	packSize = (unsigned int)st.st_size;
+	return true;
+#endif
+}
+
+static void unmapPackFile() {
+#ifdef _WIN32
+	UnmapViewOfFile(packData);
+	CloseHandle(packMapping);
+	CloseHandle(packFile);
+	packMapping = 0;
+	packFile = INVALID_HANDLE_VALUE;
+#else
+	munmap((void*)packData, packSize);
+#endif
+	packData = 0;
+	packSize = 0;
+}
+
+bool openAssetPack(const char* path) {
+	if (packData) closeAssetPack();
+	if (!mapPackFile(path)) return false;
+
+	const AssetPackHeader* header = (const AssetPackHeader*)packData;
+	bool valid = packSize >= sizeof(AssetPackHeader)
+		&& memcmp(header->magic, "APAK", 4) == 0
+		&& header->version == ASSET_PACK_VERSION
+		&& header->entryCount <= (packSize - sizeof(AssetPackHeader)) / sizeof(AssetPackEntry);
+	if (valid) {
+		packEntries = (const AssetPackEntry*)(packData + sizeof(AssetPackHeader));
+		packEntryCount = header->entryCount;
+		for (unsigned int i = 0; i < packEntryCount && valid; i++) {
+			const AssetPackEntry& e = packEntries[i];
+			valid = e.nameOffset <= packSize && e.nameLength <= packSize - e.nameOffset
+				&& e.dataOffset <= packSize && e.dataSize <= packSize - e.dataOffset;
+		}
+	}
+	if (!valid) {
+		printf("[assets] %s is not a valid asset pack\n", path);
+		closeAssetPack();
+		return false;
+	}
+	return true;
+}
+
+void closeAssetPack() {
+	if (packData) unmapPackFile();
+	packEntries = 0;
+	packEntryCount = 0;
+}
+
+bool isAssetPackOpen() {
+	return packData != 0;
+}
+
+const unsigned char* findAsset(const char* name, unsigned int* size) {
+	if (!packData) return 0;
+	char normalized[MAX_ASSET_NAME];
+	int length = normalizeAssetName(name, normalized);
+	if (length < 0) return 0;
+	unsigned long long hash = hashAssetName(normalized, length);
+
+	// Index is sorted by hash; collisions sit next to each other.
+	unsigned int lo = 0, hi = packEntryCount;
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		if (packEntries[mid].nameHash < hash) lo = mid + 1;
+		else hi = mid;
+	}
+	for (; lo < packEntryCount && packEntries[lo].nameHash == hash; lo++) {
+		const AssetPackEntry& e = packEntries[lo];
+		if (e.nameLength == (unsigned int)length && memcmp(packData + e.nameOffset, normalized, length) == 0) {
+			if (size) *size = e.dataSize;
+			return packData + e.dataOffset;
+		}
+	}
+	return 0;
+}
+
+static bool readWholeFile(const char* path, std::vector<unsigned char>& out) {
+	FILE* f = fopen(path, "rb");
+	if (!f) return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	out.resize(size > 0 ? size : 0);
+	bool ok = size >= 0 && fread(out.data(), 1, out.size(), f) == out.size();
+	fclose(f);
+	return ok;
+}
+
+bool writeAssetPack(const char* path, const char* const* files, int count) {
+	struct PendingEntry {
+		AssetPackEntry entry;
+		std::string name;
+		std::vector<unsigned char> data;
+	};
+	std::vector<PendingEntry> pending(count);
+	for (int i = 0; i < count; i++) {
+		char normalized[MAX_ASSET_NAME];
+		int length = normalizeAssetName(files[i], normalized);
+		if (length < 0 || !readWholeFile(files[i], pending[i].data)) {
+			printf("[assets] skipping %s, could not read it\n", files[i]);
+			pending[i].name.clear();
+			continue;
+		}
+		pending[i].name.assign(normalized, length);
+		pending[i].entry.nameHash = hashAssetName(normalized, length);
+		pending[i].entry.nameLength = length;
+		pending[i].entry.dataSize = (unsigned int)pending[i].data.size();
+	}
+	pending.erase(std::remove_if(pending.begin(), pending.end(), [](const PendingEntry& p) {
+		return p.name.empty();
+	}), pending.end());
+	count = (int)pending.size();
+
+	std::sort(pending.begin(), pending.end(), [](const PendingEntry& a, const PendingEntry& b) {
+		return a.entry.nameHash < b.entry.nameHash;
+	});
+
+	unsigned int offset = sizeof(AssetPackHeader) + count * sizeof(AssetPackEntry);
+	for (PendingEntry& p : pending) {
+		p.entry.nameOffset = offset;
+		offset += p.entry.nameLength;
+	}
+	for (PendingEntry& p : pending) {
+		offset = (offset + ASSET_ALIGNMENT - 1) & ~(ASSET_ALIGNMENT - 1);
+		p.entry.dataOffset = offset;
+		offset += p.entry.dataSize;
+	}
+
+	std::vector<unsigned char> out(offset, 0);
+	AssetPackHeader header;
+	memcpy(header.magic, "APAK", 4);
+	header.version = ASSET_PACK_VERSION;
+	header.entryCount = count;
+	header.reserved = 0;
+	memcpy(out.data(), &header, sizeof(header));
+	for (int i = 0; i < count; i++) {
+		const PendingEntry& p = pending[i];
+		memcpy(out.data() + sizeof(header) + i * sizeof(AssetPackEntry), &p.entry, sizeof(AssetPackEntry));
+		memcpy(out.data() + p.entry.nameOffset, p.name.data(), p.entry.nameLength);
+		if (p.entry.dataSize) memcpy(out.data() + p.entry.dataOffset, p.data.data(), p.entry.dataSize);
+	}
+
+	FILE* f = fopen(path, "wb");
+	if (!f) {
+		printf("[assets] could not write %s\n", path);
+		return false;
+	}
+	bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+	fclose(f);
+	printf("[assets] packed %d files into %s (%u bytes)\n", count, path, offset);
+	return ok;
+}
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static unsigned int checksum(const unsigned char* data, unsigned int size) {
+	unsigned int sum = 0;
+	for (unsigned int i = 0; i < size; i++) sum = sum * 31 + data[i];
+	return sum;
+}
+
+void benchmarkAssetLoading(const char* path, const char* const* files, int count, int passes) {
+	double looseFirst = 0, packFirst = 0, looseWarm = 0, packWarm = 0;
+	bool mismatch = false;
+	for (int pass = 0; pass < passes; pass++) {
+		unsigned int looseSum = 0, packSum = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<unsigned char> buffer;
+		for (int i = 0; i < count; i++) {
+			if (readWholeFile(files[i], buffer)) {
+				looseSum += checksum(buffer.data(), (unsigned int)buffer.size());
+			}
+		}
+		double looseMs = msSince(start);
+
+		start = std::chrono::steady_clock::now();
+		if (openAssetPack(path)) {
+			for (int i = 0; i < count; i++) {
+				unsigned int size = 0;
+				const unsigned char* data = findAsset(files[i], &size);
+				if (data) packSum += checksum(data, size);
+			}
+			closeAssetPack();
+		}
+		double packMs = msSince(start);
+
+		if (looseSum != packSum) mismatch = true;
+		if (pass == 0) {
+			looseFirst = looseMs;
+			packFirst = packMs;
+		}
+		else {
+			looseWarm += looseMs / (passes - 1);
+			packWarm += packMs / (passes - 1);
+		}
+	}
+	printf("[assets] %d files, first pass: loose %.3f ms, pack %.3f ms\n", count, looseFirst, packFirst);
+	if (passes > 1) {
+		printf("[assets] warm average of %d passes: loose %.3f ms, pack %.3f ms\n", passes - 1, looseWarm, packWarm);
+	}
+	if (mismatch) {
+		printf("[assets] pack contents differ from the loose files, rebuild %s\n", path);
+	}
+}
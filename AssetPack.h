@@ -0,0 +1,43 @@
+#pragma once
+
+// Read-only asset archive, memory-mapped once at startup. Entries are looked
+// up by a hash of their normalized path ("media/HitSound.mp3" and
+// "MEDIA\hitsound.mp3" are the same entry) and returned as pointers straight
+// into the mapping. The archive holds any named blob: sounds, baked meshes, config.
+//
+// Layout: AssetPackHeader, then entryCount AssetPackEntry records sorted by
+// nameHash, then the names, then the data, each entry aligned to 16 bytes.
+
+#define ASSET_PACK_FILE "assets.pak"
+#define ASSET_PACK_VERSION 1
+
+struct AssetPackHeader {
+	char magic[4];             // "APAK"
+	unsigned int version;
+	unsigned int entryCount;
+	unsigned int reserved;
+};
+
+struct AssetPackEntry {
+	unsigned long long nameHash;
+	unsigned int nameOffset;   // From the start of the file
+	unsigned int nameLength;
+	unsigned int dataOffset;   // From the start of the file
+	unsigned int dataSize;
+};
+
+bool openAssetPack(const char* path);
+void closeAssetPack();
+bool isAssetPackOpen();
+
+// Returns a pointer into the mapping and its size, or 0 if the pack is not
+// open or has no such entry. The pointer stays valid until closeAssetPack().
+const unsigned char* findAsset(const char* name, unsigned int* size);
+
+// Offline step: packs the given files under their own relative paths,
+// skipping any that cannot be read.
+bool writeAssetPack(const char* path, const char* const* files, int count);
+
+// Times reading every file loose against reading it from the pack. The first
+// pass is cold only if the OS file cache was flushed beforehand.
+void benchmarkAssetLoading(const char* path, const char* const* files, int count, int passes);
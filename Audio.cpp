@@ -0,0 +1,835 @@
+#include "Audio.h"
+#include "AssetPack.h"
+#include "AudioLatency.h"
+#include "PcmAsset.h"
+#include "Profiler.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <semaphore.h>
+#endif
+
+using namespace irrklang;
+
+#define MUSIC_STREAM "media/main.ring" // Virtual file served by MusicStreamLoader
+#define MUSIC_VOLUME 0.07f
+#define RING_FRAMES 32768              // About 0.75 s at 44.1 kHz, must be a power of two
+#define MAX_FRAME_SIZE 4               // 16-bit stereo
+#define FEED_CHUNK_FRAMES 2048
+#define MAX_SOUND_EMITTERS 256
+#define SOUND_MIN_DISTANCE 5.0f        // Full volume within this range, in scene units
+#define AUDIO_QUEUE_SIZE 1024          // Must be a power of two
+#define EMITTER_MOVE_BATCHES 4         // Ticks of moves in flight at once
+
+static std::atomic<ISoundEngine*> soundEngine(nullptr);
+static std::thread audioThread;
+static std::thread musicThread;
+static std::atomic<bool> audioRunning(false);
+static const char* const* effectFiles = 0;
+static int effectCount = 0;
+static std::chrono::steady_clock::time_point audioStartTime;
+
+static std::atomic<int> musicUnderruns(0);
+static std::atomic<int> deviceReadyMs(-1);
+static std::atomic<int> musicStartMs(-1);
+
+static long long nsSinceAudioStart() {
+	return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - audioStartTime).count();
+}
+
+static int msSinceAudioStart() {
+	return (int)(nsSinceAudioStart() / 1000000);
+}
+
+// Single-producer/single-consumer ring of PCM frames. The music thread writes,
+// irrKlang's mixer thread reads through MusicStream::readFrames().
+class MusicRing {
+public:
+	void init(int size) {
+		frameSize = size;
+		head = 0;
+		tail = 0;
+	}
+
+	int available() {
+		return (int)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed));
+	}
+
+	// Frames the writer can add without overtaking the reader.
+	int space() {
+		return RING_FRAMES - (int)(head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire));
+	}
+
+	int write(const char* src, int frames) {
+		unsigned h = head.load(std::memory_order_relaxed);
+		unsigned t = tail.load(std::memory_order_acquire);
+		int n = RING_FRAMES - (int)(h - t);
+		if (frames < n) n = frames;
+		int index = h & (RING_FRAMES - 1);
+		int first = RING_FRAMES - index;
+		if (first > n) first = n;
+		memcpy(data + index * frameSize, src, first * frameSize);
+		memcpy(data, src + first * frameSize, (n - first) * frameSize);
+		head.store(h + n, std::memory_order_release);
+		return n;
+	}
+
+	int read(char* dst, int frames) {
+		unsigned t = tail.load(std::memory_order_relaxed);
+		unsigned h = head.load(std::memory_order_acquire);
+		int n = (int)(h - t);
+		if (frames < n) n = frames;
+		int index = t & (RING_FRAMES - 1);
+		int first = RING_FRAMES - index;
+		if (first > n) first = n;
+		memcpy(dst, data + index * frameSize, first * frameSize);
+		memcpy(dst + first * frameSize, data, (n - first) * frameSize);
+		tail.store(t + n, std::memory_order_release);
+		return n;
+	}
+
+private:
+	char data[RING_FRAMES * MAX_FRAME_SIZE];
+	int frameSize = MAX_FRAME_SIZE;
+	std::atomic<unsigned> head{ 0 }; // Next frame to write
+	std::atomic<unsigned> tail{ 0 }; // Next frame to read
+};
+
+static MusicRing musicRing;
+static SAudioStreamFormat musicFormat; // Set by the feed before it reports MUSIC_PRIMED
+
+enum MusicState {
+	MUSIC_LOADING, // The feed is filling the ring for the first time
+	MUSIC_PRIMED,  // The ring is full; the audio thread may start playback
+	MUSIC_NO_PCM,  // No baked track to feed
+	MUSIC_STARTED
+};
+
+static std::atomic<int> musicState(MUSIC_LOADING);
+
+enum AudioCommandType {
+	AUDIO_PLAY_2D,
+	AUDIO_PLAY_3D,
+	AUDIO_PLAY_EMITTER,  // 3D sound that later AUDIO_MOVE_EMITTERS commands can move
+	AUDIO_MOVE_EMITTERS, // A tick's moves; emitter names the EmitterMoveBatch
+	AUDIO_SET_LISTENER,
+	AUDIO_SET_VOLUME
+};
+
+// Commands are copied by value into the queue. fileName is not copied, so it
+// has to outlive the command; every caller passes a string literal.
+struct AudioCommand {
+	AudioCommandType type;
+	const char* fileName;
+	int emitter;
+	float volume;
+	vec3df position; // Sound position, or listener eye
+	vec3df lookDir;
+	vec3df up;
+	long long postedNs;
+};
+
+// Single-producer/single-consumer command queue. The GLUT thread pushes and
+// the audio thread pops; neither side locks or allocates.
+class AudioQueue {
+public:
+	bool push(const AudioCommand& command) {
+		unsigned h = head.load(std::memory_order_relaxed);
+		unsigned t = tail.load(std::memory_order_acquire);
+		if (h - t >= AUDIO_QUEUE_SIZE) return false;
+		commands[h & (AUDIO_QUEUE_SIZE - 1)] = command;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(AudioCommand& command) {
+		unsigned t = tail.load(std::memory_order_relaxed);
+		unsigned h = head.load(std::memory_order_acquire);
+		if (h == t) return false;
+		command = commands[t & (AUDIO_QUEUE_SIZE - 1)];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	int depth() {
+		return (int)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+	}
+
+private:
+	AudioCommand commands[AUDIO_QUEUE_SIZE];
+	std::atomic<unsigned> head{ 0 };
+	std::atomic<unsigned> tail{ 0 };
+};
+
+static AudioQueue audioQueue;
+// The audio thread sets audioSleeping before its last look at the queue and
+// then sleeps on audioWake. Whoever clears the flag posts audioWake, so each
+// sleep gets exactly one post and a producer never waits on the audio thread.
+#ifdef _WIN32
+static HANDLE audioWake = 0; // Auto-reset event
+#else
+static sem_t audioWake;
+#endif
+static std::atomic<bool> audioSleeping(false);
+
+static void wakeAudioThread() {
+	if (!audioSleeping.exchange(false)) return;
+#ifdef _WIN32
+	SetEvent(audioWake);
+#else
+	sem_post(&audioWake);
+#endif
+}
+
+static void waitForAudioWake() {
+#ifdef _WIN32
+	WaitForSingleObject(audioWake, INFINITE);
+#else
+	while (sem_wait(&audioWake) != 0 && errno == EINTR) {}
+#endif
+}
+
+static std::atomic<int> queueMaxDepth(0);
+static std::atomic<int> queueDropped(0);
+static std::atomic<int> queueMaxEnqueueNs(0);
+static std::atomic<int> queueMaxDelayUs(0);
+
+// Emitters are tracked sounds that move with the scene. They live on the
+// audio thread; the GLUT thread only keeps the positions it hasn't sent yet.
+struct SoundEmitter {
+	ISound* sound;
+	int id;
+};
+
+static SoundEmitter emitters[MAX_SOUND_EMITTERS];
+static int emitterHighWater = 0; // Slots at or above this index are all free
+
+// GLUT thread side of the emitters. Ids keep counting across slot reuse,
+// so a stale id never moves another sound.
+static int nextEmitterId = 0;
+static int pendingIds[MAX_SOUND_EMITTERS];
+static vec3df pendingPositions[MAX_SOUND_EMITTERS];
+static bool pendingDirty[MAX_SOUND_EMITTERS];
+static int dirtySlots[MAX_SOUND_EMITTERS];
+static int dirtyCount = 0;
+
+// Every emitter moved in a tick goes to the audio thread in one batch. The
+// GLUT thread fills batch movesPosted % EMITTER_MOVE_BATCHES and the audio
+// thread counts movesApplied when it is done with one, so a batch is only
+// reused once it has been applied. With every batch in flight, the moves
+// stay pending and go with the next tick's.
+struct EmitterMoveBatch {
+	int count;
+	int ids[MAX_SOUND_EMITTERS];
+	vec3df positions[MAX_SOUND_EMITTERS];
+};
+
+static EmitterMoveBatch moveBatches[EMITTER_MOVE_BATCHES];
+static unsigned int movesPosted = 0;           // GLUT thread
+static std::atomic<unsigned int> movesApplied(0); // Audio thread
+
+// Scene coordinates are OpenGL's right-handed ones, irrKlang is left-handed.
+static vec3df toAudioSpace(float x, float y, float z) {
+	return vec3df(x, y, -z);
+}
+
+// Endless stream over the ring buffer. A short read is padded with silence
+// and counted as an underrun instead of ending the stream.
+class MusicStream : public IAudioStream {
+public:
+	SAudioStreamFormat getFormat() {
+		SAudioStreamFormat format = musicFormat;
+		format.FrameCount = -1;
+		return format;
+	}
+
+	bool setPosition(ik_s32 pos) {
+		return pos == 0;
+	}
+
+	bool getIsSeekingSupported() {
+		return false;
+	}
+
+	ik_s32 readFrames(void* target, ik_s32 frameCountToRead) {
+		int frameSize = musicFormat.getFrameSize();
+		int got = musicRing.read((char*)target, frameCountToRead);
+		if (got > 0 && musicStartMs.load() < 0) {
+			musicStartMs = msSinceAudioStart();
+		}
+		if (got < frameCountToRead) {
+			int silence = musicFormat.SampleFormat == ESF_U8 ? 0x80 : 0;
+			memset((char*)target + got * frameSize, silence, (frameCountToRead - got) * frameSize);
+			musicUnderruns++;
+		}
+		return frameCountToRead;
+	}
+};
+
+class MusicStreamLoader : public IAudioStreamLoader {
+public:
+	bool isALoadableFileExtension(const ik_c8* fileName) {
+		const char* ext = strrchr(fileName, '.');
+		return ext && strcmp(ext, ".ring") == 0;
+	}
+
+	IAudioStream* createAudioStream(IFileReader*) {
+		return new MusicStream();
+	}
+};
+
+// Serves irrKlang's file reads out of the asset pack mapping. IFileReader
+// only lets irrKlang read into its own buffer, so every read is a copy;
+// preloadEffects() hands the effects over as memory sources instead, and
+// this only serves what irrKlang opens by name itself.
+class PackFileReader : public IFileReader {
+public:
+	PackFileReader(const char* fileName, const unsigned char* data, unsigned int size)
+		: data(data), size(size), pos(0) {
+		strncpy(name, fileName, sizeof(name) - 1);
+		name[sizeof(name) - 1] = 0;
+	}
+
+	ik_s32 read(void* buffer, ik_u32 sizeToRead) {
+		unsigned int n = size - pos;
+		if (sizeToRead < n) n = sizeToRead;
+		memcpy(buffer, data + pos, n);
+		pos += n;
+		return (ik_s32)n;
+	}
+
+	bool seek(ik_s32 finalPos, bool relativeMovement) {
+		long long target = relativeMovement ? (long long)pos + finalPos : finalPos;
+		if (target < 0 || target > size) return false;
+		pos = (unsigned int)target;
+		return true;
+	}
+
+	ik_s32 getSize() { return (ik_s32)size; }
+	ik_s32 getPos() { return (ik_s32)pos; }
+	const ik_c8* getFileName() { return name; }
+
+private:
+	const unsigned char* data;
+	unsigned int size;
+	unsigned int pos;
+	char name[260];
+};
+
+// Files found in the asset pack are read from the mapping, anything else
+// falls through to irrKlang's own file access. The music ring name has to
+// resolve to some file before MusicStreamLoader is asked for a stream, so
+// it resolves to an empty one.
+class AssetFileFactory : public IFileFactory {
+public:
+	IFileReader* createFileReader(const ik_c8* filename) {
+		if (strcmp(filename, MUSIC_STREAM) == 0) {
+			return new PackFileReader(filename, 0, 0);
+		}
+		unsigned int size = 0;
+		const unsigned char* data = findAsset(filename, &size);
+		if (!data) return 0;
+		return new PackFileReader(filename, data, size);
+	}
+};
+
+// The baked track, read a chunk at a time: straight out of the asset pack
+// mapping when it is packed, otherwise from the loose file. Only the
+// ring and one chunk are ever in memory, however long the track.
+struct MusicSource {
+	const unsigned char* samples; // In the mapping, or 0 for a loose file
+	FILE* file;
+	int frameCount;
+	int frameSize;
+};
+
+static bool openMusicSource(MusicSource& source) {
+	char pcmName[260];
+	pcmNameFor(MUSIC_FILE, pcmName, sizeof(pcmName));
+	source.samples = 0;
+	source.file = 0;
+	unsigned int size = 0;
+	const unsigned char* data = findAsset(pcmName, &size);
+	if (data) {
+		if (!readPcmHeader(data, size, musicFormat)) return false;
+		source.samples = data + sizeof(PcmHeader);
+	}
+	else {
+		source.file = fopen(pcmName, "rb");
+		if (!source.file) return false;
+		unsigned char header[sizeof(PcmHeader)];
+		fseek(source.file, 0, SEEK_END);
+		long fileSize = ftell(source.file);
+		fseek(source.file, 0, SEEK_SET);
+		if (fileSize < 0 || fread(header, sizeof(header), 1, source.file) != 1
+			|| !readPcmHeader(header, (unsigned int)fileSize, musicFormat)) {
+			fclose(source.file);
+			return false;
+		}
+	}
+	source.frameCount = musicFormat.FrameCount;
+	source.frameSize = musicFormat.getFrameSize();
+	if (source.frameCount <= 0 || source.frameSize <= 0 || source.frameSize > MAX_FRAME_SIZE) {
+		if (source.file) fclose(source.file);
+		return false;
+	}
+	return true;
+}
+
+// Keeps the ring topped up a chunk at a time and never touches the engine:
+// once the ring is first full it tells the audio thread, which starts
+// playback. irrKlang 1.6 has no way to pull its MP3 decoder a block at a
+// time, so the track is decoded offline by --bake-pcm and this thread
+// streams the samples.
+static void musicThreadMain() {
+	setProfileThreadName("music feed");
+	MusicSource source;
+	if (!openMusicSource(source)) {
+		musicState = MUSIC_NO_PCM;
+		wakeAudioThread();
+		return;
+	}
+	musicRing.init(source.frameSize);
+
+	char chunk[FEED_CHUNK_FRAMES * MAX_FRAME_SIZE];
+	int pos = 0;
+	while (audioRunning) {
+		int n = musicRing.space();
+		if (n > FEED_CHUNK_FRAMES) n = FEED_CHUNK_FRAMES;
+		if (n > source.frameCount - pos) n = source.frameCount - pos;
+		if (n == 0) {
+			if (musicState.load() == MUSIC_LOADING) {
+				musicState = MUSIC_PRIMED;
+				wakeAudioThread();
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(5)); // Ring is full
+			continue;
+		}
+		const char* frames = chunk;
+		if (source.samples) {
+			frames = (const char*)source.samples + pos * source.frameSize;
+		}
+		else if ((int)fread(chunk, source.frameSize, n, source.file) != n) {
+			printf("[audio] could not read %s, music stops\n", MUSIC_FILE);
+			break;
+		}
+		PROFILE_ZONE("music feed");
+		musicRing.write(frames, n);
+		pos += n;
+		if (pos == source.frameCount) { // Loop the track
+			pos = 0;
+			if (source.file) fseek(source.file, sizeof(PcmHeader), SEEK_SET);
+		}
+	}
+	if (source.file) fclose(source.file);
+}
+
+// Audio thread. Plays the ring once the feed has filled it. Without a baked
+// track, irrKlang streams the MP3 itself, decoding a block at a time.
+static void startMusic(ISoundEngine* engine) {
+	int state = musicState.load();
+	ISound* music = 0;
+	if (state == MUSIC_PRIMED) {
+		music = engine->play2D(MUSIC_STREAM, true, true, true, ESM_STREAMING);
+	}
+	else if (state == MUSIC_NO_PCM) {
+		music = engine->play2D(MUSIC_FILE, true, true, true, ESM_STREAMING);
+		if (music) musicStartMs = msSinceAudioStart(); // No ring to see the first read
+	}
+	else {
+		return;
+	}
+	musicState = MUSIC_STARTED;
+	if (music) {
+		music->setVolume(MUSIC_VOLUME);
+		music->setIsPaused(false);
+		music->drop();
+	}
+}
+
+// Loads every effect up front. A baked .pcm version is used when there is
+// one, under the original name so game code keeps playing "x.mp3". Packed
+// effects are memory sources pointing into the asset pack mapping, which
+// stays open until the engine is gone, so nothing is copied.
+static void preloadEffects(ISoundEngine* engine) {
+	IAudioStreamLoader* loader = createPcmStreamLoader();
+	engine->registerAudioStreamLoader(loader);
+	loader->drop();
+
+	for (int i = 0; i < effectCount; i++) {
+		char pcmName[260];
+		pcmNameFor(effectFiles[i], pcmName, sizeof(pcmName));
+
+		unsigned int size = 0;
+		const unsigned char* data = findAsset(pcmName, &size);
+		SAudioStreamFormat format;
+		if (data && readPcmHeader(data, size, format)) {
+			void* samples = (void*)(data + sizeof(PcmHeader));
+			engine->addSoundSourceFromPCMData(samples, format.getSampleDataSize(), effectFiles[i], format, false);
+			continue;
+		}
+		data = findAsset(effectFiles[i], &size);
+		if (data) {
+			engine->addSoundSourceFromMemory((void*)data, (ik_s32)size, effectFiles[i], false);
+			continue;
+		}
+
+		FILE* f = fopen(pcmName, "rb");
+		bool baked = f != 0;
+		if (f) fclose(f);
+
+		ISoundSource* source = 0;
+		if (baked) {
+			source = engine->addSoundSourceFromFile(pcmName, ESM_NO_STREAMING, true);
+		}
+		if (source) {
+			engine->addSoundSourceAlias(source, effectFiles[i]);
+		}
+		else {
+			engine->addSoundSourceFromFile(effectFiles[i], ESM_NO_STREAMING, true);
+		}
+	}
+}
+
+// Drops emitters whose sound has finished. Runs once per tick, on the listener update.
+static void reapEmitters() {
+	int highWater = 0;
+	for (int i = 0; i < emitterHighWater; i++) {
+		SoundEmitter& e = emitters[i];
+		if (!e.sound) continue;
+		if (e.sound->isFinished()) {
+			e.sound->drop();
+			e.sound = 0;
+			continue;
+		}
+		highWater = i + 1;
+	}
+	emitterHighWater = highWater;
+}
+
+static void runCommand(ISoundEngine* engine, const AudioCommand& command) {
+	switch (command.type) {
+	case AUDIO_PLAY_2D:
+		engine->play2D(command.fileName, false);
+		break;
+	case AUDIO_PLAY_3D:
+		engine->play3D(command.fileName, command.position, false);
+		break;
+	case AUDIO_PLAY_EMITTER: {
+		// The slot comes from the id, so a full table replaces its oldest sound.
+		int slot = command.emitter % MAX_SOUND_EMITTERS;
+		SoundEmitter& e = emitters[slot];
+		if (e.sound) {
+			e.sound->drop();
+		}
+		e.sound = engine->play3D(command.fileName, command.position, false, false, true);
+		e.id = command.emitter;
+		if (slot >= emitterHighWater) emitterHighWater = slot + 1;
+		break;
+	}
+	case AUDIO_MOVE_EMITTERS: {
+		const EmitterMoveBatch& batch = moveBatches[command.emitter];
+		for (int i = 0; i < batch.count; i++) {
+			SoundEmitter& e = emitters[batch.ids[i] % MAX_SOUND_EMITTERS];
+			if (e.sound && e.id == batch.ids[i]) {
+				e.sound->setPosition(batch.positions[i]);
+			}
+		}
+		movesApplied.fetch_add(1, std::memory_order_release);
+		break;
+	}
+	case AUDIO_SET_LISTENER:
+		engine->setListenerPosition(command.position, command.lookDir, vec3df(0, 0, 0), command.up);
+		reapEmitters();
+		break;
+	case AUDIO_SET_VOLUME:
+		engine->setSoundVolume(command.volume);
+		break;
+	}
+}
+
+static bool musicWaiting() {
+	int state = musicState.load();
+	return state == MUSIC_PRIMED || state == MUSIC_NO_PCM;
+}
+
+static void audioThreadMain() {
+	ISoundEngine* engine = createIrrKlangDevice();
+	if (!engine) {
+		printf("[audio] could not create sound device\n");
+		return;
+	}
+	deviceReadyMs = msSinceAudioStart();
+	engine->setDefault3DSoundMinDistance(SOUND_MIN_DISTANCE);
+	IFileFactory* factory = new AssetFileFactory();
+	engine->addFileFactory(factory);
+	factory->drop();
+	preloadEffects(engine);
+	soundEngine = engine; // The GLUT thread starts posting from here on
+
+	if (isAudioLatencyCaptureEnabled()) {
+		engine->setMixedDataOutputReceiver(getAudioLatencyReceiver()); // No music, so only effects break the silence
+	}
+	else {
+		IAudioStreamLoader* loader = new MusicStreamLoader();
+		engine->registerAudioStreamLoader(loader);
+		loader->drop();
+		musicThread = std::thread(musicThreadMain);
+	}
+
+	AudioCommand command;
+	while (audioRunning) {
+		if (musicWaiting()) startMusic(engine);
+		while (audioQueue.pop(command)) {
+			int delayUs = (int)((nsSinceAudioStart() - command.postedNs) / 1000);
+			if (delayUs > queueMaxDelayUs.load(std::memory_order_relaxed)) {
+				queueMaxDelayUs.store(delayUs, std::memory_order_relaxed);
+			}
+			runCommand(engine, command);
+		}
+
+		audioSleeping = true;
+		// Pairs with the fence in postCommand(): either this sees the command
+		// or the producer sees audioSleeping and posts the wake.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (audioQueue.depth() == 0 && audioRunning && !musicWaiting()) {
+			waitForAudioWake();
+		}
+		else if (!audioSleeping.exchange(false)) {
+			waitForAudioWake(); // A producer got in first; take its post
+		}
+	}
+}
+
+// GLUT thread only. Commands posted before the device exists are dropped,
+// as are commands that find the queue full; either returns false.
+static bool postCommand(AudioCommand& command) {
+	if (!soundEngine.load(std::memory_order_acquire)) return false;
+
+	long long start = nsSinceAudioStart();
+	command.postedNs = start;
+	if (!audioQueue.push(command)) {
+		queueDropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (audioSleeping.load(std::memory_order_relaxed)) {
+		wakeAudioThread();
+	}
+
+	int depth = audioQueue.depth();
+	if (depth > queueMaxDepth.load(std::memory_order_relaxed)) {
+		queueMaxDepth.store(depth, std::memory_order_relaxed);
+	}
+	int cost = (int)(nsSinceAudioStart() - start);
+	if (cost > queueMaxEnqueueNs.load(std::memory_order_relaxed)) {
+		queueMaxEnqueueNs.store(cost, std::memory_order_relaxed);
+	}
+	return true;
+}
+
+void startAudio(const char* const* effects, int count) {
+	if (audioRunning) return;
+	effectFiles = effects;
+	effectCount = count;
+	audioStartTime = std::chrono::steady_clock::now();
+#ifdef _WIN32
+	audioWake = CreateEvent(0, FALSE, FALSE, 0);
+#else
+	sem_init(&audioWake, 0, 0);
+#endif
+	audioRunning = true;
+	audioThread = std::thread(audioThreadMain);
+}
+
+void stopAudio() {
+	if (!audioRunning) return;
+	audioRunning = false;
+	wakeAudioThread();
+	if (audioThread.joinable()) {
+		audioThread.join();
+	}
+	if (musicThread.joinable()) {
+		musicThread.join();
+	}
+#ifdef _WIN32
+	CloseHandle(audioWake);
+	audioWake = 0;
+#else
+	sem_destroy(&audioWake);
+#endif
+	printAudioStats();
+	ISoundEngine* engine = soundEngine.exchange(nullptr);
+	for (int i = 0; i < emitterHighWater; i++) {
+		if (emitters[i].sound) {
+			emitters[i].sound->drop();
+			emitters[i].sound = 0;
+		}
+	}
+	if (engine) {
+		engine->setMixedDataOutputReceiver(0);
+		engine->drop();
+	}
+	if (isAudioLatencyCaptureEnabled()) {
+		printAudioLatencyHistogram();
+	}
+}
+
+void playSound(const char* fileName) {
+	profileMark(fileName, -1);
+	AudioCommand command;
+	command.type = AUDIO_PLAY_2D;
+	command.fileName = fileName;
+	postCommand(command);
+}
+
+int playSound3D(const char* fileName, float x, float y, float z, bool follow) {
+	if (!soundEngine.load()) return -1;
+	profileMark(fileName, follow ? nextEmitterId : -1);
+
+	AudioCommand command;
+	command.type = follow ? AUDIO_PLAY_EMITTER : AUDIO_PLAY_3D;
+	command.fileName = fileName;
+	command.position = toAudioSpace(x, y, z);
+	if (!follow) {
+		postCommand(command);
+		return -1;
+	}
+
+	int id = nextEmitterId++;
+	int slot = id % MAX_SOUND_EMITTERS;
+	pendingIds[slot] = id;
+	command.emitter = id;
+	postCommand(command);
+	return id;
+}
+
+void setSoundPosition(int emitter, float x, float y, float z) {
+	if (emitter < 0) return;
+	int slot = emitter % MAX_SOUND_EMITTERS;
+	if (pendingIds[slot] != emitter) return;
+	pendingPositions[slot] = toAudioSpace(x, y, z);
+	if (!pendingDirty[slot]) {
+		pendingDirty[slot] = true;
+		dirtySlots[dirtyCount++] = slot;
+	}
+}
+
+void updateAudio3D(const vec3df& eye, const vec3df& lookDir, const vec3df& up) {
+	AudioCommand command;
+	command.type = AUDIO_SET_LISTENER;
+	command.position = toAudioSpace(eye.X, eye.Y, eye.Z);
+	command.lookDir = toAudioSpace(lookDir.X, lookDir.Y, lookDir.Z);
+	command.up = toAudioSpace(up.X, up.Y, up.Z);
+	postCommand(command);
+
+	if (dirtyCount == 0) return;
+	if (movesPosted - movesApplied.load(std::memory_order_acquire) >= EMITTER_MOVE_BATCHES) return;
+	int index = movesPosted % EMITTER_MOVE_BATCHES;
+	EmitterMoveBatch& batch = moveBatches[index];
+	for (int i = 0; i < dirtyCount; i++) {
+		int slot = dirtySlots[i];
+		batch.ids[i] = pendingIds[slot];
+		batch.positions[i] = pendingPositions[slot];
+	}
+	batch.count = dirtyCount;
+	command.type = AUDIO_MOVE_EMITTERS;
+	command.emitter = index;
+	if (!postCommand(command)) return; // Still pending; the next tick tries again
+	movesPosted++;
+	for (int i = 0; i < dirtyCount; i++) pendingDirty[dirtySlots[i]] = false;
+	dirtyCount = 0;
+}
+
+void setMasterVolume(float volume) {
+	AudioCommand command;
+	command.type = AUDIO_SET_VOLUME;
+	command.volume = volume;
+	postCommand(command);
+}
+
+MusicStats getMusicStats() {
+	MusicStats stats;
+	stats.playing = musicStartMs.load() >= 0;
+	stats.framesBuffered = musicRing.available();
+	stats.underruns = musicUnderruns.load();
+	stats.deviceReadyMs = deviceReadyMs.load();
+	stats.musicStartMs = musicStartMs.load();
+	return stats;
+}
+
+AudioQueueStats getAudioQueueStats() {
+	AudioQueueStats stats;
+	stats.depth = audioQueue.depth();
+	stats.maxDepth = queueMaxDepth.load();
+	stats.dropped = queueDropped.load();
+	stats.maxEnqueueNs = queueMaxEnqueueNs.load();
+	stats.maxDelayUs = queueMaxDelayUs.load();
+	return stats;
+}
+
+void printAudioStats() {
+	MusicStats music = getMusicStats();
+	printf("[audio] device ready after %d ms, music started after %d ms, %d underruns, %d frames buffered\n",
+		music.deviceReadyMs, music.musicStartMs, music.underruns, music.framesBuffered);
+	AudioQueueStats queue = getAudioQueueStats();
+	printf("[audio] queue depth %d (max %d), %d dropped, max enqueue %d ns, max delay %d us\n",
+		queue.depth, queue.maxDepth, queue.dropped, queue.maxEnqueueNs, queue.maxDelayUs);
+}
+
+void benchmarkMusicStream(int seconds, int loadMs) {
+	audioStartTime = std::chrono::steady_clock::now();
+	audioRunning = true;
+	std::thread feed(musicThreadMain);
+	int reads = 0;
+	std::thread mixer([&reads] {
+		// Starts pulling where the audio thread would start playback.
+		while (audioRunning && musicState.load() == MUSIC_LOADING) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		if (musicState.load() != MUSIC_PRIMED) return;
+		MusicStream stream;
+		int frames = musicFormat.SampleRate / 100;
+		std::vector<char> buffer(frames * musicFormat.getFrameSize());
+		auto next = std::chrono::steady_clock::now();
+		while (audioRunning) {
+			stream.readFrames(buffer.data(), frames);
+			reads++;
+			next += std::chrono::milliseconds(10);
+			std::this_thread::sleep_until(next);
+		}
+	});
+
+	auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+	while (std::chrono::steady_clock::now() < end) {
+		auto frameStart = std::chrono::steady_clock::now();
+		while (std::chrono::steady_clock::now() - frameStart < std::chrono::milliseconds(loadMs)) {
+		}
+		std::this_thread::sleep_until(frameStart + std::chrono::milliseconds(16));
+	}
+	audioRunning = false;
+	feed.join();
+	mixer.join();
+
+	if (musicState.load() == MUSIC_NO_PCM) {
+		char pcmName[260];
+		pcmNameFor(MUSIC_FILE, pcmName, sizeof(pcmName));
+		printf("[audio] no %s to stream; run --bake-pcm first\n", pcmName);
+		return;
+	}
+	printf("[audio] music feed, %d s at %d ms of load a frame: first music frame after %d ms, "
+		"%d underruns in %d mixer reads, %d KB ring\n",
+		seconds, loadMs, musicStartMs.load(), musicUnderruns.load(), reads, (int)(sizeof(musicRing) / 1024));
+}
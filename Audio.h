@@ -0,0 +1,60 @@
+#pragma once
+
+#include <irrKlang.h>
+
+#define MUSIC_FILE "media/main.mp3" // Streamed from its pcmNameFor() file once baked
+
+// One irrKlang device shared by music and effects. It is owned by the audio
+// thread, which creates it at startup so the window never waits on audio.
+// Game code posts requests to that thread through a lock-free queue; every
+// function below except stopAudio() must be called from the GLUT thread.
+// effects lists every sound effect file; they are all loaded before the
+// device is handed to the game. The array must outlive the audio thread.
+void startAudio(const char* const* effects, int count);
+void stopAudio();
+
+// Plays an effect on the shared device, or drops it if the device isn't ready yet.
+// File names are not copied and must outlive the request, and the profiler's
+// rings too, where they name the marks recording each trigger.
+void playSound(const char* fileName);
+
+// Plays an effect at a point in the scene. With follow set, returns an
+// emitter id that setSoundPosition() can move until the sound finishes,
+// otherwise returns -1. The trace mark carries the same id.
+int playSound3D(const char* fileName, float x, float y, float z, bool follow = false);
+void setSoundPosition(int emitter, float x, float y, float z);
+
+// Once per tick: moves the listener and posts all pending emitter
+// positions to the audio thread as one batched command.
+void updateAudio3D(const irrklang::vec3df& eye, const irrklang::vec3df& lookDir, const irrklang::vec3df& up);
+
+void setMasterVolume(float volume);
+
+// Music stream counters, read from any thread.
+struct MusicStats {
+	bool playing;
+	int framesBuffered;  // frames waiting in the ring buffer
+	int underruns;       // reads that found the ring buffer short
+	int deviceReadyMs;   // startAudio() to device creation
+	int musicStartMs;    // startAudio() to first audible music frame
+};
+
+// Command queue counters, read from any thread.
+struct AudioQueueStats {
+	int depth;        // commands waiting right now
+	int maxDepth;
+	int dropped;      // commands lost to a full queue
+	int maxEnqueueNs; // worst cost of posting a command on the GLUT thread
+	int maxDelayUs;   // worst time from posting to running on the audio thread
+};
+
+MusicStats getMusicStats();
+AudioQueueStats getAudioQueueStats();
+void printAudioStats();
+
+// Runs the music feed for seconds without a sound device, against a stand-in
+// for the mixer that pulls 10 ms of frames every 10 ms. Meanwhile the
+// calling thread is busy for loadMs of every 16 ms frame, as --frame-load
+// makes the game. Prints the time to the first music frame and the
+// underruns. Call instead of startAudio(), not alongside it.
+void benchmarkMusicStream(int seconds, int loadMs);
@@ -0,0 +1,192 @@
+#include "AudioLatency.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+using namespace irrklang;
+
+#define LATENCY_EVENT_QUEUE_SIZE 256 // Must be a power of two
+#define LATENCY_MAX_PENDING 64
+#define LATENCY_MAX_SAMPLES 4096
+#define LATENCY_SILENCE_LEVEL 64     // 16-bit amplitude, about -54 dBFS
+#define LATENCY_MIN_GAP_MS 20        // Silence needed before a sound counts as starting
+#define LATENCY_TIMEOUT_MS 1000
+#define LATENCY_BUCKET_MS 5
+#define LATENCY_BUCKETS 40           // The last bucket also takes everything slower
+#define LATENCY_BAR_WIDTH 40
+
+static bool captureEnabled = false;
+
+static long long nowNs() {
+	return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Marks travel from the GLUT thread to irrKlang's mixer thread through a
+// single-producer/single-consumer ring, like the audio command queue.
+static long long eventTimes[LATENCY_EVENT_QUEUE_SIZE];
+static std::atomic<unsigned> eventHead(0);
+static std::atomic<unsigned> eventTail(0);
+
+static std::atomic<int> eventCount(0);
+static std::atomic<int> maskedCount(0);
+static std::atomic<int> lostCount(0);
+
+// Written by the mixer thread only; measuredCount publishes each entry.
+static int latencyUs[LATENCY_MAX_SAMPLES];
+static std::atomic<int> measuredCount(0);
+
+class LatencyReceiver : public ISoundMixedOutputReceiver {
+public:
+	// Mixed data is always 16-bit interleaved stereo.
+	void OnAudioDataReady(const void* data, int byteCount, int playbackrate) {
+		long long chunkNs = nowNs();
+		takeMarks();
+
+		const short* samples = (const short*)data;
+		int frames = byteCount / 4;
+		int first = -1, last = -1;
+		for (int i = 0; i < frames; i++) {
+			if (abs(samples[2 * i]) > LATENCY_SILENCE_LEVEL || abs(samples[2 * i + 1]) > LATENCY_SILENCE_LEVEL) {
+				if (first < 0) first = i;
+				last = i;
+			}
+		}
+
+		double nsPerFrame = 1e9 / playbackrate;
+		if (first >= 0 && pendingCount > 0) {
+			// Only a sound rising out of silence is the one the mark asked for;
+			// marks that share an onset all go to the oldest.
+			long long onsetNs = chunkNs + (long long)(first * nsPerFrame);
+			if (onsetNs - lastSoundNs >= LATENCY_MIN_GAP_MS * 1000000LL) {
+				record(onsetNs - pending[0]);
+				maskedCount += pendingCount - 1;
+			}
+			else {
+				maskedCount += pendingCount;
+			}
+			pendingCount = 0;
+		}
+		if (last >= 0) {
+			lastSoundNs = chunkNs + (long long)(last * nsPerFrame);
+		}
+
+		int kept = 0;
+		for (int i = 0; i < pendingCount; i++) {
+			if (chunkNs - pending[i] > LATENCY_TIMEOUT_MS * 1000000LL) lostCount++;
+			else pending[kept++] = pending[i];
+		}
+		pendingCount = kept;
+	}
+
+private:
+	// A mark made while the mix is still sounding can't be told apart from
+	// what is already playing, so it is counted as masked straight away.
+	void takeMarks() {
+		unsigned t = eventTail.load(std::memory_order_relaxed);
+		unsigned h = eventHead.load(std::memory_order_acquire);
+		for (; t != h; t++) {
+			long long mark = eventTimes[t & (LATENCY_EVENT_QUEUE_SIZE - 1)];
+			if (mark <= lastSoundNs || pendingCount == LATENCY_MAX_PENDING) maskedCount++;
+			else pending[pendingCount++] = mark;
+		}
+		eventTail.store(t, std::memory_order_release);
+	}
+
+	void record(long long ns) {
+		int n = measuredCount.load(std::memory_order_relaxed);
+		if (n >= LATENCY_MAX_SAMPLES) return;
+		latencyUs[n] = (int)(ns / 1000);
+		measuredCount.store(n + 1, std::memory_order_release);
+	}
+
+	long long pending[LATENCY_MAX_PENDING];
+	int pendingCount = 0;
+	long long lastSoundNs = 0;
+};
+
+static LatencyReceiver latencyReceiver;
+
+void enableAudioLatencyCapture() {
+	captureEnabled = true;
+}
+
+bool isAudioLatencyCaptureEnabled() {
+	return captureEnabled;
+}
+
+ISoundMixedOutputReceiver* getAudioLatencyReceiver() {
+	return &latencyReceiver;
+}
+
+void markAudioEvent() {
+	if (!captureEnabled) return;
+	eventCount++;
+	unsigned h = eventHead.load(std::memory_order_relaxed);
+	unsigned t = eventTail.load(std::memory_order_acquire);
+	if (h - t >= LATENCY_EVENT_QUEUE_SIZE) {
+		lostCount++;
+		return;
+	}
+	eventTimes[h & (LATENCY_EVENT_QUEUE_SIZE - 1)] = nowNs();
+	eventHead.store(h + 1, std::memory_order_release);
+}
+
+static std::vector<int> sortedLatencies() {
+	int n = measuredCount.load(std::memory_order_acquire);
+	std::vector<int> sorted(latencyUs, latencyUs + n);
+	std::sort(sorted.begin(), sorted.end());
+	return sorted;
+}
+
+AudioLatencyStats getAudioLatencyStats() {
+	std::vector<int> sorted = sortedLatencies();
+	int n = (int)sorted.size();
+	AudioLatencyStats stats;
+	stats.events = eventCount.load();
+	stats.measured = n;
+	stats.masked = maskedCount.load();
+	stats.lost = lostCount.load();
+	stats.minUs = n ? sorted[0] : 0;
+	stats.medianUs = n ? sorted[n / 2] : 0;
+	stats.p95Us = n ? sorted[(n * 95) / 100] : 0;
+	stats.maxUs = n ? sorted[n - 1] : 0;
+	return stats;
+}
+
+void printAudioLatencyHistogram() {
+	AudioLatencyStats stats = getAudioLatencyStats();
+	printf("[audio] latency: %d events, %d measured, %d masked, %d lost\n",
+		stats.events, stats.measured, stats.masked, stats.lost);
+	if (stats.measured == 0) return;
+	printf("[audio] latency: min %.1f ms, median %.1f ms, p95 %.1f ms, max %.1f ms\n",
+		stats.minUs / 1000.0, stats.medianUs / 1000.0, stats.p95Us / 1000.0, stats.maxUs / 1000.0);
+
+	int buckets[LATENCY_BUCKETS] = {};
+	for (int us : sortedLatencies()) {
+		int b = us / (LATENCY_BUCKET_MS * 1000);
+		buckets[b < LATENCY_BUCKETS ? b : LATENCY_BUCKETS - 1]++;
+	}
+	int lo = 0, hi = LATENCY_BUCKETS - 1, tallest = 0;
+	while (buckets[lo] == 0) lo++;
+	while (buckets[hi] == 0) hi--;
+	for (int b = lo; b <= hi; b++) tallest = std::max(tallest, buckets[b]);
+
+	for (int b = lo; b <= hi; b++) {
+		char bar[LATENCY_BAR_WIDTH + 1];
+		int width = (buckets[b] * LATENCY_BAR_WIDTH + tallest - 1) / tallest;
+		for (int i = 0; i < width; i++) bar[i] = '#';
+		bar[width] = 0;
+		if (b == LATENCY_BUCKETS - 1) {
+			printf("[audio] %4d+     ms |%-*s %d\n", b * LATENCY_BUCKET_MS, LATENCY_BAR_WIDTH, bar, buckets[b]);
+		}
+		else {
+			printf("[audio] %4d-%4d ms |%-*s %d\n", b * LATENCY_BUCKET_MS, (b + 1) * LATENCY_BUCKET_MS,
+				LATENCY_BAR_WIDTH, bar, buckets[b]);
+		}
+	}
+}
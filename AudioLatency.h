@@ -0,0 +1,39 @@
+#pragma once
+
+#include <irrKlang.h>
+
+// Instrumentation mode for end-to-end audio latency. Game events that play a
+// sound are marked with markAudioEvent(); a receiver on irrKlang's mixed
+// output finds the first non-silent samples after each mark and records the
+// time between the two. Music is left off while capturing so the mix is
+// silent between effects.
+//
+// Times are taken when the mixer hands over a chunk, so the device's own
+// output buffer adds a constant on top of every measurement.
+
+// Must be called before startAudio().
+void enableAudioLatencyCapture();
+bool isAudioLatencyCaptureEnabled();
+
+// The receiver to pass to ISoundEngine::setMixedDataOutputReceiver().
+irrklang::ISoundMixedOutputReceiver* getAudioLatencyReceiver();
+
+// GLUT thread only. Call right where the game asks for the sound; does
+// nothing unless capture is enabled.
+void markAudioEvent();
+
+struct AudioLatencyStats {
+	int events;    // marks taken
+	int measured;  // marks matched to the start of a sound
+	int masked;    // marks that fired while the mix was already playing, or shared an onset with an earlier mark
+	int lost;      // marks with no sound within the timeout
+	int minUs;
+	int medianUs;
+	int p95Us;
+	int maxUs;
+};
+
+AudioLatencyStats getAudioLatencyStats();
+
+// Prints the stats and a text histogram of the measured latencies.
+void printAudioLatencyHistogram();
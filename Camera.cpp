@@ -0,0 +1,183 @@
+#include "Camera.h"
+#include "MatrixStack.h"
+#include "Renderer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CAMERA_PI 3.14159265358979323846
+#define CAMERA_DRIFT_STEP 0.37f // Degrees per step; doesn't divide 360, so the test never sits at a whole turn
+#define CAMERA_DRIFT_PER_MILLION 0.1 // Degrees the drift check allows per million steps
+
+Camera::Camera() : focus(1.0f), fovy(60.0f), aspect(1.0f), zNear(0.001f), zFar(100.0f),
+	viewStale(true), projectionStale(true), combinedStale(true), viewUpdates(0) {
+	lookAt(Vector3f(1.0f, 1.0f, 1.0f), Vector3f(), Vector3f(0.0f, 1.0f, 0.0f));
+}
+
+void Camera::lookAt(const Vector3f& eye, const Vector3f& center, const Vector3f& up) {
+	Vector3f f = center - eye;
+	focus = f.length();
+	f = f.unit();
+	Vector3f s = f.cross(up).unit();
+	if (s.dot(s) == 0.0f) s = right(); // Looking straight along up: keep the old left and right
+	Vector3f u = s.cross(f);
+	position = eye;
+	orientation = Quaternion::fromAxes(s, u, -f);
+	moved();
+}
+
+void Camera::setPerspective(float fovy, float aspect, float zNear, float zFar) {
+	if (fovy == this->fovy && aspect == this->aspect && zNear == this->zNear && zFar == this->zFar) return;
+	this->fovy = fovy;
+	this->aspect = aspect;
+	this->zNear = zNear;
+	this->zFar = zFar;
+	projectionStale = combinedStale = true;
+}
+
+void Camera::moved() {
+	viewStale = combinedStale = true;
+}
+
+void Camera::moveX(float d) {
+	position += right() * -d;
+	moved();
+}
+
+void Camera::moveY(float d) {
+	position += up() * d;
+	moved();
+}
+
+void Camera::moveZ(float d) {
+	position += forward() * d;
+	moved();
+}
+
+// Turning about the camera's own axes is a multiply on the right. One
+// normalize per turn keeps rounding from growing the quaternion.
+void Camera::rotate(const Vector3f& axis, float degrees) {
+	orientation = (orientation * Quaternion::fromAxisAngle(axis, degrees * (float)(CAMERA_PI / 180.0))).normalized();
+	moved();
+}
+
+void Camera::rotateX(float degrees) {
+	rotate(Vector3f(1.0f, 0.0f, 0.0f), degrees);
+}
+
+void Camera::rotateY(float degrees) {
+	rotate(Vector3f(0.0f, 1.0f, 0.0f), degrees);
+}
+
+// The transpose of the orientation's basis, then the eye moved to the
+// origin: what gluLookAt builds.
+const float* Camera::viewMatrix() {
+	if (!viewStale) return view;
+	Vector3f s = right(), u = up(), b = -forward();
+	view[0] = s.x; view[4] = s.y; view[8] = s.z; view[12] = -s.dot(position);
+	view[1] = u.x; view[5] = u.y; view[9] = u.z; view[13] = -u.dot(position);
+	view[2] = b.x; view[6] = b.y; view[10] = b.z; view[14] = -b.dot(position);
+	view[3] = view[7] = view[11] = 0.0f;
+	view[15] = 1.0f;
+	viewStale = false;
+	viewUpdates++;
+	return view;
+}
+
+const float* Camera::projectionMatrix() {
+	if (!projectionStale) return projection;
+	MatrixStack stack;
+	stack.perspective(fovy, aspect, zNear, zFar);
+	memcpy(projection, stack.top(), sizeof(projection));
+	projectionStale = false;
+	return projection;
+}
+
+const float* Camera::viewProjectionMatrix() {
+	if (!combinedStale) return viewProjection;
+	multiplyMatrices(projectionMatrix(), viewMatrix(), viewProjection);
+	// Each plane is the last row of the matrix plus or minus one of the
+	// others (Gribb and Hartmann).
+	const float* m = viewProjection;
+	for (int i = 0; i < 6; i++) {
+		int row = i / 2;
+		float sign = i % 2 == 0 ? 1.0f : -1.0f;
+		float* plane = planes[i];
+		for (int k = 0; k < 4; k++) plane[k] = m[k * 4 + 3] + sign * m[k * 4 + row];
+		float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (length > 0.0f) {
+			for (int k = 0; k < 4; k++) plane[k] /= length;
+		}
+	}
+	combinedStale = false;
+	return viewProjection;
+}
+
+const float (*Camera::frustumPlanes())[4] {
+	viewProjectionMatrix();
+	return planes;
+}
+
+bool Camera::isSphereVisible(const Vector3f& center, float radius) {
+	const float (*p)[4] = frustumPlanes();
+	for (int i = 0; i < 6; i++) {
+		if (p[i][0] * center.x + p[i][1] * center.y + p[i][2] * center.z + p[i][3] < -radius) return false;
+	}
+	return true;
+}
+
+void Camera::look() {
+	renderer->multMatrix(viewMatrix());
+}
+
+// The angle between two orientations, in degrees.
+static double angleBetween(const Quaternion& a, const Quaternion& b) {
+	double dot = fabs((double)a.w * b.w + (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z);
+	return 2.0 * acos(dot < 1.0 ? dot : 1.0) * 180.0 / CAMERA_PI;
+}
+
+// The furthest the camera's axes are from square and unit length.
+static double axesError(const Camera& camera) {
+	Vector3f axes[3] = { camera.right(), camera.up(), camera.forward() };
+	double error = 0;
+	for (int i = 0; i < 3; i++) {
+		error = fmax(error, fabs(axes[i].length() - 1.0));
+		error = fmax(error, fabs(axes[i].dot(axes[(i + 1) % 3])));
+	}
+	return error;
+}
+
+bool checkCameraDrift(int rotations) {
+	// Yaw alone has an exact answer to compare against: one turn by the total,
+	// worked out in doubles. The step is taken as the angle its float
+	// quaternion really holds, which is off 0.37 degrees by a fixed rounding.
+	Camera camera;
+	camera.lookAt(Vector3f(0.0f, 2.0f, 10.0f), Vector3f(0.0f, 1.0f, 0.0f), Vector3f(0.0f, 1.0f, 0.0f));
+	Quaternion start = camera.getOrientation();
+	for (int i = 0; i < rotations; i++) camera.rotateY(CAMERA_DRIFT_STEP);
+	Quaternion step = Quaternion::fromAxisAngle(Vector3f(0.0f, 1.0f, 0.0f), CAMERA_DRIFT_STEP * (float)(CAMERA_PI / 180.0));
+	double total = fmod(rotations * 2.0 * atan2((double)step.y, (double)step.w), 2.0 * CAMERA_PI);
+	Quaternion expected = start * Quaternion::fromAxisAngle(Vector3f(0.0f, 1.0f, 0.0f), (float)total);
+	double yawDrift = angleBetween(camera.getOrientation(), expected);
+	double yawAxes = axesError(camera);
+
+	// Pitch and yaw mixed have no closed form, but the axes must stay square.
+	for (int i = 0; i < rotations; i++) {
+		if (i % 2 == 0) camera.rotateX(CAMERA_DRIFT_STEP);
+		else camera.rotateY(-CAMERA_DRIFT_STEP * 0.5f);
+	}
+	double mixedAxes = axesError(camera);
+	double mixedNorm = fabs(camera.getOrientation().norm() - 1.0);
+
+	// Rounding in each multiply and normalize adds up; a tenth of a degree per
+	// million steps is still far too little to see.
+	double allowedDrift = CAMERA_DRIFT_PER_MILLION * rotations / 1e6;
+	bool passed = yawDrift <= allowedDrift && yawAxes < 1e-5 && mixedAxes < 1e-5;
+	printf("[camera] %d yaw steps of %.2f degrees: %.5f degrees from one turn of the total (allowed %.5f)\n",
+		rotations, CAMERA_DRIFT_STEP, yawDrift, allowedDrift);
+	printf("[camera] axes off square by %.2g after yaw, %.2g after %d mixed pitch and yaw steps; |q|^2 - 1 = %.2g\n",
+		yawAxes, mixedAxes, rotations, mixedNorm);
+	printf("[camera] drift check %s\n", passed ? "passed" : "FAILED");
+	return passed;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Quaternion.h"
+#include "Vector3f.h"
+
+// A fly camera kept as a position and a quaternion orientation. It looks down
+// its local -z axis with +y up, as gluLookAt's cameras do. The view,
+// projection and combined matrices and the frustum planes are cached, and
+// only rebuilt on the first request after something changed them. Culling
+// and LOD read them from here rather than asking GL.
+class Camera {
+public:
+	Camera();
+
+	// Places the camera at eye looking at center. up need not be square to the
+	// view; like gluLookAt, only its part across the view is used.
+	void lookAt(const Vector3f& eye, const Vector3f& center, const Vector3f& up);
+	// Only marks the matrices stale when a value actually changes.
+	void setPerspective(float fovy, float aspect, float zNear, float zFar);
+
+	void moveX(float d); // Along the camera's left
+	void moveY(float d); // Along its up
+	void moveZ(float d); // Along its view
+	void rotateX(float degrees); // Pitch, tipping the view toward up
+	void rotateY(float degrees); // Yaw, turning the view toward the left
+
+	Vector3f eye() const { return position; }
+	Vector3f center() const { return position + forward() * focus; }
+	Vector3f forward() const { return orientation.rotate(Vector3f(0.0f, 0.0f, -1.0f)); }
+	Vector3f up() const { return orientation.rotate(Vector3f(0.0f, 1.0f, 0.0f)); }
+	Vector3f right() const { return orientation.rotate(Vector3f(1.0f, 0.0f, 0.0f)); }
+	Quaternion getOrientation() const { return orientation; }
+
+	// Column-major, ready for multMatrix().
+	const float* viewMatrix();
+	const float* projectionMatrix();
+	const float* viewProjectionMatrix();
+	// Left, right, bottom, top, near, far as (a, b, c, d) with a unit normal
+	// pointing into the frustum: a point p is inside when a*p.x + b*p.y +
+	// c*p.z + d >= 0 for all six.
+	const float (*frustumPlanes())[4];
+	bool isSphereVisible(const Vector3f& center, float radius);
+
+	// Multiplies the view matrix onto the renderer's current matrix.
+	void look();
+
+	int getViewUpdates() const { return viewUpdates; } // How often the view matrix was rebuilt
+
+private:
+	void moved();
+	void rotate(const Vector3f& axis, float degrees);
+
+	Vector3f position;
+	Quaternion orientation;
+	float focus; // How far ahead center() is
+	float fovy, aspect, zNear, zFar;
+
+	bool viewStale, projectionStale, combinedStale;
+	float view[16], projection[16], viewProjection[16];
+	float planes[6][4];
+	int viewUpdates;
+};
+
+// Turns a camera by small steps rotations times and prints how far its
+// orientation has drifted from a single turn by the total. Returns false if
+// the drift is larger than float rounding explains.
+bool checkCameraDrift(int rotations);
@@ -0,0 +1,362 @@
+#include "CommandList.h"
+#include "Profiler.h"
+
+#include <chrono>
+
+enum Opcode {
+	OP_INIT,
+	OP_CLEAR,
+	OP_FLUSH,
+	OP_SET_TIME,
+	OP_MATRIX_MODE,
+	OP_LOAD_IDENTITY,
+	OP_PUSH_MATRIX,
+	OP_POP_MATRIX,
+	OP_TRANSLATE,
+	OP_ROTATE,
+	OP_SCALE,
+	OP_SCALE_WAVE,
+	OP_MULT_MATRIX,
+	OP_PERSPECTIVE,
+	OP_ORTHO_2D,
+	OP_LOOK_AT,
+	OP_PUSH_ATTRIB,
+	OP_POP_ATTRIB,
+	OP_SET_MATERIAL,
+	OP_SET_LIGHT,
+	OP_COLOR,
+	OP_COLOR_WAVE,
+	OP_NORMAL,
+	OP_LINE_WIDTH,
+	OP_BEGIN,
+	OP_VERTEX,
+	OP_END,
+	OP_TEXT,
+	OP_DRAW_MESH,
+	OP_DRAW_SKINNED_MESH,
+	OP_DRAW_MESH_INSTANCES
+};
+
+void CommandList::reset() {
+	ops.clear();
+	args.clear();
+	strings.clear();
+	meshes.clear();
+	skinnedMeshes.clear();
+}
+
+void CommandList::record(unsigned char op, const float* values, int count) {
+	ops.push_back(op);
+	args.insert(args.end(), values, values + count);
+}
+
+void CommandList::init() {
+	record(OP_INIT, 0, 0);
+}
+
+void CommandList::clear() {
+	record(OP_CLEAR, 0, 0);
+}
+
+void CommandList::flush() {
+	record(OP_FLUSH, 0, 0);
+}
+
+void CommandList::setTime(float time) {
+	record(OP_SET_TIME, &time, 1);
+}
+
+void CommandList::matrixMode(MatrixMode mode) {
+	float v[] = { (float)mode };
+	record(OP_MATRIX_MODE, v, 1);
+}
+
+void CommandList::loadIdentity() {
+	record(OP_LOAD_IDENTITY, 0, 0);
+}
+
+void CommandList::pushMatrix() {
+	record(OP_PUSH_MATRIX, 0, 0);
+}
+
+void CommandList::popMatrix() {
+	record(OP_POP_MATRIX, 0, 0);
+}
+
+void CommandList::translate(float x, float y, float z) {
+	float v[] = { x, y, z };
+	record(OP_TRANSLATE, v, 3);
+}
+
+void CommandList::rotate(float angle, float x, float y, float z) {
+	float v[] = { angle, x, y, z };
+	record(OP_ROTATE, v, 4);
+}
+
+void CommandList::scale(float x, float y, float z) {
+	float v[] = { x, y, z };
+	record(OP_SCALE, v, 3);
+}
+
+// Waves are kept as waves, so a list stays valid however far time moves.
+void CommandList::scaleWave(const TimeWave& s) {
+	float v[] = { s.offset, s.amplitude, s.phase };
+	record(OP_SCALE_WAVE, v, 3);
+}
+
+void CommandList::multMatrix(const float m[16]) {
+	record(OP_MULT_MATRIX, m, 16);
+}
+
+void CommandList::perspective(float fovy, float aspect, float zNear, float zFar) {
+	float v[] = { fovy, aspect, zNear, zFar };
+	record(OP_PERSPECTIVE, v, 4);
+}
+
+void CommandList::ortho2D(float left, float right, float bottom, float top) {
+	float v[] = { left, right, bottom, top };
+	record(OP_ORTHO_2D, v, 4);
+}
+
+void CommandList::lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+	float upX, float upY, float upZ) {
+	float v[] = { eyeX, eyeY, eyeZ, centerX, centerY, centerZ, upX, upY, upZ };
+	record(OP_LOOK_AT, v, 9);
+}
+
+void CommandList::pushAttrib() {
+	record(OP_PUSH_ATTRIB, 0, 0);
+}
+
+void CommandList::popAttrib() {
+	record(OP_POP_ATTRIB, 0, 0);
+}
+
+void CommandList::setMaterial(const float ambient[4], const float diffuse[4], const float specular[4], float shininess) {
+	record(OP_SET_MATERIAL, ambient, 4);
+	args.insert(args.end(), diffuse, diffuse + 4);
+	args.insert(args.end(), specular, specular + 4);
+	args.push_back(shininess);
+}
+
+void CommandList::setLight(const float position[4], const float diffuse[4]) {
+	record(OP_SET_LIGHT, position, 4);
+	args.insert(args.end(), diffuse, diffuse + 4);
+}
+
+void CommandList::color(float r, float g, float b) {
+	float v[] = { r, g, b };
+	record(OP_COLOR, v, 3);
+}
+
+void CommandList::colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b) {
+	float v[] = {
+		r.offset, r.amplitude, r.phase,
+		g.offset, g.amplitude, g.phase,
+		b.offset, b.amplitude, b.phase
+	};
+	record(OP_COLOR_WAVE, v, 9);
+}
+
+void CommandList::normal(float x, float y, float z) {
+	float v[] = { x, y, z };
+	record(OP_NORMAL, v, 3);
+}
+
+void CommandList::lineWidth(float width) {
+	record(OP_LINE_WIDTH, &width, 1);
+}
+
+void CommandList::begin(PrimitiveType type) {
+	float v[] = { (float)type };
+	record(OP_BEGIN, v, 1);
+}
+
+void CommandList::vertex(float x, float y, float z) {
+	float v[] = { x, y, z };
+	record(OP_VERTEX, v, 3);
+}
+
+void CommandList::end() {
+	record(OP_END, 0, 0);
+}
+
+void CommandList::text(float x, float y, const char* s) {
+	float v[] = { x, y };
+	record(OP_TEXT, v, 2);
+	strings.push_back(s);
+}
+
+void CommandList::drawMesh(const Mesh& mesh) {
+	record(OP_DRAW_MESH, 0, 0);
+	meshes.push_back(&mesh);
+}
+
+void CommandList::drawSkinnedMesh(const SkinnedMesh& skinned, const float* bones) {
+	record(OP_DRAW_SKINNED_MESH, bones, 16 * skinned.boneCount);
+	skinnedMeshes.push_back(&skinned);
+}
+
+// The count goes first so submit() knows how many placements follow.
+void CommandList::drawMeshInstances(const Mesh& mesh, const float* instances, int count) {
+	float n = (float)count;
+	record(OP_DRAW_MESH_INSTANCES, &n, 1);
+	args.insert(args.end(), instances, instances + INSTANCE_FLOATS * count);
+	meshes.push_back(&mesh);
+}
+
+static TimeWave wave(const float* values) {
+	TimeWave wave = { values[0], values[1], values[2] };
+	return wave;
+}
+
+void CommandList::submit(Renderer* target) const {
+	const float* a = args.data();
+	int string = 0;
+	int mesh = 0;
+	int skinnedMesh = 0;
+	for (unsigned char op : ops) {
+		switch (op) {
+		case OP_INIT: target->init(); break;
+		case OP_CLEAR: target->clear(); break;
+		case OP_FLUSH: target->flush(); break;
+		case OP_SET_TIME: target->setTime(a[0]); a += 1; break;
+		case OP_MATRIX_MODE: target->matrixMode((MatrixMode)(int)a[0]); a += 1; break;
+		case OP_LOAD_IDENTITY: target->loadIdentity(); break;
+		case OP_PUSH_MATRIX: target->pushMatrix(); break;
+		case OP_POP_MATRIX: target->popMatrix(); break;
+		case OP_TRANSLATE: target->translate(a[0], a[1], a[2]); a += 3; break;
+		case OP_ROTATE: target->rotate(a[0], a[1], a[2], a[3]); a += 4; break;
+		case OP_SCALE: target->scale(a[0], a[1], a[2]); a += 3; break;
+		case OP_SCALE_WAVE: target->scaleWave(wave(a)); a += 3; break;
+		case OP_MULT_MATRIX: target->multMatrix(a); a += 16; break;
+		case OP_PERSPECTIVE: target->perspective(a[0], a[1], a[2], a[3]); a += 4; break;
+		case OP_ORTHO_2D: target->ortho2D(a[0], a[1], a[2], a[3]); a += 4; break;
+		case OP_LOOK_AT: target->lookAt(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]); a += 9; break;
+		case OP_PUSH_ATTRIB: target->pushAttrib(); break;
+		case OP_POP_ATTRIB: target->popAttrib(); break;
+		case OP_SET_MATERIAL: target->setMaterial(a, a + 4, a + 8, a[12]); a += 13; break;
+		case OP_SET_LIGHT: target->setLight(a, a + 4); a += 8; break;
+		case OP_COLOR: target->color(a[0], a[1], a[2]); a += 3; break;
+		case OP_COLOR_WAVE: target->colorWave(wave(a), wave(a + 3), wave(a + 6)); a += 9; break;
+		case OP_NORMAL: target->normal(a[0], a[1], a[2]); a += 3; break;
+		case OP_LINE_WIDTH: target->lineWidth(a[0]); a += 1; break;
+		case OP_BEGIN: target->begin((PrimitiveType)(int)a[0]); a += 1; break;
+		case OP_VERTEX: target->vertex(a[0], a[1], a[2]); a += 3; break;
+		case OP_END: target->end(); break;
+		case OP_TEXT: target->text(a[0], a[1], strings[string++].c_str()); a += 2; break;
+		case OP_DRAW_MESH: target->drawMesh(*meshes[mesh++]); break;
+		case OP_DRAW_SKINNED_MESH: {
+			const SkinnedMesh& skinned = *skinnedMeshes[skinnedMesh++];
+			target->drawSkinnedMesh(skinned, a);
+			a += 16 * skinned.boneCount;
+			break;
+		}
+		case OP_DRAW_MESH_INSTANCES: {
+			int count = (int)a[0];
+			target->drawMeshInstances(*meshes[mesh++], a + 1, count);
+			a += 1 + INSTANCE_FLOATS * count;
+			break;
+		}
+		}
+	}
+}
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+CommandRecorder::CommandRecorder(int threads)
+	: jobs(0), jobCount(0), generation(0), busyWorkers(0), stopping(false), nextJob(0) {
+	resetStats();
+	if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+	for (int i = 1; i < threads; i++) {
+		workers.push_back(std::thread(&CommandRecorder::workerMain, this));
+	}
+}
+
+CommandRecorder::~CommandRecorder() {
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		stopping = true;
+	}
+	poolWake.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void CommandRecorder::record(void (*const* jobs)(), int count) {
+	auto start = std::chrono::steady_clock::now();
+	if ((int)lists.size() < count) lists.resize(count);
+	for (int i = 0; i < count; i++) lists[i].reset();
+
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		this->jobs = jobs;
+		jobCount = count;
+		nextJob = 0;
+		busyWorkers = (int)workers.size();
+		generation++;
+	}
+	poolWake.notify_all();
+	runJobs();
+	{
+		std::unique_lock<std::mutex> lock(poolMutex);
+		poolDone.wait(lock, [this] { return busyWorkers == 0; });
+	}
+
+	recordMs += msSince(start);
+	for (int i = 0; i < count; i++) commands += lists[i].getCommandCount();
+}
+
+void CommandRecorder::submit(Renderer* target) {
+	PROFILE_ZONE("submit layers");
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < jobCount; i++) lists[i].submit(target);
+	submitMs += msSince(start);
+	frames++;
+}
+
+void CommandRecorder::runJobs() {
+	Renderer* saved = renderer;
+	for (int job = nextJob++; job < jobCount; job = nextJob++) {
+		PROFILE_ZONE("record layer");
+		renderer = &lists[job];
+		jobs[job]();
+	}
+	renderer = saved;
+}
+
+void CommandRecorder::workerMain() {
+	setProfileThreadName("record worker");
+	int seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(poolMutex);
+			poolWake.wait(lock, [this, seen] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+		}
+		runJobs();
+		{
+			std::lock_guard<std::mutex> lock(poolMutex);
+			if (--busyWorkers == 0) poolDone.notify_one();
+		}
+	}
+}
+
+CommandRecorderStats CommandRecorder::getStats() const {
+	CommandRecorderStats stats;
+	stats.frames = frames;
+	stats.recordMs = frames ? recordMs / frames : 0;
+	stats.submitMs = frames ? submitMs / frames : 0;
+	stats.commands = frames ? (int)(commands / frames) : 0;
+	return stats;
+}
+
+void CommandRecorder::resetStats() {
+	frames = 0;
+	recordMs = submitMs = 0;
+	commands = 0;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Renderer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records Renderer calls so they can be made on one thread and replayed on
+// another. Recording touches no graphics state, so any thread can fill a
+// list while the GL thread is busy with something else.
+class CommandList : public Renderer {
+public:
+	void reset();
+	// Replays the recorded calls, in order, on target.
+	void submit(Renderer* target) const;
+	int getCommandCount() const { return (int)ops.size(); }
+
+	void init();
+	void clear();
+	void flush();
+	void setTime(float time);
+
+	void matrixMode(MatrixMode mode);
+	void loadIdentity();
+	void pushMatrix();
+	void popMatrix();
+	void translate(float x, float y, float z);
+	void rotate(float angle, float x, float y, float z);
+	void scale(float x, float y, float z);
+	void scaleWave(const TimeWave& s);
+	void multMatrix(const float m[16]);
+	void perspective(float fovy, float aspect, float zNear, float zFar);
+	void ortho2D(float left, float right, float bottom, float top);
+	void lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+		float upX, float upY, float upZ);
+
+	void pushAttrib();
+	void popAttrib();
+	void setMaterial(const float ambient[4], const float diffuse[4], const float specular[4], float shininess);
+	void setLight(const float position[4], const float diffuse[4]);
+
+	void color(float r, float g, float b);
+	void colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b);
+	void normal(float x, float y, float z);
+	void lineWidth(float width);
+	void begin(PrimitiveType type);
+	void vertex(float x, float y, float z);
+	void end();
+
+	void text(float x, float y, const char* s);
+	// Records the mesh by reference, so it is still drawn in one call.
+	void drawMesh(const Mesh& mesh);
+	// The mesh by reference and the bones by value, since callers fill them
+	// afresh each frame.
+	void drawSkinnedMesh(const SkinnedMesh& skinned, const float* bones);
+	// The mesh by reference and the placements by value, the same way.
+	void drawMeshInstances(const Mesh& mesh, const float* instances, int count);
+
+private:
+	void record(unsigned char op, const float* values, int count);
+
+	std::vector<unsigned char> ops;
+	std::vector<float> args;           // Each op's floats, back to back
+	std::vector<std::string> strings;  // text() in call order
+	std::vector<const Mesh*> meshes;   // drawMesh() and drawMeshInstances() in call order
+	std::vector<const SkinnedMesh*> skinnedMeshes; // drawSkinnedMesh() in call order
+};
+
+struct CommandRecorderStats {
+	int frames;
+	double recordMs;  // Per frame, from handing out the jobs to the last list being done
+	double submitMs;  // Per frame, replaying every list on the GL thread
+	int commands;     // Per frame
+};
+
+// Runs a frame's draw functions on worker threads, each into its own
+// CommandList, and submits the lists in job order on the calling thread.
+// While a job runs, the global renderer on its thread is its list.
+class CommandRecorder {
+public:
+	// threads counts the calling thread, which takes jobs too; 0 means one per
+	// core.
+	explicit CommandRecorder(int threads = 0);
+	~CommandRecorder();
+
+	int getThreadCount() const { return (int)workers.size() + 1; }
+
+	// Records jobs[i] into list i. Returns once every job is done.
+	void record(void (*const* jobs)(), int count);
+	// Replays the lists from the last record() on target.
+	void submit(Renderer* target);
+
+	CommandRecorderStats getStats() const;
+	void resetStats();
+
+private:
+	void runJobs();
+	void workerMain();
+
+	std::vector<CommandList> lists;
+	void (*const* jobs)();
+	int jobCount;
+
+	std::vector<std::thread> workers;
+	std::mutex poolMutex;
+	std::condition_variable poolWake;
+	std::condition_variable poolDone;
+	int generation;
+	int busyWorkers;
+	bool stopping;
+	std::atomic<int> nextJob;
+
+	int frames;
+	double recordMs, submitMs;
+	long long commands;
+};
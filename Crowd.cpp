@@ -0,0 +1,340 @@
+#include "Crowd.h"
+#include "Animation.h"
+#include "Profiler.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#define CROWD_PI 3.14159265f
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// xorshift32: the same crowd on every run and every platform.
+static unsigned int nextRandom(unsigned int& state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static void transformPoint(const float* m, const float* p, float* out) {
+	out[0] = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+	out[1] = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+	out[2] = m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14];
+}
+
+Crowd::Crowd(const SkinnedModel& model, const float* poses, int poseCount, int spectators, const Vector3f& center)
+	: model(model), poses(poses, poses + poseCount * model.triangles.boneCount * 16), poseCount(poseCount),
+	boneCount(model.triangles.boneCount), count(spectators), tick(0), requested(0), finished(0), stopping(false) {
+	resetStats();
+	placeSeats(center);
+	buildCards();
+
+	// A sphere around the standing point's vertical that holds every vertex
+	// of every pose, whichever way the spectator faces.
+	float lowY = FLT_MAX, highY = -FLT_MAX, reach = 0.0f;
+	const SkinnedMesh* parts[2] = { &model.triangles, &model.lines };
+	for (int f = 0; f < poseCount; f++) {
+		for (int k = 0; k < 2; k++) {
+			const Mesh& mesh = parts[k]->mesh;
+			for (int i = 0; i < mesh.vertexCount; i++) {
+				float p[3];
+				transformPoint(&this->poses[(f * boneCount + parts[k]->bones[i]) * 16], mesh.positions + 3 * i, p);
+				lowY = std::min(lowY, p[1]);
+				highY = std::max(highY, p[1]);
+				reach = std::max(reach, p[0] * p[0] + p[2] * p[2]);
+			}
+		}
+	}
+	sphereHeight = (lowY + highY) * 0.5f;
+	sphereRadius = sqrtf(reach + (highY - lowY) * (highY - lowY) * 0.25f);
+
+	outerReach = 0.0f;
+	for (int i = 0; i < count; i++) {
+		Vector3f seat(x[i] - center.x, y[i] + sphereHeight - center.y, z[i] - center.z);
+		outerReach = std::max(outerReach, seat.length());
+	}
+	outerReach += sphereRadius;
+
+	int vertices = model.triangles.mesh.vertexCount + model.lines.mesh.vertexCount;
+	posedPositions.resize(3 * vertices * CROWD_PHASE_GROUPS);
+	posedNormals.resize(3 * vertices * CROWD_PHASE_GROUPS);
+
+	worker = std::thread(&Crowd::workerMain, this);
+}
+
+Crowd::~Crowd() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	worker.join();
+}
+
+// Fills rows outward from the front one until everyone is seated. Each row
+// starts a random part of a seat round so the aisles don't line up.
+void Crowd::placeSeats(const Vector3f& center) {
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	yaw.resize(count);
+	group.resize(count);
+	unsigned int random = 0x2545f491u;
+	int placed = 0;
+	for (int row = 0; placed < count; row++) {
+		float radius = CROWD_FIRST_ROW + row * CROWD_ROW_DEPTH;
+		int seats = (int)(2.0f * CROWD_PI * radius / CROWD_SEAT_WIDTH);
+		float stagger = (nextRandom(random) % 1000) / 1000.0f;
+		for (int seat = 0; seat < seats && placed < count; seat++, placed++) {
+			float angle = 2.0f * CROWD_PI * (seat + stagger) / seats;
+			x[placed] = center.x + radius * sinf(angle);
+			y[placed] = center.y + row * CROWD_ROW_RISE;
+			z[placed] = center.z + radius * cosf(angle);
+			yaw[placed] = angle * 180.0f / CROWD_PI + 180.0f; // Toward the center
+			group[placed] = nextRandom(random) % CROWD_PHASE_GROUPS;
+		}
+	}
+}
+
+// A card for each bone whose triangles, boxed in the first pose and seen
+// from the front, cover enough of the archer to be made out from afar, in
+// the bone's average color.
+void Crowd::buildCards() {
+	const Mesh& mesh = model.triangles.mesh;
+	std::vector<float> low(3 * boneCount, FLT_MAX), high(3 * boneCount, -FLT_MAX), colors(3 * boneCount, 0.0f);
+	std::vector<int> vertices(boneCount, 0);
+	float figureLow[2] = { FLT_MAX, FLT_MAX }, figureHigh[2] = { -FLT_MAX, -FLT_MAX };
+	for (int i = 0; i < mesh.vertexCount; i++) {
+		int b = model.triangles.bones[i];
+		float p[3];
+		transformPoint(&poses[16 * b], mesh.positions + 3 * i, p);
+		for (int k = 0; k < 3; k++) {
+			low[3 * b + k] = std::min(low[3 * b + k], p[k]);
+			high[3 * b + k] = std::max(high[3 * b + k], p[k]);
+			colors[3 * b + k] += mesh.colors[3 * i + k];
+		}
+		for (int k = 0; k < 2; k++) {
+			figureLow[k] = std::min(figureLow[k], p[k]);
+			figureHigh[k] = std::max(figureHigh[k], p[k]);
+		}
+		vertices[b]++;
+	}
+	float figureArea = (figureHigh[0] - figureLow[0]) * (figureHigh[1] - figureLow[1]);
+	for (int b = 0; b < boneCount; b++) {
+		if (vertices[b] == 0) continue;
+		float area = (high[3 * b] - low[3 * b]) * (high[3 * b + 1] - low[3 * b + 1]);
+		if (area < CROWD_CARD_MIN_AREA * figureArea) continue;
+		Card card;
+		for (int k = 0; k < 2; k++) {
+			card.low[k] = low[3 * b + k];
+			card.high[k] = high[3 * b + k];
+		}
+		card.depth = high[3 * b + 2];
+		for (int k = 0; k < 3; k++) card.color[k] = colors[3 * b + k] / vertices[b];
+		cards.push_back(card);
+	}
+
+	// Four corners and two triangles a card.
+	int corners = 4 * (int)cards.size();
+	cardColors.resize(3 * corners);
+	cardIndices.resize(6 * cards.size());
+	cardPositions.resize(3 * corners);
+	for (int c = 0; c < (int)cards.size(); c++) {
+		for (int v = 0; v < 4; v++) memcpy(&cardColors[3 * (4 * c + v)], cards[c].color, sizeof(cards[c].color));
+		const int quad[6] = { 0, 1, 2, 0, 2, 3 };
+		for (int k = 0; k < 6; k++) cardIndices[6 * c + k] = (unsigned short)(4 * c + quad[k]);
+	}
+	cardMesh.type = PRIM_TRIANGLES;
+	cardMesh.vertexCount = corners;
+	cardMesh.positions = cardPositions.data();
+	cardMesh.normals = 0; // All face the camera: the current normal
+	cardMesh.colors = cardColors.data();
+	cardMesh.indexCount = 6 * (int)cards.size();
+	cardMesh.indices = cardIndices.data();
+}
+
+void Crowd::beginFrame(Camera& camera, float seconds) {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return finished == requested; }); // A frame that was never drawn
+		memcpy(planes, camera.frustumPlanes(), sizeof(planes));
+		eye = camera.eye();
+		// Impostors turn about +y only, so they stand upright whatever the pitch.
+		Vector3f across = camera.right();
+		across.y = 0.0f;
+		right = across.unit();
+		toward = right.cross(Vector3f(0.0f, 1.0f, 0.0f));
+		// Wrapped while still a float, so no clock value can index outside poses.
+		float ticks = fmodf(seconds / ANIM_TICK, (float)poseCount);
+		if (ticks < 0.0f) ticks += poseCount;
+		tick = (int)ticks % poseCount;
+		requested++;
+	}
+	wake.notify_one();
+}
+
+// The bounding sphere against each plane, then the squared distance to the
+// eye for the level of detail.
+void Crowd::cull() {
+	PROFILE_ZONE("crowd cull");
+	auto start = std::chrono::steady_clock::now();
+	meshList.clear();
+	impostorList.clear();
+	nearby.clear();
+	float nearSquared = CROWD_NEAR_DISTANCE * CROWD_NEAR_DISTANCE;
+	for (int i = 0; i < count; i++) {
+		float cx = x[i], cy = y[i] + sphereHeight, cz = z[i];
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++) {
+			inside = planes[p][0] * cx + planes[p][1] * cy + planes[p][2] * cz + planes[p][3] >= -sphereRadius;
+		}
+		if (!inside) continue;
+		float dx = cx - eye.x, dy = cy - eye.y, dz = cz - eye.z;
+		float distance = dx * dx + dy * dy + dz * dz;
+		if (distance < nearSquared) nearby.push_back(std::make_pair(distance, i));
+		else impostorList.push_back(i);
+	}
+	if ((int)nearby.size() > CROWD_MAX_MESHES) {
+		std::nth_element(nearby.begin(), nearby.begin() + CROWD_MAX_MESHES, nearby.end());
+		for (size_t i = CROWD_MAX_MESHES; i < nearby.size(); i++) impostorList.push_back(nearby[i].second);
+		nearby.resize(CROWD_MAX_MESHES);
+	}
+	for (const std::pair<float, int>& spectator : nearby) meshList.push_back(spectator.second);
+	cullMs += msSince(start);
+}
+
+void Crowd::draw() {
+	auto start = std::chrono::steady_clock::now();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return finished == requested; });
+	}
+	waitMs += msSince(start);
+	renderer->pushAttrib();
+	drawMeshes();
+	drawImpostors();
+	renderer->popAttrib();
+	visible += meshList.size() + impostorList.size();
+	meshes += meshList.size();
+	impostors += impostorList.size();
+	frames++;
+}
+
+// The spectators are sorted by group, and each group that has any is
+// skinned into its pose once and drawn as instances of it.
+void Crowd::drawMeshes() {
+	PROFILE_ZONE("crowd meshes");
+	auto start = std::chrono::steady_clock::now();
+	int groupStart[CROWD_PHASE_GROUPS + 1] = { 0 };
+	for (int i : meshList) groupStart[group[i] + 1]++;
+	for (int g = 0; g < CROWD_PHASE_GROUPS; g++) groupStart[g + 1] += groupStart[g];
+	int next[CROWD_PHASE_GROUPS];
+	memcpy(next, groupStart, sizeof(next));
+	meshInstances.resize(INSTANCE_FLOATS * meshList.size());
+	for (int i : meshList) {
+		float* place = &meshInstances[INSTANCE_FLOATS * next[group[i]]++];
+		place[0] = x[i];
+		place[1] = y[i];
+		place[2] = z[i];
+		place[3] = yaw[i];
+	}
+
+	const SkinnedMesh* parts[2] = { &model.triangles, &model.lines };
+	int vertices = model.triangles.mesh.vertexCount + model.lines.mesh.vertexCount;
+	renderer->lineWidth(2.0f); // The bow's, as on the player
+	for (int g = 0; g < CROWD_PHASE_GROUPS; g++) {
+		int instances = groupStart[g + 1] - groupStart[g];
+		if (instances == 0) continue;
+		const float* pose = &poses[(tick + g * poseCount / CROWD_PHASE_GROUPS) % poseCount * boneCount * 16];
+		float* positions = &posedPositions[3 * vertices * g];
+		float* normals = &posedNormals[3 * vertices * g];
+		for (int k = 0; k < 2; k++) {
+			const SkinnedMesh& part = *parts[k];
+			skinVertices(part, pose, positions, normals);
+			Mesh& posed = posedMeshes[g][k];
+			posed = part.mesh;
+			posed.positions = positions;
+			posed.normals = part.mesh.normals ? normals : 0;
+			renderer->drawMeshInstances(posed, &meshInstances[INSTANCE_FLOATS * groupStart[g]], instances);
+			positions += 3 * part.mesh.vertexCount;
+			normals += 3 * part.mesh.vertexCount;
+		}
+	}
+	meshMs += msSince(start);
+}
+
+// Every impostor is the same set of cards this frame, only moved to its seat.
+void Crowd::drawImpostors() {
+	PROFILE_ZONE("crowd impostors");
+	auto start = std::chrono::steady_clock::now();
+	for (int c = 0; c < (int)cards.size(); c++) {
+		const Card& card = cards[c];
+		const float across[4] = { card.low[0], card.high[0], card.high[0], card.low[0] };
+		const float up[4] = { card.low[1], card.low[1], card.high[1], card.high[1] };
+		for (int v = 0; v < 4; v++) {
+			Vector3f offset = right * across[v] + toward * card.depth;
+			offset.y += up[v];
+			cardPositions[3 * (4 * c + v)] = offset.x;
+			cardPositions[3 * (4 * c + v) + 1] = offset.y;
+			cardPositions[3 * (4 * c + v) + 2] = offset.z;
+		}
+	}
+
+	int total = (int)impostorList.size();
+	impostorInstances.resize(INSTANCE_FLOATS * total);
+	for (int n = 0; n < total; n++) {
+		int i = impostorList[n];
+		float* place = &impostorInstances[INSTANCE_FLOATS * n];
+		place[0] = x[i];
+		place[1] = y[i];
+		place[2] = z[i];
+		place[3] = 0.0f; // Already turned to the camera
+	}
+	if (total > 0) {
+		renderer->normal(toward.x, toward.y, toward.z);
+		renderer->drawMeshInstances(cardMesh, impostorInstances.data(), total);
+	}
+	impostorMs += msSince(start);
+}
+
+void Crowd::workerMain() {
+	setProfileThreadName("crowd worker");
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || finished != requested; });
+			if (stopping) return;
+		}
+		cull();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished = requested;
+		}
+		done.notify_all();
+	}
+}
+
+CrowdStats Crowd::getStats() const {
+	CrowdStats stats;
+	stats.frames = frames;
+	stats.visible = frames ? (int)(visible / frames) : 0;
+	stats.meshes = frames ? (int)(meshes / frames) : 0;
+	stats.impostors = frames ? (int)(impostors / frames) : 0;
+	stats.cullMs = frames ? cullMs / frames : 0;
+	stats.waitMs = frames ? waitMs / frames : 0;
+	stats.meshMs = frames ? meshMs / frames : 0;
+	stats.impostorMs = frames ? impostorMs / frames : 0;
+	return stats;
+}
+
+void Crowd::resetStats() {
+	frames = 0;
+	visible = meshes = impostors = 0;
+	cullMs = waitMs = meshMs = impostorMs = 0;
+}
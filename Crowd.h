@@ -0,0 +1,122 @@
+#pragma once
+
+#include "Camera.h"
+#include "SkinnedMesh.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Spectators on tiered rings of seats around the hall, every one a copy of
+// the baked archer facing the middle. Close to the camera a spectator is the
+// skinned mesh, cheering through a loop of poses from one of a few starting
+// frames, so that most neighbours are out of step. Spectators that start
+// together share one skinned pose a frame and are drawn as instances of it.
+// Further out a spectator is an impostor: a card for each large part of the
+// archer as seen from the front, turned to face the camera and standing
+// still, and every impostor is an instance of the one set of cards.
+//
+// beginFrame() hands the camera to a worker thread, which culls the seats
+// against the frustum and picks each visible spectator's level of detail
+// while the caller draws the rest of the scene. draw() waits for it.
+
+#define CROWD_FIRST_ROW 34.0f // Radius of the front row around the center
+#define CROWD_ROW_DEPTH 2.0f
+#define CROWD_ROW_RISE 1.2f   // Each row stands this much above the one before
+#define CROWD_SEAT_WIDTH 1.5f
+#define CROWD_NEAR_DISTANCE 20.0f // Meshes within this of the eye, impostors beyond
+#define CROWD_MAX_MESHES 128      // The nearest win; the rest become impostors
+#define CROWD_CARD_MIN_AREA 0.02f // Of the archer's front; smaller parts get no card
+#define CROWD_PHASE_GROUPS 8      // Starting frames in the loop; at most this many skinnings a frame
+
+struct CrowdStats {
+	int frames;
+	int visible, meshes, impostors; // Per frame
+	double cullMs;     // On the worker
+	double waitMs;     // In draw(), for the worker to finish
+	double meshMs;     // Skinning and drawing the meshes
+	double impostorMs; // Placing and drawing the impostors
+};
+
+class Crowd {
+public:
+	// poses holds poseCount poses of model's bones, one per ANIM_TICK, each
+	// relative to where a spectator stands. center is the middle of the floor
+	// the rows ring.
+	Crowd(const SkinnedModel& model, const float* poses, int poseCount, int spectators, const Vector3f& center);
+	~Crowd();
+
+	int size() const { return count; }
+	int getPoseCount() const { return poseCount; }
+	// From the center of the floor to the furthest any spectator reaches.
+	float getOuterReach() const { return outerReach; }
+
+	// Once a frame, after the camera is set. seconds, on the scene's clock,
+	// picks the pose; any value is wrapped into the loop.
+	void beginFrame(Camera& camera, float seconds);
+	// Safe from a recording worker. What it records points into the crowd
+	// and the model, so both must outlive the frame's submit.
+	void draw();
+
+	CrowdStats getStats() const;
+	void resetStats();
+
+private:
+	struct Card {
+		float low[2], high[2]; // Across and up, in the archer's space
+		float depth;           // How far in front of the archer's middle
+		float color[3];
+	};
+
+	void placeSeats(const Vector3f& center);
+	void buildCards();
+	void cull();
+	void drawMeshes();
+	void drawImpostors();
+	void workerMain();
+
+	const SkinnedModel& model;
+	std::vector<float> poses;
+	int poseCount;
+	int boneCount;
+
+	// One entry per spectator in each.
+	int count;
+	std::vector<float> x, y, z;
+	std::vector<float> yaw;  // Degrees about +y, from facing +z
+	std::vector<int> group;  // Which of the CROWD_PHASE_GROUPS starting frames
+
+	float sphereHeight, sphereRadius; // Bounds of any pose, above where a spectator stands
+	float outerReach;
+
+	std::vector<Card> cards;
+	std::vector<float> cardColors;
+	std::vector<unsigned short> cardIndices;
+
+	// Read at submit, so kept until the next frame: the cards turned to the
+	// camera, and the model skinned into each group's pose.
+	std::vector<float> cardPositions;
+	Mesh cardMesh;
+	std::vector<float> posedPositions, posedNormals; // A copy of the model's vertices per group
+	Mesh posedMeshes[CROWD_PHASE_GROUPS][2];         // Triangles and lines
+	std::vector<float> meshInstances, impostorInstances;
+
+	// Written by beginFrame(), read by the worker.
+	float planes[6][4];
+	Vector3f eye, right, toward;
+	int tick; // Into the pose loop, 0 to poseCount - 1
+	// Written by the worker, read by draw().
+	std::vector<int> meshList, impostorList;
+	std::vector<std::pair<float, int>> nearby; // Squared distance and spectator
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	int requested, finished; // Frames handed to the worker and culled by it
+	bool stopping;
+
+	int frames;
+	long long visible, meshes, impostors;
+	double cullMs, waitMs, meshMs, impostorMs;
+};
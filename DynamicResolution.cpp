@@ -0,0 +1,273 @@
+#include "DynamicResolution.h"
+#include "GLProcs.h"
+#include "Profiler.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+// Timer queries are GL 3.3, past what opengl32.lib exports.
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+#define DYNRES_QUERIES 4       // Timer queries in flight: results are read a few frames late rather than waited on
+#define DYNRES_SMOOTHING 0.1f  // Weight of the newest frame in the average
+#define DYNRES_HOLD_FRAMES 15  // Between decisions, so late results from the old scale are out of the average
+#define DYNRES_HEADROOM 0.7f   // Raise only while the scene fits in this fraction of the target
+#define DYNRES_STEP 0.05f      // Scales move in multiples of this
+#define DYNRES_WARMUP_FRAMES 5 // The first frames compile and upload, and some drivers time the very first one wrong
+
+typedef void (APIENTRY* EndQueryProc)(GLenum target);
+typedef void (APIENTRY* GetQueryObjectivProc)(GLuint id, GLenum name, GLint* value);
+typedef void (APIENTRY* GetQueryObjectui64vProc)(GLuint id, GLenum name, unsigned long long* value);
+
+static GenObjectsProc genQueries;
+static DeleteObjectsProc deleteQueries;
+static BindObjectProc beginQuery;
+static EndQueryProc endQuery;
+static GetQueryObjectivProc getQueryObjectiv;
+static GetQueryObjectui64vProc getQueryObjectui64v;
+
+static bool enabled = false;
+static float minScale, maxScale, targetMs;
+static float scale = 1;
+
+static GLuint framebuffer = 0;
+static GLuint renderbuffers[2] = { 0, 0 }; // Color, depth
+static int bufferWidth = 0, bufferHeight = 0;
+static GLint window[4];           // The viewport begin found
+static GLint windowFramebuffer;   // Bound when begin was called
+static int sceneWidth, sceneHeight;
+static bool offscreen = false;    // This frame's scene is in the framebuffer
+
+static bool gpuTimed = false;
+static GLuint queries[DYNRES_QUERIES];
+static int queriesIssued = 0, queriesRead = 0;
+static bool queryOpen = false;
+static std::chrono::steady_clock::time_point passStart;
+
+static float sceneMs = 0;
+static int samples = 0;
+static int frames = 0;
+static int holdFrames = 0;
+static int raises = 0, drops = 0;
+static DynamicResolutionDecision lastDecision = { -1, 0, 1, 1 };
+
+// The timer query functions are optional; hasTimerQueries() checks them.
+static bool loadGLProcs() {
+	genQueries = (GenObjectsProc)getGLProc("glGenQueries");
+	deleteQueries = (DeleteObjectsProc)getGLProc("glDeleteQueries");
+	beginQuery = (BindObjectProc)getGLProc("glBeginQuery");
+	endQuery = (EndQueryProc)getGLProc("glEndQuery");
+	getQueryObjectiv = (GetQueryObjectivProc)getGLProc("glGetQueryObjectiv");
+	getQueryObjectui64v = (GetQueryObjectui64vProc)getGLProc("glGetQueryObjectui64v");
+	return loadFramebufferProcs() && blitFramebuffer;
+}
+
+// Timer queries are GL 3.3, or ARB_timer_query before it. Looking the
+// functions up is not enough: some drivers hand out entry points for
+// anything. Software GL is left to glFinish(): llvmpipe rasterizes when it
+// flushes, outside the query, and there the CPU doing the work is the frame
+// anyway.
+static bool hasTimerQueries() {
+	const char* name = (const char*)glGetString(GL_RENDERER);
+	if (!name || strstr(name, "llvmpipe") || strstr(name, "softpipe") || strstr(name, "GDI Generic")) return false;
+	if (!genQueries || !deleteQueries || !beginQuery || !endQuery || !getQueryObjectiv || !getQueryObjectui64v) return false;
+	int major = 0, minor = 0;
+	const char* version = (const char*)glGetString(GL_VERSION);
+	if (version && sscanf(version, "%d.%d", &major, &minor) == 2 && (major > 3 || (major == 3 && minor >= 3))) return true;
+	const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+	return extensions && strstr(extensions, "GL_ARB_timer_query");
+}
+
+static void deleteFramebuffer() {
+	if (!framebuffer) return;
+	deleteFramebuffers(1, &framebuffer);
+	deleteRenderbuffers(2, renderbuffers);
+	framebuffer = 0;
+	bufferWidth = bufferHeight = 0;
+}
+
+// Sized for the largest scale, so changing the scale never reallocates; only
+// resizing the window does.
+static bool allocateFramebuffer(int width, int height) {
+	if (framebuffer && width == bufferWidth && height == bufferHeight) return true;
+	deleteFramebuffer();
+	genRenderbuffers(2, renderbuffers);
+	bindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	renderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	bindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	renderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	bindRenderbuffer(GL_RENDERBUFFER, 0);
+	genFramebuffers(1, &framebuffer);
+	bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	framebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	framebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	bool complete = checkFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	bindFramebuffer(GL_FRAMEBUFFER, windowFramebuffer);
+	if (!complete) {
+		printf("[dynres] could not create a %dx%d framebuffer\n", width, height);
+		deleteFramebuffer();
+		return false;
+	}
+	bufferWidth = width;
+	bufferHeight = height;
+	return true;
+}
+
+bool startDynamicResolution(float minimum, float maximum, float target) {
+	if (!loadGLProcs()) {
+		printf("[dynres] %s has no framebuffer objects\n", (const char*)glGetString(GL_RENDERER));
+		return false;
+	}
+	maxScale = std::min(std::max(maximum, DYNRES_STEP), 1.0f);
+	minScale = std::min(std::max(minimum, DYNRES_STEP), maxScale);
+	targetMs = target;
+	scale = maxScale;
+	gpuTimed = hasTimerQueries();
+	if (gpuTimed) genQueries(DYNRES_QUERIES, queries);
+	queriesIssued = queriesRead = 0;
+	samples = frames = holdFrames = raises = drops = 0;
+	lastDecision.frame = -1;
+	enabled = true;
+	printf("[dynres] scale %.2f to %.2f, scene target %.1f ms, timed by %s\n", minScale, maxScale, targetMs,
+		gpuTimed ? "timer queries" : "glFinish");
+	return true;
+}
+
+void stopDynamicResolution() {
+	if (!enabled) return;
+	deleteFramebuffer();
+	if (gpuTimed) deleteQueries(DYNRES_QUERIES, queries);
+	enabled = false;
+}
+
+bool isDynamicResolutionEnabled() {
+	return enabled;
+}
+
+// Fill cost goes with the pixel count, the square of the scale. Going down
+// takes the whole step that should fit the target; going up creeps, so one
+// light frame doesn't bring back a heavy scale.
+static void decide() {
+	float next = scale;
+	if (sceneMs > targetMs) {
+		next = floorf(scale * sqrtf(targetMs / sceneMs) / DYNRES_STEP) * DYNRES_STEP;
+		next = std::min(next, scale - DYNRES_STEP);
+	}
+	else if (sceneMs < targetMs * DYNRES_HEADROOM) {
+		next = scale + DYNRES_STEP;
+	}
+	next = std::min(std::max(next, minScale), maxScale);
+	if (fabsf(next - scale) < DYNRES_STEP / 2) return;
+
+	DynamicResolutionDecision decision = { frames, sceneMs, scale, next };
+	lastDecision = decision;
+	if (next > scale) raises++;
+	else drops++;
+	printf("[dynres] frame %d: scene %.2f ms against %.1f ms, scale %.2f -> %.2f\n", frames, sceneMs, targetMs, scale, next);
+	profileMark("resolution scale", (int)(next * 100 + 0.5f));
+	// Until frames at the new scale come in, expect the average to follow the pixel count.
+	sceneMs *= next * next / (scale * scale);
+	scale = next;
+	holdFrames = DYNRES_HOLD_FRAMES;
+}
+
+static void addSample(float ms) {
+	if (++samples <= DYNRES_WARMUP_FRAMES) return;
+	sceneMs = samples == DYNRES_WARMUP_FRAMES + 1 ? ms : sceneMs + DYNRES_SMOOTHING * (ms - sceneMs);
+	if (holdFrames > 0) holdFrames--;
+	else decide();
+}
+
+// Takes whatever results have come in, oldest first, without waiting.
+static void readQueries() {
+	while (queriesRead < queriesIssued) {
+		GLuint query = queries[queriesRead % DYNRES_QUERIES];
+		GLint available = 0;
+		getQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) break;
+		unsigned long long ns = 0;
+		getQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+		queriesRead++;
+		addSample((float)(ns / 1e6));
+	}
+}
+
+void beginDynamicResolution() {
+	if (!enabled) return;
+	if (gpuTimed) readQueries();
+	glGetIntegerv(GL_VIEWPORT, window);
+	sceneWidth = std::max(1, (int)(window[2] * scale + 0.5f));
+	sceneHeight = std::max(1, (int)(window[3] * scale + 0.5f));
+	offscreen = scale < 1;
+	if (offscreen) {
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &windowFramebuffer);
+		offscreen = allocateFramebuffer((int)ceilf(window[2] * maxScale), (int)ceilf(window[3] * maxScale));
+	}
+	if (offscreen) {
+		bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, sceneWidth, sceneHeight);
+	}
+	else {
+		sceneWidth = window[2];
+		sceneHeight = window[3];
+	}
+
+	queryOpen = gpuTimed && queriesIssued - queriesRead < DYNRES_QUERIES;
+	if (queryOpen) beginQuery(GL_TIME_ELAPSED, queries[queriesIssued % DYNRES_QUERIES]);
+	else if (!gpuTimed) passStart = std::chrono::steady_clock::now();
+}
+
+void endDynamicResolution() {
+	if (!enabled) return;
+	if (queryOpen) {
+		endQuery(GL_TIME_ELAPSED);
+		queriesIssued++;
+		queryOpen = false;
+	}
+	else if (!gpuTimed) {
+		glFinish();
+		addSample(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - passStart).count());
+	}
+
+	if (offscreen) {
+		bindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		bindFramebuffer(GL_DRAW_FRAMEBUFFER, windowFramebuffer);
+		blitFramebuffer(0, 0, sceneWidth, sceneHeight, window[0], window[1], window[0] + window[2], window[1] + window[3],
+			GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		bindFramebuffer(GL_FRAMEBUFFER, windowFramebuffer);
+		glViewport(window[0], window[1], window[2], window[3]);
+		// The window's depth was never drawn: what follows starts from a clear one.
+		glClear(GL_DEPTH_BUFFER_BIT);
+		offscreen = false;
+	}
+	frames++;
+}
+
+DynamicResolutionStats getDynamicResolutionStats() {
+	DynamicResolutionStats stats;
+	stats.scale = scale;
+	stats.width = sceneWidth;
+	stats.height = sceneHeight;
+	stats.sceneMs = sceneMs;
+	stats.gpuTimed = gpuTimed;
+	stats.frames = frames;
+	stats.raises = raises;
+	stats.drops = drops;
+	stats.lastDecision = lastDecision;
+	return stats;
+}
+
+void printDynamicResolutionStats() {
+	DynamicResolutionStats stats = getDynamicResolutionStats();
+	printf("[dynres] %d frames, now %.2f scale (%dx%d), scene %.2f ms, %d raises, %d drops\n",
+		stats.frames, stats.scale, stats.width, stats.height, stats.sceneMs, stats.raises, stats.drops);
+}
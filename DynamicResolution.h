@@ -0,0 +1,42 @@
+#pragma once
+
+// Renders the scene into a framebuffer object smaller than the window and
+// upscales it, so fill-rate-bound machines trade sharpness for frame time.
+// The scale is chosen each frame by a controller acting on the smoothed GPU
+// time of the scene pass. When the controller sits at a scale of 1 the
+// framebuffer is skipped, and the scene draws straight into the window.
+//
+// Whatever is drawn after endDynamicResolution(), such as the HUD, goes into
+// the window at its full resolution. Uses raw GL, so only the GL back ends
+// can use it.
+
+struct DynamicResolutionDecision {
+	int frame;
+	float sceneMs;   // The smoothed time acted on
+	float fromScale, toScale;
+};
+
+struct DynamicResolutionStats {
+	float scale;          // Of the window's width and height
+	int width, height;    // The scene's resolution
+	float sceneMs;        // Smoothed scene pass time
+	bool gpuTimed;        // From timer queries; otherwise a glFinish() ends the scene pass
+	int frames;
+	int raises, drops;    // Decisions so far
+	DynamicResolutionDecision lastDecision; // frame is -1 until there has been one
+};
+
+// Needs a current GL context. The scale stays between minScale and maxScale
+// (at most 1) and is lowered whenever the scene takes longer than targetMs.
+bool startDynamicResolution(float minScale, float maxScale, float targetMs);
+void stopDynamicResolution();
+bool isDynamicResolutionEnabled();
+
+// Bracket the scene. begin takes the viewport as the window's size, then
+// binds the framebuffer with a viewport scaled down from it. end upscales
+// into whatever framebuffer was bound before and puts the viewport back.
+void beginDynamicResolution();
+void endDynamicResolution();
+
+DynamicResolutionStats getDynamicResolutionStats();
+void printDynamicResolutionStats();
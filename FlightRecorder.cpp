@@ -0,0 +1,91 @@
+#include "FlightRecorder.h"
+
+#ifdef PROFILER
+
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#define FLIGHT_BEFORE_MS 3000
+#define FLIGHT_AFTER_MS 1000
+#define FLIGHT_COOLDOWN_MS 10000 // Between dumps, so a bad patch writes one file rather than dozens
+#define FLIGHT_MAX_DUMPS 20      // Per run, so a machine left running can't fill its disk
+#define FLIGHT_WARMUP_FRAMES 10  // The first frames compile shaders and fill caches; they aren't hitches
+
+// Only touched on the thread that draws the frames.
+static bool recording = false;
+static float budget;
+static const char* dumpDirectory;
+static long long runStart;
+static unsigned long long frameStart;
+static int frames = 0;
+static int hitches = 0;
+static int dumps = 0;
+static double worstMs = 0;
+// The window of the dump waiting for its end to be recorded; dumpTo is 0
+// when none is.
+static unsigned long long dumpFrom = 0, dumpTo = 0;
+static unsigned long long lastDumpTo = 0;
+static std::thread dumpThread;
+
+void startFlightRecorder(float budgetMs, const char* directory) {
+	startProfiler();
+	budget = budgetMs;
+	dumpDirectory = directory;
+	runStart = (long long)time(0);
+	recording = true;
+	printf("[flight] recording, dumping frames over %.1f ms to %s\n", budget, dumpDirectory);
+}
+
+// Hands the window to a thread: copying the rings and writing the JSON takes
+// longer than a frame.
+static void writeDump() {
+	dumps++;
+	char path[512];
+	snprintf(path, sizeof(path), "%s/hitch_%lld_%d.json", dumpDirectory, runStart, dumps);
+	if (dumpThread.joinable()) dumpThread.join();
+	std::string file = path;
+	unsigned long long from = dumpFrom, to = dumpTo;
+	dumpThread = std::thread([file, from, to]() { writeChromeTrace(file.c_str(), from, to); });
+	lastDumpTo = dumpTo;
+	dumpTo = 0;
+}
+
+void stopFlightRecorder() {
+	if (!recording) return;
+	recording = false;
+	if (dumpTo) writeDump();
+	if (dumpThread.joinable()) dumpThread.join();
+	printf("[flight] %d of %d frames over %.1f ms, worst %.1f ms, %d dumps\n", hitches, frames, budget, worstMs, dumps);
+}
+
+void beginFlightFrame() {
+	if (recording) frameStart = profileTimestamp();
+}
+
+void endFlightFrame() {
+	if (!recording) return;
+	unsigned long long end = profileTimestamp();
+	frames++;
+	double ticksPerMs = profileTicksPerMs();
+	if (dumpTo && end >= dumpTo) writeDump();
+	if (frames <= FLIGHT_WARMUP_FRAMES) return;
+
+	double ms = (end - frameStart) / ticksPerMs;
+	if (ms <= budget) return;
+	hitches++;
+	worstMs = std::max(worstMs, ms);
+	profileMark("over budget", (int)ms);
+	// A hitch inside a pending window is already in it; one soon after a dump
+	// is most likely the same trouble.
+	if (dumpTo || dumps >= FLIGHT_MAX_DUMPS) return;
+	if (lastDumpTo && end < lastDumpTo + (unsigned long long)(FLIGHT_COOLDOWN_MS * ticksPerMs)) return;
+	unsigned long long before = (unsigned long long)(FLIGHT_BEFORE_MS * ticksPerMs);
+	dumpFrom = frameStart > before ? frameStart - before : 0;
+	dumpTo = end + (unsigned long long)(FLIGHT_AFTER_MS * ticksPerMs);
+	printf("[flight] frame %d took %.1f ms, dumping the %d ms around it\n", frames, ms, FLIGHT_BEFORE_MS + FLIGHT_AFTER_MS);
+}
+
+#endif
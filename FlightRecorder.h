@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Profiler.h"
+
+// Hitch capture that stays on in the field. It keeps the profiler running, so
+// the rings always hold the last few seconds of zones, input and sound marks.
+// When a frame takes longer than the budget, the stretch from
+// FLIGHT_BEFORE_MS before that frame to FLIGHT_AFTER_MS after it is written
+// as a Chrome trace named hitch_<start time>_<n>.json. The file is written on
+// a thread of its own so that the dump does not cause another hitch.
+//
+// Nothing runs per frame beyond the profiler's zones and one budget check.
+// It goes away with the profiler when NO_PROFILER is defined.
+#ifdef PROFILER
+
+// budgetMs is the longest a frame may take. Dumps go to directory, which
+// must outlive the recorder.
+void startFlightRecorder(float budgetMs, const char* directory);
+// Writes any dump still waiting for its window to close, waits for it and
+// prints how many frames went over budget.
+void stopFlightRecorder();
+
+// Bracket each frame on the thread that draws it.
+void beginFlightFrame();
+void endFlightFrame();
+
+#else
+
+inline void startFlightRecorder(float, const char*) {}
+inline void stopFlightRecorder() {}
+inline void beginFlightFrame() {}
+inline void endFlightFrame() {}
+
+#endif
@@ -0,0 +1,37 @@
+#include "GLProcs.h"
+
+#ifndef _WIN32
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#endif
+
+GenObjectsProc genFramebuffers, genRenderbuffers;
+DeleteObjectsProc deleteFramebuffers, deleteRenderbuffers;
+BindObjectProc bindFramebuffer, bindRenderbuffer;
+RenderbufferStorageProc renderbufferStorage;
+FramebufferRenderbufferProc framebufferRenderbuffer;
+CheckFramebufferStatusProc checkFramebufferStatus;
+BlitFramebufferProc blitFramebuffer;
+
+void* getGLProc(const char* name) {
+#ifdef _WIN32
+	return (void*)wglGetProcAddress(name);
+#else
+	return (void*)eglGetProcAddress(name);
+#endif
+}
+
+bool loadFramebufferProcs() {
+	genFramebuffers = (GenObjectsProc)getGLProc("glGenFramebuffers");
+	genRenderbuffers = (GenObjectsProc)getGLProc("glGenRenderbuffers");
+	deleteFramebuffers = (DeleteObjectsProc)getGLProc("glDeleteFramebuffers");
+	deleteRenderbuffers = (DeleteObjectsProc)getGLProc("glDeleteRenderbuffers");
+	bindFramebuffer = (BindObjectProc)getGLProc("glBindFramebuffer");
+	bindRenderbuffer = (BindObjectProc)getGLProc("glBindRenderbuffer");
+	renderbufferStorage = (RenderbufferStorageProc)getGLProc("glRenderbufferStorage");
+	framebufferRenderbuffer = (FramebufferRenderbufferProc)getGLProc("glFramebufferRenderbuffer");
+	checkFramebufferStatus = (CheckFramebufferStatusProc)getGLProc("glCheckFramebufferStatus");
+	blitFramebuffer = (BlitFramebufferProc)getGLProc("glBlitFramebuffer");
+	return genFramebuffers && genRenderbuffers && deleteFramebuffers && deleteRenderbuffers && bindFramebuffer
+		&& bindRenderbuffer && renderbufferStorage && framebufferRenderbuffer && checkFramebufferStatus;
+}
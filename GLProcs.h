@@ -0,0 +1,62 @@
+#pragma once
+
+// GL entry points past the 1.1 that opengl32.lib exports, looked up at run
+// time once a context is current. Include this in place of <glut.h> where
+// they are called: on POSIX glut.h takes its own APIENTRY back out, and the
+// typedefs below need it.
+#include <stdlib.h> // Before glut.h, whose own exit() would clash with it
+#ifdef _WIN32
+#include <windows.h>
+#include <glut.h>
+#else
+#include <glut.h>
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+#endif
+
+// Framebuffer objects are GL 3.0.
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER 0x8D40
+#define GL_RENDERBUFFER 0x8D41
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#define GL_DEPTH_ATTACHMENT 0x8D00
+#define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#endif
+#ifndef GL_READ_FRAMEBUFFER
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#define GL_DRAW_FRAMEBUFFER 0x8CA9
+#define GL_DRAW_FRAMEBUFFER_BINDING 0x8CA6
+#endif
+#ifndef GL_DEPTH_COMPONENT24
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058
+#endif
+
+typedef void (APIENTRY* GenObjectsProc)(GLsizei n, GLuint* ids);
+typedef void (APIENTRY* DeleteObjectsProc)(GLsizei n, const GLuint* ids);
+typedef void (APIENTRY* BindObjectProc)(GLenum target, GLuint id);
+typedef void (APIENTRY* RenderbufferStorageProc)(GLenum target, GLenum format, GLsizei width, GLsizei height);
+typedef void (APIENTRY* FramebufferRenderbufferProc)(GLenum target, GLenum attachment, GLenum renderbufferTarget, GLuint renderbuffer);
+typedef GLenum (APIENTRY* CheckFramebufferStatusProc)(GLenum target);
+typedef void (APIENTRY* BlitFramebufferProc)(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1,
+	GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter);
+
+// wglGetProcAddress on Windows, eglGetProcAddress elsewhere; 0 if the
+// driver has no such function.
+void* getGLProc(const char* name);
+
+// Looks up the framebuffer functions below for the current context. Returns
+// false if any needed to build and bind a framebuffer is missing;
+// blitFramebuffer is left for the caller to check.
+bool loadFramebufferProcs();
+
+extern GenObjectsProc genFramebuffers, genRenderbuffers;
+extern DeleteObjectsProc deleteFramebuffers, deleteRenderbuffers;
+extern BindObjectProc bindFramebuffer, bindRenderbuffer;
+extern RenderbufferStorageProc renderbufferStorage;
+extern FramebufferRenderbufferProc framebufferRenderbuffer;
+extern CheckFramebufferStatusProc checkFramebufferStatus;
+extern BlitFramebufferProc blitFramebuffer;
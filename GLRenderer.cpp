@@ -0,0 +1,374 @@
+#include "GLRenderer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <glut.h>
+#include <algorithm>
+#include <chrono>
+
+static const GLenum primitiveModes[] = {
+	GL_LINES, GL_LINE_STRIP, GL_TRIANGLES, GL_TRIANGLE_FAN, GL_QUADS, GL_QUAD_STRIP
+};
+
+GLRenderer::GLRenderer(bool bitmapFonts) : bitmapFonts(bitmapFonts), time(0), mode(MATRIX_MODELVIEW),
+	modelviewChanged(true), projectionChanged(true) {
+}
+
+void GLRenderer::init() {
+	glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_LIGHTING);
+	glEnable(GL_LIGHT0);
+	glEnable(GL_NORMALIZE);
+	glEnable(GL_COLOR_MATERIAL);
+
+	glShadeModel(GL_SMOOTH);
+	glMatrixMode(GL_MODELVIEW); // uploadMatrices() leaves it here
+	modelviewChanged = projectionChanged = true;
+}
+
+void GLRenderer::clear() {
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void GLRenderer::flush() {
+	glFlush();
+}
+
+void GLRenderer::setTime(float time) {
+	this->time = time;
+}
+
+MatrixStack& GLRenderer::stack() {
+	return mode == MATRIX_PROJECTION ? projection : modelview;
+}
+
+void GLRenderer::changed() {
+	if (mode == MATRIX_PROJECTION) projectionChanged = true;
+	else modelviewChanged = true;
+}
+
+// Called by everything that GL transforms: vertices, the light's position
+// and the raster position.
+void GLRenderer::uploadMatrices() {
+	if (projectionChanged) {
+		glMatrixMode(GL_PROJECTION);
+		glLoadMatrixf(projection.top());
+		glMatrixMode(GL_MODELVIEW);
+		projectionChanged = false;
+	}
+	if (modelviewChanged) {
+		glLoadMatrixf(modelview.top());
+		modelviewChanged = false;
+	}
+}
+
+void GLRenderer::matrixMode(MatrixMode mode) {
+	this->mode = mode;
+}
+
+void GLRenderer::loadIdentity() {
+	stack().loadIdentity();
+	changed();
+}
+
+void GLRenderer::pushMatrix() {
+	stack().push(); // The top stays the same
+}
+
+void GLRenderer::popMatrix() {
+	stack().pop();
+	changed();
+}
+
+void GLRenderer::translate(float x, float y, float z) {
+	stack().translate(x, y, z);
+	changed();
+}
+
+void GLRenderer::rotate(float angle, float x, float y, float z) {
+	stack().rotate(angle, x, y, z);
+	changed();
+}
+
+void GLRenderer::scale(float x, float y, float z) {
+	stack().scale(x, y, z);
+	changed();
+}
+
+void GLRenderer::scaleWave(const TimeWave& s) {
+	float value = evaluateWave(s, time);
+	scale(value, value, value);
+}
+
+void GLRenderer::multMatrix(const float m[16]) {
+	stack().multiply(m);
+	changed();
+}
+
+void GLRenderer::perspective(float fovy, float aspect, float zNear, float zFar) {
+	stack().perspective(fovy, aspect, zNear, zFar);
+	changed();
+}
+
+void GLRenderer::ortho2D(float left, float right, float bottom, float top) {
+	stack().ortho2D(left, right, bottom, top);
+	changed();
+}
+
+void GLRenderer::lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+	float upX, float upY, float upZ) {
+	stack().lookAt(eyeX, eyeY, eyeZ, centerX, centerY, centerZ, upX, upY, upZ);
+	changed();
+}
+
+void GLRenderer::pushAttrib() {
+	glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
+}
+
+void GLRenderer::popAttrib() {
+	glPopAttrib();
+}
+
+void GLRenderer::setMaterial(const float ambient[4], const float diffuse[4], const float specular[4], float shininess) {
+	glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, ambient);
+	glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse);
+	glMaterialfv(GL_FRONT, GL_SPECULAR, specular);
+	glMaterialf(GL_FRONT, GL_SHININESS, shininess);
+}
+
+void GLRenderer::setLight(const float position[4], const float diffuse[4]) {
+	uploadMatrices(); // GL stores the position in eye space
+	glLightfv(GL_LIGHT0, GL_POSITION, position);
+	glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuse);
+}
+
+void GLRenderer::color(float r, float g, float b) {
+	glColor3f(r, g, b);
+}
+
+void GLRenderer::colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b) {
+	glColor3f(evaluateWave(r, time), evaluateWave(g, time), evaluateWave(b, time));
+}
+
+void GLRenderer::normal(float x, float y, float z) {
+	glNormal3f(x, y, z);
+}
+
+void GLRenderer::lineWidth(float width) {
+	glLineWidth(width);
+}
+
+void GLRenderer::begin(PrimitiveType type) {
+	uploadMatrices();
+	glBegin(primitiveModes[type]);
+}
+
+void GLRenderer::vertex(float x, float y, float z) {
+	glVertex3f(x, y, z);
+}
+
+void GLRenderer::end() {
+	glEnd();
+}
+
+void GLRenderer::text(float x, float y, const char* s) {
+	if (!bitmapFonts) return;
+	uploadMatrices();
+	glRasterPos2f(x, y);
+	for (; *s; s++) {
+		glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *s);
+	}
+}
+
+// Client arrays are GL 1.1, so this needs nothing past opengl32.lib.
+void GLRenderer::drawMesh(const Mesh& mesh) {
+	uploadMatrices();
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, mesh.positions);
+	if (mesh.normals) {
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glNormalPointer(GL_FLOAT, 0, mesh.normals);
+	}
+	if (mesh.colors) {
+		glEnableClientState(GL_COLOR_ARRAY);
+		glColorPointer(3, GL_FLOAT, 0, mesh.colors);
+	}
+	if (mesh.indexCount) {
+		glDrawElements(primitiveModes[mesh.type], mesh.indexCount, GL_UNSIGNED_SHORT, mesh.indices);
+	}
+	else {
+		glDrawArrays(primitiveModes[mesh.type], 0, mesh.vertexCount);
+	}
+	if (mesh.colors) glDisableClientState(GL_COLOR_ARRAY);
+	if (mesh.normals) glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+// GL 1.1 has no instancing, so the copies are placed on the CPU and joined
+// into as few draws as 16-bit indices allow. Strips and fans don't join, so
+// those are drawn one copy at a time.
+void GLRenderer::drawMeshInstances(const Mesh& mesh, const float* instances, int count) {
+	int vertices = mesh.vertexCount;
+	bool joinable = mesh.type == PRIM_LINES || mesh.type == PRIM_TRIANGLES || mesh.type == PRIM_QUADS;
+	if (!joinable || vertices <= 0 || vertices > 65536) {
+		Renderer::drawMeshInstances(mesh, instances, count);
+		return;
+	}
+	float currentNormal[3];
+	if (!mesh.normals) glGetFloatv(GL_CURRENT_NORMAL, currentNormal);
+	int perDraw = 65536 / vertices;
+	for (int first = 0; first < count; first += perDraw) {
+		int copies = std::min(perDraw, count - first);
+		batchPositions.resize(3 * vertices * copies);
+		batchNormals.resize(3 * vertices * copies);
+		if (mesh.colors) batchColors.resize(3 * vertices * copies);
+		batchIndices.resize(mesh.indexCount * copies);
+		for (int k = 0; k < copies; k++) {
+			const float* place = instances + INSTANCE_FLOATS * (first + k);
+			float radians = (float)(place[3] * 3.14159265358979323846 / 180.0);
+			float c = cosf(radians), s = sinf(radians);
+			float* positions = &batchPositions[3 * vertices * k];
+			float* normals = &batchNormals[3 * vertices * k];
+			for (int v = 0; v < vertices; v++) {
+				const float* p = mesh.positions + 3 * v;
+				const float* n = mesh.normals ? mesh.normals + 3 * v : currentNormal;
+				positions[3 * v] = c * p[0] + s * p[2] + place[0];
+				positions[3 * v + 1] = p[1] + place[1];
+				positions[3 * v + 2] = c * p[2] - s * p[0] + place[2];
+				normals[3 * v] = c * n[0] + s * n[2];
+				normals[3 * v + 1] = n[1];
+				normals[3 * v + 2] = c * n[2] - s * n[0];
+			}
+			if (mesh.colors) memcpy(&batchColors[3 * vertices * k], mesh.colors, 3 * vertices * sizeof(float));
+			unsigned short* indices = batchIndices.data() + mesh.indexCount * k;
+			for (int i = 0; i < mesh.indexCount; i++) indices[i] = (unsigned short)(mesh.indices[i] + vertices * k);
+		}
+		Mesh batch = mesh;
+		batch.vertexCount = vertices * copies;
+		batch.positions = batchPositions.data();
+		batch.normals = batchNormals.data();
+		batch.colors = mesh.colors ? batchColors.data() : 0;
+		batch.indexCount = mesh.indexCount * copies;
+		batch.indices = mesh.indexCount ? batchIndices.data() : 0;
+		drawMesh(batch);
+	}
+}
+
+#define MATRIX_BENCH_DEPTH 8 // Parts in a block's chain
+
+// The same calls on GL's stack and on a MatrixStack, so one block can be run
+// on either.
+struct GLMatrixCalls {
+	void loadIdentity() { glLoadIdentity(); }
+	void push() { glPushMatrix(); }
+	void pop() { glPopMatrix(); }
+	void translate(float x, float y, float z) { glTranslatef(x, y, z); }
+	void rotate(float angle, float x, float y, float z) { glRotatef(angle, x, y, z); }
+	void scale(float x, float y, float z) { glScalef(x, y, z); }
+	void lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ) {
+		gluLookAt(eyeX, eyeY, eyeZ, centerX, centerY, centerZ, 0, 1, 0);
+	}
+};
+
+struct CPUMatrixCalls {
+	MatrixStack stack;
+	void loadIdentity() { stack.loadIdentity(); }
+	void push() { stack.push(); }
+	void pop() { stack.pop(); }
+	void translate(float x, float y, float z) { stack.translate(x, y, z); }
+	void rotate(float angle, float x, float y, float z) { stack.rotate(angle, x, y, z); }
+	void scale(float x, float y, float z) { stack.scale(x, y, z); }
+	void lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ) {
+		stack.lookAt(eyeX, eyeY, eyeZ, centerX, centerY, centerZ, 0, 1, 0);
+	}
+};
+
+// A camera, then a chain of parts each placed on the one before, the way the
+// player's body is drawn. Leaves the chain pushed.
+template <class Calls>
+static void pushMatrixBlock(Calls& calls, int block) {
+	calls.loadIdentity();
+	calls.lookAt(0.0f, 10.0f, 20.0f, 0.0f, 1.0f, (float)(block % 10));
+	for (int i = 0; i < MATRIX_BENCH_DEPTH; i++) {
+		calls.push();
+		calls.translate(0.1f * i, 1.0f, -0.5f);
+		calls.rotate((float)((block + i * 15) % 360), 0.3f, 1.0f, 0.2f);
+		calls.scale(1.0f, 1.1f, 0.9f);
+	}
+}
+
+template <class Calls>
+static void popMatrixBlock(Calls& calls) {
+	for (int i = 0; i < MATRIX_BENCH_DEPTH; i++) calls.pop();
+}
+
+static float largestDifference(const float* a, const float* b) {
+	float largest = 0;
+	for (int i = 0; i < 16; i++) {
+		float d = fabsf(a[i] - b[i]);
+		if (d > largest) largest = d;
+	}
+	return largest;
+}
+
+void benchmarkMatrixStack(int blocks) {
+	const int callsPerBlock = 2 + MATRIX_BENCH_DEPTH * 5;
+	GLMatrixCalls gl;
+	CPUMatrixCalls cpu;
+	glMatrixMode(GL_MODELVIEW);
+
+	// Agreement first: each block's deepest matrix, and a projection.
+	float glMatrix[16];
+	float modelviewDifference = 0;
+	for (int block = 0; block < 360; block++) {
+		pushMatrixBlock(gl, block);
+		pushMatrixBlock(cpu, block);
+		glGetFloatv(GL_MODELVIEW_MATRIX, glMatrix);
+		float d = largestDifference(glMatrix, cpu.stack.top());
+		if (d > modelviewDifference) modelviewDifference = d;
+		popMatrixBlock(gl);
+		popMatrixBlock(cpu);
+	}
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	gluPerspective(60.0, 16.0 / 9.0, 0.1, 300.0);
+	glGetFloatv(GL_PROJECTION_MATRIX, glMatrix);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	MatrixStack projection;
+	projection.perspective(60.0f, 16.0f / 9.0f, 0.1f, 300.0f);
+	float projectionDifference = largestDifference(glMatrix, projection.top());
+
+	auto start = std::chrono::steady_clock::now();
+	for (int block = 0; block < blocks; block++) {
+		pushMatrixBlock(gl, block);
+		popMatrixBlock(gl);
+	}
+	glFinish();
+	auto glEnd = std::chrono::steady_clock::now();
+	for (int block = 0; block < blocks; block++) {
+		pushMatrixBlock(cpu, block);
+		popMatrixBlock(cpu);
+	}
+	auto cpuEnd = std::chrono::steady_clock::now();
+	// What GLRenderer does: the same work, plus loading the matrix a draw at
+	// the end of the chain would use.
+	for (int block = 0; block < blocks; block++) {
+		pushMatrixBlock(cpu, block);
+		glLoadMatrixf(cpu.stack.top());
+		popMatrixBlock(cpu);
+	}
+	glFinish();
+	auto uploadEnd = std::chrono::steady_clock::now();
+
+	double calls = (double)blocks * callsPerBlock;
+	printf("[matrix] %.0f calls: GL stack %.1f ns per call, MatrixStack %.1f ns, with an upload per draw %.1f ns\n", calls,
+		std::chrono::duration<double, std::nano>(glEnd - start).count() / calls,
+		std::chrono::duration<double, std::nano>(cpuEnd - glEnd).count() / calls,
+		std::chrono::duration<double, std::nano>(uploadEnd - cpuEnd).count() / calls);
+	printf("[matrix] largest difference from GL: modelview %g, projection %g\n", modelviewDifference, projectionDifference);
+}
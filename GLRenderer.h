@@ -0,0 +1,72 @@
+#pragma once
+
+#include "MatrixStack.h"
+#include "Renderer.h"
+
+#include <vector>
+
+// Forwards every call to the current OpenGL context, except the matrix
+// calls. Those work on a MatrixStack, and the top matrices are loaded into
+// GL before a draw that needs them, only if they changed since the last.
+class GLRenderer : public Renderer {
+public:
+	// bitmapFonts says whether GLUT has been initialised, which freeglut's
+	// fonts need.
+	explicit GLRenderer(bool bitmapFonts);
+
+	void init();
+	void clear();
+	void flush();
+	void setTime(float time);
+
+	void matrixMode(MatrixMode mode);
+	void loadIdentity();
+	void pushMatrix();
+	void popMatrix();
+	void translate(float x, float y, float z);
+	void rotate(float angle, float x, float y, float z);
+	void scale(float x, float y, float z);
+	void scaleWave(const TimeWave& s);
+	void multMatrix(const float m[16]);
+	void perspective(float fovy, float aspect, float zNear, float zFar);
+	void ortho2D(float left, float right, float bottom, float top);
+	void lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+		float upX, float upY, float upZ);
+
+	void pushAttrib();
+	void popAttrib();
+	void setMaterial(const float ambient[4], const float diffuse[4], const float specular[4], float shininess);
+	void setLight(const float position[4], const float diffuse[4]);
+
+	void color(float r, float g, float b);
+	void colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b);
+	void normal(float x, float y, float z);
+	void lineWidth(float width);
+	void begin(PrimitiveType type);
+	void vertex(float x, float y, float z);
+	void end();
+
+	void text(float x, float y, const char* s);
+	void drawMesh(const Mesh& mesh);
+	void drawMeshInstances(const Mesh& mesh, const float* instances, int count);
+
+private:
+	MatrixStack& stack(); // The one matrixMode() selects
+	void changed();       // Marks the selected matrix for upload
+	void uploadMatrices();
+
+	bool bitmapFonts;
+	float time;
+	MatrixMode mode;
+	MatrixStack modelview, projection;
+	bool modelviewChanged, projectionChanged;
+
+	// drawMeshInstances() batches, refilled by each.
+	std::vector<float> batchPositions, batchNormals, batchColors;
+	std::vector<unsigned short> batchIndices;
+};
+
+// Times the same transforms on GL's matrix stack and on a MatrixStack, and
+// prints both with the largest difference between their matrices. Needs a
+// current GL context.
+void benchmarkMatrixStack(int blocks);
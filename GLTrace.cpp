@@ -0,0 +1,286 @@
+#include "GLTrace.h"
+
+#ifdef GL_TRACE
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#define UNSCOPED_ROUTINE 0
+
+struct TraceCounters {
+	long long calls;    // GL, GLU and GLUT calls, as GLRenderer would make them
+	long long vertices;
+	long long draws;    // begin()/end() pairs
+	double cpuMs;
+};
+
+struct TraceRow {
+	int frame;
+	int routine;
+	TraceCounters counters;
+};
+
+static std::mutex routineMutex;
+static std::vector<const char*> routineNames(1, "(unscoped)");
+
+// Only touched on the tracing thread.
+static thread_local bool tracingThread = false;
+static std::vector<TraceCounters> frameCounters; // This frame's, by routine
+static std::vector<int> scopeStack;
+static std::vector<TraceRow> rows;
+static std::chrono::steady_clock::time_point lastMark;
+static bool frameStarted = false;
+static int frameCount = 0;
+
+int registerTraceRoutine(const char* name) {
+	std::lock_guard<std::mutex> lock(routineMutex);
+	for (int i = 0; i < (int)routineNames.size(); i++) {
+		if (strcmp(routineNames[i], name) == 0) return i;
+	}
+	routineNames.push_back(name);
+	return (int)routineNames.size() - 1;
+}
+
+static TraceCounters& counters(int routine) {
+	if (routine >= (int)frameCounters.size()) {
+		TraceCounters zero = { 0, 0, 0, 0 };
+		frameCounters.resize(routine + 1, zero);
+	}
+	return frameCounters[routine];
+}
+
+static int currentRoutine() {
+	return scopeStack.empty() ? UNSCOPED_ROUTINE : scopeStack.back();
+}
+
+// Charges the time since the last mark to the routine running now. The
+// first traced call after a flush starts the frame, so the wait between
+// frames is never counted.
+static void mark() {
+	auto now = std::chrono::steady_clock::now();
+	if (frameStarted) {
+		counters(currentRoutine()).cpuMs += std::chrono::duration<double, std::milli>(now - lastMark).count();
+	}
+	frameStarted = true;
+	lastMark = now;
+}
+
+TraceScope::TraceScope(int routine) : active(tracingThread) {
+	if (!active) return;
+	mark();
+	scopeStack.push_back(routine);
+}
+
+TraceScope::~TraceScope() {
+	if (!active) return;
+	mark();
+	scopeStack.pop_back();
+}
+
+static void endFrame() {
+	mark();
+	for (int i = 0; i < (int)frameCounters.size(); i++) {
+		const TraceCounters& c = frameCounters[i];
+		if (c.calls == 0 && c.cpuMs == 0) continue;
+		TraceRow row = { frameCount, i, c };
+		rows.push_back(row);
+	}
+	frameCounters.clear();
+	frameStarted = false;
+	frameCount++;
+}
+
+// Counts each call against the routine running now, then forwards it.
+class TracingRenderer : public Renderer {
+public:
+	explicit TracingRenderer(Renderer* target) : target(target) {
+	}
+
+	Renderer* getTarget() const { return target; }
+
+	void init() { count(7); target->init(); }
+	void clear() { count(1); target->clear(); }
+	void flush() {
+		count(1);
+		target->flush();
+		endFrame();
+	}
+	void setTime(float time) { count(0); target->setTime(time); }
+
+	void matrixMode(MatrixMode mode) { count(1); target->matrixMode(mode); }
+	void loadIdentity() { count(1); target->loadIdentity(); }
+	void pushMatrix() { count(1); target->pushMatrix(); }
+	void popMatrix() { count(1); target->popMatrix(); }
+	void translate(float x, float y, float z) { count(1); target->translate(x, y, z); }
+	void rotate(float angle, float x, float y, float z) { count(1); target->rotate(angle, x, y, z); }
+	void scale(float x, float y, float z) { count(1); target->scale(x, y, z); }
+	void multMatrix(const float m[16]) { count(1); target->multMatrix(m); }
+	void scaleWave(const TimeWave& s) { count(1); target->scaleWave(s); }
+	void perspective(float fovy, float aspect, float zNear, float zFar) {
+		count(1);
+		target->perspective(fovy, aspect, zNear, zFar);
+	}
+	void ortho2D(float left, float right, float bottom, float top) {
+		count(1);
+		target->ortho2D(left, right, bottom, top);
+	}
+	void lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+		float upX, float upY, float upZ) {
+		count(1);
+		target->lookAt(eyeX, eyeY, eyeZ, centerX, centerY, centerZ, upX, upY, upZ);
+	}
+
+	void pushAttrib() { count(1); target->pushAttrib(); }
+	void popAttrib() { count(1); target->popAttrib(); }
+	void setMaterial(const float ambient[4], const float diffuse[4], const float specular[4], float shininess) {
+		count(4);
+		target->setMaterial(ambient, diffuse, specular, shininess);
+	}
+	void setLight(const float position[4], const float diffuse[4]) {
+		count(2);
+		target->setLight(position, diffuse);
+	}
+
+	void color(float r, float g, float b) { count(1); target->color(r, g, b); }
+	void colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b) { count(1); target->colorWave(r, g, b); }
+	void normal(float x, float y, float z) { count(1); target->normal(x, y, z); }
+	void lineWidth(float width) { count(1); target->lineWidth(width); }
+	void begin(PrimitiveType type) { count(1); target->begin(type); }
+	void vertex(float x, float y, float z) {
+		TraceCounters& c = counters(currentRoutine());
+		c.calls++;
+		c.vertices++;
+		target->vertex(x, y, z);
+	}
+	void end() {
+		TraceCounters& c = counters(currentRoutine());
+		c.calls++;
+		c.draws++;
+		target->end();
+	}
+
+	void text(float x, float y, const char* s) {
+		count(1 + (int)strlen(s)); // glRasterPos, then one glutBitmapCharacter a character
+		target->text(x, y, s);
+	}
+	void drawMesh(const Mesh& mesh) {
+		TraceCounters& c = counters(currentRoutine());
+		// Enable, pointer and disable for each array, then the draw.
+		c.calls += 4 + (mesh.normals ? 3 : 0) + (mesh.colors ? 3 : 0);
+		c.vertices += mesh.indexCount ? mesh.indexCount : mesh.vertexCount;
+		c.draws++;
+		target->drawMesh(mesh);
+	}
+	// Skinned on the CPU, then drawn as a mesh.
+	void drawSkinnedMesh(const SkinnedMesh& skinned, const float* bones) {
+		TraceCounters& c = counters(currentRoutine());
+		c.calls += 4 + (skinned.mesh.normals ? 3 : 0) + (skinned.mesh.colors ? 3 : 0);
+		c.vertices += skinned.mesh.indexCount ? skinned.mesh.indexCount : skinned.mesh.vertexCount;
+		c.draws++;
+		target->drawSkinnedMesh(skinned, bones);
+	}
+	// Counted as GLRenderer draws it: the copies batched into meshes of up
+	// to 65536 vertices on the CPU.
+	void drawMeshInstances(const Mesh& mesh, const float* instances, int count) {
+		TraceCounters& c = counters(currentRoutine());
+		int perDraw = mesh.vertexCount > 0 ? std::max(1, 65536 / mesh.vertexCount) : 1;
+		int draws = (count + perDraw - 1) / perDraw;
+		c.calls += draws * (4 + 3 + (mesh.colors ? 3 : 0)); // Batches always carry normals
+		c.vertices += count * (mesh.indexCount ? mesh.indexCount : mesh.vertexCount);
+		c.draws += draws;
+		target->drawMeshInstances(mesh, instances, count);
+	}
+
+private:
+	void count(int calls) {
+		if (!frameStarted) mark();
+		counters(currentRoutine()).calls += calls;
+	}
+
+	Renderer* target;
+};
+
+static TracingRenderer* tracer = 0;
+
+Renderer* startGLTrace(Renderer* target) {
+	tracingThread = true;
+	frameCounters.clear();
+	scopeStack.clear();
+	rows.clear();
+	frameStarted = false;
+	frameCount = 0;
+	tracer = new TracingRenderer(target);
+	return tracer;
+}
+
+Renderer* stopGLTrace(const char* csvPath) {
+	if (!tracer) return 0;
+	Renderer* target = tracer->getTarget();
+	delete tracer;
+	tracer = 0;
+	tracingThread = false;
+
+	int routineCount;
+	{
+		std::lock_guard<std::mutex> lock(routineMutex);
+		routineCount = (int)routineNames.size();
+	}
+	TraceCounters zero = { 0, 0, 0, 0 };
+	std::vector<TraceCounters> totals(routineCount, zero);
+	for (const TraceRow& row : rows) {
+		TraceCounters& t = totals[row.routine];
+		t.calls += row.counters.calls;
+		t.vertices += row.counters.vertices;
+		t.draws += row.counters.draws;
+		t.cpuMs += row.counters.cpuMs;
+	}
+	std::vector<int> order;
+	for (int i = 0; i < routineCount; i++) {
+		if (totals[i].calls > 0 || totals[i].cpuMs > 0) order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&totals](int a, int b) { return totals[a].cpuMs > totals[b].cpuMs; });
+
+	if (frameCount > 0) {
+		printf("[trace] %d frames, per frame:\n", frameCount);
+		printf("[trace] %-20s %9s %9s %7s %9s\n", "routine", "calls", "vertices", "draws", "cpu ms");
+		for (int i : order) {
+			const TraceCounters& t = totals[i];
+			printf("[trace] %-20s %9.1f %9.1f %7.1f %9.4f\n", routineNames[i],
+				(double)t.calls / frameCount, (double)t.vertices / frameCount, (double)t.draws / frameCount, t.cpuMs / frameCount);
+		}
+	}
+
+	if (csvPath) {
+		FILE* f = fopen(csvPath, "w");
+		if (!f) {
+			printf("[trace] could not write %s\n", csvPath);
+			return target;
+		}
+		// One line per routine per frame, then the frame's total.
+		fprintf(f, "frame,routine,calls,vertices,draws,cpu_ms\n");
+		for (size_t i = 0; i < rows.size(); i++) {
+			const TraceRow& row = rows[i];
+			const TraceCounters& c = row.counters;
+			fprintf(f, "%d,%s,%lld,%lld,%lld,%.4f\n", row.frame, routineNames[row.routine], c.calls, c.vertices, c.draws, c.cpuMs);
+			if (i + 1 == rows.size() || rows[i + 1].frame != row.frame) {
+				TraceCounters total = zero;
+				for (size_t j = i + 1; j-- > 0 && rows[j].frame == row.frame;) {
+					total.calls += rows[j].counters.calls;
+					total.vertices += rows[j].counters.vertices;
+					total.draws += rows[j].counters.draws;
+					total.cpuMs += rows[j].counters.cpuMs;
+				}
+				fprintf(f, "%d,total,%lld,%lld,%lld,%.4f\n", row.frame, total.calls, total.vertices, total.draws, total.cpuMs);
+			}
+		}
+		fclose(f);
+		printf("[trace] wrote %d frames to %s\n", frameCount, csvPath);
+	}
+	return target;
+}
+
+#endif
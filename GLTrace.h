@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Renderer.h"
+
+// Per-draw-routine GL accounting. The draw code reaches GL, GLU and GLUT only
+// through the Renderer interface, so a Renderer that counts and forwards
+// sees every call it makes. Each draw routine opens a TRACE_DRAW scope; the
+// calls, vertices, draws and CPU time inside it are charged to it, minus
+// whatever nested routines take. Everything else in a frame is charged to
+// "(unscoped)".
+//
+// Debug builds have it; elsewhere TRACE_DRAW expands to nothing and none of
+// this is compiled. Define GL_TRACE to get it in other builds, or
+// NO_GL_TRACE to leave it out of debug ones.
+#if defined(_DEBUG) && !defined(NO_GL_TRACE) && !defined(GL_TRACE)
+#define GL_TRACE
+#endif
+
+#ifdef GL_TRACE
+
+// Returns the routine's index, registering it the first time name is seen.
+int registerTraceRoutine(const char* name);
+
+// Charges the thread's traced calls to routine until it goes out of scope.
+// Does nothing on threads other than the one tracing, so draw routines
+// recorded by --parallel-record workers are charged when their lists are
+// submitted, to whichever routine submits them.
+class TraceScope {
+public:
+	explicit TraceScope(int routine);
+	~TraceScope();
+
+private:
+	bool active;
+};
+
+#define TRACE_DRAW(name) \
+	static const int traceRoutine = registerTraceRoutine(name); \
+	TraceScope traceScope(traceRoutine)
+
+// Puts a tracer in front of target on the calling thread and returns it;
+// draw through the returned renderer from then on. Each flush() ends a frame.
+Renderer* startGLTrace(Renderer* target);
+// Prints per-frame averages, writes every frame's counters to csvPath (when
+// not 0) and returns the renderer that was being traced.
+Renderer* stopGLTrace(const char* csvPath);
+
+#else
+
+#define TRACE_DRAW(name)
+
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Renderer.h"
+
+// Fixed placements for the repeated parts of static props: the arrows on
+// their shelves, the legs of a table, the rings of a flag. A layout is a
+// constexpr array of matrices worked out by the compiler, so the program
+// only ever reads them. Writing past the end of a layout while building it,
+// or breaking a static_assert on where its parts sit, fails the build
+// instead of drawing a misplaced prop.
+
+// A column-major matrix, ready for multMatrix().
+struct Transform {
+	float m[16];
+};
+
+constexpr Transform translation(float x, float y, float z) {
+	return Transform{ { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, x, y, z, 1.0f } };
+}
+
+constexpr Transform scaling(float x, float y, float z) {
+	return Transform{ { x, 0.0f, 0.0f, 0.0f, 0.0f, y, 0.0f, 0.0f, 0.0f, 0.0f, z, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f } };
+}
+
+// Applies b first, then a, as the Renderer calls for a and then b would.
+constexpr Transform operator*(const Transform& a, const Transform& b) {
+	Transform out = {};
+	for (int column = 0; column < 4; column++) {
+		for (int row = 0; row < 4; row++) {
+			float sum = 0.0f;
+			for (int k = 0; k < 4; k++) sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+			out.m[column * 4 + row] = sum;
+		}
+	}
+	return out;
+}
+
+// Where a transform puts the origin.
+constexpr float originX(const Transform& t) { return t.m[12]; }
+constexpr float originY(const Transform& t) { return t.m[13]; }
+constexpr float originZ(const Transform& t) { return t.m[14]; }
+
+constexpr float squaredDistance(const Transform& a, const Transform& b) {
+	return (originX(a) - originX(b)) * (originX(a) - originX(b)) +
+		(originY(a) - originY(b)) * (originY(a) - originY(b)) +
+		(originZ(a) - originZ(b)) * (originZ(a) - originZ(b));
+}
+
+template <int N>
+struct Layout {
+	Transform transforms[N];
+	static constexpr int count = N;
+};
+
+// Calls draw(i) once for each placement i, with its matrix multiplied onto
+// the current one.
+template <int N>
+void drawLayout(const Layout<N>& layout, void (*draw)(int instance)) {
+	for (int i = 0; i < N; i++) {
+		renderer->pushMatrix();
+		renderer->multMatrix(layout.transforms[i].m);
+		draw(i);
+		renderer->popMatrix();
+	}
+}
@@ -0,0 +1,178 @@
+#include "MatrixStack.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MATRIX_SSE
+#include <xmmintrin.h>
+#endif
+
+#define MATRIX_PI 3.14159265358979323846
+
+static void identity(float* m) {
+	memset(m, 0, 16 * sizeof(float));
+	m[0] = m[5] = m[10] = m[15] = 1.0f;
+}
+
+static void normalize3(float* v) {
+	float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (length > 0) {
+		v[0] /= length;
+		v[1] /= length;
+		v[2] /= length;
+	}
+}
+
+MatrixStack::MatrixStack() {
+	stack.push_back(Matrix());
+	identity(stack.back().m);
+}
+
+void MatrixStack::loadIdentity() {
+	identity(stack.back().m);
+}
+
+void MatrixStack::push() {
+	stack.push_back(stack.back());
+}
+
+void MatrixStack::pop() {
+	if (stack.size() > 1) stack.pop_back();
+}
+
+// Each column of the result is a's columns weighted by a column of b. The
+// SSE path sums in the same order as the scalar one, so both give the same
+// bits.
+void multiplyMatrices(const float* a, const float* b, float* out) {
+#ifdef MATRIX_SSE
+	__m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+	__m128 r[4];
+	for (int col = 0; col < 4; col++) {
+		const float* c = b + col * 4;
+		r[col] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(a0, _mm_set1_ps(c[0])), _mm_mul_ps(a1, _mm_set1_ps(c[1]))),
+			_mm_mul_ps(a2, _mm_set1_ps(c[2]))), _mm_mul_ps(a3, _mm_set1_ps(c[3])));
+	}
+	for (int col = 0; col < 4; col++) _mm_storeu_ps(out + col * 4, r[col]);
+#else
+	float r[16];
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			r[col * 4 + row] = a[row] * b[col * 4] + a[4 + row] * b[col * 4 + 1]
+				+ a[8 + row] * b[col * 4 + 2] + a[12 + row] * b[col * 4 + 3];
+		}
+	}
+	memcpy(out, r, sizeof(r));
+#endif
+}
+
+// top = top * m
+void MatrixStack::multiply(const float* m) {
+	float* t = stack.back().m;
+	multiplyMatrices(t, m, t);
+}
+
+// Translation and scale only touch some columns, so they skip the full
+// multiply. The columns they do touch come out as the multiply would have
+// them.
+void MatrixStack::translate(float x, float y, float z) {
+	float* t = stack.back().m;
+#ifdef MATRIX_SSE
+	__m128 c = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(_mm_loadu_ps(t), _mm_set1_ps(x)), _mm_mul_ps(_mm_loadu_ps(t + 4), _mm_set1_ps(y))),
+		_mm_mul_ps(_mm_loadu_ps(t + 8), _mm_set1_ps(z))), _mm_loadu_ps(t + 12));
+	_mm_storeu_ps(t + 12, c);
+#else
+	for (int row = 0; row < 4; row++) t[12 + row] = t[row] * x + t[4 + row] * y + t[8 + row] * z + t[12 + row];
+#endif
+}
+
+void MatrixStack::rotate(float angle, float x, float y, float z) {
+	float axis[3] = { x, y, z };
+	normalize3(axis);
+	x = axis[0];
+	y = axis[1];
+	z = axis[2];
+	float radians = (float)(angle * MATRIX_PI / 180.0);
+	float c = cosf(radians), s = sinf(radians), k = 1.0f - c;
+	float r[16];
+	identity(r);
+	r[0] = x * x * k + c;
+	r[1] = y * x * k + z * s;
+	r[2] = x * z * k - y * s;
+	r[4] = x * y * k - z * s;
+	r[5] = y * y * k + c;
+	r[6] = y * z * k + x * s;
+	r[8] = x * z * k + y * s;
+	r[9] = y * z * k - x * s;
+	r[10] = z * z * k + c;
+	multiply(r);
+}
+
+void MatrixStack::scale(float x, float y, float z) {
+	float* t = stack.back().m;
+	for (int row = 0; row < 4; row++) {
+		t[row] *= x;
+		t[4 + row] *= y;
+		t[8 + row] *= z;
+	}
+}
+
+void MatrixStack::perspective(float fovy, float aspect, float zNear, float zFar) {
+	float f = (float)(1.0 / tan(fovy * MATRIX_PI / 360.0));
+	float p[16];
+	memset(p, 0, sizeof(p));
+	p[0] = f / aspect;
+	p[5] = f;
+	p[10] = (zFar + zNear) / (zNear - zFar);
+	p[11] = -1.0f;
+	p[14] = 2.0f * zFar * zNear / (zNear - zFar);
+	multiply(p);
+}
+
+void MatrixStack::ortho2D(float left, float right, float bottom, float top) {
+	float o[16];
+	identity(o);
+	o[0] = 2.0f / (right - left);
+	o[5] = 2.0f / (top - bottom);
+	o[10] = -1.0f;
+	o[12] = -(right + left) / (right - left);
+	o[13] = -(top + bottom) / (top - bottom);
+	multiply(o);
+}
+
+void MatrixStack::lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+	float upX, float upY, float upZ) {
+	float f[3] = { centerX - eyeX, centerY - eyeY, centerZ - eyeZ };
+	normalize3(f);
+	float s[3] = { f[1] * upZ - f[2] * upY, f[2] * upX - f[0] * upZ, f[0] * upY - f[1] * upX };
+	normalize3(s);
+	float u[3] = { s[1] * f[2] - s[2] * f[1], s[2] * f[0] - s[0] * f[2], s[0] * f[1] - s[1] * f[0] };
+	float m[16];
+	identity(m);
+	for (int i = 0; i < 3; i++) {
+		m[i * 4] = s[i];
+		m[i * 4 + 1] = u[i];
+		m[i * 4 + 2] = -f[i];
+	}
+	multiply(m);
+	translate(-eyeX, -eyeY, -eyeZ);
+}
+
+void computeNormalMatrix(const float* m, float* normalMatrix) {
+	// Cofactors of the upper 3x3, column-major like the matrices.
+	float c[9];
+	c[0] = m[5] * m[10] - m[6] * m[9];
+	c[1] = m[6] * m[8] - m[4] * m[10];
+	c[2] = m[4] * m[9] - m[5] * m[8];
+	c[3] = m[9] * m[2] - m[10] * m[1];
+	c[4] = m[10] * m[0] - m[8] * m[2];
+	c[5] = m[8] * m[1] - m[9] * m[0];
+	c[6] = m[1] * m[6] - m[2] * m[5];
+	c[7] = m[2] * m[4] - m[0] * m[6];
+	c[8] = m[0] * m[5] - m[1] * m[4];
+	float det = m[0] * c[0] + m[4] * c[3] + m[8] * c[6];
+	float invDet = det != 0 ? 1.0f / det : 0.0f;
+	for (int i = 0; i < 9; i++) normalMatrix[i] = c[i] * invDet;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+// A GL-style matrix stack, kept on the CPU so that no back end has to ask
+// the driver for its transforms. Matrices are column-major, and every
+// operation post-multiplies the top matrix the way glTranslatef and friends
+// do, so results match GL's. Products use SSE where the compiler targets it.
+class MatrixStack {
+public:
+	MatrixStack();
+
+	const float* top() const { return stack.back().m; }
+
+	void loadIdentity();
+	void push();
+	void pop(); // Popping the last matrix leaves it in place, like GL's stack underflow
+	void multiply(const float* m);
+
+	void translate(float x, float y, float z);
+	void rotate(float angle, float x, float y, float z); // Degrees
+	void scale(float x, float y, float z);
+	void perspective(float fovy, float aspect, float zNear, float zFar);
+	void ortho2D(float left, float right, float bottom, float top);
+	void lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+		float upX, float upY, float upZ);
+
+private:
+	struct Matrix {
+		float m[16];
+	};
+
+	std::vector<Matrix> stack;
+};
+
+// out = a * b, all column-major. out may be a or b.
+void multiplyMatrices(const float* a, const float* b, float* out);
+
+// Inverse transpose of the modelview's upper 3x3, column-major: what GL
+// transforms normals with. Unit normals stay unit under rotation and
+// uniform scale; a singular matrix gives zeros.
+void computeNormalMatrix(const float* modelview, float* normalMatrix);
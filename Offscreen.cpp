@@ -0,0 +1,162 @@
+#include "Offscreen.h"
+#include "GLProcs.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+#ifndef _WIN32
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+static GLuint framebuffer = 0;
+static GLuint renderbuffers[2] = { 0, 0 }; // Color, depth
+static int frameWidth = 0, frameHeight = 0;
+
+#ifdef _WIN32
+static int window = 0;
+#else
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+#endif
+
+static bool makeContextCurrent() {
+#ifdef _WIN32
+	glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB | GLUT_DEPTH);
+	glutInitWindowSize(1, 1);
+	window = glutCreateWindow("3D Archery Game (offscreen)");
+	glutHideWindow();
+	return window != 0;
+#else
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay) {
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+	}
+	if (display == EGL_NO_DISPLAY) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0)) return false;
+	if (!eglBindAPI(EGL_OPENGL_API)) return false;
+	// Compatibility profile by default, which the fixed-function scene needs.
+	context = eglCreateContext(display, (EGLConfig)0, EGL_NO_CONTEXT, 0);
+	return context != EGL_NO_CONTEXT && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+#endif
+}
+
+bool createOffscreenContext(int width, int height) {
+	if (!makeContextCurrent()) {
+		printf("[headless] could not create an offscreen GL context\n");
+		destroyOffscreenContext();
+		return false;
+	}
+
+	if (!loadFramebufferProcs()) {
+		printf("[headless] %s has no framebuffer objects\n", (const char*)glGetString(GL_RENDERER));
+		destroyOffscreenContext();
+		return false;
+	}
+
+	genRenderbuffers(2, renderbuffers);
+	bindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	renderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	bindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	renderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	genFramebuffers(1, &framebuffer);
+	bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	framebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	framebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	if (checkFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("[headless] could not create a %dx%d framebuffer\n", width, height);
+		destroyOffscreenContext();
+		return false;
+	}
+
+	frameWidth = width;
+	frameHeight = height;
+	glViewport(0, 0, width, height);
+	printf("[headless] %dx%d on %s, GL %s\n", width, height,
+		(const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+	return true;
+}
+
+void destroyOffscreenContext() {
+	if (framebuffer) {
+		bindFramebuffer(GL_FRAMEBUFFER, 0);
+		deleteFramebuffers(1, &framebuffer);
+		deleteRenderbuffers(2, renderbuffers);
+		framebuffer = 0;
+	}
+#ifdef _WIN32
+	if (window) {
+		glutDestroyWindow(window);
+		window = 0;
+	}
+#else
+	if (display != EGL_NO_DISPLAY) {
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+		eglTerminate(display);
+	}
+	context = EGL_NO_CONTEXT;
+	display = EGL_NO_DISPLAY;
+#endif
+}
+
+// Binary PPM, rows flipped from GL's bottom-up order.
+static bool writePpm(const char* path, const unsigned char* rgb, int width, int height) {
+	FILE* f = fopen(path, "wb");
+	if (!f) return false;
+	fprintf(f, "P6\n%d %d\n255\n", width, height);
+	bool ok = true;
+	for (int y = height - 1; y >= 0 && ok; y--) {
+		ok = fwrite(rgb + y * width * 3, width * 3, 1, f) == 1;
+	}
+	fclose(f);
+	return ok;
+}
+
+static double msBetween(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+	return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+void renderOffscreen(void (*display)(), int frames, const char* outPrefix) {
+	std::vector<unsigned char> pixels(frameWidth * frameHeight * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	double submitTotal = 0, finishTotal = 0, writeTotal = 0, submitMax = 0;
+	for (int frame = 0; frame < frames; frame++) {
+		auto start = std::chrono::steady_clock::now();
+		display();
+		auto submitted = std::chrono::steady_clock::now();
+		glFinish();
+		auto finished = std::chrono::steady_clock::now();
+
+		double submitMs = msBetween(start, submitted);
+		double finishMs = msBetween(submitted, finished);
+		submitTotal += submitMs;
+		finishTotal += finishMs;
+		if (submitMs > submitMax) submitMax = submitMs;
+		printf("[headless] frame %d: submit %.3f ms, finish %.3f ms\n", frame, submitMs, finishMs);
+
+		if (outPrefix) {
+			glReadPixels(0, 0, frameWidth, frameHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+			char path[260];
+			snprintf(path, sizeof(path), "%s_%04d.ppm", outPrefix, frame);
+			if (!writePpm(path, pixels.data(), frameWidth, frameHeight)) {
+				printf("[headless] could not write %s\n", path);
+			}
+			writeTotal += msBetween(finished, std::chrono::steady_clock::now());
+		}
+	}
+
+	if (frames <= 0) return;
+	printf("[headless] %d frames: render %.1f ms total, %.3f ms/frame (submit avg %.3f ms, max %.3f ms, finish avg %.3f ms)\n",
+		frames, submitTotal + finishTotal, (submitTotal + finishTotal) / frames,
+		submitTotal / frames, submitMax, finishTotal / frames);
+	if (outPrefix) {
+		printf("[headless] readback and writing took %.1f ms\n", writeTotal);
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+// Offscreen rendering for hosts with no display and no GPU. The scene is
+// drawn into a framebuffer object on a context that needs no window:
+// EGL surfaceless (Mesa llvmpipe) on POSIX. On Windows a hidden GLUT window
+// hosts the context, so glutInit() must have been called; drop Mesa's
+// opengl32.dll next to the executable to get llvmpipe there.
+bool createOffscreenContext(int width, int height);
+void destroyOffscreenContext();
+
+// Calls display once per frame and times it: submit is the CPU time spent in
+// display, finish is the wait for the GL to execute it. Each frame is written
+// to <outPrefix>_NNNN.ppm unless outPrefix is 0.
+void renderOffscreen(void (*display)(), int frames, const char* outPrefix);
@@ -1,387 +1,273 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <glut.h>
+#include <chrono>
 #include <iostream>
-#include <irrKlang.h>
+#include "Animation.h"
+#include "AssetPack.h"
+#include "Audio.h"
+#include "AudioLatency.h"
+#include "Camera.h"
+#include "CommandList.h"
+#include "Crowd.h"
+#include "DynamicResolution.h"
+#include "FlightRecorder.h"
+#include "GLTrace.h"
+#include "GLRenderer.h"
+#include "Layout.h"
+#include "Offscreen.h"
+#include "PcmAsset.h"
+#include "Profiler.h"
+#include "SceneGraph.h"
+#include "ShaderRenderer.h"
+#include "SkinnedMesh.h"
+#include "Shapes.h"
+#include "SoftRenderer.h"
+#include "Vector3f.h"
+#include "VectorBatch.h"
 
 #define GLUT_KEY_ESCAPE 27
-#define DEG2RAD(a) (a * 0.0174532925)
 
-class Vector3f {
-public:
-	float x, y, z;
-
-	Vector3f(float _x = 0.0f, float _y = 0.0f, float _z = 0.0f) {
-		x = _x;
-		y = _y;
-		z = _z;
-	}
-
-	Vector3f operator+(Vector3f& v) {
-		return Vector3f(x + v.x, y + v.y, z + v.z);
-	}
-
-	Vector3f operator-(Vector3f& v) {
-		return Vector3f(x - v.x, y - v.y, z - v.z);
-	}
-
-	Vector3f operator*(float n) {
-		return Vector3f(x * n, y * n, z * n);
-	}
-
-	Vector3f operator/(float n) {
-		return Vector3f(x / n, y / n, z / n);
-	}
-
-	Vector3f unit() {
-		return *this / sqrt(x * x + y * y + z * z);
-	}
-
-	Vector3f cross(Vector3f v) {
-		return Vector3f(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x);
-	}
-};
-
-class Camera {
-public:
-	Vector3f eye, center, up;
-
-	Camera(float eyeX = 1.0f, float eyeY = 1.0f, float eyeZ = 1.0f, float centerX = 0.0f, float centerY = 0.0f, float centerZ = 0.0f, float upX = 0.0f, float upY = 1.0f, float upZ = 0.0f) {
-		eye = Vector3f(eyeX, eyeY, eyeZ);
-		center = Vector3f(centerX, centerY, centerZ);
-		up = Vector3f(upX, upY, upZ);
-	}
-
-	void moveX(float d) {
-		Vector3f right = up.cross(center - eye).unit();
-		eye = eye + right * d;
-		center = center + right * d;
-	}
-
-	void moveY(float d) {
-		eye = eye + up.unit() * d;
-		center = center + up.unit() * d;
-	}
-
-	void moveZ(float d) {
-		Vector3f view = (center - eye).unit();
-		eye = eye + view * d;
-		center = center + view * d;
-	}
-
-	void rotateX(float a) {
-		Vector3f view = (center - eye).unit();
-		Vector3f right = up.cross(view).unit();
-		view = view * cos(DEG2RAD(a)) + up * sin(DEG2RAD(a));
-		up = view.cross(right);
-		center = eye + view;
-	}
-
-	void rotateY(float a) {
-		Vector3f view = (center - eye).unit();
-		Vector3f right = up.cross(view).unit();
-		view = view * cos(DEG2RAD(a)) + right * sin(DEG2RAD(a));
-		right = view.cross(up);
-		center = eye + view;
-	}
-
-	void look() {
-		gluLookAt(
-			eye.x, eye.y, eye.z,
-			center.x, center.y, center.z,
-			up.x, up.y, up.z
-		);
-	}
-};
+thread_local Renderer* renderer = 0;
 
 Camera camera;
 
-const Vector3f TOP_VIEW_EYE(0.0f, 30.0f, 0.0f);   // Position above the scene
-const Vector3f TOP_VIEW_CENTER(0.0f, 0.0f, 10.0f); // Looking down at the center
-const Vector3f TOP_VIEW_UP(0.0f, 0.0f, -1.0f);    // Up is negative Z-axis
+constexpr Vector3f TOP_VIEW_EYE(0.0f, 30.0f, 0.0f);   // Position above the scene
+constexpr Vector3f TOP_VIEW_CENTER(0.0f, 0.0f, 10.0f); // Looking down at the center
+constexpr Vector3f TOP_VIEW_UP(0.0f, 0.0f, -1.0f);    // Up is negative Z-axis
 
-const Vector3f SIDE_VIEW_EYE(30.0f, 0.0f, 0.0f);   // Position to the side of the scene
-const Vector3f SIDE_VIEW_CENTER(0.0f, 0.0f, 10.0f); // Looking at the center
-const Vector3f SIDE_VIEW_UP(0.0f, 1.0f, 0.0f);     // Up is Y-axis
+constexpr Vector3f SIDE_VIEW_EYE(30.0f, 0.0f, 0.0f);   // Position to the side of the scene
+constexpr Vector3f SIDE_VIEW_CENTER(0.0f, 0.0f, 10.0f); // Looking at the center
+constexpr Vector3f SIDE_VIEW_UP(0.0f, 1.0f, 0.0f);     // Up is Y-axis
 
-const Vector3f FRONT_VIEW_EYE(0.0f, 0.0f, 25.0f);  // Position in front of the scene
-const Vector3f FRONT_VIEW_CENTER(0.0f, 0.0f, 0.0f); // Looking at the center
-const Vector3f FRONT_VIEW_UP(0.0f, 1.0f, 0.0f);    // Up is Y-axis
+constexpr Vector3f FRONT_VIEW_EYE(0.0f, 0.0f, 25.0f);  // Position in front of the scene
+constexpr Vector3f FRONT_VIEW_CENTER(0.0f, 0.0f, 0.0f); // Looking at the center
+constexpr Vector3f FRONT_VIEW_UP(0.0f, 1.0f, 0.0f);    // Up is Y-axis
 
-irrklang::ISoundEngine* engine2 = irrklang::createIrrKlangDevice();
+constexpr Vector3f STANDS_VIEW_EYE(0.0f, 22.0f, 62.0f);  // Up in the crowd behind the back wall
+constexpr Vector3f STANDS_VIEW_CENTER(0.0f, 0.0f, 10.0f); // Looking down into the hall
+constexpr Vector3f STANDS_VIEW_UP(0.0f, 1.0f, 0.0f);
+
+constexpr Vector3f CROWD_CENTER(0.0f, 0.0f, 10.0f); // The middle of the hall's floor
+int crowdSize = 0; // Set with --crowd <spectators>
+Crowd* crowd = 0;
 
 float TableRotation = 0.0;
-float colorR = 1.0f, colorG = 0.0f, colorB = 0.0f; // Initial color
+// Each wall channel swings between 0 and 1, a third of a turn apart.
+const TimeWave wallColor[3] = { { 0.5f, 0.5f, 0.0f }, { 0.5f, 0.5f, 2.0f }, { 0.5f, 0.5f, 4.0f } };
 
 void drawWall(double thickness) {
-	glPushMatrix();
-	glColor3f(colorR, colorG, colorB);
-	glTranslated(0.5, 0.5 * thickness, 0.5);
-	glScaled(1.0, thickness, 1.0);
-	glutSolidCube(1);
-	glPopMatrix();
-	glPushMatrix();
-	glColor3f(colorR, colorB, colorG);
-	glTranslated(0.5, thickness, 0.5);
-	glutSolidCube(1);
-	glPopMatrix();
-}
-void drawTableLeg(double thick, double len) {
-	glPushMatrix();
-	glTranslated(0, len / 2, 0);
-	glScaled(thick, len, thick);
-	glutSolidCube(1.0);
-	glPopMatrix();
+	renderer->pushMatrix();
+	renderer->colorWave(wallColor[0], wallColor[1], wallColor[2]);
+	renderer->translate(0.5, 0.5 * thickness, 0.5);
+	renderer->scale(1.0, thickness, 1.0);
+	solidCube(1);
+	renderer->popMatrix();
+	renderer->pushMatrix();
+	renderer->colorWave(wallColor[0], wallColor[2], wallColor[1]);
+	renderer->translate(0.5, thickness, 0.5);
+	solidCube(1);
+	renderer->popMatrix();
 }
 void drawJackPart() {
-	glPushMatrix();
-	glScaled(0.2, 0.2, 1.0);
-	glutSolidSphere(1, 15, 15);
-	glPopMatrix();
-	glPushMatrix();
-	glTranslated(0, 0, 1.2);
-	glutSolidSphere(0.2, 15, 15);
-	glTranslated(0, 0, -2.4);
-	glutSolidSphere(0.2, 15, 15);
-	glPopMatrix();
+	renderer->pushMatrix();
+	renderer->scale(0.2, 0.2, 1.0);
+	solidSphere(1, 15, 15);
+	renderer->popMatrix();
+	renderer->pushMatrix();
+	renderer->translate(0, 0, 1.2);
+	solidSphere(0.2, 15, 15);
+	renderer->translate(0, 0, -2.4);
+	solidSphere(0.2, 15, 15);
+	renderer->popMatrix();
 }
 void drawJack() {
-	glPushMatrix();
+	renderer->pushMatrix();
 	drawJackPart();
-	glRotated(90.0, 0, 1, 0);
+	renderer->rotate(90.0, 0, 1, 0);
 	drawJackPart();
-	glRotated(90.0, 1, 0, 0);
+	renderer->rotate(90.0, 1, 0, 0);
 	drawJackPart();
-	glPopMatrix();
-}
-void drawTable(double topWid, double topThick, double legThick, double legLen) {
-	glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
-	glPushMatrix();
-	glTranslatef(10, -1.2, 10);
-	glScalef(4.0, 4.0, 4.0);
-	glRotated(TableRotation, 0.0, 1.0, 0.0);
-	glColor3f(1.0, 1.0, 0.0);
-	glPushMatrix();
-	glTranslated(0, legLen, 0);
-	glScaled(topWid, topThick, topWid);
-	glutSolidCube(1.0);
-	glPopMatrix();
-
-	double dist = 0.95 * topWid / 2.0 - legThick / 2.0;
-	glPushMatrix();
-	glTranslated(dist, 0, dist);
-	drawTableLeg(legThick, legLen);
-	glTranslated(0, 0, -2 * dist);
-	drawTableLeg(legThick, legLen);
-	glTranslated(-2 * dist, 0, 2 * dist);
-	drawTableLeg(legThick, legLen);
-	glTranslated(0, 0, -2 * dist);
-	drawTableLeg(legThick, legLen);
-	glPopMatrix();
-	glPopMatrix();
-	glPopAttrib();
+	renderer->popMatrix();
+}
+constexpr float TABLE_TOP_WIDTH = 0.6f;
+constexpr float TABLE_TOP_THICKNESS = 0.02f;
+constexpr float TABLE_LEG_THICKNESS = 0.02f;
+constexpr float TABLE_LEG_LENGTH = 0.3f;
+constexpr float TABLE_LEG_INSET = 0.95f * TABLE_TOP_WIDTH / 2.0f - TABLE_LEG_THICKNESS / 2.0f; // From the center to each leg
+
+// A unit cube stretched into a leg standing on the floor at (x, z).
+constexpr Transform tableLeg(float x, float z) {
+	return translation(x, TABLE_LEG_LENGTH / 2.0f, z) * scaling(TABLE_LEG_THICKNESS, TABLE_LEG_LENGTH, TABLE_LEG_THICKNESS);
+}
+
+constexpr Layout<4> tableLegs = { {
+	tableLeg(TABLE_LEG_INSET, TABLE_LEG_INSET), tableLeg(TABLE_LEG_INSET, -TABLE_LEG_INSET),
+	tableLeg(-TABLE_LEG_INSET, TABLE_LEG_INSET), tableLeg(-TABLE_LEG_INSET, -TABLE_LEG_INSET)
+} };
+static_assert(TABLE_LEG_INSET + TABLE_LEG_THICKNESS / 2.0f <= TABLE_TOP_WIDTH / 2.0f, "Table legs stick out past the top");
+static_assert(TABLE_LEG_INSET > TABLE_LEG_THICKNESS / 2.0f, "Table legs overlap");
+
+void drawTable() {
+	TRACE_DRAW("drawTable");
+	renderer->pushAttrib();
+	renderer->pushMatrix();
+	renderer->translate(10, -1.2, 10);
+	renderer->scale(4.0, 4.0, 4.0);
+	renderer->rotate(TableRotation, 0.0, 1.0, 0.0);
+	renderer->color(1.0, 1.0, 0.0);
+	renderer->pushMatrix();
+	renderer->translate(0, TABLE_LEG_LENGTH, 0);
+	renderer->scale(TABLE_TOP_WIDTH, TABLE_TOP_THICKNESS, TABLE_TOP_WIDTH);
+	solidCube(1.0);
+	renderer->popMatrix();
+
+	drawLayout(tableLegs, [](int) { solidCube(1.0); });
+	renderer->popMatrix();
+	renderer->popAttrib();
 }
 
 void setupLights() {
 	GLfloat ambient[] = { 0.7f, 0.7f, 0.7, 1.0f };
 	GLfloat diffuse[] = { 0.6f, 0.6f, 0.6, 1.0f };
 	GLfloat specular[] = { 1.0f, 1.0f, 1.0, 1.0f };
-	GLfloat shininess[] = { 50 };
-	glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, ambient);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, specular);
-	glMaterialfv(GL_FRONT, GL_SHININESS, shininess);
+	renderer->setMaterial(ambient, diffuse, specular, 50);
 
 	GLfloat lightIntensity[] = { 0.7f, 0.7f, 1, 1.0f };
 	GLfloat lightPosition[] = { -7.0f, 6.0f, 3.0f, 0.0f };
-	glLightfv(GL_LIGHT0, GL_POSITION, lightIntensity);
-	glLightfv(GL_LIGHT0, GL_DIFFUSE, lightIntensity);
+	renderer->setLight(lightPosition, lightIntensity);
 }
-void setupCamera() {
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(60, 640 / 480, 0.001, 100);
+#define CAMERA_NEAR 0.001f
+#define CAMERA_FAR 100.0f // Takes in the hall; the stands around it can need more
 
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
+void setupCamera() {
+	// Out to the far side of the back row, wherever the camera is.
+	float zFar = CAMERA_FAR;
+	if (crowd) zFar = fmaxf(zFar, (camera.eye() - CROWD_CENTER).length() + crowd->getOuterReach());
+	renderer->matrixMode(MATRIX_PROJECTION);
+	renderer->loadIdentity();
+	camera.setPerspective(60, 640 / 480, CAMERA_NEAR, zFar);
+	renderer->multMatrix(camera.projectionMatrix());
+
+	renderer->matrixMode(MATRIX_MODELVIEW);
+	renderer->loadIdentity();
 	camera.look();
 }
 
 float playerX = 0.0f; // Initial x-position of the player
 float playerZ = 0.0f;
 float rotationAngle = 0.0f;
-float walkAngle = 0.0f; // Walking cycle for animation
 bool isWalking = false; // Tracks if the player is currently walking
 const float moveSpeed = 0.05f;
 const float rotateSpeed = 0.3f; // Rotation sensitivity
 int lastMouseX = 0;
+// The player's pose, copied from playerAnimation each frame for the scene
+// graph's bindings.
 float leftLegAngle = 0.0f;
 float rightLegAngle = 0.0f;
-bool legForward = true; // To alternate the swing direction
-float legSwingSpeed = 1.0f; // Speed of the leg swing
+float drawArmYaw = 0.0f;
+float drawHandPull = 0.0f;
 bool isShoot = false;
 float arrowSpeed = 0.1;
 float arrowX = playerX;
 float arrowZ = playerZ;
+const float arrowHeight = 1.5f; // Height of the arrow above the floor, used for its sounds
+int arrowSound = -1; // Emitter following the arrow in flight
 
 
-void updateLegs() {
-	if (isWalking) {
-		if (legForward) {
-			leftLegAngle += legSwingSpeed;
-			rightLegAngle -= legSwingSpeed;
-			if (leftLegAngle >= 15.0f) { // Max swing angle
-				legForward = false;
-			}
-		}
-		else {
-			leftLegAngle -= legSwingSpeed;
-			rightLegAngle += legSwingSpeed;
-			if (leftLegAngle <= -15.0f) { // Min swing angle
-				legForward = true;
-			}
-		}
-	}
-	else {
-		// Reset leg angles when not moving
-		leftLegAngle = 0.0f;
-		rightLegAngle = 0.0f;
-	}
+AnimationSet playerAnimation(1); // The player is character 0
+
+// Picks the player's clips from what the game is doing and ticks them on by
+// the time since the last frame.
+void updateAnimation() {
+	static int lastUpdate = -1;
+	int currentTime = glutGet(GLUT_ELAPSED_TIME);
+	playerAnimation.play(0, isWalking ? CLIP_WALK : CLIP_IDLE, isWalking ? 0.1f : 0.2f);
+	// The arrow on the bow is drawn back; once it is loosed the arm follows
+	// through and stays there until the next one is nocked.
+	if (isShoot) playerAnimation.play(0, CLIP_RELEASE, 0.0f);
+	else playerAnimation.play(0, CLIP_DRAW_BOW, 0.1f);
+	if (lastUpdate >= 0) playerAnimation.advance((currentTime - lastUpdate) / 1000.0f);
+	lastUpdate = currentTime;
+	leftLegAngle = playerAnimation.channel(ANIM_LEFT_LEG)[0];
+	rightLegAngle = playerAnimation.channel(ANIM_RIGHT_LEG)[0];
+	drawArmYaw = playerAnimation.channel(ANIM_DRAW_ARM)[0];
+	drawHandPull = playerAnimation.channel(ANIM_DRAW_HAND)[0];
 }
 
 
 
+// The player's parts draw at the origin. They are baked once into the
+// archer's skinned mesh, each as its own bone, and the scene graph's nodes
+// place the bones (see buildSceneGraph).
+
 // 1. Draw the Head (1 primitive)
 void drawHead() {
-	glPushMatrix();
-	glTranslatef(0.0f, 0.8f, 0.0f); // Position above the torso
-	glutSolidSphere(0.3, 20, 20);   // Sphere for the head
-	glPopMatrix();
+	renderer->color(0.9f, 0.7f, 0.5f); // Skin color for the head
+	solidSphere(0.3, 20, 20);   // Sphere for the head
 }
 
 // 2. Draw the Torso (1 primitive)
 void drawTorso() {
-	glPushMatrix();
-	glScalef(0.5f, 1.0f, 0.3f); // Scale a cube to create a rectangular torso
-	glutSolidCube(1.0);          // Cube for the torso
-	glPopMatrix();
-}
-
-// 3. Draw the Left Arm (1 primitive)
-void drawLeftArm() {
-	glPushMatrix();
-	glTranslatef(-0.3f, 0.1f, 0.2f); // Position to the left of the torso
-	glRotatef(30.0, 0.0, 1.0, 0.0);
-	glRotatef(-90.0, 1.0, 0.0, 0.0);
-	glScalef(0.2f, 0.8f, 0.2f);      // Scale to make it look like an arm
-	glutSolidCube(1.0);              // Cube for the left arm
-	glPopMatrix();
+	renderer->color(0.2f, 0.6f, 1.0f); // Shirt color for the torso
+	solidCube(1.0);          // Cube for the torso
 }
 
-// 4. Draw the Right Arm (1 primitive)
-void drawRightArm() {
-	glPushMatrix();
-	glTranslatef(0.27f, 0.3f, 0.4f); // Position the right arm to the right of the torso
-	glRotatef(-15, 0.0, 1.0, 0.0);
-	glRotatef(-90.0f, 1.0f, 0.0f, 0.0f); // Rotate the arm to face forward
-	glScalef(0.2f, 0.8f, 0.2f); // Scale to make it look like an arm
-	glutSolidCube(1.0); // Cube for the right arm
-	glPopMatrix();
+// 3. Draw an Arm (1 primitive)
+void drawArm() {
+	renderer->color(0.2f, 0.6f, 1.0f); // Same shirt color as the torso
+	solidCube(1.0);              // Cube for the arm
 }
 
-
-// 5. Draw the Left Leg (1 primitive)
-void drawLeftLeg() {
-	glPushMatrix();
-	glTranslatef(-0.2f, -0.75f, 0.0f); // Position below the torso on the left
-
-	glScalef(0.2f, 0.8f, 0.2f);       // Scale to make it look like a leg
-	glutSolidCube(1.0);               // Cube for the left leg
-	glPopMatrix();
+// 4. Draw a Leg (1 primitive)
+void drawLeg() {
+	renderer->color(0.5f, 0.35f, 0.05f); // Pants color for the leg
+	solidCube(1.0);               // Cube for the leg
 }
 
-// 6. Draw the Right Leg (1 primitive)
-void drawRightLeg() {
-	glPushMatrix();
-	glTranslatef(0.2f, -0.75f, 0.0f); // Position below the torso on the right
-	glScalef(0.2f, 0.8f, 0.2f);       // Scale to make it look like a leg
-	glutSolidCube(1.0);               // Cube for the right leg
-	glPopMatrix();
-}
-
-// Draw Eyes
-void drawEyes() {
-	// Left Eye
-	glPushMatrix();
-	glTranslatef(-0.1f, 0.9f, 0.25f);  // Position the left eye
-	glColor3f(0.0f, 0.0f, 0.0f);  // Black color for the eye
-	glutSolidSphere(0.05, 20, 20);  // Draw a small sphere for the eye
-	glPopMatrix();
-
-	// Right Eye
-	glPushMatrix();
-	glTranslatef(0.1f, 0.9f, 0.25f);  // Position the right eye
-	glColor3f(0.0f, 0.0f, 0.0f);  // Black color for the eye
-	glutSolidSphere(0.05, 20, 20);  // Draw a small sphere for the eye
-	glPopMatrix();
-
-
+// Draw an Eye
+void drawEye() {
+	renderer->color(0.0f, 0.0f, 0.0f);  // Black color for the eye
+	solidSphere(0.05, 20, 20);  // Draw a small sphere for the eye
 }
 
 // Draw Mouth
 void drawMouth() {
-	glPushMatrix();
-	glTranslatef(0.0f, 0.8f, 0.3f); // Position the mouth slightly below the nose
-
-	glColor3f(0.0f, 0.0f, 0.0f); // Black color for the mouth
+	renderer->color(0.0f, 0.0f, 0.0f); // Black color for the mouth
 
 	// Draw a simple closed mouth as a line
-	glBegin(GL_LINES);
-	glVertex3f(-0.1f, 0.0f, 0.0f); // Left corner of the mouth
-	glVertex3f(0.1f, 0.0f, 0.0f);  // Right corner of the mouth
-	glEnd();
-
-	glPopMatrix();
-
-
+	renderer->begin(PRIM_LINES);
+	renderer->vertex(-0.1f, 0.0f, 0.0f); // Left corner of the mouth
+	renderer->vertex(0.1f, 0.0f, 0.0f);  // Right corner of the mouth
+	renderer->end();
 }
 
-void drawRightHand() {
-	glPushMatrix();
-	glTranslatef(0.1f, 0.3f, 0.85f); // Position the hand at the end of the rotated arm
-	glColor3f(0.9f, 0.7f, 0.5f); // Same skin color as the head
-	glutSolidSphere(0.1, 20, 20); // Small sphere for the hand
-	glPopMatrix();
-}
-
-void drawLeftHand() {
-	glPushMatrix();
-	glTranslatef(-0.05, 0.1, 0.6);
-	glColor3f(0.9f, 0.7f, 0.5f); // Same skin color as the head
-	glutSolidSphere(0.1, 20, 20); // Small sphere for the hand
-	glPopMatrix();
+void drawHand() {
+	renderer->color(0.9f, 0.7f, 0.5f); // Same skin color as the head
+	solidSphere(0.1, 20, 20); // Small sphere for the hand
 }
 
 // Function to draw the semi-circle part of the bow
 void drawBowSemiCircle(float x) {
 	if (x == 0.0) {
-		glPushMatrix();
-		glTranslatef(0.0f, -0.5f, 0.0f);
+		renderer->pushMatrix();
+		renderer->translate(0.0f, -0.5f, 0.0f);
 
-		glColor3f(0.5f, 0.3f, 0.1f); // Color for the semi-circle (wooden color)
+		renderer->color(0.5f, 0.3f, 0.1f); // Color for the semi-circle (wooden color)
 
-		glBegin(GL_LINE_STRIP);
+		renderer->begin(PRIM_LINE_STRIP);
 		int num_segments = 100; // Number of segments to approximate the semi-circle
 		for (int i = 0; i <= num_segments; i++) {
 			float theta = 3.14159f * float(i) / float(num_segments); // Half-circle (pi radians)
 			float x = 1.0f * cos(theta); // X coordinate
 			float y = 1.0f * sin(theta); // Y coordinate
-			glVertex3f(x, y, 0.0f);      // Add a point to the semi-circle
+			renderer->vertex(x, y, 0.0f);      // Add a point to the semi-circle
 		}
-		glEnd();
+		renderer->end();
 
-		glPopMatrix();
+		renderer->popMatrix();
 	}
 	else {
 		float radius = 0.0f;
@@ -391,89 +277,85 @@ void drawBowSemiCircle(float x) {
 		else {
 			radius = 1.9 * x;
 		}
-		glPushMatrix();
-		glTranslatef(0.0f, -0.5f, 0.0f);
+		renderer->pushMatrix();
+		renderer->translate(0.0f, -0.5f, 0.0f);
 
-		glColor3f(0.5f, 0.3f, 0.1f); // Color for the semi-circle (wooden color)
+		renderer->color(0.5f, 0.3f, 0.1f); // Color for the semi-circle (wooden color)
 
-		glBegin(GL_LINE_STRIP);
+		renderer->begin(PRIM_LINE_STRIP);
 		int num_segments = 100; // Number of segments to approximate the semi-circle
 		for (int i = 0; i <= num_segments; i++) {
 			float theta = 3.14159f * float(i) / float(num_segments); // Half-circle (pi radians)
 			float x = radius * cos(theta); // X coordinate scaled by the radius
 			float y = radius * sin(theta); // Y coordinate scaled by the radius
-			glVertex3f(x, y, 0.0f);        // Add a point to the semi-circle
+			renderer->vertex(x, y, 0.0f);        // Add a point to the semi-circle
 		}
-		glEnd();
+		renderer->end();
 
-		glPopMatrix();
+		renderer->popMatrix();
 
 	}
 }
 
 // Function to draw the bowstring as two lines (to allow interaction with the arrow)
 void drawBowString() {
-	glPushMatrix();
-	glTranslatef(0.0f, -0.5f, 0.0f); // Position the string (align with the center of the bow)
+	renderer->pushMatrix();
+	renderer->translate(0.0f, -0.5f, 0.0f); // Position the string (align with the center of the bow)
 
-	glColor3f(0.1f, 0.1f, 0.1f); // Color for the string (black or dark color)
-	glLineWidth(2.0f); // Thicker line for the string
+	renderer->color(0.1f, 0.1f, 0.1f); // Color for the string (black or dark color)
+	renderer->lineWidth(2.0f); // Thicker line for the string
 
 	// Left side of the bowstring
-	glBegin(GL_LINES);
-	glVertex3f(-1.0f, 0.0f, 0.0f); // Left side of the string
-	glVertex3f(0.0f, 0.0f, 0.0f);  // Middle point (where the arrow attaches)
-	glEnd();
+	renderer->begin(PRIM_LINES);
+	renderer->vertex(-1.0f, 0.0f, 0.0f); // Left side of the string
+	renderer->vertex(0.0f, 0.0f, 0.0f);  // Middle point (where the arrow attaches)
+	renderer->end();
 
 	// Right side of the bowstring
-	glBegin(GL_LINES);
-	glVertex3f(1.0f, 0.0f, 0.0f);  // Right side of the string
-	glVertex3f(0.0f, 0.0f, 0.0f);  // Middle point (where the arrow attaches)
-	glEnd();
+	renderer->begin(PRIM_LINES);
+	renderer->vertex(1.0f, 0.0f, 0.0f);  // Right side of the string
+	renderer->vertex(0.0f, 0.0f, 0.0f);  // Middle point (where the arrow attaches)
+	renderer->end();
 
-	glPopMatrix();
+	renderer->popMatrix();
 }
 
 
 
 void drawCurvedString(float x) {
-	glPushMatrix();
-	glTranslatef(0.0f, -0.5f, 0.0f); // Position the string (align with the center of the bow)
+	renderer->pushMatrix();
+	renderer->translate(0.0f, -0.5f, 0.0f); // Position the string (align with the center of the bow)
 
-	glColor3f(0.1f, 0.1f, 0.1f); // Color for the string (black or dark color)
-	glLineWidth(2.0f); // Thicker line for the string
+	renderer->color(0.1f, 0.1f, 0.1f); // Color for the string (black or dark color)
+	renderer->lineWidth(2.0f); // Thicker line for the string
 
 	// Left side of the bowstring
-	glPushMatrix();
-	glTranslatef(0.0f, 0.5 * x, 0.0f);
-	glRotatef(30 * x, 0.0f, 0.0f, 1.0f);
-	glBegin(GL_LINES);
-	glVertex3f(-1.0f, 0.0f, 0.0f); // Left side of the string
-	glVertex3f(0.0f, 0.0f, 0.0f);  // Middle point (where the arrow attaches)
-	glEnd();
-	glPopMatrix();
+	renderer->pushMatrix();
+	renderer->translate(0.0f, 0.5 * x, 0.0f);
+	renderer->rotate(30 * x, 0.0f, 0.0f, 1.0f);
+	renderer->begin(PRIM_LINES);
+	renderer->vertex(-1.0f, 0.0f, 0.0f); // Left side of the string
+	renderer->vertex(0.0f, 0.0f, 0.0f);  // Middle point (where the arrow attaches)
+	renderer->end();
+	renderer->popMatrix();
 
 	// Right side of the bowstring
-	glPushMatrix();
-	glTranslatef(0.0f, 0.5 * x, 0.0f);
-	glRotatef(-30 * x, 0.0f, 0.0f, 1.0f);
-	glBegin(GL_LINES);
-	glVertex3f(1.0f, 0.0f, 0.0f);  // Right side of the string
-	glVertex3f(0.0f, 0.0f, 0.0f);  // Middle point (where the arrow attaches)
-	glEnd();
-	glPopMatrix();
+	renderer->pushMatrix();
+	renderer->translate(0.0f, 0.5 * x, 0.0f);
+	renderer->rotate(-30 * x, 0.0f, 0.0f, 1.0f);
+	renderer->begin(PRIM_LINES);
+	renderer->vertex(1.0f, 0.0f, 0.0f);  // Right side of the string
+	renderer->vertex(0.0f, 0.0f, 0.0f);  // Middle point (where the arrow attaches)
+	renderer->end();
+	renderer->popMatrix();
 
-	glPopMatrix();
+	renderer->popMatrix();
 
 }
 
 // Function to draw the bow
 void drawBow(float x) {
-	glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
-	glPushMatrix();
-	glTranslated(0.1, 1.4, 1.4);
-	glRotated(90, 0.0, 1.0, 0.0);
-	glRotated(90, 0.0, 0.0, 1.0);
+	renderer->pushAttrib();
 	drawBowSemiCircle(x); // Draw the semi-circle of the bow
 	if (x == 0.0) {
 		drawBowString();  // Draw the string of the bow (two lines)
@@ -481,186 +363,227 @@ void drawBow(float x) {
 	else {
 		drawCurvedString(x);
 	}
-	glPopAttrib();
-	glPopMatrix();
+	renderer->popAttrib();
+}
+
+void drawPlayerBow() {
+	drawBow(0.5f);
 }
 
 void drawArrow() {
-	glPushMatrix();
-	glTranslatef(0.01f, 1.5f, 1.0f); // Position the arrow
-	glScaled(0.7, 0.7, 0.5);
-	glRotatef(-90, 0, 1, 0);
-	glRotated(90, 0, 0, 1);
-	glRotated(90, 1.0, 0, 0);
+	TRACE_DRAW("drawArrow");
+	renderer->pushMatrix();
+	renderer->translate(0.01f, 1.5f, 1.0f); // Position the arrow
+	renderer->scale(0.7, 0.7, 0.5);
+	renderer->rotate(-90, 0, 1, 0);
+	renderer->rotate(90, 0, 0, 1);
+	renderer->rotate(90, 1.0, 0, 0);
 
 	// Shaft of the arrow - Cylinder
-	glColor3f(0.8f, 0.8f, 0.8f); // Light gray color
-	GLUquadric* quad = gluNewQuadric();
-	gluCylinder(quad, 0.05, 0.05, 2.0, 20, 5); // Arrow shaft
+	renderer->color(0.8f, 0.8f, 0.8f); // Light gray color
+	solidCylinder(0.05, 0.05, 2.0, 20, 5); // Arrow shaft
 
 	// Arrowhead - Cone
-	glPushMatrix();
-	glTranslatef(0.0f, 0.0f, 2.0f); // Position at end of shaft
-	glColor3f(1.0f, 0.0f, 0.0f); // Red color for the arrowhead
-	glutSolidCone(0.1, 0.3, 20, 10); // Arrowhead
-	glPopMatrix();
+	renderer->pushMatrix();
+	renderer->translate(0.0f, 0.0f, 2.0f); // Position at end of shaft
+	renderer->color(1.0f, 0.0f, 0.0f); // Red color for the arrowhead
+	solidCone(0.1, 0.3, 20, 10); // Arrowhead
+	renderer->popMatrix();
 
 	// Fletchings (feathers) at the back of the arrow
-	glColor3f(0.7f, 0.7f, 0.7f); // Gray color for fletchings
+	renderer->color(0.7f, 0.7f, 0.7f); // Gray color for fletchings
 
 	// Right fletching
-	glPushMatrix();
-	glTranslatef(0.1f, 0.0f, -0.2f); // Position at back of the shaft
-	glRotatef(30, 0.0f, 1.0f, 0.0f); // Rotate fletching
-	glutSolidCone(0.05, 0.2, 10, 5); // Right fletching
-	glPopMatrix();
+	renderer->pushMatrix();
+	renderer->translate(0.1f, 0.0f, -0.2f); // Position at back of the shaft
+	renderer->rotate(30, 0.0f, 1.0f, 0.0f); // Rotate fletching
+	solidCone(0.05, 0.2, 10, 5); // Right fletching
+	renderer->popMatrix();
 
 	// Left fletching
-	glPushMatrix();
-	glTranslatef(-0.1f, 0.0f, -0.2f); // Position at back of the shaft
-	glRotatef(-30, 0.0f, 1.0f, 0.0f); // Rotate fletching
-	glutSolidCone(0.05, 0.2, 10, 5); // Left fletching
-	glPopMatrix();
+	renderer->pushMatrix();
+	renderer->translate(-0.1f, 0.0f, -0.2f); // Position at back of the shaft
+	renderer->rotate(-30, 0.0f, 1.0f, 0.0f); // Rotate fletching
+	solidCone(0.05, 0.2, 10, 5); // Left fletching
+	renderer->popMatrix();
 
 	// Top fletching
-	glPushMatrix();
-	glTranslatef(0.0f, 0.1f, -0.2f); // Position at back of the shaft
-	glRotatef(90, 1.0f, 0.0f, 0.0f); // Rotate top fletching
-	glutSolidCone(0.05, 0.2, 10, 5); // Top fletching
-	glPopMatrix();
+	renderer->pushMatrix();
+	renderer->translate(0.0f, 0.1f, -0.2f); // Position at back of the shaft
+	renderer->rotate(90, 1.0f, 0.0f, 0.0f); // Rotate top fletching
+	solidCone(0.05, 0.2, 10, 5); // Top fletching
+	renderer->popMatrix();
 
-	gluDeleteQuadric(quad);
-	glPopMatrix();
+	renderer->popMatrix();
 }
 
 
 float tempAngle = 0.0;
 
-void drawPlayer(float x, float y, float z) {
+SceneGraph sceneGraph; // Built by buildSceneGraph(), updated at the top of each frame
+SceneNode playerNode, lampNode, chairNode;
+
+#define ARCHER_BONES 12
+
+// The player's parts in the order of their bones, and what draws each.
+SceneNode archerBones[ARCHER_BONES];
+void (*archerBoneDraws[ARCHER_BONES])();
+int archerBoneCount = 0;
+
+SceneNode addArcherPart(SceneNode parent, void (*draw)()) {
+	SceneNode node = sceneGraph.add(parent);
+	archerBones[archerBoneCount] = node;
+	archerBoneDraws[archerBoneCount++] = draw;
+	return node;
+}
+
+// Draws every part through a MeshBuilder, so the archer is one vertex buffer
+// of triangles and lines with a bone number on each vertex.
+SkinnedModel* bakeArcher() {
+	SkinnedModel* model = new SkinnedModel();
+	MeshBuilder builder;
+	Renderer* previous = renderer;
+	renderer = &builder;
+	for (int i = 0; i < archerBoneCount; i++) {
+		builder.setBone(i);
+		archerBoneDraws[i]();
+	}
+	renderer = previous;
+	builder.build(*model, archerBoneCount);
+	return model;
+}
+
+const SkinnedModel& archerModel() {
+	static const SkinnedModel* model = bakeArcher(); // Built by whichever thread asks first
+	return *model;
+}
+
+void drawPlayer() {
+	TRACE_DRAW("drawPlayer");
+	const SkinnedModel* archer = &archerModel();
 	// Save the current lighting and color states
-	glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
-	glPushMatrix();
-	glTranslatef(playerX, 0.0f, playerZ);
-	glRotatef(rotationAngle, 0, 1, 0);
-
-	// Enable GL_COLOR_MATERIAL to use glColor calls for each part
-	glEnable(GL_COLOR_MATERIAL);
-	glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
-
-	glPushMatrix();
-	glTranslatef(x, y, z); // Position the player at (x, y, z)
-	glScaled(2.0, 2.0, 2.0);
-	// Set specific colors for each part to avoid unintended color issues
-
-	// Draw Head
-	glColor3f(0.9f, 0.7f, 0.5f); // Skin color for the head
-	drawHead();
-
-	// Draw Torso
-	glColor3f(0.2f, 0.6f, 1.0f); // Shirt color for the torso
-	drawTorso();
-
-	// Draw Left Arm
-	glColor3f(0.2f, 0.6f, 1.0f); // Same shirt color for the left arm
-	drawLeftArm();
-	glColor3f(0.9f, 0.7f, 0.5f); // Skin color for the hand
-	drawLeftHand();
-
-	// Draw Right Arm
-	glColor3f(0.2f, 0.6f, 1.0f); // Same shirt color for the right arm
-	drawRightArm();
-	glColor3f(0.9f, 0.7f, 0.5f); // Skin color for the hand
-	drawRightHand();
-
-	// Draw Left Leg
-	glColor3f(0.5f, 0.35f, 0.05f); // Pants color for the left leg
-	glPushMatrix();
-	glRotatef(leftLegAngle, 1, 0, 0); // Apply the swing rotation
-	drawLeftLeg(); // Your function to draw a leg
-	glPopMatrix();
-
-
-	// Draw Right Leg
-	glColor3f(0.5f, 0.35f, 0.05f); // Pants color for the right leg
-	glPushMatrix();
-	glRotatef(rightLegAngle, 1, 0, 0); // Apply the swing rotation
-	drawRightLeg(); // Your function to draw a leg
-	glPopMatrix();
-
-	// Draw Eyes
-	glColor3f(0.0f, 0.0f, 0.0f); // Black color for eyes
-	drawEyes();
-
-	// Draw Mouth
-	glColor3f(0.0f, 0.0f, 0.0f); // Black color for mouth
-	drawMouth();
-
-	glPopMatrix();
-	drawBow(0.5f);
-	glPopMatrix();
+	renderer->pushAttrib();
+	float bones[ARCHER_BONES * 16];
+	for (int i = 0; i < archerBoneCount; i++) memcpy(bones + 16 * i, sceneGraph.world(archerBones[i]), 16 * sizeof(float));
+	renderer->drawSkinnedMesh(archer->triangles, bones);
+	renderer->lineWidth(2.0f); // The bow's
+	renderer->drawSkinnedMesh(archer->lines, bones);
 	if (!isShoot) {
-		glPushMatrix();
-		glTranslatef(playerX, 0.0f, playerZ);
-		glRotatef(rotationAngle, 0, 1, 0);
+		renderer->pushMatrix();
+		renderer->translate(playerX, 0.0f, playerZ);
+		renderer->rotate(rotationAngle, 0, 1, 0);
 		drawArrow();
-		glPopMatrix();
+		renderer->popMatrix();
 		tempAngle = rotationAngle;
 		arrowX = playerX;
 		arrowZ = playerZ;
 	}
 	else {
-		glPushMatrix();
+		renderer->pushMatrix();
 
-		glTranslatef(arrowX, 0.0, arrowZ);
-		glRotatef(tempAngle, 0, 1, 0);
+		renderer->translate(arrowX, 0.0, arrowZ);
+		renderer->rotate(tempAngle, 0, 1, 0);
 		drawArrow();
-		glPopMatrix();
+		renderer->popMatrix();
 	}
 
 	// Restore previous lighting and color states
-	glPopAttrib();
+	renderer->popAttrib();
 }
 
-// Function to draw a ring using a cylinder
-void drawRing(float radius, float innerRadius, float r, float g, float b) {
-	glPushMatrix();
-	glColor3f(r, g, b);  // Set color for the ring
+const TimeWave TargetScale = { 2.75f, 2.25f, 0.0f }; // Grows from 0.5 to 5 and back
+const float targetX = 0.0f, targetY = 1.5f, targetZ = -3.95f; // Center of the target, on the wall
 
-	// Create the outer cylinder (ring)
-	GLUquadric* quad = gluNewQuadric();
-	gluCylinder(quad, innerRadius, radius, 0.02f, 50, 1);  // Thin cylinder with small height
-	gluDeleteQuadric(quad);
-
-	glPopMatrix();
+// The target's rings, bullseye first, each starting where the one before
+// ends. The mesh is baked from this table and ShootArrow() scores against it,
+// so what is drawn is what counts as a hit.
+struct TargetRing {
+	float outerRadius; // Before TargetScale
+	float color[3];
+};
+const TargetRing targetRings[] = {
+	{ 0.1f, { 1.0f, 0.0f, 0.0f } }, // Red bullseye
+	{ 0.2f, { 0.0f, 0.0f, 1.0f } }, // Blue
+	{ 0.3f, { 0.0f, 0.0f, 0.0f } }, // Black
+	{ 0.4f, { 1.0f, 1.0f, 1.0f } }, // White
+	{ 0.5f, { 1.0f, 1.0f, 0.0f } }  // Yellow
+};
+const int targetRingCount = sizeof(targetRings) / sizeof(targetRings[0]);
+#define TARGET_SLICES 50
+#define TARGET_FACE_Z 0.02f // In front of the wall, before TargetScale
+
+// The ring a point lies in, at radius from the center of the target as drawn
+// at time, or -1 when it misses.
+int targetRingAt(float radius, float time) {
+	float scale = evaluateWave(TargetScale, time);
+	for (int i = 0; i < targetRingCount; i++) {
+		if (radius <= targetRings[i].outerRadius * scale) return i;
+	}
+	return -1;
 }
 
-float TargetScale = 1.0;
-
-// Function to draw the entire archery target using cylinders for the rings
-void drawArcheryTarget() {
-	glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
-
-	glPushMatrix();
-	glScaled(TargetScale, TargetScale, TargetScale);  // Scale the target
-
-	// Draw the rings as cylinders
-	// 1. Bullseye (red)
-	drawRing(0.1f, 0.0f, 1.0f, 0.0f, 0.0f);  // Red center
-
-	// 2. Inner ring (blue)
-	drawRing(0.2f, 0.1f, 0.0f, 0.0f, 1.0f);  // Blue ring
-
-	// 3. Second ring (black)
-	drawRing(0.3f, 0.2f, 0.0f, 0.0f, 0.0f);  // Black ring
-
-	// 4. Third ring (white)
-	drawRing(0.4f, 0.3f, 1.0f, 1.0f, 1.0f);  // White ring
+// Flat annuli facing +z, one band of quads per ring with its own vertices at
+// the edges so the colors don't bleed into each other.
+struct TargetMeshData {
+	float positions[targetRingCount * 2 * TARGET_SLICES * 3];
+	float normals[targetRingCount * 2 * TARGET_SLICES * 3];
+	float colors[targetRingCount * 2 * TARGET_SLICES * 3];
+	unsigned short indices[targetRingCount * TARGET_SLICES * 6];
+	Mesh mesh;
+};
 
-	// 5. Outer ring (yellow)
-	drawRing(0.5f, 0.4f, 1.0f, 1.0f, 0.0f);  // Yellow ring
+TargetMeshData* bakeTargetMesh() {
+	TargetMeshData* data = new TargetMeshData();
+	float innerRadius = 0.0f;
+	int vertex = 0, index = 0;
+	for (int ring = 0; ring < targetRingCount; ring++) {
+		float outerRadius = targetRings[ring].outerRadius;
+		int first = vertex;
+		for (int i = 0; i < TARGET_SLICES; i++) {
+			float angle = 2.0f * 3.14159265f * i / TARGET_SLICES;
+			float radii[2] = { innerRadius, outerRadius };
+			for (int edge = 0; edge < 2; edge++) {
+				float* p = data->positions + 3 * vertex;
+				p[0] = radii[edge] * cosf(angle);
+				p[1] = radii[edge] * sinf(angle);
+				p[2] = TARGET_FACE_Z;
+				float* n = data->normals + 3 * vertex;
+				n[0] = 0.0f;
+				n[1] = 0.0f;
+				n[2] = 1.0f;
+				float* c = data->colors + 3 * vertex;
+				c[0] = targetRings[ring].color[0];
+				c[1] = targetRings[ring].color[1];
+				c[2] = targetRings[ring].color[2];
+				vertex++;
+			}
+			// Inner and outer edge of this slice and the next, counterclockwise from the front.
+			int inner0 = first + 2 * i, outer0 = inner0 + 1;
+			int inner1 = first + 2 * ((i + 1) % TARGET_SLICES), outer1 = inner1 + 1;
+			unsigned short quad[6] = {
+				(unsigned short)inner0, (unsigned short)outer0, (unsigned short)outer1,
+				(unsigned short)inner0, (unsigned short)outer1, (unsigned short)inner1
+			};
+			for (int k = 0; k < 6; k++) data->indices[index++] = quad[k];
+		}
+		innerRadius = outerRadius;
+	}
+	Mesh mesh = { PRIM_TRIANGLES, vertex, data->positions, data->normals, data->colors, index, data->indices };
+	data->mesh = mesh;
+	return data;
+}
 
-	glPopMatrix();
-	glPopAttrib();
+// One draw of the baked rings under one scale. The scale is uniform, so the
+// baked normals keep their direction.
+void drawArcheryTarget() {
+	TRACE_DRAW("drawArcheryTarget");
+	static const TargetMeshData* target = bakeTargetMesh(); // Built by whichever thread draws first
+	renderer->pushAttrib();
+	renderer->pushMatrix();
+	renderer->scaleWave(TargetScale);
+	renderer->drawMesh(target->mesh);
+	renderer->popMatrix();
+	renderer->popAttrib();
 }
 
 
@@ -669,7 +592,7 @@ void drawCircle(float outerRadius) {
 	float innerRadius = outerRadius - 0.1f; // Small offset for the inner radius to define the ring's thickness
 	float depth = 0.05f; // Depth for the 3D effect
 
-	glBegin(GL_QUAD_STRIP);
+	renderer->begin(PRIM_QUAD_STRIP);
 	for (int i = 0; i <= numSegments; i++) {
 		float angle = 2.0f * 3.14159f * i / numSegments;
 		float xOuter = outerRadius * cos(angle);
@@ -678,134 +601,162 @@ void drawCircle(float outerRadius) {
 		float yInner = innerRadius * sin(angle);
 
 		// Front face of the ring
-		glVertex3f(xOuter, yOuter, depth); // Outer point on front face
-		glVertex3f(xInner, yInner, depth); // Inner point on front face
+		renderer->vertex(xOuter, yOuter, depth); // Outer point on front face
+		renderer->vertex(xInner, yInner, depth); // Inner point on front face
 
 		// Back face of the ring
-		glVertex3f(xOuter, yOuter, -depth); // Outer point on back face
-		glVertex3f(xInner, yInner, -depth); // Inner point on back face
+		renderer->vertex(xOuter, yOuter, -depth); // Outer point on back face
+		renderer->vertex(xInner, yInner, -depth); // Inner point on back face
 	}
-	glEnd();
+	renderer->end();
 }
 
 
+constexpr float OLYMPIC_RING_RADIUS = 0.6f;
+
+// Blue, black and red along the top, yellow and green below between them.
+constexpr Layout<5> olympicRings = { {
+	translation(-1.5f, 0.0f, 0.0f), translation(0.0f, 0.0f, 0.0f), translation(1.5f, 0.0f, 0.0f),
+	translation(-0.75f, -0.5f, 0.0f), translation(0.75f, -0.5f, 0.0f)
+} };
+const float olympicRingColors[5][3] = { { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } };
+
+constexpr bool ringsLinked(int a, int b) {
+	return squaredDistance(olympicRings.transforms[a], olympicRings.transforms[b]) < 4.0f * OLYMPIC_RING_RADIUS * OLYMPIC_RING_RADIUS;
+}
+static_assert(!ringsLinked(0, 1) && !ringsLinked(1, 2), "The top rings touch");
+static_assert(ringsLinked(3, 0) && ringsLinked(3, 1) && ringsLinked(4, 1) && ringsLinked(4, 2), "A lower ring doesn't link both rings above it");
+
 void drawOlympicFlag() {
-	glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
-	float ringRadius = 0.6;  // Radius of each ring
-	float yOffset = 0.0;     // Vertical offset for the rings
-
-
-
-
-	glPushMatrix();
-	glTranslated(-1.5, yOffset, 0.0); // Position of the blue ring
-	glColor3f(0.0, 0.0, 1.0);          // Blue color
-	drawCircle(ringRadius);
-	glPopMatrix();
-
-	// Black Ring
-	glPushMatrix();
-	glTranslated(0.0, yOffset, 0.0);
-	glColor3f(0.0, 0.0, 0.0);
-	drawCircle(ringRadius);
-	glPopMatrix();
-
-	// Red Ring
-	glPushMatrix();
-	glTranslated(1.5, yOffset, 0.0);
-	glColor3f(1.0, 0.0, 0.0);
-	drawCircle(ringRadius);
-	glPopMatrix();
-
-	// Yellow Ring
-	glPushMatrix();
-	glTranslated(-0.75, -0.5, 0.0);
-	glColor3f(1.0, 1.0, 0.0);
-	drawCircle(ringRadius);
-	glPopMatrix();
-
-	// Green Ring
-	glPushMatrix();
-	glTranslated(0.75, -0.5, 0.0);
-	glColor3f(0.0, 1.0, 0.0);
-	drawCircle(ringRadius);
-	glPopMatrix();
-	glPopAttrib();
-}
-
-
-float timeElapsed = 0.0f; // Keeps track of time
-float PodR = 1.0;
-float PodG = 0.0;
-float PodB = 0.0;
+	TRACE_DRAW("drawOlympicFlag");
+	renderer->pushAttrib();
+	drawLayout(olympicRings, [](int ring) {
+		renderer->color(olympicRingColors[ring][0], olympicRingColors[ring][1], olympicRingColors[ring][2]);
+		drawCircle(OLYMPIC_RING_RADIUS);
+	});
+	renderer->popAttrib();
+}
+
+
+#define ANIMATION_TIMER_MS 50
+#define ANIMATION_TIME_STEP 0.005f // timeElapsed gained per timer tick
+#define ANIMATION_TIME_SECONDS (ANIMATION_TIMER_MS / 1000.0f / ANIMATION_TIME_STEP) // Per unit of timeElapsed
+
+float timeElapsed = 0.0f; // The clock every TimeWave in the scene runs on
+TimeWave PodColor[3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } };
 bool changePodColor = false;
 
-// Single function for updating color and rendering
-void updateWallColor(int val) {
-	// Update color over time using a sine wave pattern
-	colorR = (sin(timeElapsed) + 1.0f) / 2.0f;      // Red oscillates between 0 and 1
-	colorG = (sin(timeElapsed + 2.0f) + 1.0f) / 2.0f; // Green with a phase shift
-	colorB = (sin(timeElapsed + 4.0f) + 1.0f) / 2.0f; // Blue with a phase shift
-	TargetScale = (sin(timeElapsed) + 1.0f) * (5.0f - 0.5f) / 2.0f + 0.5f;
+// The podium cycles like the walls, with its channels rotated, while
+// changePodColor is on, and keeps the color it had when it goes off.
+void togglePodColor() {
+	changePodColor = !changePodColor;
 	if (changePodColor) {
-		PodG = (sin(timeElapsed) + 1.0f) / 2.0f;      // Red oscillates between 0 and 1
-		PodB = (sin(timeElapsed + 2.0f) + 1.0f) / 2.0f; // Green with a phase shift
-		PodR = (sin(timeElapsed + 4.0f) + 1.0f) / 2.0f; // Blue with a phase shift
+		PodColor[0] = wallColor[2];
+		PodColor[1] = wallColor[0];
+		PodColor[2] = wallColor[1];
 	}
-	// Update the time for the next frame
-	timeElapsed += 0.005f;
+	else {
+		for (int i = 0; i < 3; i++) PodColor[i] = constantWave(evaluateWave(PodColor[i], timeElapsed));
+	}
+}
+
+// Only the clock moves; the renderer works out the colors and scales from it.
+void updateAnimationTime(int val) {
+	PROFILE_ZONE("animation timer");
+	timeElapsed += ANIMATION_TIME_STEP;
 	glutPostRedisplay();
-	glutTimerFunc(50, updateWallColor, 0);
+	glutTimerFunc(ANIMATION_TIMER_MS, updateAnimationTime, 0);
 }
 
-void drawRoom() {
-	glPushMatrix();
+// Objects that occlusion culling tests, each with a box in drawBounds().
+// Stress lamps follow the fixed objects.
+enum SceneObject {
+	OBJECT_PLAYER,
+	OBJECT_FLAG,
+	OBJECT_TARGET,
+	OBJECT_LAMP,
+	OBJECT_PODIUM,
+	OBJECT_CHAIR,
+	OBJECT_TABLE,
+	OBJECT_ARROWS_HOLDER,
+	OBJECT_COUNT
+};
 
-	glTranslated(0.0, 8.85, 0.0);
+#define MAX_STRESS_LAMPS 4096
+int stressLampCount = 0; // Extra lamps, set with --stress <count>
+float stressLampOffsets[MAX_STRESS_LAMPS][2]; // x and z from the room's lamp
+bool objectCulled[OBJECT_COUNT + MAX_STRESS_LAMPS];
+
+// Lays the stress lamps out on a grid reaching well past the walls.
+void setupStressScene(int count) {
+	stressLampCount = count < MAX_STRESS_LAMPS ? count : MAX_STRESS_LAMPS;
+	int side = (int)ceil(sqrt((double)stressLampCount));
+	for (int i = 0; i < stressLampCount; i++) {
+		float u = side > 1 ? (float)(i % side) / (side - 1) : 0.5f;
+		float v = side > 1 ? (float)(i / side) / (side - 1) : 0.5f;
+		stressLampOffsets[i][0] = -40.0f + 80.0f * u;
+		stressLampOffsets[i][1] = -50.0f + 90.0f * v;
+	}
+}
+
+// The walls and floor, which are also the occluders.
+void drawRoomWalls() {
+	TRACE_DRAW("drawRoomWalls");
+	renderer->pushMatrix();
+
+	renderer->translate(0.0, 8.85, 0.0);
 	// Front Wall (Z-axis)
-	glPushMatrix();
-	glTranslated(-15.0, -10.0, -5.0); // Position the front wall
-	glScaled(30.0, 2.0, 1.0);      // Scale it to make it wide
+	renderer->pushMatrix();
+	renderer->translate(-15.0, -10.0, -5.0); // Position the front wall
+	renderer->scale(30.0, 2.0, 1.0);      // Scale it to make it wide
 	drawWall(5.0);                 // Thickness of the wall
-	glPopMatrix();
+	renderer->popMatrix();
 	// Back Wall (Z-axis)
-	glPushMatrix();
-	glTranslated(-15.0, -10.0, 25.0);  // Position the back wall
-	glScaled(30.0, 2.0, 1.0);     // Scale it to make it wide
+	renderer->pushMatrix();
+	renderer->translate(-15.0, -10.0, 25.0);  // Position the back wall
+	renderer->scale(30.0, 2.0, 1.0);     // Scale it to make it wide
 	drawWall(5.0);                // Thickness of the wall
-	glPopMatrix();
+	renderer->popMatrix();
 
 	// Left Wall (X-axis)
-	glPushMatrix();
-	glTranslated(-15.0, -10.0, 25.0); // Position the left wall
-	glRotated(90.0, 0.0, 1.0, 0.0); // Rotate the wall 90 degrees
-	glScaled(30.0, 2.0, 1.0);      // Scale it to make it tall
+	renderer->pushMatrix();
+	renderer->translate(-15.0, -10.0, 25.0); // Position the left wall
+	renderer->rotate(90.0, 0.0, 1.0, 0.0); // Rotate the wall 90 degrees
+	renderer->scale(30.0, 2.0, 1.0);      // Scale it to make it tall
 	drawWall(5.0);                 // Thickness of the wall
-	glPopMatrix();
+	renderer->popMatrix();
 
 	//// Right Wall (X-axis)
-	//glPushMatrix();
-	//glTranslated(15.0, -10.0, 25.0);  // Position the right wall
-	//glRotated(90.0, 0.0, 1.0, 0.0); // Rotate the wall 90 degrees
-	//glScaled(30.0, 2.0, 1.0);     // Scale it to make it tall
+	//renderer->pushMatrix();
+	//renderer->translate(15.0, -10.0, 25.0);  // Position the right wall
+	//renderer->rotate(90.0, 0.0, 1.0, 0.0); // Rotate the wall 90 degrees
+	//renderer->scale(30.0, 2.0, 1.0);     // Scale it to make it tall
 	//drawWall(5.0);                // Thickness of the wall
-	//glPopMatrix();
+	//renderer->popMatrix();
 
-	glPushMatrix();
-	glTranslatef(-15.0, -10.0, -10.0);
-	glRotated(90.0, 1.0, 0.0, 0.0);
-	glScaled(30.0, 8.0, 1.0);
+	renderer->pushMatrix();
+	renderer->translate(-15.0, -10.0, -10.0);
+	renderer->rotate(90.0, 1.0, 0.0, 0.0);
+	renderer->scale(30.0, 8.0, 1.0);
 	drawWall(5.0);
-	glPopMatrix();
-	glPopMatrix();
-	glPushMatrix();
-	glTranslated(0.0, 7.0, -3.95);
-	drawOlympicFlag();
-	glPopMatrix();
-	glPushMatrix();
-	glTranslated(0.0, 1.5, -3.95);
-	drawArcheryTarget();
-	glPopMatrix();
+	renderer->popMatrix();
+	renderer->popMatrix();
+}
+
+void drawRoom() {
+	drawRoomWalls();
+	if (!objectCulled[OBJECT_FLAG]) {
+		renderer->pushMatrix();
+		renderer->translate(0.0, 7.0, -3.95);
+		drawOlympicFlag();
+		renderer->popMatrix();
+	}
+	if (!objectCulled[OBJECT_TARGET]) {
+		renderer->pushMatrix();
+		renderer->translate(targetX, targetY, targetZ);
+		drawArcheryTarget();
+		renderer->popMatrix();
+	}
 
 }
 int timer = 60;
@@ -813,7 +764,9 @@ bool isOver = false;
 int score = 0;
 float shootingAngle = 0.0;
 bool firstMov = true;
+bool arrowInShelf = false; // Knocked the arrows shelf on this shot
 int numberHit = 0;
+void getObjectBounds(int object, float* boxMin, float* boxMax);
 void ShootArrow() {
 	if (firstMov) {
 		shootingAngle = rotationAngle * 3.14 / 180.0f;
@@ -829,11 +782,21 @@ void ShootArrow() {
 		if (newX < 14.0 && newX > -12.0 && newZ < 25.0 && newZ > -2) {
 			arrowX = newX;
 			arrowZ = newZ;
-			if (newZ < -1.7 && newZ > -2 && newX <0.2 && newX > -0.2) {
+			setSoundPosition(arrowSound, arrowX, arrowHeight, arrowZ);
+			// The arrow knocks the shelf once as it passes over it.
+			float shelfMin[3], shelfMax[3];
+			getObjectBounds(OBJECT_ARROWS_HOLDER, shelfMin, shelfMax);
+			if (!arrowInShelf && arrowX > shelfMin[0] && arrowX < shelfMax[0] && arrowZ > shelfMin[2] && arrowZ < shelfMax[2]) {
+				arrowInShelf = true;
+				markAudioEvent();
+				playSound3D("media/HitSound.mp3", arrowX, arrowHeight, arrowZ);
+			}
+			if (newZ < -1.7 && newZ > -2 && targetRingAt(hypotf(newX - targetX, arrowHeight - targetY), timeElapsed) >= 0) {
 				score += 1;
 				numberHit += 1;
 				if (numberHit == 1 || numberHit == 4 || numberHit == 7) {
-					engine2->play2D("media/HitSound.mp3", false);
+					markAudioEvent();
+					playSound3D("media/HitSound.mp3", arrowX, arrowHeight, arrowZ);
 				}
 			}
 			if (score >= 9) {
@@ -845,6 +808,8 @@ void ShootArrow() {
 			arrowZ = playerZ;
 			isShoot = false;
 			firstMov = true;
+			arrowSound = -1;
+			arrowInShelf = false;
 		}
 	}
 	else {
@@ -871,37 +836,26 @@ void animateLamp() {
 	}
 }
 
-void drawLamp() {
-	glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
-	glPushMatrix();
-
-	// Translate the object to a desired position
-	glTranslatef(-5.0f, sphereY, 20.0f); // Position the lamp
-
-	glPushMatrix();
-	// Draw the light bulb (Sphere)
-	glTranslatef(0.0, 0.5, 0.7);
-	glColor3f(1.0f, 1.0f, 0.0f); // Yellow color for the light bulb
-	glutSolidSphere(1.0f, 50, 50); // Draw the light bulb as a sphere
-	glPopMatrix();
+void drawLampBulb() {
+	renderer->color(1.0f, 1.0f, 0.0f); // Yellow color for the light bulb
+	solidSphere(1.0f, 50, 50); // Draw the light bulb as a sphere
+}
 
-	// Draw the lamp stand (Cylinder)
-	glTranslatef(0.0f, -1.5f, 0.0f); // Move the stand below the bulb
-	glColor3f(0.6f, 0.6f, 0.6f); // Gray color for the stand
-	glPushMatrix();
-	glTranslatef(0.0, -2, 2.0);
-	glRotated(-90, 1.0, 0.0, 0.0);
-	GLUquadric* quadric = gluNewQuadric();
-	gluCylinder(quadric, 0.2f, 0.2f, 4.0f, 32, 32); // Draw the stand as a cylinder
-	glPopMatrix();
+void drawLampStand() {
+	renderer->color(0.6f, 0.6f, 0.6f); // Gray color for the stand
+	solidCylinder(0.2f, 0.2f, 4.0f, 32, 32); // Draw the stand as a cylinder
+}
 
-	// Draw the lampshade (Cone)
-	glTranslatef(0.0f, 2.0f, 0.0f); // Move the cone above the stand
-	glColor3f(0.5f, 0.5f, 0.5f); // Gray color for the lampshade
-	glutSolidCone(1.5f, 3.0f, 50, 50);  // Draw the lampshade as a cone
+void drawLampShade() {
+	renderer->color(0.5f, 0.5f, 0.5f); // Gray color for the lampshade
+	solidCone(1.5f, 3.0f, 50, 50);  // Draw the lampshade as a cone
+}
 
-	glPopMatrix();
-	glPopAttrib();
+void drawLamp() {
+	TRACE_DRAW("drawLamp");
+	renderer->pushAttrib();
+	sceneGraph.draw(lampNode);
+	renderer->popAttrib();
 }
 
 
@@ -909,31 +863,32 @@ void drawLamp() {
 
 
 void drawOlympicPodium() {
-	glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
-	glPushMatrix();
+	TRACE_DRAW("drawOlympicPodium");
+	renderer->pushAttrib();
+	renderer->pushMatrix();
 	// Translate to position the podium
-	glTranslatef(-5.0f, -0.5, 15.0f);
-	glColor3f(PodR, PodG, PodB);
+	renderer->translate(-5.0f, -0.5, 15.0f);
+	renderer->colorWave(PodColor[0], PodColor[1], PodColor[2]);
 
 	// Draw the base (Rectangular Block)
 
-	glPushMatrix();
-	glScalef(3.0f, 0.5f, 1.0f);  // Scale the rectangular block
-	glutSolidCube(2.0f); // Draw the rectangular base
-	glPopMatrix();
+	renderer->pushMatrix();
+	renderer->scale(3.0f, 0.5f, 1.0f);  // Scale the rectangular block
+	solidCube(2.0f); // Draw the rectangular base
+	renderer->popMatrix();
 
 	// Draw the first step (Cylinder)
-	glTranslatef(0.0f, 1.5f, 0.0f); // Move up for the first step
-	glutSolidCube(2.0f);
+	renderer->translate(0.0f, 1.5f, 0.0f); // Move up for the first step
+	solidCube(2.0f);
 
 	// Draw the second step (Cylinder)
-	glPushMatrix();
-	glTranslatef(1.0f, -1.0f, 0.0f); // Move up for the second step
-	glScalef(2.0, 0.5, 1.0);
-	glutSolidCube(2.0f);
-	glPopMatrix();
-	glPopMatrix();
-	glPopAttrib();
+	renderer->pushMatrix();
+	renderer->translate(1.0f, -1.0f, 0.0f); // Move up for the second step
+	renderer->scale(2.0, 0.5, 1.0);
+	solidCube(2.0f);
+	renderer->popMatrix();
+	renderer->popMatrix();
+	renderer->popAttrib();
 }
 
 bool rotateChair = false;
@@ -954,84 +909,189 @@ void animateTable() {
 	}
 }
 
+void drawChairSeat() {
+	renderer->color(0.5f, 0.35f, 0.05f); // Wood-like color
+	solidCube(1.0f);             // Draw the seat as a cube
+}
+
+void drawChairLeg() {
+	renderer->color(0.3f, 0.2f, 0.1f); // Darker wood color
+	solidCylinder(0.05f, 0.05f, 1.0f, 16, 16); // Draw the leg
+}
+
+// Four legs, stretched to different heights, and the rail across the back.
+// Each cylinder is stood up by rotating it about axis.
+struct ChairLeg {
+	float position[3];
+	float scale[3];
+	float axis[3];
+};
+
+const ChairLeg chairLegs[] = {
+	{ { -0.8f, -1.0f, -0.8f }, { 1.0f, 6.0f, 1.0f }, { 1.0f, 0.0f, 0.0f } },
+	{ { 0.8f, -1.0f, -0.8f }, { 1.0f, 6.0f, 1.0f }, { 1.0f, 0.0f, 0.0f } },
+	{ { -0.8f, -1.0f, 0.8f }, { 1.0f, 2.1f, 1.0f }, { 1.0f, 0.0f, 0.0f } },
+	{ { 0.8f, -1.0f, 0.8f }, { 1.0f, 2.1f, 1.0f }, { 1.0f, 0.0f, 0.0f } },
+	{ { 0.75f, 4.8f, -0.8f }, { 1.65f, 2.1f, 1.0f }, { 0.0f, 1.0f, 0.0f } }
+};
+const int chairLegCount = sizeof(chairLegs) / sizeof(chairLegs[0]);
+
 void drawChair() {
-	glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
-	glPushMatrix();
-	glTranslatef(10.0f, -0.2f, 15.0);
-	glRotatef(chairRotation + 180, 0.0f, 1.0f, 0.0f);
-	// Seat (Cube)
-	glColor3f(0.5f, 0.35f, 0.05f); // Wood-like color
-	glPushMatrix();
-	glTranslatef(0.0f, 1.0f, 0.0f);  // Position the seat
-	glScalef(2.0f, 0.2f, 2.0f);      // Scale to form the seat
-	glutSolidCube(1.0f);             // Draw the seat as a cube
-	glPopMatrix();
-
-	// Legs (Cylinders)
-	glColor3f(0.3f, 0.2f, 0.1f); // Darker wood color
-
-	// First leg
-	glPushMatrix();
-	glTranslatef(-0.8f, -1.0f, -0.8f);  // Position the first leg
-	glScaled(1.0, 6.0, 1.0);
-	glRotatef(-90, 1.0f, 0.0f, 0.0f);  // Rotate the cylinder to align with Z-axis
-	GLUquadric* quadric = gluNewQuadric();
-	gluCylinder(quadric, 0.05f, 0.05f, 1.0f, 16, 16); // Draw the leg
-	glPopMatrix();
-
-	// Second leg
-	glPushMatrix();
-	glTranslatef(0.8f, -1.0f, -0.8f);  // Position the second leg
-	glScaled(1.0, 6.0, 1.0);
-	glRotatef(-90, 1.0f, 0.0f, 0.0f); // Rotate to align with Z-axis
-	gluCylinder(quadric, 0.05f, 0.05f, 1.0f, 16, 16); // Draw the leg
-	glPopMatrix();
-
-	// Third leg
-	glPushMatrix();
-	glTranslatef(-0.8f, -1.0f, 0.8f);  // Position the third leg
-	glScaled(1.0, 2.1, 1.0);
-	glRotatef(-90, 1.0f, 0.0f, 0.0f); // Rotate to align with Z-axis
-	gluCylinder(quadric, 0.05f, 0.05f, 1.0f, 16, 16); // Draw the leg
-	glPopMatrix();
-
-	// Fourth leg
-	glPushMatrix();
-	glTranslatef(0.8f, -1.0f, 0.8f);   // Position the fourth leg
-	glScaled(1.0, 2.1, 1.0);
-	glRotatef(-90, 1.0f, 0.0f, 0.0f); // Rotate to align with Z-axis
-	gluCylinder(quadric, 0.05f, 0.05f, 1.0f, 16, 16); // Draw the leg
-	glPopMatrix();
-
-	glPushMatrix();
-	glTranslatef(0.75f, 4.8f, -0.8f);   // Position the fourth leg
-	glScaled(1.65, 2.1, 1.0);
-	glRotatef(-90, 0.0f, 1.0f, 0.0f); // Rotate to align with Z-axis
-	gluCylinder(quadric, 0.05f, 0.05f, 1.0f, 16, 16); // Draw the leg
-	glPopMatrix();
-
-	glPopMatrix();
-	glPopAttrib();
+	TRACE_DRAW("drawChair");
+	renderer->pushAttrib();
+	sceneGraph.draw(chairNode);
+	renderer->popAttrib();
 }
 
+// The spectators' cheer, a pose for each tick of the loop. The player's node
+// is taken back out of each bone, so a pose places the archer from where it
+// stands. Only run outside a frame: it poses the player through the scene
+// graph and puts the player back.
+std::vector<float> bakeCrowdPoses() {
+	const AnimationClip& clip = animationClips[CLIP_CHEER];
+	int poseCount = (int)(clip.times[clip.keyCount - 1] / ANIM_TICK + 0.5f);
+	std::vector<float> poses(poseCount * ARCHER_BONES * 16);
+	AnimationSet cheer(1);
+	cheer.play(0, CLIP_CHEER, 0.0f);
+	float* channels[ANIM_CHANNELS] = { &leftLegAngle, &rightLegAngle, &drawArmYaw, &drawHandPull };
+	float saved[ANIM_CHANNELS];
+	for (int c = 0; c < ANIM_CHANNELS; c++) saved[c] = *channels[c];
+	MatrixStack fromPlayer;
+	fromPlayer.rotate(-rotationAngle, 0.0f, 1.0f, 0.0f);
+	fromPlayer.translate(-playerX, 0.0f, -playerZ);
+	for (int f = 0; f < poseCount; f++) {
+		for (int c = 0; c < ANIM_CHANNELS; c++) *channels[c] = cheer.channel((AnimationChannel)c)[0];
+		sceneGraph.update();
+		for (int i = 0; i < archerBoneCount; i++) {
+			multiplyMatrices(fromPlayer.top(), sceneGraph.world(archerBones[i]), &poses[(f * ARCHER_BONES + i) * 16]);
+		}
+		cheer.tick();
+	}
+	for (int c = 0; c < ANIM_CHANNELS; c++) *channels[c] = saved[c];
+	sceneGraph.update();
+	return poses;
+}
+
+Crowd* buildCrowd(int spectators) {
+	std::vector<float> poses = bakeCrowdPoses();
+	return new Crowd(archerModel(), poses.data(), (int)poses.size() / (ARCHER_BONES * 16), spectators, CROWD_CENTER);
+}
+
+// The player, lamp and chair as nodes. Only the values bound here move them,
+// and update() recomputes a node's matrices only when one of those changes.
+void buildSceneGraph() {
+	playerNode = sceneGraph.add(-1);
+	sceneGraph.translate(playerNode, 0.0f, 0.0f, 0.0f);
+	sceneGraph.bind(playerNode, 0, &playerX);
+	sceneGraph.bind(playerNode, 2, &playerZ);
+	sceneGraph.rotate(playerNode, 0.0f, 0, 1, 0);
+	sceneGraph.bind(playerNode, 0, &rotationAngle);
+
+	SceneNode body = sceneGraph.add(playerNode);
+	sceneGraph.translate(body, 0.0f, 1.0f, 0.0f); // Stand the player on the floor
+	sceneGraph.scale(body, 2.0, 2.0, 2.0);
+
+	SceneNode part = addArcherPart(body, drawHead);
+	sceneGraph.translate(part, 0.0f, 0.8f, 0.0f); // Position above the torso
+	part = addArcherPart(body, drawTorso);
+	sceneGraph.scale(part, 0.5f, 1.0f, 0.3f); // Scale a cube to create a rectangular torso
+
+	part = addArcherPart(body, drawArm); // Left arm
+	sceneGraph.translate(part, -0.3f, 0.1f, 0.2f); // Position to the left of the torso
+	sceneGraph.rotate(part, 30.0, 0.0, 1.0, 0.0);
+	sceneGraph.rotate(part, -90.0, 1.0, 0.0, 0.0);
+	sceneGraph.scale(part, 0.2f, 0.8f, 0.2f);      // Scale to make it look like an arm
+	part = addArcherPart(body, drawHand);
+	sceneGraph.translate(part, -0.05f, 0.1f, 0.6f);
+
+	part = addArcherPart(body, drawArm); // Right arm
+	sceneGraph.translate(part, 0.27f, 0.3f, 0.4f); // Position the right arm to the right of the torso
+	sceneGraph.rotate(part, -15, 0.0, 1.0, 0.0);
+	sceneGraph.bind(part, 0, &drawArmYaw);
+	sceneGraph.rotate(part, -90.0f, 1.0f, 0.0f, 0.0f); // Rotate the arm to face forward
+	sceneGraph.scale(part, 0.2f, 0.8f, 0.2f); // Scale to make it look like an arm
+	part = addArcherPart(body, drawHand);
+	sceneGraph.translate(part, 0.1f, 0.3f, 0.85f); // Position the hand at the end of the rotated arm
+	sceneGraph.bind(part, 2, &drawHandPull);
+
+	part = addArcherPart(body, drawLeg); // Left leg
+	sceneGraph.rotate(part, 0.0f, 1, 0, 0); // The swing
+	sceneGraph.bind(part, 0, &leftLegAngle);
+	sceneGraph.translate(part, -0.2f, -0.75f, 0.0f); // Position below the torso on the left
+	sceneGraph.scale(part, 0.2f, 0.8f, 0.2f);       // Scale to make it look like a leg
+
+	part = addArcherPart(body, drawLeg); // Right leg
+	sceneGraph.rotate(part, 0.0f, 1, 0, 0);
+	sceneGraph.bind(part, 0, &rightLegAngle);
+	sceneGraph.translate(part, 0.2f, -0.75f, 0.0f); // Position below the torso on the right
+	sceneGraph.scale(part, 0.2f, 0.8f, 0.2f);
+
+	part = addArcherPart(body, drawEye);
+	sceneGraph.translate(part, -0.1f, 0.9f, 0.25f);  // Position the left eye
+	part = addArcherPart(body, drawEye);
+	sceneGraph.translate(part, 0.1f, 0.9f, 0.25f);  // Position the right eye
+	part = addArcherPart(body, drawMouth);
+	sceneGraph.translate(part, 0.0f, 0.8f, 0.3f); // Position the mouth slightly below the nose
+
+	part = addArcherPart(playerNode, drawPlayerBow);
+	sceneGraph.translate(part, 0.1f, 1.4f, 1.4f);
+	sceneGraph.rotate(part, 90, 0.0, 1.0, 0.0);
+	sceneGraph.rotate(part, 90, 0.0, 0.0, 1.0);
+
+	lampNode = sceneGraph.add(-1);
+	sceneGraph.translate(lampNode, -5.0f, 0.0f, 20.0f); // Bounces on sphereY
+	sceneGraph.bind(lampNode, 1, &sphereY);
+	part = sceneGraph.add(lampNode, drawLampBulb);
+	sceneGraph.translate(part, 0.0, 0.5, 0.7);
+	part = sceneGraph.add(lampNode, drawLampStand);
+	sceneGraph.translate(part, 0.0f, -3.5f, 2.0f); // Below the bulb
+	sceneGraph.rotate(part, -90, 1.0, 0.0, 0.0);
+	part = sceneGraph.add(lampNode, drawLampShade);
+	sceneGraph.translate(part, 0.0f, 0.5f, 0.0f);
+
+	chairNode = sceneGraph.add(-1);
+	sceneGraph.translate(chairNode, 10.0f, -0.2f, 15.0f);
+	sceneGraph.rotate(chairNode, 180.0f, 0.0f, 1.0f, 0.0f);
+	sceneGraph.bind(chairNode, 0, &chairRotation);
+	part = sceneGraph.add(chairNode, drawChairSeat);
+	sceneGraph.translate(part, 0.0f, 1.0f, 0.0f);  // Position the seat
+	sceneGraph.scale(part, 2.0f, 0.2f, 2.0f);      // Scale to form the seat
+	for (int i = 0; i < chairLegCount; i++) {
+		const ChairLeg& leg = chairLegs[i];
+		part = sceneGraph.add(chairNode, drawChairLeg);
+		sceneGraph.translate(part, leg.position[0], leg.position[1], leg.position[2]);
+		sceneGraph.scale(part, leg.scale[0], leg.scale[1], leg.scale[2]);
+		sceneGraph.rotate(part, -90, leg.axis[0], leg.axis[1], leg.axis[2]);
+	}
+}
+
+
 
 
+bool glutStarted = false;
+// Taken first thing in main(). Headless runs never call glutInit(), so
+// GLUT_ELAPSED_TIME has no program start to count from there.
+std::chrono::steady_clock::time_point programStart;
+
+int msSinceStart() {
+	return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - programStart).count();
+}
 
 void drawScoreboard(float x, float y, int z, char* text) {
+	TRACE_DRAW("drawScoreboard");
 	// Switch to orthographic projection for the text
-	glMatrixMode(GL_PROJECTION);
-	glPushMatrix();
-	glLoadIdentity();
-	gluOrtho2D(0, 800, 0, 600);
+	renderer->matrixMode(MATRIX_PROJECTION);
+	renderer->pushMatrix();
+	renderer->loadIdentity();
+	renderer->ortho2D(0, 800, 0, 600);
 
-	glMatrixMode(GL_MODELVIEW);
-	glPushMatrix();
-	glLoadIdentity();
+	renderer->matrixMode(MATRIX_MODELVIEW);
+	renderer->pushMatrix();
+	renderer->loadIdentity();
 
 	// Draw the "Score" label in fixed screen space
-	glColor3f(0.0f, 0.0f, 0.0f); // White text
+	renderer->color(0.0f, 0.0f, 0.0f); // White text
 	// Draw the actual score in fixed screen space
-	glRasterPos2f(x, y); // Adjust coordinates to place score below the label
 	char scoreText[50];
 	if (z >= 0) {
 		sprintf(scoreText, "%s: %d", text, z);
@@ -1039,16 +1099,14 @@ void drawScoreboard(float x, float y, int z, char* text) {
 	else {
 		sprintf(scoreText, "%s", text);
 	}
-	for (const char& c : scoreText) {
-		glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-	}
+	renderer->text(x, y, scoreText); // Adjust coordinates to place score below the label
 
 
 	// Restore previous projection and modelview matrices
-	glPopMatrix();
-	glMatrixMode(GL_PROJECTION);
-	glPopMatrix();
-	glMatrixMode(GL_MODELVIEW);
+	renderer->popMatrix();
+	renderer->matrixMode(MATRIX_PROJECTION);
+	renderer->popMatrix();
+	renderer->matrixMode(MATRIX_MODELVIEW);
 }
 
 // Function to handle game timer
@@ -1069,68 +1127,84 @@ float FlagScale = 1.0;
 bool flagScaleUp = true;
 float flagScaleSpeed = 0.05;
 
+constexpr float SHELF_PANEL_X = 0.6f; // Center of each side panel
+constexpr float SHELF_PANEL_THICKNESS = 0.1f;
+constexpr int ARROW_SHELVES = 3;
+constexpr int ARROW_COLUMNS = 4;
+
+// Four arrows standing on each shelf, 0.3 apart, tucked behind the front.
+constexpr Layout<ARROW_SHELVES * ARROW_COLUMNS> arrowGridLayout() {
+	Layout<ARROW_SHELVES * ARROW_COLUMNS> layout = {};
+	for (int shelf = 0; shelf < ARROW_SHELVES; shelf++) {
+		for (int column = 0; column < ARROW_COLUMNS; column++) {
+			layout.transforms[shelf * ARROW_COLUMNS + column] = translation(-0.5f + 0.3f * column, (shelf - 1) * 0.5f - 0.3f, 0.15f - 0.4f) *
+				scaling(0.3f, 0.3f, 0.3f);
+		}
+	}
+	return layout;
+}
+
+constexpr Layout<ARROW_SHELVES * ARROW_COLUMNS> arrowGrid = arrowGridLayout();
+
+constexpr bool arrowsBetweenPanels() {
+	for (int i = 0; i < arrowGrid.count; i++) {
+		float x = originX(arrowGrid.transforms[i]);
+		if (x <= -SHELF_PANEL_X + SHELF_PANEL_THICKNESS / 2.0f || x >= SHELF_PANEL_X - SHELF_PANEL_THICKNESS / 2.0f) return false;
+	}
+	return true;
+}
+static_assert(arrowsBetweenPanels(), "An arrow stands in or past a side panel");
+
 void drawArrowsHolder() {
-	glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
-	glPushMatrix();
-	glTranslatef(-10, 0.5, 5);
-	glRotatef(90, 0, 1, 0);
-	glScalef(FlagScale, FlagScale, FlagScale);
+	TRACE_DRAW("drawArrowsHolder");
+	renderer->pushAttrib();
+	renderer->pushMatrix();
+	renderer->translate(-10, 0.5, 5);
+	renderer->rotate(90, 0, 1, 0);
+	renderer->scale(FlagScale, FlagScale, FlagScale);
 	// Color for the shelf frame
-	glColor3f(0.5f, 0.35f, 0.05f);  // Brown
+	renderer->color(0.5f, 0.35f, 0.05f);  // Brown
 
 	// Side Panels
-	glPushMatrix();
-	glTranslatef(-0.6f, 0.0f, 0.0f); // Left side panel
-	glScalef(0.1f, 1.5f, 0.3f);
-	glutSolidCube(1.0f);
-	glPopMatrix();
-
-	glPushMatrix();
-	glTranslatef(0.6f, 0.0f, 0.0f); // Right side panel
-	glScalef(0.1f, 1.5f, 0.3f);
-	glutSolidCube(1.0f);
-	glPopMatrix();
+	renderer->pushMatrix();
+	renderer->translate(-SHELF_PANEL_X, 0.0f, 0.0f); // Left side panel
+	renderer->scale(SHELF_PANEL_THICKNESS, 1.5f, 0.3f);
+	solidCube(1.0f);
+	renderer->popMatrix();
+
+	renderer->pushMatrix();
+	renderer->translate(SHELF_PANEL_X, 0.0f, 0.0f); // Right side panel
+	renderer->scale(SHELF_PANEL_THICKNESS, 1.5f, 0.3f);
+	solidCube(1.0f);
+	renderer->popMatrix();
 
 	// Top and Bottom Panels
-	glPushMatrix();
-	glTranslatef(0.0f, 0.75f, 0.0f); // Top panel
-	glScalef(1.2f, 0.1f, 0.3f);
-	glutSolidCube(1.0f);
-	glPopMatrix();
-
-	glPushMatrix();
-	glTranslatef(0.0f, -0.75f, 0.0f); // Bottom panel
-	glScalef(1.2f, 0.1f, 0.3f);
-	glutSolidCube(1.0f);
-	glPopMatrix();
+	renderer->pushMatrix();
+	renderer->translate(0.0f, 0.75f, 0.0f); // Top panel
+	renderer->scale(1.2f, 0.1f, 0.3f);
+	solidCube(1.0f);
+	renderer->popMatrix();
+
+	renderer->pushMatrix();
+	renderer->translate(0.0f, -0.75f, 0.0f); // Bottom panel
+	renderer->scale(1.2f, 0.1f, 0.3f);
+	solidCube(1.0f);
+	renderer->popMatrix();
 
 	// Shelves
 	for (int i = -1; i <= 1; i++) {
-		glPushMatrix();
-		glTranslatef(0.0f, i * 0.5f, 0.0f); // Position each shelf
-		glScalef(1.2f, 0.1f, 0.3f);
-		glutSolidCube(1.0f);
-		glPopMatrix();
+		renderer->pushMatrix();
+		renderer->translate(0.0f, i * 0.5f, 0.0f); // Position each shelf
+		renderer->scale(1.2f, 0.1f, 0.3f);
+		solidCube(1.0f);
+		renderer->popMatrix();
 	}
 
 	// Arrows on shelves
-	for (int i = -1; i <= 1; i++) {
-		glPushMatrix();
-		glTranslatef(0.0f, i * 0.5f, 0.15f);  // Adjust to each shelf level
-
-		for (float j = -0.5f; j <= 0.5f; j += 0.3f) {
-			glPushMatrix();
-			glTranslatef(j, -0.3f, -0.4);
-			glScalef(0.3f, 0.3f, 0.3f);
-			drawArrow();
-			glPopMatrix();
-		}
-
-		glPopMatrix();
-	}
+	drawLayout(arrowGrid, [](int) { drawArrow(); });
 
-	glPopMatrix();
-	glPopAttrib();
+	renderer->popMatrix();
+	renderer->popAttrib();
 }
 
 
@@ -1148,48 +1222,304 @@ void animateArrowsHolder() {
 }
 
 void drawGameOver() {
-	glColor3f(1.0f, 0.0f, 0.0f);  // Set color to red
-	glRasterPos2f(300, 300);
+	TRACE_DRAW("drawGameOver");
+	renderer->color(1.0f, 0.0f, 0.0f);  // Set color to red
 
 	if (score < 3) {
 		drawScoreboard(300, 300, -1, "Game Over!");
-		engine2->play2D("media/lose.mp3", false);
+		playSound("media/lose.mp3");
 	}
 	else {
 		drawScoreboard(300, 300, -1, "Game End!");
-		engine2->play2D("media/win.mp3", false);
+		playSound("media/win.mp3");
 	}
 
-	glColor3f(1.0f, 1.0f, 1.0f);  // White color for score
+	renderer->color(1.0f, 1.0f, 1.0f);  // White color for score
 	char scoreText[50];
 	sprintf(scoreText, "Final Score: %d", score);
 	drawScoreboard(300, 400, -1, scoreText);
 
-	glColor3f(1.0f, 1.0f, 1.0f);  // Instructions
+	renderer->color(1.0f, 1.0f, 1.0f);  // Instructions
 	drawScoreboard(300, 500, -1, "Press R to restart!");
 }
 
 
 
-void Display() {
+// Moves the audio listener to the camera, once per tick.
+void updateListener() {
+	Vector3f eye = camera.eye(), look = camera.forward(), up = camera.up();
+	updateAudio3D(
+		irrklang::vec3df(eye.x, eye.y, eye.z),
+		irrklang::vec3df(look.x, look.y, look.z),
+		irrklang::vec3df(up.x, up.y, up.z)
+	);
+}
+
+int frameLoadMs = 0; // Extra busy work per frame, set with --frame-load <ms>
+bool firstFrameDrawn = false;
+SoftRenderer* softRenderer = 0; // Set with --cpu-raster
+bool useShaders = false; // Set with --shaders
+ShaderRenderer* shaderRenderer = 0; // The renderer when --shaders got its way
+
+// The renderer for the current GL context: the GLSL pipeline with --shaders,
+// unless the GL cannot run it, otherwise the fixed-function one. Comes back
+// initialised.
+Renderer* createGLRenderer() {
+	if (useShaders) {
+		shaderRenderer = new ShaderRenderer(glutStarted);
+		shaderRenderer->init();
+		if (shaderRenderer->isReady()) return shaderRenderer;
+		delete shaderRenderer;
+		shaderRenderer = 0;
+		printf("[shader] falling back to the fixed-function pipeline\n");
+	}
+	Renderer* glRenderer = new GLRenderer(glutStarted);
+	glRenderer->init();
+	return glRenderer;
+}
+
+const char* glTraceFile = 0; // Set with --gl-trace [file.csv]
+
+// Puts the GL call tracer in front of renderer when --gl-trace asked for it.
+void startTrace() {
+	if (!glTraceFile) return;
+#ifdef GL_TRACE
+	renderer = startGLTrace(renderer);
+#else
+	printf("[trace] this build has no GL tracing, build Debug or define GL_TRACE\n");
+#endif
+}
+
+// Reports and writes the trace, and takes the tracer back out.
+void stopTrace() {
+#ifdef GL_TRACE
+	if (glTraceFile) renderer = stopGLTrace(glTraceFile);
+#endif
+}
+
+// Copies the CPU rasterizer's image to the window. GL itself is left in its
+// default state in this mode, so identity matrices put (-1, -1) at the
+// bottom-left corner.
+void presentSoftFrame() {
+	glRasterPos2f(-1, -1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, softRenderer->getStride());
+	glDrawPixels(softRenderer->getWidth(), softRenderer->getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, softRenderer->getPixels());
+	glFlush();
+}
+
+void reshapeSoftFrame(int width, int height) {
+	glViewport(0, 0, width, height);
+	softRenderer->resize(width, height);
+}
+
+// World-space box around each culled object, covering every pose its
+// animation can take.
+void getObjectBounds(int object, float* boxMin, float* boxMax) {
+	float cx = 0, cy = 0, cz = 0;  // Center
+	float ex = 0, ey = 0, ez = 0;  // Half extents
+	switch (object) {
+	case OBJECT_PLAYER: {
+		// Any rotation about the player, and the arrow wherever it has flown.
+		float x0 = playerX < arrowX ? playerX : arrowX, x1 = playerX < arrowX ? arrowX : playerX;
+		float z0 = playerZ < arrowZ ? playerZ : arrowZ, z1 = playerZ < arrowZ ? arrowZ : playerZ;
+		cx = (x0 + x1) / 2; cy = 0.95f; cz = (z0 + z1) / 2;
+		ex = (x1 - x0) / 2 + 2.2f; ey = 2.25f; ez = (z1 - z0) / 2 + 2.2f;
+		break;
+	}
+	case OBJECT_FLAG:
+		cx = 0.0f; cy = 6.75f; cz = -3.95f;
+		ex = 2.1f; ey = 0.85f; ez = 0.05f;
+		break;
+	case OBJECT_TARGET: {
+		float scale = evaluateWave(TargetScale, timeElapsed);
+		cx = targetX; cy = targetY; cz = targetZ + TARGET_FACE_Z * scale;
+		ex = ey = targetRings[targetRingCount - 1].outerRadius * scale; ez = 0.01f * scale;
+		break;
+	}
+	case OBJECT_LAMP:
+		cx = -5.0f; cy = sphereY - 0.75f; cz = 21.35f;
+		ex = 1.5f; ey = 2.75f; ez = 1.65f;
+		break;
+	case OBJECT_PODIUM:
+		cx = -5.0f; cy = 0.5f; cz = 15.0f;
+		ex = 3.0f; ey = 1.5f; ez = 1.0f;
+		break;
+	case OBJECT_CHAIR:
+		cx = 10.0f; cy = 1.8f; cz = 15.0f;
+		ex = 1.42f; ey = 3.0f; ez = 1.42f;
+		break;
+	case OBJECT_TABLE:
+		cx = 10.0f; cy = -0.58f; cz = 10.0f;
+		ex = 1.7f; ey = 0.62f; ez = 1.7f;
+		break;
+	case OBJECT_ARROWS_HOLDER:
+		cx = -10.0f + 0.125f * FlagScale; cy = 0.5f; cz = 5.0f;
+		ex = 0.275f * FlagScale; ey = 0.8f * FlagScale; ez = 0.65f * FlagScale;
+		break;
+	default: // Stress lamp
+		cx = -5.0f + stressLampOffsets[object - OBJECT_COUNT][0]; cy = sphereY - 0.75f;
+		cz = 21.35f + stressLampOffsets[object - OBJECT_COUNT][1];
+		ex = 1.5f; ey = 2.75f; ez = 1.65f;
+		break;
+	}
+	boxMin[0] = cx - ex; boxMin[1] = cy - ey; boxMin[2] = cz - ez;
+	boxMax[0] = cx + ex; boxMax[1] = cy + ey; boxMax[2] = cz + ez;
+}
+
+#define OCCLUSION_WIDTH 160
+#define OCCLUSION_HEIGHT 120
+SoftRenderer* occlusionBuffer = 0; // Set with --occlusion-cull
+
+int cullFrames = 0;
+long long cullTested = 0, cullOutside = 0, cullOccluded = 0;
+double cullMs = 0;
+
+// Draws the walls and the podium into a small depth-only view on the CPU and
+// marks every object whose box is outside the view or behind them.
+void cullScene() {
+	auto start = std::chrono::steady_clock::now();
+	Renderer* target = renderer;
+	renderer = occlusionBuffer;
 	setupCamera();
-	setupLights();
+	renderer->clear();
+	drawRoomWalls();
+	drawOlympicPodium();
+	renderer->flush();
+	renderer = target;
+
+	int count = OBJECT_COUNT + stressLampCount;
+	for (int i = 0; i < count; i++) {
+		float boxMin[3], boxMax[3];
+		getObjectBounds(i, boxMin, boxMax);
+		// The bounding sphere against the camera's cached frustum rejects most
+		// objects out of view before their corners are projected.
+		Vector3f low(boxMin[0], boxMin[1], boxMin[2]), high(boxMax[0], boxMax[1], boxMax[2]);
+		BoxTest result = BOX_OUTSIDE_VIEW;
+		if (camera.isSphereVisible((low + high) * 0.5f, (high - low).length() * 0.5f)) {
+			result = occlusionBuffer->testBox(boxMin, boxMax);
+		}
+		objectCulled[i] = result != BOX_VISIBLE;
+		if (result == BOX_OUTSIDE_VIEW) cullOutside++;
+		if (result == BOX_OCCLUDED) cullOccluded++;
+	}
+	cullTested += count;
+	cullFrames++;
+	cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	if (!isOver) {
-		glPushMatrix();
+void resetCullStats() {
+	cullFrames = 0;
+	cullTested = cullOutside = cullOccluded = 0;
+	cullMs = 0;
+}
 
-		drawPlayer(0.0f, 1.0f, 0.0f); // Position the player
-		drawRoom();
+void drawPlayerLayer() {
+	if (!objectCulled[OBJECT_PLAYER]) drawPlayer();
+}
+
+void drawPropsLayer() {
+	if (!objectCulled[OBJECT_LAMP]) drawLamp();
+	if (!objectCulled[OBJECT_PODIUM]) drawOlympicPodium();
+	if (!objectCulled[OBJECT_CHAIR]) drawChair();
+	if (!objectCulled[OBJECT_TABLE]) drawTable();
+	if (!objectCulled[OBJECT_ARROWS_HOLDER]) drawArrowsHolder();
+	for (int i = 0; i < stressLampCount; i++) {
+		if (objectCulled[OBJECT_COUNT + i]) continue;
+		renderer->pushMatrix();
+		renderer->translate(stressLampOffsets[i][0], 0.0f, stressLampOffsets[i][1]);
 		drawLamp();
-		drawOlympicPodium();
-		drawChair();
-		drawTable(0.6, 0.02, 0.02, 0.3);
-		drawScoreboard(80, 550, score, "Score");
-		drawScoreboard(80, 520, timer, "Time");
-		drawArrowsHolder();
-		glPopMatrix();
-		updateLegs();
+		renderer->popMatrix();
+	}
+}
+
+void drawCrowdLayer() {
+	if (!crowd) return;
+	TRACE_DRAW("drawCrowd");
+	crowd->draw();
+}
+
+void drawHudLayer() {
+	drawScoreboard(80, 550, score, "Score");
+	drawScoreboard(80, 520, timer, "Time");
+}
+
+// The scene, in drawing order. With --parallel-record each layer is recorded
+// on a worker thread; the draw functions only read game state, so they are
+// safe to run side by side while the GL thread waits. The HUD is drawn on
+// its own after them, at the window's resolution whatever the scene's.
+void (*const drawLayers[])() = { drawPlayerLayer, drawRoom, drawPropsLayer, drawCrowdLayer };
+const int drawLayerCount = sizeof(drawLayers) / sizeof(drawLayers[0]);
+
+bool profilerOverlay = false; // Toggled with 'p'; on from the start with --profile-overlay
+const char* profileFile = 0;  // Set with --profile [file.json]
+
+void writeProfile() {
+	if (profileFile) writeChromeTrace(profileFile);
+}
+
+// --dynamic-res [min [max]] scales the scene between min and max of the
+// window's resolution to keep it under dynamicResTargetMs.
+bool dynamicRes = false;
+float dynamicResMin = 0.5f, dynamicResMax = 1.0f;
+float dynamicResTargetMs = 16.7f; // Set with --dynamic-res-target ms
+
+// The flight recorder is on in the windowed game unless --no-flight-recorder
+// is given; headless runs and benchmarks only get it with --flight-budget.
+#define FLIGHT_BUDGET_MS 33.3f // Two frames at 60 Hz
+bool flightRecorder = true;
+float flightBudgetMs = 0;          // Set with --flight-budget ms
+const char* flightDirectory = "."; // Set with --flight-dir
+
+#define RECORD_REPORT_FRAMES 300
+CommandRecorder* commandRecorder = 0; // Set with --parallel-record
+
+void printRecordStats() {
+	CommandRecorderStats stats = commandRecorder->getStats();
+	if (stats.frames == 0) return;
+	printf("[record] %d frames on %d threads: record %.3f ms, submit %.3f ms, %d commands per frame\n",
+		stats.frames, commandRecorder->getThreadCount(), stats.recordMs, stats.submitMs, stats.commands);
+	commandRecorder->resetStats();
+}
+
+void Display() {
+	beginFlightFrame();
+	PROFILE_ZONE("Display");
+	{
+		PROFILE_ZONE("setup");
+		renderer->setTime(timeElapsed);
+		setupCamera();
+		setupLights();
+		beginDynamicResolution();
+		renderer->clear();
+	}
+	if (!isOver) {
+		{
+			PROFILE_ZONE("scene graph");
+			sceneGraph.update();
+		}
+		// Culled on its worker while the layers before it are drawn.
+		if (crowd) crowd->beginFrame(camera, timeElapsed * ANIMATION_TIME_SECONDS);
+		if (occlusionBuffer) {
+			PROFILE_ZONE("cull");
+			cullScene();
+		}
+		{
+			PROFILE_ZONE("draw");
+			renderer->pushMatrix();
+			if (commandRecorder) {
+				commandRecorder->record(drawLayers, drawLayerCount);
+				commandRecorder->submit(renderer);
+				if (commandRecorder->getStats().frames >= RECORD_REPORT_FRAMES) printRecordStats();
+			}
+			else {
+				for (int i = 0; i < drawLayerCount; i++) drawLayers[i]();
+			}
+			renderer->popMatrix();
+			endDynamicResolution();
+			drawHudLayer();
+		}
+		PROFILE_ZONE("animate");
+		updateAnimation();
 		ShootArrow();
 		animateLamp();
 		animateChair();
@@ -1198,10 +1528,34 @@ void Display() {
 		updateTime();
 	}
 	else {
+		PROFILE_ZONE("draw");
+		endDynamicResolution(); // The game over text is HUD, drawn at full resolution
 		drawGameOver();
 	}
+	{
+		PROFILE_ZONE("listener");
+		updateListener();
+	}
+	if (profilerOverlay) drawProfilerOverlay(800, 600);
 
-	glFlush();
+	{
+		PROFILE_ZONE("flush");
+		renderer->flush();
+		if (softRenderer) presentSoftFrame();
+	}
+
+	if (frameLoadMs > 0) {
+		PROFILE_ZONE("frame load");
+		int loadStart = glutGet(GLUT_ELAPSED_TIME);
+		while (glutGet(GLUT_ELAPSED_TIME) - loadStart < frameLoadMs) {
+		}
+	}
+	if (!firstFrameDrawn) {
+		firstFrameDrawn = true;
+		printf("[startup] first frame after %d ms\n", msSinceStart());
+	}
+	profileFrame();
+	endFlightFrame();
 }
 
 
@@ -1221,6 +1575,8 @@ void toggleFullscreen() {
 }
 
 void Keyboard(unsigned char key, int x, int y) {
+	PROFILE_ZONE("Keyboard");
+	profileMark("key", key);
 	float d = 0.01;
 	float a = 1.0;
 
@@ -1260,29 +1616,26 @@ void Keyboard(unsigned char key, int x, int y) {
 		toggleFullscreen();
 		break;
 	case '1': // Top View
-		camera.eye = TOP_VIEW_EYE;
-		camera.center = TOP_VIEW_CENTER;
-		camera.up = TOP_VIEW_UP;
+		camera.lookAt(TOP_VIEW_EYE, TOP_VIEW_CENTER, TOP_VIEW_UP);
 		break;
 	case '2': // Side View
-		camera.eye = SIDE_VIEW_EYE;
-		camera.center = SIDE_VIEW_CENTER;
-		camera.up = SIDE_VIEW_UP;
+		camera.lookAt(SIDE_VIEW_EYE, SIDE_VIEW_CENTER, SIDE_VIEW_UP);
 		break;
 	case '3': // Front View
-		camera.eye = FRONT_VIEW_EYE;
-		camera.center = FRONT_VIEW_CENTER;
-		camera.up = FRONT_VIEW_UP;
+		camera.lookAt(FRONT_VIEW_EYE, FRONT_VIEW_CENTER, FRONT_VIEW_UP);
 		break;
 	case ' ':
-		if (!isShoot) engine2->play2D("media/shootSound.mp3", false);
+		if (!isShoot) {
+			markAudioEvent();
+			arrowSound = playSound3D("media/shootSound.mp3", arrowX, arrowHeight, arrowZ, true);
+		}
 		isShoot = true;
 		break;
 	case '5':
 		bounce = !bounce;
 		break;
 	case '6':
-		changePodColor = !changePodColor;
+		togglePodColor();
 		break;
 	case '7':
 		rotateChair = !rotateChair;
@@ -1300,6 +1653,10 @@ void Keyboard(unsigned char key, int x, int y) {
 			isOver = false;
 		}
 		break;
+	case 'p':
+		profilerOverlay = !profilerOverlay;
+		if (profilerOverlay) startProfiler();
+		break;
 	case GLUT_KEY_ESCAPE:
 		exit(EXIT_SUCCESS);
 	}
@@ -1307,6 +1664,8 @@ void Keyboard(unsigned char key, int x, int y) {
 	glutPostRedisplay();
 }
 void Special(int key, int x, int y) {
+	PROFILE_ZONE("Special");
+	profileMark("special key", key);
 	float rad = -rotationAngle * 3.14 / 180.0f; // Convert angle to radians for movement
 	isWalking = false;
 	// Define tentative new positions
@@ -1364,6 +1723,8 @@ void Special(int key, int x, int y) {
 }
 
 void SpecialUp(int key, int x, int y) {
+	PROFILE_ZONE("SpecialUp");
+	profileMark("special key up", key);
 	isWalking = false;
 	glutPostRedisplay();
 }
@@ -1387,6 +1748,8 @@ bool rightDoubleClickDetected = false; // Flag for right double-click
 
 // Function to handle mouse button events (press/release)
 void mouseButton(int button, int state, int x, int y) {
+	PROFILE_ZONE("mouseButton");
+	profileMark(state == GLUT_DOWN ? "mouse down" : "mouse up", button);
 	if (button == GLUT_LEFT_BUTTON) {
 		if (state == GLUT_DOWN) {
 			leftButtonPressed = true; // Start dragging
@@ -1441,6 +1804,7 @@ void mouseButton(int button, int state, int x, int y) {
 
 // Function to handle mouse dragging (moving while holding the left button)
 void mouseDrag(int x, int y) {
+	PROFILE_ZONE("mouseDrag");
 	if (leftButtonPressed) {
 		float xoffset = x - lastX;
 		rotationAngle -= xoffset * rotateSpeed;
@@ -1489,8 +1853,428 @@ void mouseDrag(int x, int y) {
 
 
 
-void main(int argc, char** argv) {
+// Short effects, preloaded at startup. --bake-pcm decodes them and
+// MUSIC_FILE to .pcm files, so they play without any MP3 decoding and the
+// music can be streamed a chunk at a time.
+const char* effectFiles[] = {
+	"media/HitSound.mp3",
+	"media/shootSound.mp3",
+	"media/win.mp3",
+	"media/lose.mp3",
+};
+const int effectFileCount = sizeof(effectFiles) / sizeof(effectFiles[0]);
+
+// Files that go into the asset pack, under the same names the game loads them by.
+// Run --bake-pcm before --pack so the baked effects are included.
+const char* assetFiles[] = {
+	"media/main.mp3",
+	"media/HitSound.mp3",
+	"media/shootSound.mp3",
+	"media/win.mp3",
+	"media/lose.mp3",
+	"media/HitSound.pcm",
+	"media/shootSound.pcm",
+	"media/win.pcm",
+	"media/lose.pcm",
+	"media/main.pcm",
+};
+const int assetFileCount = sizeof(assetFiles) / sizeof(assetFiles[0]);
+
+bool setCameraView(const char* view) {
+	if (strcmp(view, "top") == 0) {
+		camera.lookAt(TOP_VIEW_EYE, TOP_VIEW_CENTER, TOP_VIEW_UP);
+	}
+	else if (strcmp(view, "side") == 0) {
+		camera.lookAt(SIDE_VIEW_EYE, SIDE_VIEW_CENTER, SIDE_VIEW_UP);
+	}
+	else if (strcmp(view, "front") == 0) {
+		camera.lookAt(FRONT_VIEW_EYE, FRONT_VIEW_CENTER, FRONT_VIEW_UP);
+	}
+	else if (strcmp(view, "stands") == 0) {
+		camera.lookAt(STANDS_VIEW_EYE, STANDS_VIEW_CENTER, STANDS_VIEW_UP);
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+// --headless [frames] [--size WxH] [--camera top|side|front|stands] [--out prefix|-]
+// Renders without a window or audio and writes <prefix>_NNNN.ppm per frame.
+// On Linux, with freeglut, GLU, EGL and irrKlang's libIrrKlang.so installed,
+// from the repository root:
+//   g++ -std=c++14 -O2 -I. -Iexternals/includes *.cpp -o archery -lglut -lGLU -lGL -lEGL -lpthread -lIrrKlang
+bool runHeadless(int argc, char** argv) {
+	int frames = 1, width = 640, height = 480;
+	const char* view = "top";
+	const char* outPrefix = "frame";
+	for (int i = 1; i < argc - 1; i++) {
+		if (strcmp(argv[i], "--headless") == 0 && atoi(argv[i + 1]) > 0) {
+			frames = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--size") == 0) {
+			sscanf(argv[i + 1], "%dx%d", &width, &height);
+		}
+		else if (strcmp(argv[i], "--camera") == 0) {
+			view = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--out") == 0) {
+			outPrefix = strcmp(argv[i + 1], "-") == 0 ? 0 : argv[i + 1];
+		}
+	}
+	if (!setCameraView(view)) {
+		printf("[headless] unknown camera %s, use top, side, front or stands\n", view);
+		return false;
+	}
+	if (width <= 0 || height <= 0) {
+		printf("[headless] bad size %dx%d\n", width, height);
+		return false;
+	}
+
+#ifdef _WIN32
+	glutInit(&argc, argv); // GLUT 3.7 needs no display for this; its hidden window hosts the context
+	glutStarted = true;
+#endif
+	if (!createOffscreenContext(width, height)) return false;
+	renderer = createGLRenderer();
+	startTrace();
+	if (flightBudgetMs > 0) startFlightRecorder(flightBudgetMs, flightDirectory);
+	if (dynamicRes) startDynamicResolution(dynamicResMin, dynamicResMax, dynamicResTargetMs);
+	renderOffscreen(Display, frames, outPrefix);
+	if (isDynamicResolutionEnabled()) printDynamicResolutionStats();
+	stopDynamicResolution();
+	stopFlightRecorder();
+	stopTrace();
+	writeProfile();
+	if (commandRecorder) printRecordStats();
+	if (shaderRenderer) {
+		ShaderRendererStats stats = shaderRenderer->getStats();
+		printf("[shader] %d frames: %d draws, %d transform, %d lighting and %d time block uploads\n",
+			frames, stats.draws, stats.transformUploads, stats.lightingUploads, stats.timeUploads);
+	}
+	delete renderer;
+	renderer = 0;
+	shaderRenderer = 0;
+	destroyOffscreenContext();
+	return true;
+}
+
+// Draws frames with display and returns the average frames per second. GL
+// work is waited for so both backends are timed to a finished image.
+double timeFrames(int frames, bool finishGL) {
+	auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++) {
+		Display();
+		if (finishGL) glFinish();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return frames / seconds;
+}
+
+// Draws frames and returns the average milliseconds per frame, GL work included.
+double timeFrameMs(int frames) {
+	auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++) {
+		Display();
+		glFinish();
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+}
+
+// --bench-occlusion [frames] [--stress <count>]
+// For each camera preset, reports how many objects occlusion culling skips
+// and the frame time with it off and on, on the offscreen GL context.
+void runOcclusionBenchmark(int argc, char** argv, int frames) {
+	static const char* views[] = { "top", "side", "front" };
+#ifdef _WIN32
+	glutInit(&argc, argv);
+	glutStarted = true;
+#else
+	(void)argc;
+	(void)argv;
+#endif
+	if (!createOffscreenContext(640, 480)) return;
+	GLRenderer glRenderer(glutStarted);
+	renderer = &glRenderer;
+	renderer->init();
+	SoftRenderer culler(OCCLUSION_WIDTH, OCCLUSION_HEIGHT, 1);
+	printf("[occlusion] %d objects, %d of them stress lamps, %d frames per run\n",
+		OBJECT_COUNT + stressLampCount, stressLampCount, frames);
+
+	for (int i = 0; i < 3; i++) {
+		setCameraView(views[i]);
+		occlusionBuffer = 0;
+		for (int j = 0; j < OBJECT_COUNT + MAX_STRESS_LAMPS; j++) objectCulled[j] = false;
+		timer = 60; // Keep the game clock from ending the run
+		Display();
+		glFinish();
+		double offMs = timeFrameMs(frames);
+
+		occlusionBuffer = &culler;
+		timer = 60;
+		Display();
+		glFinish();
+		resetCullStats();
+		double onMs = timeFrameMs(frames);
+		printf("[occlusion] %-5s %5.1f%% culled (%.1f%% outside the view, %.1f%% occluded): %.3f ms/frame off, %.3f ms/frame on (culling %.3f ms)\n",
+			views[i], 100.0 * (cullOutside + cullOccluded) / cullTested, 100.0 * cullOutside / cullTested,
+			100.0 * cullOccluded / cullTested, offMs, onMs, cullMs / cullFrames);
+	}
+	occlusionBuffer = 0;
+	renderer = 0;
+	destroyOffscreenContext();
+}
+
+// --bench-crowd [frames]
+// For each camera preset and the view from the stands, the frame time of the hall alone and with 1k, 10k
+// and 50k spectators on the offscreen GL context, against a 60 Hz frame,
+// and where the crowd's share of it goes. With --shaders, the crowd is
+// drawn with instanced draws.
+#define CROWD_BUDGET_MS 16.7f
+
+void runCrowdBenchmark(int argc, char** argv, int frames) {
+	static const char* views[] = { "top", "side", "front", "stands" };
+	static const int sizes[] = { 1000, 10000, 50000 };
+#ifdef _WIN32
 	glutInit(&argc, argv);
+	glutStarted = true;
+#else
+	(void)argc;
+	(void)argv;
+#endif
+	if (!createOffscreenContext(640, 480)) return;
+	renderer = createGLRenderer();
+	Crowd* crowds[3];
+	for (int i = 0; i < 3; i++) crowds[i] = buildCrowd(sizes[i]);
+	printf("[crowd] %d frames per run, %d poses, meshes within %.0f units, at most %d\n",
+		frames, crowds[0]->getPoseCount(), CROWD_NEAR_DISTANCE, CROWD_MAX_MESHES);
+
+	for (int v = 0; v < 4; v++) {
+		setCameraView(views[v]);
+		crowd = 0;
+		timer = 60; // Keep the game clock from ending the run
+		Display();
+		glFinish();
+		double hallMs = timeFrameMs(frames);
+		printf("[crowd] %-6s hall alone: %.3f ms/frame\n", views[v], hallMs);
+		for (int i = 0; i < 3; i++) {
+			crowd = crowds[i];
+			timer = 60;
+			Display();
+			glFinish();
+			crowd->resetStats();
+			double frameMs = timeFrameMs(frames);
+			CrowdStats stats = crowd->getStats();
+			printf("[crowd] %-6s %5d spectators: %.3f ms/frame, %.0f%% of %.1f ms; %d visible, %d meshes (%.3f ms), "
+				"%d impostors (%.3f ms), cull %.3f ms on the worker, %.3f ms waited for it\n",
+				views[v], crowd->size(), frameMs, 100.0 * frameMs / CROWD_BUDGET_MS, CROWD_BUDGET_MS, stats.visible,
+				stats.meshes, stats.meshMs, stats.impostors, stats.impostorMs, stats.cullMs, stats.waitMs);
+		}
+	}
+	crowd = 0;
+	for (int i = 0; i < 3; i++) delete crowds[i];
+	delete renderer;
+	renderer = 0;
+	shaderRenderer = 0;
+	destroyOffscreenContext();
+}
+
+// --bench-raster [frames]
+// Times the scene on the GL driver (llvmpipe when there is no GPU) against the
+// CPU rasterizer at 640x480 and 1920x1080.
+void runRasterBenchmark(int argc, char** argv, int frames) {
+	static const int sizes[][2] = { { 640, 480 }, { 1920, 1080 } };
+	setCameraView("top");
+#ifdef _WIN32
+	glutInit(&argc, argv);
+	glutStarted = true;
+#else
+	(void)argc;
+	(void)argv;
+#endif
+	for (int i = 0; i < 2; i++) {
+		int width = sizes[i][0], height = sizes[i][1];
+		if (createOffscreenContext(width, height)) {
+			GLRenderer glRenderer(glutStarted);
+			renderer = &glRenderer;
+			renderer->init();
+			Display(); // Warm-up: first-use allocations in the driver
+			glFinish();
+			double fps = timeFrames(frames, true);
+			printf("[bench] %dx%d %s: %.1f fps\n", width, height, (const char*)glGetString(GL_RENDERER), fps);
+			renderer = 0;
+			destroyOffscreenContext();
+		}
+
+		SoftRenderer cpuRenderer(width, height);
+		renderer = &cpuRenderer;
+		Display();
+		double fps = timeFrames(frames, false);
+		printf("[bench] %dx%d cpu raster, %d threads: %.1f fps\n", width, height, cpuRenderer.getThreadCount(), fps);
+		renderer = 0;
+	}
+}
+
+// --bench-matrix [blocks]
+void runMatrixBenchmark(int argc, char** argv, int blocks) {
+#ifdef _WIN32
+	glutInit(&argc, argv);
+	glutStarted = true;
+#else
+	(void)argc;
+	(void)argv;
+#endif
+	if (!createOffscreenContext(64, 64)) return;
+	benchmarkMatrixStack(blocks);
+	destroyOffscreenContext();
+}
+
+int main(int argc, char** argv) {
+	programStart = std::chrono::steady_clock::now();
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--parallel-record") == 0) {
+			commandRecorder = new CommandRecorder(); // Layers are recorded on workers, then submitted here
+		}
+		if (strcmp(argv[i], "--profile") == 0) {
+			profileFile = i + 1 < argc && argv[i + 1][0] != '-' ? argv[i + 1] : "profile.json";
+		}
+		if (strcmp(argv[i], "--profile-overlay") == 0) {
+			profilerOverlay = true;
+		}
+		if (strcmp(argv[i], "--dynamic-res") == 0) {
+			dynamicRes = true;
+			if (i + 1 < argc && atof(argv[i + 1]) > 0) dynamicResMin = (float)atof(argv[i + 1]);
+			if (i + 2 < argc && atof(argv[i + 1]) > 0 && atof(argv[i + 2]) > 0) dynamicResMax = (float)atof(argv[i + 2]);
+		}
+		if (strcmp(argv[i], "--dynamic-res-target") == 0 && i + 1 < argc) {
+			dynamicResTargetMs = (float)atof(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "--no-flight-recorder") == 0) {
+			flightRecorder = false;
+		}
+		if (strcmp(argv[i], "--flight-budget") == 0 && i + 1 < argc) {
+			flightBudgetMs = (float)atof(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "--flight-dir") == 0 && i + 1 < argc) {
+			flightDirectory = argv[i + 1];
+		}
+		if (strcmp(argv[i], "--gl-trace") == 0) {
+			glTraceFile = i + 1 < argc && argv[i + 1][0] != '-' ? argv[i + 1] : "gltrace.csv";
+		}
+		if (strcmp(argv[i], "--shaders") == 0) {
+			useShaders = true; // GLSL 3.3 with per-pixel lighting instead of fixed function
+		}
+		if (strcmp(argv[i], "--occlusion-cull") == 0) {
+			occlusionBuffer = new SoftRenderer(OCCLUSION_WIDTH, OCCLUSION_HEIGHT, 1);
+		}
+		if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc) {
+			setupStressScene(atoi(argv[i + 1]));
+		}
+		if (strcmp(argv[i], "--crowd") == 0 && i + 1 < argc) {
+			crowdSize = atoi(argv[i + 1]);
+		}
+	}
+
+	buildSceneGraph();
+	if (crowdSize > 0) crowd = buildCrowd(crowdSize);
+	setProfileThreadName("main");
+	if (profileFile || profilerOverlay) startProfiler();
+
+	// Offline steps run before GLUT and exit.
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bake-pcm") == 0) {
+			const char* music = MUSIC_FILE;
+			bool baked = bakePcmAssets(effectFiles, effectFileCount);
+			exit(bakePcmAssets(&music, 1) && baked ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		if (strcmp(argv[i], "--bench-music") == 0) {
+			int seconds = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			int loadMs = 0;
+			for (int j = 1; j < argc - 1; j++) {
+				if (strcmp(argv[j], "--frame-load") == 0) loadMs = atoi(argv[j + 1]);
+			}
+			bool packed = openAssetPack(ASSET_PACK_FILE); // Streams from the mapping when the track is packed
+			benchmarkMusicStream(seconds > 0 ? seconds : 10, loadMs);
+			if (packed) closeAssetPack();
+			exit(EXIT_SUCCESS);
+		}
+		if (strcmp(argv[i], "--pack") == 0) {
+			exit(writeAssetPack(ASSET_PACK_FILE, assetFiles, assetFileCount) ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		if (strcmp(argv[i], "--bench-assets") == 0) {
+			int passes = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			benchmarkAssetLoading(ASSET_PACK_FILE, assetFiles, assetFileCount, passes > 0 ? passes : 10);
+			exit(EXIT_SUCCESS);
+		}
+		if (strcmp(argv[i], "--headless") == 0) {
+			exit(runHeadless(argc, argv) ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		if (strcmp(argv[i], "--bench-occlusion") == 0) {
+			int frames = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			runOcclusionBenchmark(argc, argv, frames > 0 ? frames : 100);
+			exit(EXIT_SUCCESS);
+		}
+		if (strcmp(argv[i], "--bench-profiler") == 0) {
+			int zones = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			benchmarkProfiler(zones > 0 ? zones : 10000000);
+			exit(EXIT_SUCCESS);
+		}
+		if (strcmp(argv[i], "--bench-scene-graph") == 0) {
+			int nodes = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			benchmarkSceneGraph(nodes > 0 ? nodes : 10000);
+			exit(EXIT_SUCCESS);
+		}
+		if (strcmp(argv[i], "--bench-animation") == 0) {
+			int archers = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			benchmarkAnimation(archers > 0 ? archers : 10000);
+			exit(EXIT_SUCCESS);
+		}
+		if (strcmp(argv[i], "--bench-matrix") == 0) {
+			int blocks = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			runMatrixBenchmark(argc, argv, blocks > 0 ? blocks : 100000);
+			exit(EXIT_SUCCESS);
+		}
+		if (strcmp(argv[i], "--bench-vectors") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			benchmarkVectorBatch(count > 0 ? count : 4096);
+			exit(EXIT_SUCCESS);
+		}
+		if (strcmp(argv[i], "--camera-drift") == 0) {
+			int rotations = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			exit(checkCameraDrift(rotations > 0 ? rotations : 1000000) ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		if (strcmp(argv[i], "--bench-crowd") == 0) {
+			int frames = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			runCrowdBenchmark(argc, argv, frames > 0 ? frames : 50);
+			exit(EXIT_SUCCESS);
+		}
+		if (strcmp(argv[i], "--bench-raster") == 0) {
+			int frames = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			runRasterBenchmark(argc, argv, frames > 0 ? frames : 100);
+			exit(EXIT_SUCCESS);
+		}
+	}
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--audio-latency") == 0) {
+			enableAudioLatencyCapture(); // Histogram is printed when the game exits
+		}
+	}
+
+	// Without a pack, sounds are read from the loose files under media/.
+	if (openAssetPack(ASSET_PACK_FILE)) {
+		atexit(closeAssetPack); // Registered first so it runs after stopAudio
+	}
+	startAudio(effectFiles, effectFileCount); // Opens the sound device and music stream on its own thread
+	atexit(stopAudio);
+
+	glutInit(&argc, argv);
+	glutStarted = true;
+	for (int i = 1; i < argc - 1; i++) {
+		if (strcmp(argv[i], "--frame-load") == 0) {
+			frameLoadMs = atoi(argv[i + 1]);
+		}
+	}
 
 	glutInitWindowSize(640, 480);
 	glutInitWindowPosition(50, 50);
@@ -1504,31 +2288,36 @@ void main(int argc, char** argv) {
 	glutMotionFunc(mouseDrag);
 
 	glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB | GLUT_DEPTH);
-	glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
-
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_LIGHTING);
-	glEnable(GL_LIGHT0);
-	glEnable(GL_NORMALIZE);
-	glEnable(GL_COLOR_MATERIAL);
-
-	glShadeModel(GL_SMOOTH);
-	glutFullScreen();
-	updateWallColor(0);
-
-	irrklang::ISoundEngine* engine = irrklang::createIrrKlangDevice();
-	if (!engine) {
-		return;
+	bool cpuRaster = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--cpu-raster") == 0) {
+			cpuRaster = true; // Draw on the CPU and only blit through GL
+		}
 	}
-	engine->setSoundVolume(0.07f);
-	irrklang::ISound* sound = engine->play2D("media/main.mp3", true);
-
+	if (cpuRaster) {
+		softRenderer = new SoftRenderer(640, 480);
+		renderer = softRenderer;
+		glutReshapeFunc(reshapeSoftFrame);
+		renderer->init();
+	}
+	else {
+		renderer = createGLRenderer();
+		if (dynamicRes && startDynamicResolution(dynamicResMin, dynamicResMax, dynamicResTargetMs)) {
+			atexit(printDynamicResolutionStats);
+		}
+	}
+	startTrace();
+	atexit(stopTrace);
+	atexit(writeProfile);
+	if (flightRecorder) {
+		startFlightRecorder(flightBudgetMs > 0 ? flightBudgetMs : FLIGHT_BUDGET_MS, flightDirectory);
+		atexit(stopFlightRecorder);
+	}
+	glutFullScreen();
+	updateAnimationTime(0);
 
-	camera.eye = TOP_VIEW_EYE;
-	camera.center = TOP_VIEW_CENTER;
-	camera.up = TOP_VIEW_UP;
-	glutMainLoop();
 
-	engine->drop();// Enter the GLUT event processing loop
-	engine2->drop();
+	camera.lookAt(TOP_VIEW_EYE, TOP_VIEW_CENTER, TOP_VIEW_UP);
+	glutMainLoop(); // Enter the GLUT event processing loop
+	return 0;
 }
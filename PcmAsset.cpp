@@ -0,0 +1,145 @@
+#include "PcmAsset.h"
+#include "AssetPack.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace irrklang;
+
+void pcmNameFor(const char* fileName, char* out, int outSize) {
+	const char* dot = strrchr(fileName, '.');
+	const char* slash = strrchr(fileName, '/');
+	int stem = (dot && (!slash || dot > slash)) ? (int)(dot - fileName) : (int)strlen(fileName);
+	snprintf(out, outSize, "%.*s.pcm", stem, fileName);
+}
+
+bool readPcmHeader(const unsigned char* data, unsigned int size, SAudioStreamFormat& format) {
+	if (size < sizeof(PcmHeader)) return false;
+	PcmHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, "PCM1", 4) != 0) return false;
+	format.ChannelCount = header.channelCount;
+	format.SampleRate = header.sampleRate;
+	format.FrameCount = header.frameCount;
+	format.SampleFormat = (ESampleFormat)header.sampleFormat;
+	return format.ChannelCount > 0 && format.FrameCount >= 0
+		&& (unsigned int)format.getSampleDataSize() <= size - sizeof(PcmHeader);
+}
+
+class PcmStream : public IAudioStream {
+public:
+	// owned is deleted with the stream; it is 0 when samples point into the asset pack.
+	PcmStream(const unsigned char* samples, SAudioStreamFormat format, unsigned char* owned)
+		: samples(samples), format(format), owned(owned), pos(0) {
+	}
+
+	~PcmStream() {
+		delete[] owned;
+	}
+
+	SAudioStreamFormat getFormat() {
+		return format;
+	}
+
+	bool setPosition(ik_s32 pos) {
+		if (pos < 0 || pos > format.FrameCount) return false;
+		this->pos = pos;
+		return true;
+	}
+
+	ik_s32 readFrames(void* target, ik_s32 frameCountToRead) {
+		int n = format.FrameCount - pos;
+		if (frameCountToRead < n) n = frameCountToRead;
+		int frameSize = format.getFrameSize();
+		memcpy(target, samples + pos * frameSize, n * frameSize);
+		pos += n;
+		return n;
+	}
+
+private:
+	const unsigned char* samples;
+	SAudioStreamFormat format;
+	unsigned char* owned;
+	int pos;
+};
+
+class PcmStreamLoader : public IAudioStreamLoader {
+public:
+	bool isALoadableFileExtension(const ik_c8* fileName) {
+		const char* ext = strrchr(fileName, '.');
+		return ext && strcmp(ext, ".pcm") == 0;
+	}
+
+	IAudioStream* createAudioStream(IFileReader* file) {
+		SAudioStreamFormat format;
+		unsigned int size = 0;
+		const unsigned char* data = findAsset(file->getFileName(), &size);
+		if (data) {
+			if (!readPcmHeader(data, size, format)) return 0;
+			return new PcmStream(data + sizeof(PcmHeader), format, 0);
+		}
+
+		// Loose file: one read into memory we own, still no decoding.
+		size = file->getSize();
+		unsigned char* copy = new unsigned char[size > 0 ? size : 1];
+		file->seek(0);
+		if (file->read(copy, size) != (ik_s32)size || !readPcmHeader(copy, size, format)) {
+			delete[] copy;
+			return 0;
+		}
+		return new PcmStream(copy + sizeof(PcmHeader), format, copy);
+	}
+};
+
+IAudioStreamLoader* createPcmStreamLoader() {
+	return new PcmStreamLoader();
+}
+
+bool bakePcmAssets(const char* const* files, int count) {
+	ISoundEngine* engine = createIrrKlangDevice(ESOD_NULL);
+	if (!engine) {
+		printf("[audio] could not create a decoding device\n");
+		return false;
+	}
+	bool ok = true;
+	for (int i = 0; i < count; i++) {
+		ISoundSource* source = engine->addSoundSourceFromFile(files[i], ESM_NO_STREAMING, false);
+		const void* samples = 0;
+		SAudioStreamFormat format;
+		if (source) {
+			source->setForcedStreamingThreshold(0); // Decode it whole, however long it is
+			samples = source->getSampleData();
+			format = source->getAudioFormat();
+		}
+		if (!samples || format.FrameCount <= 0) {
+			printf("[audio] could not decode %s\n", files[i]);
+			ok = false;
+			continue;
+		}
+
+		PcmHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "PCM1", 4);
+		header.channelCount = format.ChannelCount;
+		header.sampleRate = format.SampleRate;
+		header.frameCount = format.FrameCount;
+		header.sampleFormat = format.SampleFormat;
+
+		char pcmName[260];
+		pcmNameFor(files[i], pcmName, sizeof(pcmName));
+		FILE* f = fopen(pcmName, "wb");
+		bool written = f
+			&& fwrite(&header, sizeof(header), 1, f) == 1
+			&& fwrite(samples, format.getSampleDataSize(), 1, f) == 1;
+		if (f) fclose(f);
+		if (!written) {
+			printf("[audio] could not write %s\n", pcmName);
+			ok = false;
+			continue;
+		}
+		printf("[audio] baked %s: %d frames, %d Hz, %d channels\n",
+			pcmName, format.FrameCount, format.SampleRate, format.ChannelCount);
+	}
+	engine->drop();
+	return ok;
+}
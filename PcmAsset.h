@@ -0,0 +1,30 @@
+#pragma once
+
+#include <irrKlang.h>
+
+// Pre-decoded sound: a PcmHeader followed by interleaved samples in the
+// header's format. Written offline by bakePcmAssets(), played through the
+// loader from createPcmStreamLoader() without any decode work.
+struct PcmHeader {
+	char magic[4];    // "PCM1"
+	int channelCount;
+	int sampleRate;
+	int frameCount;
+	int sampleFormat; // irrklang::ESampleFormat
+	int reserved[3];  // Keeps the samples 16-byte aligned inside the asset pack
+};
+
+// Writes fileName with its extension replaced by ".pcm" into out.
+void pcmNameFor(const char* fileName, char* out, int outSize);
+
+// Fills format from the PcmHeader at data. size is the whole file's, so
+// only the header has to be read to check that all the samples are there.
+bool readPcmHeader(const unsigned char* data, unsigned int size, irrklang::SAudioStreamFormat& format);
+
+// Serves ".pcm" files straight from the asset pack mapping when they are
+// packed, otherwise from a copy read through irrKlang's file access.
+irrklang::IAudioStreamLoader* createPcmStreamLoader();
+
+// Offline step: decodes each file with irrKlang on the null output driver and
+// writes the result next to it under its pcmNameFor() name.
+bool bakePcmAssets(const char* const* files, int count);
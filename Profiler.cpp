@@ -0,0 +1,325 @@
+#include "Profiler.h"
+
+#ifdef PROFILER
+
+#include "Renderer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#define PROFILE_RING_SIZE (1 << 15) // Events per thread, a power of two
+#define PROFILE_FRAME_HISTORY 128   // Frames in the graph
+#define OVERLAY_TOP_ZONES 6
+#define OVERLAY_BUDGET_MS 16.7f     // 60 Hz; the graph's scale is twice that
+
+struct ProfileEvent {
+	const char* name;
+	unsigned long long start, end; // The same for marks
+	bool mark;
+	int value; // Marks only
+};
+
+// Written only by its thread. written counts every event ever recorded, so
+// event i lives at i % PROFILE_RING_SIZE until it is overwritten.
+struct ProfileRing {
+	ProfileEvent events[PROFILE_RING_SIZE];
+	std::atomic<unsigned long long> written;
+	std::atomic<const char*> threadName;
+	int thread;
+};
+
+std::atomic<bool> profilerEnabled(false);
+
+static std::mutex ringsMutex;
+static std::vector<ProfileRing*> rings; // Never freed: a thread's ring outlives it for the export
+static thread_local ProfileRing* threadRing = 0;
+
+// Calibration: ticks and steady_clock read together.
+static unsigned long long startTicks = 0;
+static std::chrono::steady_clock::time_point startTime;
+
+// Frame ends, written by whichever thread calls profileFrame().
+static unsigned long long frameEnds[PROFILE_FRAME_HISTORY];
+static std::atomic<int> frameCount(0);
+
+static ProfileRing* registerThread() {
+	ProfileRing* ring = new ProfileRing();
+	ring->written = 0;
+	ring->threadName = 0;
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	ring->thread = (int)rings.size() + 1;
+	rings.push_back(ring);
+	threadRing = ring;
+	return ring;
+}
+
+void recordProfileZone(const char* name, unsigned long long start, unsigned long long end) {
+	ProfileRing* ring = threadRing ? threadRing : registerThread();
+	unsigned long long n = ring->written.load(std::memory_order_relaxed);
+	ProfileEvent& e = ring->events[n & (PROFILE_RING_SIZE - 1)];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	e.mark = false;
+	ring->written.store(n + 1, std::memory_order_release);
+}
+
+void recordProfileMark(const char* name, int value, unsigned long long time) {
+	ProfileRing* ring = threadRing ? threadRing : registerThread();
+	unsigned long long n = ring->written.load(std::memory_order_relaxed);
+	ProfileEvent& e = ring->events[n & (PROFILE_RING_SIZE - 1)];
+	e.name = name;
+	e.start = time;
+	e.end = time;
+	e.mark = true;
+	e.value = value;
+	ring->written.store(n + 1, std::memory_order_release);
+}
+
+void setProfileThreadName(const char* name) {
+	ProfileRing* ring = threadRing ? threadRing : registerThread();
+	ring->threadName = name;
+}
+
+double profileTicksPerMs() {
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	return ms > 0 ? (profileTimestamp() - startTicks) / ms : 1e6;
+}
+
+void startProfiler() {
+	if (profilerEnabled) return;
+	startTicks = profileTimestamp();
+	startTime = std::chrono::steady_clock::now();
+	// A first millisecond for profileTicksPerMs() to work from; it sharpens as the run goes on.
+	while (std::chrono::steady_clock::now() - startTime < std::chrono::milliseconds(1)) {
+	}
+	profilerEnabled = true;
+}
+
+void stopProfiler() {
+	profilerEnabled = false;
+}
+
+void profileFrame() {
+	if (!profilerEnabled.load(std::memory_order_relaxed)) return;
+	int n = frameCount.load(std::memory_order_relaxed);
+	frameEnds[n % PROFILE_FRAME_HISTORY] = profileTimestamp();
+	frameCount.store(n + 1, std::memory_order_release);
+}
+
+// Copies out what ring still holds. Events the writer laps while they are
+// being copied are dropped rather than returned half-written. The writer
+// may already be filling slot `after`, so the event it replaces counts as
+// lapped too.
+static void copyEvents(ProfileRing* ring, std::vector<ProfileEvent>& out) {
+	unsigned long long end = ring->written.load(std::memory_order_acquire);
+	unsigned long long begin = end > PROFILE_RING_SIZE ? end - PROFILE_RING_SIZE : 0;
+	size_t first = out.size();
+	for (unsigned long long i = begin; i < end; i++) {
+		out.push_back(ring->events[i & (PROFILE_RING_SIZE - 1)]);
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	unsigned long long after = ring->written.load(std::memory_order_relaxed);
+	if (after + 1 > begin + PROFILE_RING_SIZE) {
+		size_t lapped = (size_t)std::min(after + 1 - PROFILE_RING_SIZE - begin, end - begin);
+		out.erase(out.begin() + first, out.begin() + first + lapped);
+	}
+}
+
+static std::vector<ProfileRing*> snapshotRings() {
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	return rings;
+}
+
+// Escapes just enough for zone and thread names.
+static void writeJsonString(FILE* f, const char* s) {
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') fputc('\\', f);
+		if ((unsigned char)*s >= 0x20) fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+bool writeChromeTrace(const char* path, unsigned long long from, unsigned long long to) {
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		printf("[profile] could not write %s\n", path);
+		return false;
+	}
+	double ticksPerUs = profileTicksPerMs() / 1000.0;
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	int eventCount = 0;
+	std::vector<ProfileEvent> events;
+	for (ProfileRing* ring : snapshotRings()) {
+		const char* threadName = ring->threadName;
+		char fallbackName[32];
+		if (!threadName) {
+			snprintf(fallbackName, sizeof(fallbackName), "thread %d", ring->thread);
+			threadName = fallbackName;
+		}
+		fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", ring->thread);
+		writeJsonString(f, threadName);
+		fprintf(f, "}}");
+		first = false;
+
+		events.clear();
+		copyEvents(ring, events);
+		for (const ProfileEvent& e : events) {
+			if (e.start < startTicks || e.end < from || e.start > to) continue;
+			fprintf(f, ",\n{\"ph\":\"%s\",\"name\":", e.mark ? "i" : "X");
+			writeJsonString(f, e.name);
+			if (e.mark) {
+				fprintf(f, ",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"s\":\"t\",\"args\":{\"value\":%d}}", ring->thread,
+					(e.start - startTicks) / ticksPerUs, e.value);
+			}
+			else {
+				fprintf(f, ",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", ring->thread,
+					(e.start - startTicks) / ticksPerUs, (e.end - e.start) / ticksPerUs);
+			}
+			eventCount++;
+		}
+	}
+	fprintf(f, "\n]}\n");
+	bool ok = ferror(f) == 0;
+	fclose(f);
+	if (ok) printf("[profile] wrote %d events to %s\n", eventCount, path);
+	return ok;
+}
+
+struct ZoneTotal {
+	const char* name;
+	double ms;
+};
+
+void drawProfilerOverlay(float width, float height) {
+	if (!profilerEnabled.load(std::memory_order_relaxed)) return;
+	int frames = frameCount.load(std::memory_order_acquire);
+	double msPerTick = 1.0 / profileTicksPerMs();
+
+	// Totals over the last second of frames, merged by name across threads.
+	unsigned long long now = profileTimestamp();
+	unsigned long long windowStart = now - (unsigned long long)(1000.0 / msPerTick);
+	int windowFrames = 0;
+	for (int i = 1; i <= std::min(frames, PROFILE_FRAME_HISTORY); i++) {
+		if (frameEnds[(frames - i) % PROFILE_FRAME_HISTORY] < windowStart) break;
+		windowFrames++;
+	}
+	// Zones are recorded as they close, so each ring is walked back from its
+	// newest event only as far as the window goes, or until it reaches one
+	// the writer may have lapped while it was read, as in copyEvents().
+	std::vector<ZoneTotal> totals;
+	for (ProfileRing* ring : snapshotRings()) {
+		unsigned long long end = ring->written.load(std::memory_order_acquire);
+		unsigned long long oldest = end > PROFILE_RING_SIZE ? end - PROFILE_RING_SIZE : 0;
+		for (unsigned long long i = end; i-- > oldest;) {
+			ProfileEvent e = ring->events[i & (PROFILE_RING_SIZE - 1)];
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (i + PROFILE_RING_SIZE <= ring->written.load(std::memory_order_relaxed)) break;
+			if (e.end < windowStart) break;
+			if (e.mark) continue;
+			double ms = (e.end - e.start) * msPerTick;
+			auto it = std::find_if(totals.begin(), totals.end(),
+				[&e](const ZoneTotal& t) { return t.name == e.name || strcmp(t.name, e.name) == 0; });
+			if (it == totals.end()) {
+				ZoneTotal total = { e.name, ms };
+				totals.push_back(total);
+			}
+			else {
+				it->ms += ms;
+			}
+		}
+	}
+	std::sort(totals.begin(), totals.end(), [](const ZoneTotal& a, const ZoneTotal& b) { return a.ms > b.ms; });
+
+	renderer->matrixMode(MATRIX_PROJECTION);
+	renderer->pushMatrix();
+	renderer->loadIdentity();
+	renderer->ortho2D(0, width, 0, height);
+	renderer->matrixMode(MATRIX_MODELVIEW);
+	renderer->pushMatrix();
+	renderer->loadIdentity();
+	renderer->pushAttrib();
+	// Lit head-on with no highlight, so the overlay shows its colors whatever
+	// the scene's light is doing.
+	static const float noSpecular[4] = { 0, 0, 0, 1 };
+	static const float headOn[4] = { 0, 0, 1, 0 };
+	static const float white[4] = { 1, 1, 1, 1 };
+	renderer->setMaterial(noSpecular, noSpecular, noSpecular, 0);
+	renderer->setLight(headOn, white);
+	renderer->normal(0, 0, 1);
+
+	// Frame-time graph in the top right: one bar a frame, the line at the budget.
+	float graphW = 2.0f * PROFILE_FRAME_HISTORY, graphH = 80;
+	float x0 = width - graphW - 10, y0 = height - graphH - 10;
+	float msScale = graphH / (2 * OVERLAY_BUDGET_MS);
+	renderer->begin(PRIM_QUADS);
+	for (int i = 1; i < std::min(frames, PROFILE_FRAME_HISTORY); i++) {
+		int frame = frames - i;
+		float ms = (float)((frameEnds[frame % PROFILE_FRAME_HISTORY] - frameEnds[(frame - 1) % PROFILE_FRAME_HISTORY]) * msPerTick);
+		float h = std::min(ms * msScale, graphH);
+		float x = x0 + graphW - 2.0f * i;
+		if (ms <= OVERLAY_BUDGET_MS) renderer->color(0.1f, 0.7f, 0.1f);
+		else if (ms <= 2 * OVERLAY_BUDGET_MS) renderer->color(0.8f, 0.7f, 0.0f);
+		else renderer->color(0.8f, 0.1f, 0.1f);
+		renderer->vertex(x, y0, 0);
+		renderer->vertex(x + 2, y0, 0);
+		renderer->vertex(x + 2, y0 + h, 0);
+		renderer->vertex(x, y0 + h, 0);
+	}
+	renderer->end();
+	renderer->color(0, 0, 0);
+	renderer->begin(PRIM_LINE_STRIP);
+	renderer->vertex(x0, y0 + graphH, 0);
+	renderer->vertex(x0, y0, 0);
+	renderer->vertex(x0 + graphW, y0, 0);
+	renderer->end();
+	renderer->begin(PRIM_LINES);
+	renderer->vertex(x0, y0 + OVERLAY_BUDGET_MS * msScale, 0);
+	renderer->vertex(x0 + graphW, y0 + OVERLAY_BUDGET_MS * msScale, 0);
+	renderer->end();
+
+	// Top zones under it, in ms per frame.
+	char line[96];
+	float y = y0 - 24;
+	snprintf(line, sizeof(line), "%d fps", windowFrames);
+	renderer->text(x0, y, line);
+	int shown = std::min((int)totals.size(), OVERLAY_TOP_ZONES);
+	for (int i = 0; i < shown; i++) {
+		y -= 22;
+		snprintf(line, sizeof(line), "%-16.16s %6.2f ms", totals[i].name, windowFrames ? totals[i].ms / windowFrames : totals[i].ms);
+		renderer->text(x0, y, line);
+	}
+
+	renderer->popAttrib();
+	renderer->popMatrix();
+	renderer->matrixMode(MATRIX_PROJECTION);
+	renderer->popMatrix();
+	renderer->matrixMode(MATRIX_MODELVIEW);
+}
+
+static double nsPerZone(int zones) {
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < zones; i++) {
+		PROFILE_ZONE("benchmark");
+	}
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / zones;
+}
+
+void benchmarkProfiler(int zones) {
+	bool wasEnabled = profilerEnabled;
+	if (!wasEnabled) startProfiler();
+	nsPerZone(zones / 10); // Warm the ring and the caches
+	double enabled = nsPerZone(zones);
+	stopProfiler();
+	double disabled = nsPerZone(zones);
+	if (wasEnabled) profilerEnabled = true;
+	printf("[profile] %d zones: %.1f ns per zone enabled, %.2f ns disabled\n", zones, enabled, disabled);
+}
+
+#endif
@@ -0,0 +1,113 @@
+#pragma once
+
+// Scoped CPU zones. PROFILE_ZONE("name") times the rest of the enclosing
+// block into a ring owned by the calling thread: one writer, no locks, the
+// oldest events overwritten once it is full. Readers (the Chrome trace
+// export and the overlay) copy events out without stopping the writers.
+//
+// While the profiler is disabled a zone costs one flag test; defining
+// NO_PROFILER removes it from the build, leaving the calls below empty.
+// Zone names must be string literals or otherwise live for the whole run.
+#ifndef NO_PROFILER
+#define PROFILER
+#endif
+
+#ifdef PROFILER
+
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define PROFILE_TSC
+#else
+#include <chrono>
+#endif
+
+extern std::atomic<bool> profilerEnabled;
+
+// Raw ticks: the TSC where there is one, steady_clock nanoseconds elsewhere.
+// Converted to time against a calibration taken by startProfiler().
+inline unsigned long long profileTimestamp() {
+#ifdef PROFILE_TSC
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Starts recording zones, if it is not already.
+void startProfiler();
+void stopProfiler();
+
+// Names the calling thread in the trace. Optional; unnamed threads show up
+// by number.
+void setProfileThreadName(const char* name);
+
+// Marks the end of a frame on the calling thread, for the frame graph.
+void profileFrame();
+
+// Profile ticks per millisecond, as calibrated so far.
+double profileTicksPerMs();
+
+// Writes what is still in the rings as Chrome trace-event JSON, for
+// chrome://tracing or ui.perfetto.dev. Only events overlapping from..to,
+// in profile ticks, are written. Safe to call from any thread while the
+// others keep recording.
+bool writeChromeTrace(const char* path, unsigned long long from = 0, unsigned long long to = ~0ULL);
+
+// Frame-time graph and the zones that took longest over the last second,
+// drawn through the global renderer in a width x height ortho2D space.
+void drawProfilerOverlay(float width, float height);
+
+// Times many empty zones with the profiler on and off and prints the cost
+// per zone.
+void benchmarkProfiler(int zones);
+
+void recordProfileZone(const char* name, unsigned long long start, unsigned long long end);
+void recordProfileMark(const char* name, int value, unsigned long long time);
+
+// An instant event on the calling thread's ring, such as a key press or a
+// sound being triggered; value goes into the trace with it.
+inline void profileMark(const char* name, int value) {
+	if (profilerEnabled.load(std::memory_order_relaxed)) recordProfileMark(name, value, profileTimestamp());
+}
+
+class ProfileZone {
+public:
+	explicit ProfileZone(const char* name) : name(profilerEnabled.load(std::memory_order_relaxed) ? name : 0) {
+		if (this->name) start = profileTimestamp();
+	}
+
+	~ProfileZone() {
+		if (name) recordProfileZone(name, start, profileTimestamp());
+	}
+
+private:
+	const char* name; // 0 when the profiler was off as the zone opened
+	unsigned long long start;
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+#else
+
+#define PROFILE_ZONE(name)
+
+inline void startProfiler() {}
+inline void stopProfiler() {}
+inline void setProfileThreadName(const char*) {}
+inline void profileFrame() {}
+inline double profileTicksPerMs() { return 1; }
+inline bool writeChromeTrace(const char*, unsigned long long = 0, unsigned long long = ~0ULL) { return false; }
+inline void profileMark(const char*, int) {}
+inline void drawProfilerOverlay(float, float) {}
+inline void benchmarkProfiler(int) {}
+
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <math.h>
+
+#include "Vector3f.h"
+
+// A rotation as a unit quaternion: four floats instead of a 3x3 basis, and
+// composing two costs 16 multiplies. Small rounding errors only ever scale
+// it, which normalized() takes back out, so it can't shear the way a basis
+// updated vector by vector does.
+class Quaternion {
+public:
+	float w, x, y, z;
+
+	constexpr Quaternion(float _w = 1.0f, float _x = 0.0f, float _y = 0.0f, float _z = 0.0f) : w(_w), x(_x), y(_y), z(_z) {
+	}
+
+	// axis must be unit length.
+	static Quaternion fromAxisAngle(const Vector3f& axis, float radians) {
+		float s = sinf(radians * 0.5f);
+		return Quaternion(cosf(radians * 0.5f), axis.x * s, axis.y * s, axis.z * s);
+	}
+
+	// The rotation taking the x, y and z axes to the given orthonormal,
+	// right-handed axes.
+	static Quaternion fromAxes(const Vector3f& xAxis, const Vector3f& yAxis, const Vector3f& zAxis) {
+		float trace = xAxis.x + yAxis.y + zAxis.z;
+		if (trace > 0.0f) {
+			float s = sqrtf(trace + 1.0f) * 2.0f;
+			return Quaternion(0.25f * s, (yAxis.z - zAxis.y) / s, (zAxis.x - xAxis.z) / s, (xAxis.y - yAxis.x) / s).normalized();
+		}
+		if (xAxis.x > yAxis.y && xAxis.x > zAxis.z) {
+			float s = sqrtf(1.0f + xAxis.x - yAxis.y - zAxis.z) * 2.0f;
+			return Quaternion((yAxis.z - zAxis.y) / s, 0.25f * s, (yAxis.x + xAxis.y) / s, (zAxis.x + xAxis.z) / s).normalized();
+		}
+		if (yAxis.y > zAxis.z) {
+			float s = sqrtf(1.0f + yAxis.y - xAxis.x - zAxis.z) * 2.0f;
+			return Quaternion((zAxis.x - xAxis.z) / s, (yAxis.x + xAxis.y) / s, 0.25f * s, (zAxis.y + yAxis.z) / s).normalized();
+		}
+		float s = sqrtf(1.0f + zAxis.z - xAxis.x - yAxis.y) * 2.0f;
+		return Quaternion((xAxis.y - yAxis.x) / s, (zAxis.x + xAxis.z) / s, (zAxis.y + yAxis.z) / s, 0.25f * s).normalized();
+	}
+
+	// Applies q first, then this.
+	constexpr Quaternion operator*(const Quaternion& q) const {
+		return Quaternion(
+			w * q.w - x * q.x - y * q.y - z * q.z,
+			w * q.x + x * q.w + y * q.z - z * q.y,
+			w * q.y - x * q.z + y * q.w + z * q.x,
+			w * q.z + x * q.y - y * q.x + z * q.w);
+	}
+
+	constexpr float norm() const {
+		return w * w + x * x + y * y + z * z;
+	}
+
+	Quaternion normalized() const {
+		float l = sqrtf(norm());
+		return l > 0.0f ? Quaternion(w / l, x / l, y / l, z / l) : Quaternion();
+	}
+
+	constexpr Vector3f rotate(const Vector3f& v) const {
+		// v + 2w(q x v) + 2q x (q x v), with q the vector part
+		return v + Vector3f(x, y, z).cross(v) * (2.0f * w) + Vector3f(x, y, z).cross(Vector3f(x, y, z).cross(v)) * 2.0f;
+	}
+};
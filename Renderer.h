@@ -0,0 +1,151 @@
+#pragma once
+
+#include <math.h>
+
+// The graphics calls the draw code makes: the fixed-function subset the
+// scene was written against. GLRenderer forwards them to OpenGL,
+// SoftRenderer rasterizes them on the CPU and CommandList records them for
+// later. A backend is only ever driven by one thread at a time.
+
+enum MatrixMode {
+	MATRIX_MODELVIEW,
+	MATRIX_PROJECTION
+};
+
+enum PrimitiveType {
+	PRIM_LINES,
+	PRIM_LINE_STRIP,
+	PRIM_TRIANGLES,
+	PRIM_TRIANGLE_FAN,
+	PRIM_QUADS,
+	PRIM_QUAD_STRIP
+};
+
+// A parameter that animates by itself: offset + amplitude * sin(time + phase),
+// with time from Renderer::setTime(). Amplitude 0 makes it a constant.
+struct TimeWave {
+	float offset, amplitude, phase;
+};
+
+inline TimeWave constantWave(float value) {
+	TimeWave wave = { value, 0.0f, 0.0f };
+	return wave;
+}
+
+inline float evaluateWave(const TimeWave& wave, float time) {
+	return wave.offset + wave.amplitude * sinf(time + wave.phase);
+}
+
+// Geometry baked once and drawn with drawMesh(). Three floats a vertex in
+// each array; normals and colors may be 0. The arrays are not copied, so
+// they must outlive any CommandList the mesh is recorded into.
+struct Mesh {
+	PrimitiveType type;
+	int vertexCount;
+	const float* positions;
+	const float* normals;
+	const float* colors;            // RGB, tracked by color material like color()
+	int indexCount;                 // 0 draws the vertices in order
+	const unsigned short* indices;
+};
+
+#define INSTANCE_FLOATS 4 // x, y, z and yaw: one placement for drawMeshInstances()
+
+// A mesh whose vertices each follow one of boneCount bones, drawn with
+// drawSkinnedMesh(). Positions and normals are in their bone's space.
+struct SkinnedMesh {
+	Mesh mesh;
+	const unsigned char* bones; // A bone number per vertex
+	int boneCount;
+};
+
+class Renderer {
+public:
+	virtual ~Renderer() {}
+
+	// Depth test, light 0 and color material on, white clear color. Call once
+	// the backend has somewhere to draw.
+	virtual void init() = 0;
+	virtual void clear() = 0; // Color and depth
+	virtual void flush() = 0; // End of frame
+
+	// The clock every TimeWave drawn after it is evaluated against. Draw code
+	// that only uses waves stays the same from frame to frame; only this moves.
+	virtual void setTime(float time) = 0;
+
+	virtual void matrixMode(MatrixMode mode) = 0;
+	virtual void loadIdentity() = 0;
+	virtual void pushMatrix() = 0;
+	virtual void popMatrix() = 0;
+	virtual void translate(float x, float y, float z) = 0;
+	virtual void rotate(float angle, float x, float y, float z) = 0; // Degrees
+	virtual void scale(float x, float y, float z) = 0;
+	virtual void scaleWave(const TimeWave& s) = 0; // Uniform scale following s
+	virtual void multMatrix(const float m[16]) = 0; // Column-major, like glMultMatrixf
+	virtual void perspective(float fovy, float aspect, float zNear, float zFar) = 0;
+	virtual void ortho2D(float left, float right, float bottom, float top) = 0;
+	virtual void lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+		float upX, float upY, float upZ) = 0;
+
+	// Saves and restores the current color, normal and lighting state
+	// (GL_CURRENT_BIT | GL_LIGHTING_BIT).
+	virtual void pushAttrib() = 0;
+	virtual void popAttrib() = 0;
+
+	// Color material tracks ambient and diffuse, so only specular and
+	// shininess show while it is on. Ambient is set on both faces, the rest
+	// on front faces, as setupLights() always did.
+	virtual void setMaterial(const float ambient[4], const float diffuse[4], const float specular[4], float shininess) = 0;
+	// Light 0. The position goes through the current modelview matrix.
+	virtual void setLight(const float position[4], const float diffuse[4]) = 0;
+
+	virtual void color(float r, float g, float b) = 0;
+	virtual void colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b) = 0;
+	virtual void normal(float x, float y, float z) = 0;
+	virtual void lineWidth(float width) = 0;
+	virtual void begin(PrimitiveType type) = 0;
+	virtual void vertex(float x, float y, float z) = 0;
+	virtual void end() = 0;
+
+	// Bitmap text with its first baseline at (x, y) in the current
+	// transform. Backends without fonts draw nothing.
+	virtual void text(float x, float y, const char* s) = 0;
+
+	// One draw of a whole mesh. Backends that can hand the arrays to the GPU
+	// as they are override this; the rest get it vertex by vertex. The
+	// current color and normal are left undefined, as after glDrawElements.
+	virtual void drawMesh(const Mesh& mesh) {
+		int count = mesh.indexCount ? mesh.indexCount : mesh.vertexCount;
+		begin(mesh.type);
+		for (int i = 0; i < count; i++) {
+			int v = 3 * (mesh.indexCount ? mesh.indices[i] : i);
+			if (mesh.colors) color(mesh.colors[v], mesh.colors[v + 1], mesh.colors[v + 2]);
+			if (mesh.normals) normal(mesh.normals[v], mesh.normals[v + 1], mesh.normals[v + 2]);
+			vertex(mesh.positions[v], mesh.positions[v + 1], mesh.positions[v + 2]);
+		}
+		end();
+	}
+	// The mesh with each vertex moved by its bone: bones holds boneCount
+	// column-major matrices, applied before the current one. The default skins
+	// on the CPU into a copy and hands that to drawMesh(), so it is still one
+	// draw. Defined in SkinnedMesh.cpp.
+	virtual void drawSkinnedMesh(const SkinnedMesh& skinned, const float* bones);
+	// The mesh once for each of count placements, INSTANCE_FLOATS apiece in
+	// instances: turned yaw degrees about +y, then moved to x, y, z, all
+	// before the current matrix. A mesh without normals turns the current
+	// normal with it. The default draws the copies one at a time.
+	virtual void drawMeshInstances(const Mesh& mesh, const float* instances, int count) {
+		for (int i = 0; i < count; i++) {
+			const float* p = instances + INSTANCE_FLOATS * i;
+			pushMatrix();
+			translate(p[0], p[1], p[2]);
+			rotate(p[3], 0.0f, 1.0f, 0.0f);
+			drawMesh(mesh);
+			popMatrix();
+		}
+	}
+};
+
+// The backend the draw code on this thread talks to: the one picked in main()
+// on the GL thread, a CommandList on a recording worker.
+extern thread_local Renderer* renderer;
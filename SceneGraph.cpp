@@ -0,0 +1,205 @@
+#include "SceneGraph.h"
+#include "Renderer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#define SCENE_BENCH_FRAMES 1000
+
+SceneGraph::SceneGraph() : localsRecomputed(0), worldsRecomputed(0) {
+}
+
+SceneNode SceneGraph::add(SceneNode parent, void (*draw)()) {
+	SceneNode index = (SceneNode)nodes.size();
+	Node node;
+	node.parent = parent;
+	node.firstChild = node.lastChild = node.nextSibling = -1;
+	node.draw = draw;
+	node.stepCount = 0;
+	node.dirty = false;
+	nodes.push_back(node);
+	if (parent >= 0) {
+		Node& p = nodes[parent];
+		if (p.lastChild >= 0) nodes[p.lastChild].nextSibling = index;
+		else p.firstChild = index;
+		p.lastChild = index;
+	}
+	markDirty(index);
+	return index;
+}
+
+void SceneGraph::addStep(SceneNode node, StepType type, float a, float b, float c, float d) {
+	Node& n = nodes[node];
+	if (n.stepCount == SCENE_MAX_STEPS) {
+		printf("[scene] node %d has more than %d steps; ignoring the rest\n", node, SCENE_MAX_STEPS);
+		return;
+	}
+	Step& step = n.steps[n.stepCount++];
+	step.type = type;
+	step.values[0] = a;
+	step.values[1] = b;
+	step.values[2] = c;
+	step.values[3] = d;
+	memset(step.bound, 0, sizeof(step.bound));
+	markDirty(node);
+}
+
+void SceneGraph::translate(SceneNode node, float x, float y, float z) {
+	addStep(node, STEP_TRANSLATE, x, y, z, 0.0f);
+}
+
+void SceneGraph::rotate(SceneNode node, float angle, float x, float y, float z) {
+	addStep(node, STEP_ROTATE, angle, x, y, z);
+}
+
+void SceneGraph::scale(SceneNode node, float x, float y, float z) {
+	addStep(node, STEP_SCALE, x, y, z, 0.0f);
+}
+
+void SceneGraph::bind(SceneNode node, int parameter, const float* value) {
+	Node& n = nodes[node];
+	if (n.stepCount == 0) return;
+	n.steps[n.stepCount - 1].bound[parameter] = value;
+	Binding binding = { value, *value, node };
+	bindings.push_back(binding);
+	markDirty(node);
+}
+
+void SceneGraph::markDirty(SceneNode node) {
+	if (nodes[node].dirty) return;
+	nodes[node].dirty = true;
+	dirtyNodes.push_back(node);
+}
+
+void SceneGraph::computeLocal(Node& node) {
+	scratch.loadIdentity();
+	for (int i = 0; i < node.stepCount; i++) {
+		const Step& step = node.steps[i];
+		float v[4];
+		for (int k = 0; k < 4; k++) v[k] = step.bound[k] ? step.values[k] + *step.bound[k] : step.values[k];
+		switch (step.type) {
+		case STEP_TRANSLATE: scratch.translate(v[0], v[1], v[2]); break;
+		case STEP_ROTATE: scratch.rotate(v[0], v[1], v[2], v[3]); break;
+		case STEP_SCALE: scratch.scale(v[0], v[1], v[2]); break;
+		}
+	}
+	memcpy(node.local, scratch.top(), sizeof(node.local));
+	localsRecomputed++;
+}
+
+void SceneGraph::computeWorlds(SceneNode node) {
+	pending.push_back(node);
+	while (!pending.empty()) {
+		SceneNode i = pending.back();
+		pending.pop_back();
+		Node& n = nodes[i];
+		if (n.parent < 0) memcpy(n.world, n.local, sizeof(n.world));
+		else multiplyMatrices(nodes[n.parent].world, n.local, n.world);
+		worldsRecomputed++;
+		for (SceneNode child = n.firstChild; child >= 0; child = nodes[child].nextSibling) pending.push_back(child);
+	}
+}
+
+void SceneGraph::update() {
+	for (size_t i = 0; i < bindings.size(); i++) {
+		Binding& binding = bindings[i];
+		if (*binding.value == binding.last) continue;
+		binding.last = *binding.value;
+		markDirty(binding.node);
+	}
+	localsRecomputed = worldsRecomputed = 0;
+	if (dirtyNodes.empty()) return;
+
+	for (size_t i = 0; i < dirtyNodes.size(); i++) computeLocal(nodes[dirtyNodes[i]]);
+	// A node below another dirty node is redone with that node's subtree.
+	for (size_t i = 0; i < dirtyNodes.size(); i++) {
+		SceneNode ancestor = nodes[dirtyNodes[i]].parent;
+		while (ancestor >= 0 && !nodes[ancestor].dirty) ancestor = nodes[ancestor].parent;
+		if (ancestor < 0) computeWorlds(dirtyNodes[i]);
+	}
+	for (size_t i = 0; i < dirtyNodes.size(); i++) nodes[dirtyNodes[i]].dirty = false;
+	dirtyNodes.clear();
+}
+
+void SceneGraph::updateAll() {
+	for (size_t i = 0; i < bindings.size(); i++) bindings[i].last = *bindings[i].value;
+	localsRecomputed = worldsRecomputed = 0;
+	// Parents come before their children, so one pass in order is enough.
+	for (size_t i = 0; i < nodes.size(); i++) {
+		Node& n = nodes[i];
+		computeLocal(n);
+		if (n.parent < 0) memcpy(n.world, n.local, sizeof(n.world));
+		else multiplyMatrices(nodes[n.parent].world, n.local, n.world);
+		worldsRecomputed++;
+		n.dirty = false;
+	}
+	dirtyNodes.clear();
+}
+
+void SceneGraph::draw(SceneNode node) const {
+	const Node& n = nodes[node];
+	if (n.draw) {
+		renderer->pushMatrix();
+		renderer->multMatrix(n.world);
+		n.draw();
+		renderer->popMatrix();
+	}
+	for (SceneNode child = n.firstChild; child >= 0; child = nodes[child].nextSibling) draw(child);
+}
+
+SceneGraphStats SceneGraph::getStats() const {
+	SceneGraphStats stats;
+	stats.nodes = (int)nodes.size();
+	stats.bindings = (int)bindings.size();
+	stats.localsRecomputed = localsRecomputed;
+	stats.worldsRecomputed = worldsRecomputed;
+	return stats;
+}
+
+// Runs frames of animation, calling update() or updateAll() after each, and
+// returns microseconds per frame. worlds gets the average recomputed.
+static double timeSceneFrames(SceneGraph& graph, std::vector<float>& angles, bool all, bool animate, double& worlds) {
+	long long recomputed = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < SCENE_BENCH_FRAMES; frame++) {
+		if (animate) {
+			for (size_t i = 0; i < angles.size(); i++) angles[i] += 1.0f;
+		}
+		if (all) graph.updateAll();
+		else graph.update();
+		recomputed += graph.getStats().worldsRecomputed;
+	}
+	auto end = std::chrono::steady_clock::now();
+	worlds = (double)recomputed / SCENE_BENCH_FRAMES;
+	return std::chrono::duration<double, std::micro>(end - start).count() / SCENE_BENCH_FRAMES;
+}
+
+void benchmarkSceneGraph(int nodeCount) {
+	SceneGraph graph;
+	int animatedCount = nodeCount / 100 > 0 ? nodeCount / 100 : 1;
+	std::vector<float> angles(animatedCount, 0.0f);
+	srand(1);
+	// Each node hangs off a random earlier one, which keeps the tree shallow
+	// and bushy like a scene's, and every hundredth node or so spins.
+	int spacing = nodeCount / animatedCount, animated = 0;
+	for (int i = 0; i < nodeCount; i++) {
+		SceneNode node = graph.add(i > 0 ? rand() % i : -1);
+		graph.translate(node, (float)(rand() % 200 - 100) * 0.1f, (float)(rand() % 20) * 0.1f, (float)(rand() % 200 - 100) * 0.1f);
+		graph.rotate(node, (float)(rand() % 360), 0.0f, 1.0f, 0.0f);
+		if (i % spacing == spacing / 2 && animated < animatedCount) graph.bind(node, 0, &angles[animated++]);
+		graph.scale(node, 1.0f, 1.0f, 1.0f);
+	}
+	graph.update();
+
+	double changedWorlds, stillWorlds, allWorlds;
+	double changedUs = timeSceneFrames(graph, angles, false, true, changedWorlds);
+	double stillUs = timeSceneFrames(graph, angles, false, false, stillWorlds);
+	double allUs = timeSceneFrames(graph, angles, true, true, allWorlds);
+	printf("[scene] %d nodes, %d animated, %d frames each\n", nodeCount, animated, SCENE_BENCH_FRAMES);
+	printf("[scene] dirty update:  %.1f us per frame, %.0f nodes recomputed\n", changedUs, changedWorlds);
+	printf("[scene] nothing moved: %.1f us per frame, %.0f nodes recomputed\n", stillUs, stillWorlds);
+	printf("[scene] rebuild all:   %.1f us per frame, %.0f nodes recomputed (%.1fx the dirty update)\n",
+		allUs, allWorlds, changedUs > 0 ? allUs / changedUs : 0.0);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+
+#include "MatrixStack.h"
+
+// A tree of transforms for the parts of the scene that move. Each node
+// builds its local matrix from a few translate, rotate and scale steps and
+// caches it with its world matrix, which is relative to the graph's root.
+// A step's parameters can be bound to variables the game animates. update()
+// compares each bound variable with the value it saw last frame, and only
+// the nodes whose variables changed, and the nodes below them, are
+// recomputed. A frame where nothing moves costs one comparison per binding.
+//
+// Drawing a node multiplies its cached world matrix onto the renderer's
+// current matrix, so whatever the caller has pushed still places the
+// subtree. The stress lamps rely on this.
+
+#define SCENE_MAX_STEPS 4
+
+typedef int SceneNode; // Index into the graph; -1 is no node
+
+struct SceneGraphStats {
+	int nodes;
+	int bindings;
+	int localsRecomputed; // By the last update
+	int worldsRecomputed;
+};
+
+class SceneGraph {
+public:
+	SceneGraph();
+
+	// Parents must be added before their children. draw, when given, is called
+	// with the node's world matrix applied and draws only primitives.
+	SceneNode add(SceneNode parent, void (*draw)() = 0);
+
+	// Steps are applied in the order they are added, as the matching Renderer
+	// calls would be.
+	void translate(SceneNode node, float x, float y, float z);
+	void rotate(SceneNode node, float angle, float x, float y, float z); // Degrees
+	void scale(SceneNode node, float x, float y, float z);
+	// Adds *value to one parameter of the node's last step, counting them in
+	// the order the step's call takes them. value must outlive the graph.
+	void bind(SceneNode node, int parameter, const float* value);
+
+	// Once a frame, before anything is drawn. Must not overlap draw(), so run
+	// it before layers are handed to recording workers.
+	void update();
+	// Recomputes every node whether or not it changed; what update() avoids.
+	void updateAll();
+
+	// The node and everything below it. Safe to call from several threads.
+	void draw(SceneNode node) const;
+
+	const float* world(SceneNode node) const { return nodes[node].world; }
+	SceneGraphStats getStats() const;
+
+private:
+	enum StepType { STEP_TRANSLATE, STEP_ROTATE, STEP_SCALE };
+
+	struct Step {
+		StepType type;
+		float values[4];
+		const float* bound[4]; // Added to the matching value when not null
+	};
+
+	struct Node {
+		SceneNode parent, firstChild, lastChild, nextSibling;
+		void (*draw)();
+		int stepCount;
+		Step steps[SCENE_MAX_STEPS];
+		bool dirty; // Its local matrix is out of date
+		float local[16];
+		float world[16];
+	};
+
+	struct Binding {
+		const float* value;
+		float last;
+		SceneNode node;
+	};
+
+	void addStep(SceneNode node, StepType type, float a, float b, float c, float d);
+	void markDirty(SceneNode node);
+	void computeLocal(Node& node);
+	void computeWorlds(SceneNode node); // The node and its subtree
+
+	std::vector<Node> nodes;
+	std::vector<Binding> bindings;
+	std::vector<SceneNode> dirtyNodes;
+	std::vector<SceneNode> pending;
+	MatrixStack scratch;
+	int localsRecomputed, worldsRecomputed;
+};
+
+// Times a frame of update() against one of updateAll() on a random tree of
+// nodeCount nodes with 1% of them animated, and prints both.
+void benchmarkSceneGraph(int nodeCount);
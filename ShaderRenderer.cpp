@@ -0,0 +1,752 @@
+#include "ShaderRenderer.h"
+#include "GLProcs.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+// Shaders, buffers and vertex arrays are past what opengl32.lib exports.
+#ifndef GL_VERSION_1_5
+typedef ptrdiff_t GLsizeiptr;
+typedef ptrdiff_t GLintptr;
+#endif
+#ifndef GL_VERSION_2_0
+typedef char GLchar;
+#endif
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_STREAM_DRAW 0x88E0
+#define GL_DYNAMIC_DRAW 0x88E8
+#endif
+#ifndef GL_VERTEX_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#define GL_INFO_LOG_LENGTH 0x8B84
+#endif
+#ifndef GL_UNIFORM_BUFFER
+#define GL_UNIFORM_BUFFER 0x8A11
+#define GL_INVALID_INDEX 0xFFFFFFFFu
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef GLuint (APIENTRY* CreateShaderProc)(GLenum type);
+typedef void (APIENTRY* ShaderSourceProc)(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths);
+typedef void (APIENTRY* CompileShaderProc)(GLuint shader);
+typedef void (APIENTRY* GetObjectIntProc)(GLuint id, GLenum name, GLint* value);
+typedef void (APIENTRY* GetInfoLogProc)(GLuint id, GLsizei size, GLsizei* length, GLchar* log);
+typedef GLuint (APIENTRY* CreateProgramProc)();
+typedef void (APIENTRY* AttachShaderProc)(GLuint program, GLuint shader);
+typedef void (APIENTRY* ObjectProc)(GLuint id);
+typedef void (APIENTRY* ProgramParameteriProc)(GLuint program, GLenum name, GLint value);
+typedef void (APIENTRY* GetProgramBinaryProc)(GLuint program, GLsizei size, GLsizei* length, GLenum* format, void* binary);
+typedef void (APIENTRY* ProgramBinaryProc)(GLuint program, GLenum format, const void* binary, GLsizei length);
+typedef GLuint (APIENTRY* GetUniformBlockIndexProc)(GLuint program, const GLchar* name);
+typedef void (APIENTRY* UniformBlockBindingProc)(GLuint program, GLuint block, GLuint binding);
+typedef void (APIENTRY* BindBufferBaseProc)(GLenum target, GLuint index, GLuint buffer);
+typedef void (APIENTRY* BufferDataProc)(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+typedef void (APIENTRY* BufferSubDataProc)(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
+typedef void (APIENTRY* VertexAttribPointerProc)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* offset);
+typedef void (APIENTRY* VertexAttrib4fProc)(GLuint index, GLfloat x, GLfloat y, GLfloat z, GLfloat w);
+typedef void (APIENTRY* VertexAttribDivisorProc)(GLuint index, GLuint divisor);
+typedef void (APIENTRY* DrawArraysInstancedProc)(GLenum mode, GLint first, GLsizei count, GLsizei instances);
+
+static CreateShaderProc createShader;
+static ShaderSourceProc shaderSource;
+static CompileShaderProc compileShader;
+static GetObjectIntProc getShaderiv, getProgramiv;
+static GetInfoLogProc getShaderInfoLog, getProgramInfoLog;
+static CreateProgramProc createProgram;
+static AttachShaderProc attachShader;
+static ObjectProc linkProgram, useProgram, deleteShader, deleteProgram, enableVertexAttribArray, disableVertexAttribArray, bindVertexArray;
+static ProgramParameteriProc programParameteri;
+static GetProgramBinaryProc getProgramBinary;
+static ProgramBinaryProc programBinary;
+static GetUniformBlockIndexProc getUniformBlockIndex;
+static UniformBlockBindingProc uniformBlockBinding;
+static GenObjectsProc genBuffers, genVertexArrays;
+static BindObjectProc bindBuffer;
+static BindBufferBaseProc bindBufferBase;
+static BufferDataProc bufferData;
+static BufferSubDataProc bufferSubData;
+static VertexAttribPointerProc vertexAttribPointer;
+static VertexAttrib4fProc vertexAttrib4f;
+static VertexAttribDivisorProc vertexAttribDivisor;
+static DrawArraysInstancedProc drawArraysInstanced;
+
+// The program binary calls are optional: without them every run compiles.
+static bool loadGLProcs() {
+	createShader = (CreateShaderProc)getGLProc("glCreateShader");
+	shaderSource = (ShaderSourceProc)getGLProc("glShaderSource");
+	compileShader = (CompileShaderProc)getGLProc("glCompileShader");
+	getShaderiv = (GetObjectIntProc)getGLProc("glGetShaderiv");
+	getProgramiv = (GetObjectIntProc)getGLProc("glGetProgramiv");
+	getShaderInfoLog = (GetInfoLogProc)getGLProc("glGetShaderInfoLog");
+	getProgramInfoLog = (GetInfoLogProc)getGLProc("glGetProgramInfoLog");
+	createProgram = (CreateProgramProc)getGLProc("glCreateProgram");
+	attachShader = (AttachShaderProc)getGLProc("glAttachShader");
+	linkProgram = (ObjectProc)getGLProc("glLinkProgram");
+	useProgram = (ObjectProc)getGLProc("glUseProgram");
+	deleteShader = (ObjectProc)getGLProc("glDeleteShader");
+	deleteProgram = (ObjectProc)getGLProc("glDeleteProgram");
+	enableVertexAttribArray = (ObjectProc)getGLProc("glEnableVertexAttribArray");
+	disableVertexAttribArray = (ObjectProc)getGLProc("glDisableVertexAttribArray");
+	bindVertexArray = (ObjectProc)getGLProc("glBindVertexArray");
+	programParameteri = (ProgramParameteriProc)getGLProc("glProgramParameteri");
+	getProgramBinary = (GetProgramBinaryProc)getGLProc("glGetProgramBinary");
+	programBinary = (ProgramBinaryProc)getGLProc("glProgramBinary");
+	getUniformBlockIndex = (GetUniformBlockIndexProc)getGLProc("glGetUniformBlockIndex");
+	uniformBlockBinding = (UniformBlockBindingProc)getGLProc("glUniformBlockBinding");
+	genBuffers = (GenObjectsProc)getGLProc("glGenBuffers");
+	genVertexArrays = (GenObjectsProc)getGLProc("glGenVertexArrays");
+	bindBuffer = (BindObjectProc)getGLProc("glBindBuffer");
+	bindBufferBase = (BindBufferBaseProc)getGLProc("glBindBufferBase");
+	bufferData = (BufferDataProc)getGLProc("glBufferData");
+	bufferSubData = (BufferSubDataProc)getGLProc("glBufferSubData");
+	vertexAttribPointer = (VertexAttribPointerProc)getGLProc("glVertexAttribPointer");
+	vertexAttrib4f = (VertexAttrib4fProc)getGLProc("glVertexAttrib4f");
+	vertexAttribDivisor = (VertexAttribDivisorProc)getGLProc("glVertexAttribDivisor");
+	drawArraysInstanced = (DrawArraysInstancedProc)getGLProc("glDrawArraysInstanced");
+	return createShader && shaderSource && compileShader && getShaderiv && getProgramiv && getShaderInfoLog
+		&& getProgramInfoLog && createProgram && attachShader && linkProgram && useProgram && deleteShader
+		&& deleteProgram && enableVertexAttribArray && disableVertexAttribArray && bindVertexArray
+		&& getUniformBlockIndex && uniformBlockBinding && genBuffers && genVertexArrays && bindBuffer
+		&& bindBufferBase && bufferData && bufferSubData && vertexAttribPointer && vertexAttrib4f
+		&& vertexAttribDivisor && drawArraysInstanced;
+}
+
+static const char* vertexShaderSource =
+	"#version 330 core\n"
+	"layout(location = 0) in vec3 position;\n"
+	"layout(location = 1) in vec3 normal;\n"
+	"layout(location = 2) in vec3 color;\n"
+	"layout(location = 3) in vec3 colorAmplitude;\n"
+	"layout(location = 4) in vec3 colorPhase;\n"
+	"layout(location = 5) in vec4 instance;\n" // x, y, z and yaw in degrees; all zero outside instanced draws
+	"layout(std140) uniform Transform {\n"
+	"	mat4 modelview;\n"
+	"	mat4 projection;\n"
+	"	mat3 normalMatrix;\n"
+	"};\n"
+	"layout(std140) uniform Animation {\n"
+	"	float time;\n"
+	"};\n"
+	"out vec3 eyePosition;\n"
+	"out vec3 eyeNormal;\n"
+	"out vec3 vertexColor;\n"
+	"void main() {\n"
+	"	float yaw = radians(instance.w);\n"
+	"	mat3 turn = mat3(cos(yaw), 0.0, -sin(yaw), 0.0, 1.0, 0.0, sin(yaw), 0.0, cos(yaw));\n"
+	"	vec4 eye = modelview * vec4(turn * position + instance.xyz, 1.0);\n"
+	"	eyePosition = eye.xyz / eye.w;\n"
+	"	eyeNormal = normalMatrix * (turn * normal);\n"
+	"	vertexColor = color + colorAmplitude * sin(time + colorPhase);\n"
+	"	gl_Position = projection * eye;\n"
+	"}\n";
+
+// GL's lighting equation for light 0 with color material driving ambient and
+// diffuse and a non-local viewer, the same one SoftRenderer evaluates per
+// vertex, here per pixel. A zero normal marks text, which is not lit.
+static const char* fragmentShaderSource =
+	"#version 330 core\n"
+	"layout(std140) uniform Lighting {\n"
+	"	vec4 lightPosition;\n"
+	"	vec4 lightDiffuse;\n"
+	"	vec4 specular;\n"
+	"};\n"
+	"in vec3 eyePosition;\n"
+	"in vec3 eyeNormal;\n"
+	"in vec3 vertexColor;\n"
+	"out vec4 fragColor;\n"
+	"const float globalAmbient = 0.2;\n"
+	"void main() {\n"
+	"	if (eyeNormal == vec3(0.0)) {\n"
+	"		fragColor = vec4(clamp(vertexColor, 0.0, 1.0), 1.0);\n"
+	"		return;\n"
+	"	}\n"
+	"	vec3 n = normalize(eyeNormal);\n"
+	"	vec3 toLight = normalize(lightPosition.w != 0.0\n"
+	"		? lightPosition.xyz / lightPosition.w - eyePosition : lightPosition.xyz);\n"
+	"	float diffuse = max(dot(n, toLight), 0.0);\n"
+	"	float highlight = 0.0;\n"
+	"	if (diffuse > 0.0) {\n"
+	"		float nDotH = dot(n, normalize(toLight + vec3(0.0, 0.0, 1.0)));\n"
+	"		if (nDotH > 0.0) highlight = pow(nDotH, specular.w);\n"
+	"	}\n"
+	"	vec3 lit = vertexColor * (globalAmbient + diffuse * lightDiffuse.rgb) + highlight * specular.rgb;\n"
+	"	fragColor = vec4(clamp(lit, 0.0, 1.0), 1.0);\n"
+	"}\n";
+
+#define VERTEX_FLOATS 15     // Position, normal, then the color waves
+#define VERTEX_ATTRIBUTES 5  // Three floats each
+#define INSTANCE_ATTRIBUTE 5 // After them, from its own buffer
+
+#define GLYPH_DOT_PIXELS 2   // Screen pixels per font dot: about the height of GLUT's Helvetica 18
+#define GLYPH_ADVANCE 6      // Dots from one character to the next
+
+// 5x7 font for ' ' to '~', a byte per column with the top row in bit 0.
+static const unsigned char glyphs[95][5] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+	{ 0x00, 0x00, 0x5F, 0x00, 0x00 }, // !
+	{ 0x00, 0x07, 0x00, 0x07, 0x00 }, // "
+	{ 0x14, 0x7F, 0x14, 0x7F, 0x14 }, // #
+	{ 0x24, 0x2A, 0x7F, 0x2A, 0x12 }, // $
+	{ 0x23, 0x13, 0x08, 0x64, 0x62 }, // %
+	{ 0x36, 0x49, 0x55, 0x22, 0x50 }, // &
+	{ 0x00, 0x05, 0x03, 0x00, 0x00 }, // '
+	{ 0x00, 0x1C, 0x22, 0x41, 0x00 }, // (
+	{ 0x00, 0x41, 0x22, 0x1C, 0x00 }, // )
+	{ 0x08, 0x2A, 0x1C, 0x2A, 0x08 }, // *
+	{ 0x08, 0x08, 0x3E, 0x08, 0x08 }, // +
+	{ 0x00, 0x50, 0x30, 0x00, 0x00 }, // ,
+	{ 0x08, 0x08, 0x08, 0x08, 0x08 }, // -
+	{ 0x00, 0x60, 0x60, 0x00, 0x00 }, // .
+	{ 0x20, 0x10, 0x08, 0x04, 0x02 }, // /
+	{ 0x3E, 0x51, 0x49, 0x45, 0x3E }, // 0
+	{ 0x00, 0x42, 0x7F, 0x40, 0x00 }, // 1
+	{ 0x42, 0x61, 0x51, 0x49, 0x46 }, // 2
+	{ 0x21, 0x41, 0x45, 0x4B, 0x31 }, // 3
+	{ 0x18, 0x14, 0x12, 0x7F, 0x10 }, // 4
+	{ 0x27, 0x45, 0x45, 0x45, 0x39 }, // 5
+	{ 0x3C, 0x4A, 0x49, 0x49, 0x30 }, // 6
+	{ 0x01, 0x71, 0x09, 0x05, 0x03 }, // 7
+	{ 0x36, 0x49, 0x49, 0x49, 0x36 }, // 8
+	{ 0x06, 0x49, 0x49, 0x29, 0x1E }, // 9
+	{ 0x00, 0x36, 0x36, 0x00, 0x00 }, // :
+	{ 0x00, 0x56, 0x36, 0x00, 0x00 }, // ;
+	{ 0x08, 0x14, 0x22, 0x41, 0x00 }, // <
+	{ 0x14, 0x14, 0x14, 0x14, 0x14 }, // =
+	{ 0x00, 0x41, 0x22, 0x14, 0x08 }, // >
+	{ 0x02, 0x01, 0x51, 0x09, 0x06 }, // ?
+	{ 0x32, 0x49, 0x79, 0x41, 0x3E }, // @
+	{ 0x7E, 0x11, 0x11, 0x11, 0x7E }, // A
+	{ 0x7F, 0x49, 0x49, 0x49, 0x36 }, // B
+	{ 0x3E, 0x41, 0x41, 0x41, 0x22 }, // C
+	{ 0x7F, 0x41, 0x41, 0x22, 0x1C }, // D
+	{ 0x7F, 0x49, 0x49, 0x49, 0x41 }, // E
+	{ 0x7F, 0x09, 0x09, 0x01, 0x01 }, // F
+	{ 0x3E, 0x41, 0x41, 0x51, 0x32 }, // G
+	{ 0x7F, 0x08, 0x08, 0x08, 0x7F }, // H
+	{ 0x00, 0x41, 0x7F, 0x41, 0x00 }, // I
+	{ 0x20, 0x40, 0x41, 0x3F, 0x01 }, // J
+	{ 0x7F, 0x08, 0x14, 0x22, 0x41 }, // K
+	{ 0x7F, 0x40, 0x40, 0x40, 0x40 }, // L
+	{ 0x7F, 0x02, 0x04, 0x02, 0x7F }, // M
+	{ 0x7F, 0x04, 0x08, 0x10, 0x7F }, // N
+	{ 0x3E, 0x41, 0x41, 0x41, 0x3E }, // O
+	{ 0x7F, 0x09, 0x09, 0x09, 0x06 }, // P
+	{ 0x3E, 0x41, 0x51, 0x21, 0x5E }, // Q
+	{ 0x7F, 0x09, 0x19, 0x29, 0x46 }, // R
+	{ 0x46, 0x49, 0x49, 0x49, 0x31 }, // S
+	{ 0x01, 0x01, 0x7F, 0x01, 0x01 }, // T
+	{ 0x3F, 0x40, 0x40, 0x40, 0x3F }, // U
+	{ 0x1F, 0x20, 0x40, 0x20, 0x1F }, // V
+	{ 0x7F, 0x20, 0x18, 0x20, 0x7F }, // W
+	{ 0x63, 0x14, 0x08, 0x14, 0x63 }, // X
+	{ 0x03, 0x04, 0x78, 0x04, 0x03 }, // Y
+	{ 0x61, 0x51, 0x49, 0x45, 0x43 }, // Z
+	{ 0x00, 0x7F, 0x41, 0x41, 0x00 }, // [
+	{ 0x02, 0x04, 0x08, 0x10, 0x20 }, // backslash
+	{ 0x00, 0x41, 0x41, 0x7F, 0x00 }, // ]
+	{ 0x04, 0x02, 0x01, 0x02, 0x04 }, // ^
+	{ 0x40, 0x40, 0x40, 0x40, 0x40 }, // _
+	{ 0x00, 0x01, 0x02, 0x04, 0x00 }, // `
+	{ 0x20, 0x54, 0x54, 0x54, 0x78 }, // a
+	{ 0x7F, 0x48, 0x44, 0x44, 0x38 }, // b
+	{ 0x38, 0x44, 0x44, 0x44, 0x20 }, // c
+	{ 0x38, 0x44, 0x44, 0x48, 0x7F }, // d
+	{ 0x38, 0x54, 0x54, 0x54, 0x18 }, // e
+	{ 0x08, 0x7E, 0x09, 0x01, 0x02 }, // f
+	{ 0x08, 0x14, 0x54, 0x54, 0x3C }, // g
+	{ 0x7F, 0x08, 0x04, 0x04, 0x78 }, // h
+	{ 0x00, 0x44, 0x7D, 0x40, 0x00 }, // i
+	{ 0x20, 0x40, 0x44, 0x3D, 0x00 }, // j
+	{ 0x00, 0x7F, 0x10, 0x28, 0x44 }, // k
+	{ 0x00, 0x41, 0x7F, 0x40, 0x00 }, // l
+	{ 0x7C, 0x04, 0x18, 0x04, 0x78 }, // m
+	{ 0x7C, 0x08, 0x04, 0x04, 0x78 }, // n
+	{ 0x38, 0x44, 0x44, 0x44, 0x38 }, // o
+	{ 0x7C, 0x14, 0x14, 0x14, 0x08 }, // p
+	{ 0x08, 0x14, 0x14, 0x18, 0x7C }, // q
+	{ 0x7C, 0x08, 0x04, 0x04, 0x08 }, // r
+	{ 0x48, 0x54, 0x54, 0x54, 0x20 }, // s
+	{ 0x04, 0x3F, 0x44, 0x40, 0x20 }, // t
+	{ 0x3C, 0x40, 0x40, 0x20, 0x7C }, // u
+	{ 0x1C, 0x20, 0x40, 0x20, 0x1C }, // v
+	{ 0x3C, 0x40, 0x30, 0x40, 0x3C }, // w
+	{ 0x44, 0x28, 0x10, 0x28, 0x44 }, // x
+	{ 0x0C, 0x50, 0x50, 0x50, 0x3C }, // y
+	{ 0x44, 0x64, 0x54, 0x4C, 0x44 }, // z
+	{ 0x00, 0x08, 0x36, 0x41, 0x00 }, // {
+	{ 0x00, 0x00, 0x7F, 0x00, 0x00 }, // |
+	{ 0x00, 0x41, 0x36, 0x08, 0x00 }, // }
+	{ 0x08, 0x04, 0x08, 0x10, 0x08 }, // ~
+};
+
+// Header of SHADER_CACHE_FILE, followed by the program binary.
+struct ShaderCacheHeader {
+	char magic[4];    // "SHB1"
+	unsigned int key; // hashShaderKey() of the program it was saved from
+	unsigned int format;
+	unsigned int length;
+};
+
+// 32-bit FNV-1a over the shader sources and the driver that compiled them.
+// A driver update changes the key, so stale binaries are never offered.
+static unsigned int hashShaderKey() {
+	const char* parts[] = {
+		vertexShaderSource, fragmentShaderSource,
+		(const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION)
+	};
+	unsigned int hash = 2166136261u;
+	for (const char* part : parts) {
+		for (const char* c = part ? part : ""; *c; c++) {
+			hash ^= (unsigned char)*c;
+			hash *= 16777619u;
+		}
+		hash *= 16777619u; // Keeps "ab"+"c" apart from "a"+"bc"
+	}
+	return hash;
+}
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static GLuint compileStage(GLenum type, const char* source) {
+	GLuint shader = createShader(type);
+	shaderSource(shader, 1, &source, 0);
+	compileShader(shader);
+	GLint ok = 0;
+	getShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok) {
+		char log[1024] = "";
+		getShaderInfoLog(shader, sizeof(log), 0, log);
+		printf("[shader] %s shader did not compile: %s\n", type == GL_VERTEX_SHADER ? "vertex" : "fragment", log);
+		deleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+ShaderRenderer::ShaderRenderer(bool bitmapFonts)
+	: bitmapFonts(bitmapFonts), program(0), vertexArray(0), vertexBuffer(0), instanceBuffer(0),
+	mode(MATRIX_MODELVIEW), time(0), uploadedTime(0), blocksUploaded(false), primitiveType(PRIM_TRIANGLES),
+	instances(0), instanceCount(0) {
+	blockBuffers[0] = blockBuffers[1] = blockBuffers[2] = 0;
+	resetStats();
+}
+
+void ShaderRenderer::resetStats() {
+	memset(&stats, 0, sizeof(stats));
+}
+
+void ShaderRenderer::init() {
+	glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
+	glEnable(GL_DEPTH_TEST);
+
+	modelview = MatrixStack();
+	projection = MatrixStack();
+	mode = MATRIX_MODELVIEW;
+	current.color[0] = current.color[1] = current.color[2] = constantWave(1.0f);
+	current.normal[0] = current.normal[1] = 0.0f;
+	current.normal[2] = 1.0f;
+	LightingBlock& l = current.lighting;
+	memset(&l, 0, sizeof(l));
+	l.lightPosition[2] = 1.0f;
+	l.lightDiffuse[0] = l.lightDiffuse[1] = l.lightDiffuse[2] = l.lightDiffuse[3] = 1.0f;
+	attribStack.clear();
+	blocksUploaded = false;
+
+	if (program) return;
+	if (!loadGLProcs() || !buildProgram()) {
+		printf("[shader] %s cannot run the GLSL 3.3 pipeline\n", (const char*)glGetString(GL_RENDERER));
+		return;
+	}
+
+	// Both blocks keep their binding points for good; only their contents change.
+	uniformBlockBinding(program, getUniformBlockIndex(program, "Transform"), 0);
+	uniformBlockBinding(program, getUniformBlockIndex(program, "Lighting"), 1);
+	uniformBlockBinding(program, getUniformBlockIndex(program, "Animation"), 2);
+	genBuffers(3, blockBuffers);
+	bindBuffer(GL_UNIFORM_BUFFER, blockBuffers[0]);
+	bufferData(GL_UNIFORM_BUFFER, sizeof(TransformBlock), 0, GL_DYNAMIC_DRAW);
+	bindBuffer(GL_UNIFORM_BUFFER, blockBuffers[1]);
+	bufferData(GL_UNIFORM_BUFFER, sizeof(LightingBlock), 0, GL_DYNAMIC_DRAW);
+	bindBuffer(GL_UNIFORM_BUFFER, blockBuffers[2]);
+	bufferData(GL_UNIFORM_BUFFER, sizeof(AnimationBlock), 0, GL_DYNAMIC_DRAW);
+	for (int i = 0; i < 3; i++) bindBufferBase(GL_UNIFORM_BUFFER, i, blockBuffers[i]);
+
+	genVertexArrays(1, &vertexArray);
+	genBuffers(1, &vertexBuffer);
+	bindVertexArray(vertexArray);
+	bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	for (int i = 0; i < VERTEX_ATTRIBUTES; i++) {
+		vertexAttribPointer(i, 3, GL_FLOAT, GL_FALSE, VERTEX_FLOATS * sizeof(float), (const void*)(i * 3 * sizeof(float)));
+		enableVertexAttribArray(i);
+	}
+	// Only enabled for instanced draws; the rest read the constant, which
+	// places nothing.
+	genBuffers(1, &instanceBuffer);
+	bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	vertexAttribPointer(INSTANCE_ATTRIBUTE, INSTANCE_FLOATS, GL_FLOAT, GL_FALSE, 0, 0);
+	vertexAttribDivisor(INSTANCE_ATTRIBUTE, 1);
+	vertexAttrib4f(INSTANCE_ATTRIBUTE, 0.0f, 0.0f, 0.0f, 0.0f);
+	useProgram(program);
+}
+
+bool ShaderRenderer::buildProgram() {
+	auto start = std::chrono::steady_clock::now();
+	GLint formats = 0;
+	bool cacheable = programParameteri && getProgramBinary && programBinary;
+	if (cacheable) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	cacheable = cacheable && formats > 0;
+	unsigned int key = cacheable ? hashShaderKey() : 0;
+
+	if (cacheable) {
+		program = loadCachedProgram(key);
+		if (program) {
+			printf("[shader] loaded the program from %s in %.2f ms\n", SHADER_CACHE_FILE, msSince(start));
+			return true;
+		}
+	}
+
+	GLuint vertexShader = compileStage(GL_VERTEX_SHADER, vertexShaderSource);
+	GLuint fragmentShader = compileStage(GL_FRAGMENT_SHADER, fragmentShaderSource);
+	if (!vertexShader || !fragmentShader) {
+		if (vertexShader) deleteShader(vertexShader);
+		if (fragmentShader) deleteShader(fragmentShader);
+		return false;
+	}
+	GLuint linked = createProgram();
+	attachShader(linked, vertexShader);
+	attachShader(linked, fragmentShader);
+	if (cacheable) programParameteri(linked, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	linkProgram(linked);
+	deleteShader(vertexShader); // Freed along with the program
+	deleteShader(fragmentShader);
+	GLint ok = 0;
+	getProgramiv(linked, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		char log[1024] = "";
+		getProgramInfoLog(linked, sizeof(log), 0, log);
+		printf("[shader] program did not link: %s\n", log);
+		deleteProgram(linked);
+		return false;
+	}
+	program = linked;
+	printf("[shader] compiled and linked the program in %.2f ms\n", msSince(start));
+	if (cacheable) saveCachedProgram(key, program);
+	return true;
+}
+
+// Returns 0 when there is no cache for key or the driver turns it down.
+unsigned int ShaderRenderer::loadCachedProgram(unsigned int key) {
+	FILE* f = fopen(SHADER_CACHE_FILE, "rb");
+	if (!f) return 0;
+	ShaderCacheHeader header;
+	std::vector<char> binary;
+	bool ok = fread(&header, sizeof(header), 1, f) == 1
+		&& memcmp(header.magic, "SHB1", 4) == 0 && header.key == key && header.length > 0;
+	if (ok) {
+		binary.resize(header.length);
+		ok = fread(binary.data(), header.length, 1, f) == 1;
+	}
+	fclose(f);
+	if (!ok) return 0;
+
+	GLuint loaded = createProgram();
+	programBinary(loaded, header.format, binary.data(), (GLsizei)header.length);
+	GLint linked = 0;
+	getProgramiv(loaded, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		printf("[shader] %s was turned down by the driver, recompiling\n", SHADER_CACHE_FILE);
+		deleteProgram(loaded);
+		return 0;
+	}
+	return loaded;
+}
+
+void ShaderRenderer::saveCachedProgram(unsigned int key, unsigned int program) {
+	GLint length = 0;
+	getProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	getProgramBinary(program, length, &length, &format, binary.data());
+
+	ShaderCacheHeader header;
+	memcpy(header.magic, "SHB1", 4);
+	header.key = key;
+	header.format = format;
+	header.length = (unsigned int)length;
+	FILE* f = fopen(SHADER_CACHE_FILE, "wb");
+	bool written = f
+		&& fwrite(&header, sizeof(header), 1, f) == 1
+		&& fwrite(binary.data(), length, 1, f) == 1;
+	if (f) fclose(f);
+	if (!written) printf("[shader] could not write %s\n", SHADER_CACHE_FILE);
+}
+
+void ShaderRenderer::clear() {
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void ShaderRenderer::flush() {
+	glFlush();
+}
+
+void ShaderRenderer::setTime(float time) {
+	this->time = time;
+}
+
+MatrixStack& ShaderRenderer::stack() {
+	return mode == MATRIX_PROJECTION ? projection : modelview;
+}
+
+void ShaderRenderer::matrixMode(MatrixMode mode) {
+	this->mode = mode;
+}
+
+void ShaderRenderer::loadIdentity() {
+	stack().loadIdentity();
+}
+
+void ShaderRenderer::pushMatrix() {
+	stack().push();
+}
+
+void ShaderRenderer::popMatrix() {
+	stack().pop();
+}
+
+void ShaderRenderer::translate(float x, float y, float z) {
+	stack().translate(x, y, z);
+}
+
+void ShaderRenderer::rotate(float angle, float x, float y, float z) {
+	stack().rotate(angle, x, y, z);
+}
+
+void ShaderRenderer::scale(float x, float y, float z) {
+	stack().scale(x, y, z);
+}
+
+// Evaluated here rather than in the shader: the scale sits partway down the
+// matrix stack, and the matrices are rebuilt every frame anyway.
+void ShaderRenderer::scaleWave(const TimeWave& s) {
+	float value = evaluateWave(s, time);
+	stack().scale(value, value, value);
+}
+
+void ShaderRenderer::multMatrix(const float m[16]) {
+	stack().multiply(m);
+}
+
+void ShaderRenderer::perspective(float fovy, float aspect, float zNear, float zFar) {
+	stack().perspective(fovy, aspect, zNear, zFar);
+}
+
+void ShaderRenderer::ortho2D(float left, float right, float bottom, float top) {
+	stack().ortho2D(left, right, bottom, top);
+}
+
+void ShaderRenderer::lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+	float upX, float upY, float upZ) {
+	stack().lookAt(eyeX, eyeY, eyeZ, centerX, centerY, centerZ, upX, upY, upZ);
+}
+
+void ShaderRenderer::pushAttrib() {
+	attribStack.push_back(current);
+}
+
+void ShaderRenderer::popAttrib() {
+	if (attribStack.empty()) return;
+	current = attribStack.back();
+	attribStack.pop_back();
+}
+
+void ShaderRenderer::setMaterial(const float[4], const float[4], const float specular[4], float shininess) {
+	// Ambient and diffuse come from the vertex color, as with color material.
+	for (int i = 0; i < 3; i++) current.lighting.specular[i] = specular[i];
+	current.lighting.specular[3] = shininess;
+}
+
+void ShaderRenderer::setLight(const float position[4], const float diffuse[4]) {
+	const float* m = modelview.top();
+	for (int i = 0; i < 4; i++) {
+		current.lighting.lightPosition[i] = m[i] * position[0] + m[4 + i] * position[1] + m[8 + i] * position[2] + m[12 + i] * position[3];
+	}
+	for (int i = 0; i < 4; i++) current.lighting.lightDiffuse[i] = diffuse[i];
+}
+
+void ShaderRenderer::color(float r, float g, float b) {
+	current.color[0] = constantWave(r);
+	current.color[1] = constantWave(g);
+	current.color[2] = constantWave(b);
+}
+
+void ShaderRenderer::colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b) {
+	current.color[0] = r;
+	current.color[1] = g;
+	current.color[2] = b;
+}
+
+void ShaderRenderer::normal(float x, float y, float z) {
+	current.normal[0] = x;
+	current.normal[1] = y;
+	current.normal[2] = z;
+}
+
+void ShaderRenderer::lineWidth(float width) {
+	glLineWidth(width);
+}
+
+void ShaderRenderer::begin(PrimitiveType type) {
+	primitiveType = type;
+	vertices.clear();
+}
+
+void ShaderRenderer::vertex(float x, float y, float z) {
+	const TimeWave* c = current.color;
+	float v[VERTEX_FLOATS] = {
+		x, y, z,
+		current.normal[0], current.normal[1], current.normal[2],
+		c[0].offset, c[1].offset, c[2].offset,
+		c[0].amplitude, c[1].amplitude, c[2].amplitude,
+		c[0].phase, c[1].phase, c[2].phase
+	};
+	vertices.insert(vertices.end(), v, v + VERTEX_FLOATS);
+}
+
+// Writes whichever block differs from what the shader last saw. The scene
+// sets the same light and material every frame and draws many primitives
+// under one matrix, so most draws write nothing.
+void ShaderRenderer::uploadBlocks() {
+	TransformBlock transform;
+	memcpy(transform.modelview, modelview.top(), sizeof(transform.modelview));
+	memcpy(transform.projection, projection.top(), sizeof(transform.projection));
+	float normalMatrix[9];
+	computeNormalMatrix(modelview.top(), normalMatrix);
+	for (int col = 0; col < 3; col++) {
+		memcpy(transform.normalMatrix + col * 4, normalMatrix + col * 3, 3 * sizeof(float));
+		transform.normalMatrix[col * 4 + 3] = 0.0f;
+	}
+
+	if (!blocksUploaded || memcmp(&transform, &uploadedTransform, sizeof(transform)) != 0) {
+		bindBuffer(GL_UNIFORM_BUFFER, blockBuffers[0]);
+		bufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(transform), &transform);
+		uploadedTransform = transform;
+		stats.transformUploads++;
+	}
+	if (!blocksUploaded || memcmp(&current.lighting, &uploadedLighting, sizeof(LightingBlock)) != 0) {
+		bindBuffer(GL_UNIFORM_BUFFER, blockBuffers[1]);
+		bufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightingBlock), &current.lighting);
+		uploadedLighting = current.lighting;
+		stats.lightingUploads++;
+	}
+	if (!blocksUploaded || time != uploadedTime) {
+		AnimationBlock animation = { time, { 0.0f, 0.0f, 0.0f } };
+		bindBuffer(GL_UNIFORM_BUFFER, blockBuffers[2]);
+		bufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(animation), &animation);
+		uploadedTime = time;
+		stats.timeUploads++;
+	}
+	blocksUploaded = true;
+}
+
+void ShaderRenderer::end() {
+	if (!program || vertices.empty()) return;
+	int count = (int)vertices.size() / VERTEX_FLOATS;
+	const float* data = vertices.data();
+	GLenum mode;
+	switch (primitiveType) {
+	case PRIM_LINES: mode = GL_LINES; break;
+	case PRIM_LINE_STRIP: mode = GL_LINE_STRIP; break;
+	case PRIM_TRIANGLE_FAN: mode = GL_TRIANGLE_FAN; break;
+	case PRIM_QUAD_STRIP: mode = GL_TRIANGLE_STRIP; break; // Same vertex order, same quads
+	case PRIM_QUADS: {
+		// Quads are gone from the core profile: 0 1 2 3 becomes 0 1 2, 0 2 3.
+		static const int corners[6] = { 0, 1, 2, 0, 2, 3 };
+		triangles.clear();
+		for (int quad = 0; quad + 4 <= count; quad += 4) {
+			for (int corner : corners) {
+				const float* v = data + (quad + corner) * VERTEX_FLOATS;
+				triangles.insert(triangles.end(), v, v + VERTEX_FLOATS);
+			}
+		}
+		data = triangles.data();
+		count = (int)triangles.size() / VERTEX_FLOATS;
+		mode = GL_TRIANGLES;
+		break;
+	}
+	default: mode = GL_TRIANGLES; break;
+	}
+	if (count == 0) return;
+
+	uploadBlocks();
+	bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	bufferData(GL_ARRAY_BUFFER, count * VERTEX_FLOATS * sizeof(float), data, GL_STREAM_DRAW); // Orphans last draw's data
+	if (instanceCount > 0) {
+		bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		bufferData(GL_ARRAY_BUFFER, instanceCount * INSTANCE_FLOATS * sizeof(float), instances, GL_STREAM_DRAW);
+		enableVertexAttribArray(INSTANCE_ATTRIBUTE);
+		drawArraysInstanced(mode, 0, count, instanceCount);
+		disableVertexAttribArray(INSTANCE_ATTRIBUTE);
+	}
+	else {
+		glDrawArrays(mode, 0, count);
+	}
+	stats.draws++;
+}
+
+// drawMesh() streams the mesh's vertices once; end() sees the placements
+// and draws them instanceCount times.
+void ShaderRenderer::drawMeshInstances(const Mesh& mesh, const float* instances, int count) {
+	if (count <= 0) return;
+	this->instances = instances;
+	instanceCount = count;
+	drawMesh(mesh);
+	instanceCount = 0;
+}
+
+// The core profile has no bitmap fonts, so each dot of the glyph goes
+// through the program as a quad, sized in screen pixels the way
+// glutBitmapCharacter draws, with x, y on the baseline.
+void ShaderRenderer::text(float x, float y, const char* s) {
+	if (!bitmapFonts || !program) return;
+	float m[16];
+	multiplyMatrices(projection.top(), modelview.top(), m);
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (m[0] == 0 || m[5] == 0 || viewport[2] <= 0 || viewport[3] <= 0) return;
+	float dotX = GLYPH_DOT_PIXELS * 2.0f / (m[0] * viewport[2]);
+	float dotY = GLYPH_DOT_PIXELS * 2.0f / (m[5] * viewport[3]);
+
+	pushAttrib();
+	normal(0.0f, 0.0f, 0.0f);
+	begin(PRIM_QUADS);
+	for (; *s; s++, x += GLYPH_ADVANCE * dotX) {
+		if (*s < ' ' || *s > '~') continue;
+		const unsigned char* glyph = glyphs[*s - ' '];
+		for (int col = 0; col < 5; col++) {
+			for (int row = 0; row < 7; row++) {
+				if (!(glyph[col] >> row & 1)) continue;
+				float left = x + col * dotX;
+				float bottom = y + (6 - row) * dotY;
+				vertex(left, bottom, 0.0f);
+				vertex(left + dotX, bottom, 0.0f);
+				vertex(left + dotX, bottom + dotY, 0.0f);
+				vertex(left, bottom + dotY, 0.0f);
+			}
+		}
+	}
+	end();
+	popAttrib();
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "MatrixStack.h"
+#include "Renderer.h"
+
+#include <vector>
+
+struct ShaderRendererStats {
+	int draws;
+	int transformUploads; // Transform block writes; a draw under an unchanged matrix makes none
+	int lightingUploads;  // Lighting block writes
+	int timeUploads;      // Animation block writes, one per frame that moved the clock
+};
+
+// Draws through one GLSL 3.3 program with per-pixel lighting instead of the
+// fixed-function pipeline. Matrices are kept on the CPU and reach the shader
+// in uniform blocks, which are only written when their contents changed
+// since the last draw. Each begin()/end() pair is one draw from a streaming
+// vertex buffer. Normals go through the modelview's inverse transpose and
+// are renormalized per pixel, so GL_NORMALIZE is left off.
+//
+// Vertex colors are TimeWaves, evaluated in the vertex shader against the
+// time in a third block: animating colors rewrites that block and nothing
+// else.
+//
+// drawMeshInstances() is one instanced draw: the placements go into their
+// own buffer as a per-instance attribute, and the vertex shader turns and
+// moves each copy.
+//
+// The linked program is cached in SHADER_CACHE_FILE as a program binary,
+// keyed on the shader sources and the GL renderer and version, so later
+// runs on the same driver skip compiling.
+#define SHADER_CACHE_FILE "shaders.bin"
+
+class ShaderRenderer : public Renderer {
+public:
+	// bitmapFonts says whether GLUT has been initialised. Text is drawn
+	// from a built-in font through the program, but only then, so frames
+	// match GLRenderer's, which needs GLUT for its fonts.
+	explicit ShaderRenderer(bool bitmapFonts);
+
+	// False until init() has built the program, and after it failed to: the
+	// GL is older than 3.3 or the shaders did not compile.
+	bool isReady() const { return program != 0; }
+
+	ShaderRendererStats getStats() const { return stats; }
+	void resetStats();
+
+	void init();
+	void clear();
+	void flush();
+	void setTime(float time);
+
+	void matrixMode(MatrixMode mode);
+	void loadIdentity();
+	void pushMatrix();
+	void popMatrix();
+	void translate(float x, float y, float z);
+	void rotate(float angle, float x, float y, float z);
+	void scale(float x, float y, float z);
+	void scaleWave(const TimeWave& s);
+	void multMatrix(const float m[16]);
+	void perspective(float fovy, float aspect, float zNear, float zFar);
+	void ortho2D(float left, float right, float bottom, float top);
+	void lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+		float upX, float upY, float upZ);
+
+	void pushAttrib();
+	void popAttrib();
+	void setMaterial(const float ambient[4], const float diffuse[4], const float specular[4], float shininess);
+	void setLight(const float position[4], const float diffuse[4]);
+
+	void color(float r, float g, float b);
+	void colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b);
+	void normal(float x, float y, float z);
+	void lineWidth(float width);
+	void begin(PrimitiveType type);
+	void vertex(float x, float y, float z);
+	void end();
+
+	void text(float x, float y, const char* s);
+	void drawMeshInstances(const Mesh& mesh, const float* instances, int count);
+
+private:
+	// std140 layouts of the shader's uniform blocks.
+	struct TransformBlock {
+		float modelview[16];
+		float projection[16];
+		float normalMatrix[12]; // A mat3 is three vec4 columns
+	};
+
+	struct LightingBlock {
+		float lightPosition[4]; // Eye space
+		float lightDiffuse[4];
+		float specular[4];      // w is the shininess
+	};
+
+	struct AnimationBlock {
+		float time;
+		float padding[3];
+	};
+
+	struct Attrib {
+		TimeWave color[3];
+		float normal[3];
+		LightingBlock lighting;
+	};
+
+	MatrixStack& stack();
+	bool buildProgram();
+	unsigned int loadCachedProgram(unsigned int key);
+	void saveCachedProgram(unsigned int key, unsigned int program);
+	void uploadBlocks();
+
+	bool bitmapFonts;
+	unsigned int program;
+	unsigned int vertexArray;
+	unsigned int vertexBuffer;
+	unsigned int blockBuffers[3]; // Transform, lighting, animation
+	unsigned int instanceBuffer;
+
+	MatrixStack modelview, projection;
+	MatrixMode mode;
+	float time;
+
+	Attrib current;
+	std::vector<Attrib> attribStack;
+
+	// What the blocks hold right now, to skip writes that change nothing.
+	TransformBlock uploadedTransform;
+	LightingBlock uploadedLighting;
+	float uploadedTime;
+	bool blocksUploaded;
+
+	PrimitiveType primitiveType;
+	const float* instances; // Set for the end() a drawMeshInstances() makes
+	int instanceCount;      // 0 outside drawMeshInstances()
+	std::vector<float> vertices;  // Position, normal, color waves per vertex
+	std::vector<float> triangles; // Quads split up, ready to draw
+
+	ShaderRendererStats stats;
+};
@@ -0,0 +1,130 @@
+#include "Shapes.h"
+#include "Renderer.h"
+
+#include <math.h>
+
+#define MAX_SHAPE_SLICES 128
+#define SHAPE_PI 3.14159265358979323846
+
+void solidCube(double size) {
+	static const float normals[6][3] = {
+		{ -1, 0, 0 }, { 0, 1, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+	};
+	static const int faces[6][4] = {
+		{ 0, 1, 2, 3 }, { 3, 2, 6, 7 }, { 7, 6, 5, 4 }, { 4, 5, 1, 0 }, { 5, 6, 2, 1 }, { 7, 4, 0, 3 }
+	};
+	float h = (float)size / 2;
+	float v[8][3];
+	v[0][0] = v[1][0] = v[2][0] = v[3][0] = -h;
+	v[4][0] = v[5][0] = v[6][0] = v[7][0] = h;
+	v[0][1] = v[1][1] = v[4][1] = v[5][1] = -h;
+	v[2][1] = v[3][1] = v[6][1] = v[7][1] = h;
+	v[0][2] = v[3][2] = v[4][2] = v[7][2] = -h;
+	v[1][2] = v[2][2] = v[5][2] = v[6][2] = h;
+
+	renderer->begin(PRIM_QUADS);
+	for (int i = 5; i >= 0; i--) {
+		renderer->normal(normals[i][0], normals[i][1], normals[i][2]);
+		for (int j = 0; j < 4; j++) {
+			const float* p = v[faces[i][j]];
+			renderer->vertex(p[0], p[1], p[2]);
+		}
+	}
+	renderer->end();
+}
+
+// Smooth-shaded, outside facing, like gluSphere with GLU_FILL and GLU_SMOOTH.
+void solidSphere(double radius, int slices, int stacks) {
+	if (slices > MAX_SHAPE_SLICES) slices = MAX_SHAPE_SLICES;
+	if (stacks > MAX_SHAPE_SLICES) stacks = MAX_SHAPE_SLICES;
+	if (slices < 2 || stacks < 2) return;
+
+	float sinSlice[MAX_SHAPE_SLICES + 1], cosSlice[MAX_SHAPE_SLICES + 1];
+	float sinStack[MAX_SHAPE_SLICES + 1], cosStack[MAX_SHAPE_SLICES + 1];
+	for (int i = 0; i < slices; i++) {
+		double angle = 2 * SHAPE_PI * i / slices;
+		sinSlice[i] = (float)sin(angle);
+		cosSlice[i] = (float)cos(angle);
+	}
+	sinSlice[slices] = sinSlice[0];
+	cosSlice[slices] = cosSlice[0];
+	for (int j = 0; j <= stacks; j++) {
+		double angle = SHAPE_PI * j / stacks;
+		sinStack[j] = (float)sin(angle);
+		cosStack[j] = (float)cos(angle);
+	}
+	sinStack[0] = 0;
+	sinStack[stacks] = 0;
+	float r = (float)radius;
+
+	// The poles are fans, everything between is a quad strip per stack.
+	renderer->begin(PRIM_TRIANGLE_FAN);
+	renderer->normal(0, 0, 1);
+	renderer->vertex(0, 0, r);
+	for (int i = slices; i >= 0; i--) {
+		renderer->normal(sinSlice[i] * sinStack[1], cosSlice[i] * sinStack[1], cosStack[1]);
+		renderer->vertex(r * sinSlice[i] * sinStack[1], r * cosSlice[i] * sinStack[1], r * cosStack[1]);
+	}
+	renderer->end();
+
+	renderer->begin(PRIM_TRIANGLE_FAN);
+	renderer->normal(0, 0, -1);
+	renderer->vertex(0, 0, -r);
+	int last = stacks - 1;
+	for (int i = 0; i <= slices; i++) {
+		renderer->normal(sinSlice[i] * sinStack[last], cosSlice[i] * sinStack[last], cosStack[last]);
+		renderer->vertex(r * sinSlice[i] * sinStack[last], r * cosSlice[i] * sinStack[last], r * cosStack[last]);
+	}
+	renderer->end();
+
+	for (int j = 1; j < stacks - 1; j++) {
+		renderer->begin(PRIM_QUAD_STRIP);
+		for (int i = 0; i <= slices; i++) {
+			renderer->normal(sinSlice[i] * sinStack[j + 1], cosSlice[i] * sinStack[j + 1], cosStack[j + 1]);
+			renderer->vertex(r * sinSlice[i] * sinStack[j + 1], r * cosSlice[i] * sinStack[j + 1], r * cosStack[j + 1]);
+			renderer->normal(sinSlice[i] * sinStack[j], cosSlice[i] * sinStack[j], cosStack[j]);
+			renderer->vertex(r * sinSlice[i] * sinStack[j], r * cosSlice[i] * sinStack[j], r * cosStack[j]);
+		}
+		renderer->end();
+	}
+}
+
+// Open at the base, like GLUT's.
+void solidCone(double base, double height, int slices, int stacks) {
+	solidCylinder(base, 0.0, height, slices, stacks);
+}
+
+// Along +z from the origin, open at both ends, like gluCylinder.
+void solidCylinder(double baseRadius, double topRadius, double height, int slices, int stacks) {
+	if (slices > MAX_SHAPE_SLICES) slices = MAX_SHAPE_SLICES;
+	if (slices < 2 || stacks < 1 || height == 0) return;
+
+	double deltaRadius = baseRadius - topRadius;
+	double length = sqrt(deltaRadius * deltaRadius + height * height);
+	float zNormal = (float)(deltaRadius / length);
+	float xyNormalRatio = (float)(height / length);
+
+	float sinSlice[MAX_SHAPE_SLICES + 1], cosSlice[MAX_SHAPE_SLICES + 1];
+	for (int i = 0; i < slices; i++) {
+		double angle = 2 * SHAPE_PI * i / slices;
+		sinSlice[i] = (float)sin(angle);
+		cosSlice[i] = (float)cos(angle);
+	}
+	sinSlice[slices] = sinSlice[0];
+	cosSlice[slices] = cosSlice[0];
+
+	for (int j = 0; j < stacks; j++) {
+		float zLow = (float)(j * height / stacks);
+		float zHigh = (float)((j + 1) * height / stacks);
+		float radiusLow = (float)(baseRadius - deltaRadius * ((double)j / stacks));
+		float radiusHigh = (float)(baseRadius - deltaRadius * ((double)(j + 1) / stacks));
+
+		renderer->begin(PRIM_QUAD_STRIP);
+		for (int i = 0; i <= slices; i++) {
+			renderer->normal(xyNormalRatio * sinSlice[i], xyNormalRatio * cosSlice[i], zNormal);
+			renderer->vertex(radiusLow * sinSlice[i], radiusLow * cosSlice[i], zLow);
+			renderer->vertex(radiusHigh * sinSlice[i], radiusHigh * cosSlice[i], zHigh);
+		}
+		renderer->end();
+	}
+}
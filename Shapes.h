@@ -0,0 +1,9 @@
+#pragma once
+
+// Solid primitives built from Renderer calls, vertex for vertex what GLUT
+// 3.7 and GLU draw for glutSolidCube/Sphere/Cone and gluCylinder, so every
+// backend gets the same geometry and none of them needs a GLUT window.
+void solidCube(double size);
+void solidSphere(double radius, int slices, int stacks);
+void solidCone(double base, double height, int slices, int stacks);
+void solidCylinder(double baseRadius, double topRadius, double height, int slices, int stacks);
@@ -0,0 +1,233 @@
+#include "SkinnedMesh.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+void skinVertices(const SkinnedMesh& skinned, const float* bones, float* positions, float* normals) {
+	// Parts are rigid, so each vertex follows exactly one bone and needs no
+	// weights.
+	float normalMatrices[SKIN_MAX_BONES][9];
+	int boneCount = skinned.boneCount < SKIN_MAX_BONES ? skinned.boneCount : SKIN_MAX_BONES;
+	if (skinned.mesh.normals) {
+		for (int b = 0; b < boneCount; b++) computeNormalMatrix(bones + 16 * b, normalMatrices[b]);
+	}
+	for (int i = 0; i < skinned.mesh.vertexCount; i++) {
+		int b = skinned.bones[i] < boneCount ? skinned.bones[i] : 0;
+		const float* m = bones + 16 * b;
+		const float* p = skinned.mesh.positions + 3 * i;
+		float* out = positions + 3 * i;
+		out[0] = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+		out[1] = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+		out[2] = m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14];
+		if (!skinned.mesh.normals) continue;
+		const float* n = skinned.mesh.normals + 3 * i;
+		const float* nm = normalMatrices[b];
+		float x = nm[0] * n[0] + nm[3] * n[1] + nm[6] * n[2];
+		float y = nm[1] * n[0] + nm[4] * n[1] + nm[7] * n[2];
+		float z = nm[2] * n[0] + nm[5] * n[1] + nm[8] * n[2];
+		float length = sqrtf(x * x + y * y + z * z);
+		float scale = length > 0.0f ? 1.0f / length : 0.0f;
+		normals[3 * i] = x * scale;
+		normals[3 * i + 1] = y * scale;
+		normals[3 * i + 2] = z * scale;
+	}
+}
+
+void Renderer::drawSkinnedMesh(const SkinnedMesh& skinned, const float* bones) {
+	// One scratch copy per thread: recording workers skin too.
+	thread_local std::vector<float> positions, normals;
+	positions.resize(3 * skinned.mesh.vertexCount);
+	normals.resize(skinned.mesh.normals ? 3 * skinned.mesh.vertexCount : 0);
+	skinVertices(skinned, bones, positions.data(), normals.data());
+	Mesh mesh = skinned.mesh;
+	mesh.positions = positions.data();
+	mesh.normals = skinned.mesh.normals ? normals.data() : 0;
+	drawMesh(mesh);
+}
+
+MeshBuilder::MeshBuilder() : mode(MATRIX_MODELVIEW), time(0.0f), bone(0), primitiveType(PRIM_TRIANGLES) {
+	current.color[0] = current.color[1] = current.color[2] = 1.0f;
+	current.normal[0] = current.normal[1] = 0.0f;
+	current.normal[2] = 1.0f;
+}
+
+void MeshBuilder::setBone(int bone) {
+	this->bone = bone;
+	modelview = MatrixStack();
+}
+
+// Only the modelview places geometry; projection calls are ignored.
+void MeshBuilder::loadIdentity() {
+	if (mode == MATRIX_MODELVIEW) modelview.loadIdentity();
+}
+
+void MeshBuilder::pushMatrix() {
+	if (mode == MATRIX_MODELVIEW) modelview.push();
+}
+
+void MeshBuilder::popMatrix() {
+	if (mode == MATRIX_MODELVIEW) modelview.pop();
+}
+
+void MeshBuilder::translate(float x, float y, float z) {
+	if (mode == MATRIX_MODELVIEW) modelview.translate(x, y, z);
+}
+
+void MeshBuilder::rotate(float angle, float x, float y, float z) {
+	if (mode == MATRIX_MODELVIEW) modelview.rotate(angle, x, y, z);
+}
+
+void MeshBuilder::scale(float x, float y, float z) {
+	if (mode == MATRIX_MODELVIEW) modelview.scale(x, y, z);
+}
+
+void MeshBuilder::scaleWave(const TimeWave& s) {
+	float value = evaluateWave(s, time);
+	scale(value, value, value);
+}
+
+void MeshBuilder::multMatrix(const float m[16]) {
+	if (mode == MATRIX_MODELVIEW) modelview.multiply(m);
+}
+
+void MeshBuilder::pushAttrib() {
+	attribStack.push_back(current);
+}
+
+void MeshBuilder::popAttrib() {
+	if (attribStack.empty()) return;
+	current = attribStack.back();
+	attribStack.pop_back();
+}
+
+void MeshBuilder::color(float r, float g, float b) {
+	current.color[0] = r;
+	current.color[1] = g;
+	current.color[2] = b;
+}
+
+void MeshBuilder::colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b) {
+	color(evaluateWave(r, time), evaluateWave(g, time), evaluateWave(b, time));
+}
+
+void MeshBuilder::normal(float x, float y, float z) {
+	current.normal[0] = x;
+	current.normal[1] = y;
+	current.normal[2] = z;
+}
+
+void MeshBuilder::begin(PrimitiveType type) {
+	primitiveType = type;
+	primitive.clear();
+}
+
+void MeshBuilder::vertex(float x, float y, float z) {
+	const float* m = modelview.top();
+	float normalMatrix[9];
+	computeNormalMatrix(m, normalMatrix);
+	const float* n = current.normal;
+	Vertex v;
+	v.position[0] = m[0] * x + m[4] * y + m[8] * z + m[12];
+	v.position[1] = m[1] * x + m[5] * y + m[9] * z + m[13];
+	v.position[2] = m[2] * x + m[6] * y + m[10] * z + m[14];
+	for (int i = 0; i < 3; i++) {
+		v.normal[i] = normalMatrix[i] * n[0] + normalMatrix[3 + i] * n[1] + normalMatrix[6 + i] * n[2];
+		v.color[i] = current.color[i];
+	}
+	v.bone = (unsigned char)bone;
+	primitive.push_back(v);
+}
+
+// Appends count corners, each an offset from first into the part's vertices.
+void MeshBuilder::addIndices(Part& part, int first, const int* corners, int count) {
+	for (int i = 0; i < count; i++) part.indices.push_back(first + corners[i]);
+}
+
+// The same triangles GL would rasterize, wound the same way.
+void MeshBuilder::end() {
+	int count = (int)primitive.size();
+	bool isLines = primitiveType == PRIM_LINES || primitiveType == PRIM_LINE_STRIP;
+	Part& part = isLines ? lines : triangles;
+	int first = (int)part.vertices.size();
+	part.vertices.insert(part.vertices.end(), primitive.begin(), primitive.end());
+	switch (primitiveType) {
+	case PRIM_LINES:
+		for (int i = 0; i + 2 <= count; i += 2) {
+			int corners[2] = { i, i + 1 };
+			addIndices(part, first, corners, 2);
+		}
+		break;
+	case PRIM_LINE_STRIP:
+		for (int i = 0; i + 2 <= count; i++) {
+			int corners[2] = { i, i + 1 };
+			addIndices(part, first, corners, 2);
+		}
+		break;
+	case PRIM_TRIANGLES:
+		for (int i = 0; i + 3 <= count; i += 3) {
+			int corners[3] = { i, i + 1, i + 2 };
+			addIndices(part, first, corners, 3);
+		}
+		break;
+	case PRIM_TRIANGLE_FAN:
+		for (int i = 1; i + 2 <= count; i++) {
+			int corners[3] = { 0, i, i + 1 };
+			addIndices(part, first, corners, 3);
+		}
+		break;
+	case PRIM_QUADS:
+		for (int i = 0; i + 4 <= count; i += 4) {
+			int corners[6] = { i, i + 1, i + 2, i, i + 2, i + 3 };
+			addIndices(part, first, corners, 6);
+		}
+		break;
+	case PRIM_QUAD_STRIP:
+		// Quad i is 2i, 2i+1, 2i+3, 2i+2.
+		for (int i = 0; i + 4 <= count; i += 2) {
+			int corners[6] = { i, i + 1, i + 3, i, i + 3, i + 2 };
+			addIndices(part, first, corners, 6);
+		}
+		break;
+	}
+	primitive.clear();
+}
+
+bool MeshBuilder::build(SkinnedModel& model, int boneCount) const {
+	int triangleCount = (int)triangles.vertices.size(), lineCount = (int)lines.vertices.size();
+	if (triangleCount > 65536 || lineCount > 65536) {
+		printf("[mesh] %d and %d vertices are more than 16-bit indices reach\n", triangleCount, lineCount);
+		return false;
+	}
+	int total = triangleCount + lineCount;
+	model.positions.resize(3 * total);
+	model.normals.resize(3 * total);
+	model.colors.resize(3 * total);
+	model.bones.resize(total);
+	for (int i = 0; i < total; i++) {
+		const Vertex& v = i < triangleCount ? triangles.vertices[i] : lines.vertices[i - triangleCount];
+		memcpy(&model.positions[3 * i], v.position, sizeof(v.position));
+		memcpy(&model.normals[3 * i], v.normal, sizeof(v.normal));
+		memcpy(&model.colors[3 * i], v.color, sizeof(v.color));
+		model.bones[i] = v.bone;
+	}
+	model.triangleIndices.assign(triangles.indices.begin(), triangles.indices.end());
+	model.lineIndices.assign(lines.indices.begin(), lines.indices.end());
+
+	SkinnedMesh* meshes[2] = { &model.triangles, &model.lines };
+	const std::vector<unsigned short>* indices[2] = { &model.triangleIndices, &model.lineIndices };
+	int first[2] = { 0, triangleCount }, counts[2] = { triangleCount, lineCount };
+	for (int k = 0; k < 2; k++) {
+		Mesh& mesh = meshes[k]->mesh;
+		mesh.type = k == 0 ? PRIM_TRIANGLES : PRIM_LINES;
+		mesh.vertexCount = counts[k];
+		mesh.positions = model.positions.data() + 3 * first[k];
+		mesh.normals = model.normals.data() + 3 * first[k];
+		mesh.colors = model.colors.data() + 3 * first[k];
+		mesh.indexCount = (int)indices[k]->size();
+		mesh.indices = indices[k]->data();
+		meshes[k]->bones = model.bones.data() + first[k];
+		meshes[k]->boneCount = boneCount;
+	}
+	return true;
+}
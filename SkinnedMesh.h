@@ -0,0 +1,107 @@
+#pragma once
+
+#include "MatrixStack.h"
+#include "Renderer.h"
+
+#include <vector>
+
+#define SKIN_MAX_BONES 32
+
+// Moves each vertex of skinned by its bone's matrix into positions and,
+// when the mesh has normals, normals: three floats a vertex. Normals go
+// through the bone's inverse transpose and come out unit length.
+void skinVertices(const SkinnedMesh& skinned, const float* bones, float* positions, float* normals);
+
+// The arrays of a baked model. The triangles and the lines share one vertex
+// buffer, the triangles' vertices first; each SkinnedMesh points at its own
+// part of it, so a model cannot be copied.
+struct SkinnedModel {
+	SkinnedModel() {}
+	SkinnedModel(const SkinnedModel&) = delete;
+	SkinnedModel& operator=(const SkinnedModel&) = delete;
+
+	std::vector<float> positions, normals, colors;
+	std::vector<unsigned char> bones;
+	std::vector<unsigned short> triangleIndices, lineIndices;
+	SkinnedMesh triangles, lines;
+};
+
+// A Renderer that keeps what is drawn through it rather than drawing it, so
+// draw code can be baked into a model as it stands. Polygons are kept as
+// triangles and line strips as line pairs, transformed by its own matrix
+// stack and tagged with the bone given to setBone(). Color waves are
+// evaluated at the time given to setTime(); text is dropped.
+class MeshBuilder : public Renderer {
+public:
+	MeshBuilder();
+
+	// What follows is in this bone's space: the matrix goes back to identity.
+	void setBone(int bone);
+	// False, leaving model alone, when either part has more vertices than
+	// 16-bit indices reach.
+	bool build(SkinnedModel& model, int boneCount) const;
+
+	void init() {}
+	void clear() {}
+	void flush() {}
+	void setTime(float time) { this->time = time; }
+
+	void matrixMode(MatrixMode mode) { this->mode = mode; }
+	void loadIdentity();
+	void pushMatrix();
+	void popMatrix();
+	void translate(float x, float y, float z);
+	void rotate(float angle, float x, float y, float z);
+	void scale(float x, float y, float z);
+	void scaleWave(const TimeWave& s);
+	void multMatrix(const float m[16]);
+	void perspective(float, float, float, float) {}
+	void ortho2D(float, float, float, float) {}
+	void lookAt(float, float, float, float, float, float, float, float, float) {}
+
+	void pushAttrib();
+	void popAttrib();
+	void setMaterial(const float[4], const float[4], const float[4], float) {}
+	void setLight(const float[4], const float[4]) {}
+
+	void color(float r, float g, float b);
+	void colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b);
+	void normal(float x, float y, float z);
+	void lineWidth(float) {}
+	void begin(PrimitiveType type);
+	void vertex(float x, float y, float z);
+	void end();
+
+	void text(float, float, const char*) {}
+
+private:
+	struct Vertex {
+		float position[3];
+		float normal[3];
+		float color[3];
+		unsigned char bone;
+	};
+
+	struct Attrib {
+		float color[3];
+		float normal[3];
+	};
+
+	struct Part {
+		std::vector<Vertex> vertices;
+		std::vector<int> indices;
+	};
+
+	void addIndices(Part& part, int first, const int* corners, int count);
+
+	MatrixStack modelview;
+	MatrixMode mode;
+	float time;
+	int bone;
+	Attrib current;
+	std::vector<Attrib> attribStack;
+
+	PrimitiveType primitiveType;
+	std::vector<Vertex> primitive; // Since begin()
+	Part triangles, lines;
+};
@@ -0,0 +1,681 @@
+#include "SoftRenderer.h"
+#include "Profiler.h"
+#include "VectorBatch.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFT_RASTER_SSE2
+#include <emmintrin.h>
+#endif
+
+#define TILE_SIZE 64                 // Pixels, a multiple of 4
+#define LINE_PRIMITIVE 0x80000000u   // Bin entries with this bit index lines, the rest triangles
+#define CLEAR_COLOR 0x00ffffffu      // White, alpha 0
+#define CLEAR_DEPTH 0.0f             // Depth is stored reversed, see Triangle::z
+#define GLOBAL_AMBIENT 0.2f          // GL's default light model ambient
+
+static void normalize3(float* v) {
+	float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (length > 0) {
+		v[0] /= length;
+		v[1] /= length;
+		v[2] /= length;
+	}
+}
+
+static unsigned int packColor(float r, float g, float b) {
+	return (unsigned int)(r + 0.5f) | ((unsigned int)(g + 0.5f) << 8) | ((unsigned int)(b + 0.5f) << 16) | 0xff000000u;
+}
+
+SoftRenderer::SoftRenderer(int width, int height, int threads)
+	: width(0), height(0), tilesX(0), tilesY(0), stride(0), clearPending(false),
+	mode(MATRIX_MODELVIEW), normalMatrixDirty(true), currentLineWidth(1.0f), time(0), primitiveType(PRIM_TRIANGLES),
+	generation(0), busyWorkers(0), stopping(false), nextTile(0) {
+	resize(width, height);
+	init();
+
+	if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+	for (int i = 1; i < threads; i++) {
+		workers.push_back(std::thread(&SoftRenderer::workerMain, this));
+	}
+}
+
+SoftRenderer::~SoftRenderer() {
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		stopping = true;
+	}
+	poolWake.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void SoftRenderer::resize(int width, int height) {
+	if (width == this->width && height == this->height) return;
+	this->width = width;
+	this->height = height;
+	tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	stride = tilesX * TILE_SIZE;
+	// Padded to whole tiles so the rasterizer never bounds-checks a 4-pixel group.
+	colorBuffer.assign(stride * tilesY * TILE_SIZE, CLEAR_COLOR);
+	depthBuffer.assign(stride * tilesY * TILE_SIZE, CLEAR_DEPTH);
+	bins.assign(tilesX * tilesY, std::vector<unsigned int>());
+	triangles.clear();
+	lines.clear();
+}
+
+void SoftRenderer::init() {
+	modelview = MatrixStack();
+	projection = MatrixStack();
+	mode = MATRIX_MODELVIEW;
+	normalMatrixDirty = true;
+
+	current.color[0] = current.color[1] = current.color[2] = 1.0f;
+	current.normal[0] = current.normal[1] = 0.0f;
+	current.normal[2] = 1.0f;
+	Lighting& l = current.lighting;
+	l.specular[0] = l.specular[1] = l.specular[2] = 0.0f;
+	l.shininess = 0.0f;
+	l.lightPosition[0] = l.lightPosition[1] = l.lightPosition[3] = 0.0f;
+	l.lightPosition[2] = 1.0f;
+	l.lightDiffuse[0] = l.lightDiffuse[1] = l.lightDiffuse[2] = 1.0f;
+	attribStack.clear();
+}
+
+void SoftRenderer::clear() {
+	if (!triangles.empty() || !lines.empty()) runTiles(); // Draw what came before the clear first
+	clearPending = true;
+}
+
+void SoftRenderer::flush() {
+	if (clearPending || !triangles.empty() || !lines.empty()) runTiles();
+}
+
+void SoftRenderer::setTime(float time) {
+	this->time = time;
+}
+
+MatrixStack& SoftRenderer::stack() {
+	return mode == MATRIX_PROJECTION ? projection : modelview;
+}
+
+void SoftRenderer::matrixMode(MatrixMode mode) {
+	this->mode = mode;
+}
+
+void SoftRenderer::loadIdentity() {
+	stack().loadIdentity();
+	if (mode == MATRIX_MODELVIEW) normalMatrixDirty = true;
+}
+
+void SoftRenderer::pushMatrix() {
+	stack().push();
+}
+
+void SoftRenderer::popMatrix() {
+	stack().pop();
+	if (mode == MATRIX_MODELVIEW) normalMatrixDirty = true;
+}
+
+void SoftRenderer::translate(float x, float y, float z) {
+	stack().translate(x, y, z);
+	if (mode == MATRIX_MODELVIEW) normalMatrixDirty = true;
+}
+
+void SoftRenderer::rotate(float angle, float x, float y, float z) {
+	stack().rotate(angle, x, y, z);
+	if (mode == MATRIX_MODELVIEW) normalMatrixDirty = true;
+}
+
+void SoftRenderer::scale(float x, float y, float z) {
+	stack().scale(x, y, z);
+	if (mode == MATRIX_MODELVIEW) normalMatrixDirty = true;
+}
+
+void SoftRenderer::scaleWave(const TimeWave& s) {
+	float value = evaluateWave(s, time);
+	scale(value, value, value);
+}
+
+void SoftRenderer::multMatrix(const float m[16]) {
+	stack().multiply(m);
+	if (mode == MATRIX_MODELVIEW) normalMatrixDirty = true;
+}
+
+void SoftRenderer::perspective(float fovy, float aspect, float zNear, float zFar) {
+	stack().perspective(fovy, aspect, zNear, zFar);
+	if (mode == MATRIX_MODELVIEW) normalMatrixDirty = true;
+}
+
+void SoftRenderer::ortho2D(float left, float right, float bottom, float top) {
+	stack().ortho2D(left, right, bottom, top);
+	if (mode == MATRIX_MODELVIEW) normalMatrixDirty = true;
+}
+
+void SoftRenderer::lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+	float upX, float upY, float upZ) {
+	stack().lookAt(eyeX, eyeY, eyeZ, centerX, centerY, centerZ, upX, upY, upZ);
+	if (mode == MATRIX_MODELVIEW) normalMatrixDirty = true;
+}
+
+void SoftRenderer::pushAttrib() {
+	attribStack.push_back(current);
+}
+
+void SoftRenderer::popAttrib() {
+	if (attribStack.empty()) return;
+	current = attribStack.back();
+	attribStack.pop_back();
+}
+
+void SoftRenderer::setMaterial(const float[4], const float[4], const float specular[4], float shininess) {
+	// Ambient and diffuse come from the current color while color material is on.
+	for (int i = 0; i < 3; i++) current.lighting.specular[i] = specular[i];
+	current.lighting.shininess = shininess;
+}
+
+void SoftRenderer::setLight(const float position[4], const float diffuse[4]) {
+	const float* m = modelview.top();
+	for (int i = 0; i < 4; i++) {
+		current.lighting.lightPosition[i] = m[i] * position[0] + m[4 + i] * position[1] + m[8 + i] * position[2] + m[12 + i] * position[3];
+	}
+	for (int i = 0; i < 3; i++) current.lighting.lightDiffuse[i] = diffuse[i];
+}
+
+void SoftRenderer::color(float r, float g, float b) {
+	current.color[0] = r;
+	current.color[1] = g;
+	current.color[2] = b;
+}
+
+void SoftRenderer::colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b) {
+	color(evaluateWave(r, time), evaluateWave(g, time), evaluateWave(b, time));
+}
+
+void SoftRenderer::normal(float x, float y, float z) {
+	current.normal[0] = x;
+	current.normal[1] = y;
+	current.normal[2] = z;
+}
+
+void SoftRenderer::lineWidth(float width) {
+	currentLineWidth = width;
+}
+
+void SoftRenderer::begin(PrimitiveType type) {
+	primitiveType = type;
+	primitiveVertices.clear();
+}
+
+// Transform and light one vertex: GL's lighting equation for a single light
+// with color material driving ambient and diffuse and a non-local viewer.
+void SoftRenderer::vertex(float x, float y, float z) {
+	if (normalMatrixDirty) {
+		computeNormalMatrix(modelview.top(), normalMatrix);
+		normalMatrixDirty = false;
+	}
+	const float* mv = modelview.top();
+	float eye[4];
+	for (int i = 0; i < 4; i++) {
+		eye[i] = mv[i] * x + mv[4 + i] * y + mv[8 + i] * z + mv[12 + i];
+	}
+	const float* nm = normalMatrix;
+	const float* n0 = current.normal;
+	float n[3];
+	for (int i = 0; i < 3; i++) {
+		n[i] = nm[i] * n0[0] + nm[3 + i] * n0[1] + nm[6 + i] * n0[2];
+	}
+	normalize3(n);
+
+	const Lighting& light = current.lighting;
+	float toLight[3];
+	if (light.lightPosition[3] != 0) {
+		for (int i = 0; i < 3; i++) toLight[i] = light.lightPosition[i] / light.lightPosition[3] - eye[i] / eye[3];
+	}
+	else {
+		for (int i = 0; i < 3; i++) toLight[i] = light.lightPosition[i];
+	}
+	normalize3(toLight);
+	float diffuse = n[0] * toLight[0] + n[1] * toLight[1] + n[2] * toLight[2];
+	float specular = 0;
+	if (diffuse > 0) {
+		float half[3] = { toLight[0], toLight[1], toLight[2] + 1.0f };
+		normalize3(half);
+		float nDotH = n[0] * half[0] + n[1] * half[1] + n[2] * half[2];
+		if (nDotH > 0) specular = powf(nDotH, light.shininess);
+	}
+	else {
+		diffuse = 0;
+	}
+
+	float lit[3];
+	for (int i = 0; i < 3; i++) {
+		float c = current.color[i] * (GLOBAL_AMBIENT + diffuse * light.lightDiffuse[i]) + specular * light.specular[i];
+		lit[i] = (c < 0 ? 0 : c > 1 ? 1 : c) * 255.0f;
+	}
+
+	const float* p = projection.top();
+	ClipVertex v;
+	v.x = p[0] * eye[0] + p[4] * eye[1] + p[8] * eye[2] + p[12] * eye[3];
+	v.y = p[1] * eye[0] + p[5] * eye[1] + p[9] * eye[2] + p[13] * eye[3];
+	v.z = p[2] * eye[0] + p[6] * eye[1] + p[10] * eye[2] + p[14] * eye[3];
+	v.w = p[3] * eye[0] + p[7] * eye[1] + p[11] * eye[2] + p[15] * eye[3];
+	v.r = lit[0];
+	v.g = lit[1];
+	v.b = lit[2];
+	// The game's near plane of 0.001 puts all of the room within 1e-4 of
+	// depth 1.0, where a float has too few steps left. Storing 1 - depth keeps
+	// the values near 0 instead, and taking w - z in one dot product avoids
+	// the cancellation of subtracting the two clip coordinates.
+	v.reverseZ = (p[3] - p[2]) * eye[0] + (p[7] - p[6]) * eye[1] + (p[11] - p[10]) * eye[2] + (p[15] - p[14]) * eye[3];
+	primitiveVertices.push_back(v);
+}
+
+void SoftRenderer::end() {
+	const std::vector<ClipVertex>& v = primitiveVertices;
+	int n = (int)v.size();
+	switch (primitiveType) {
+	case PRIM_LINES:
+		for (int i = 0; i + 1 < n; i += 2) emitLine(v[i], v[i + 1]);
+		break;
+	case PRIM_LINE_STRIP:
+		for (int i = 0; i + 1 < n; i++) emitLine(v[i], v[i + 1]);
+		break;
+	case PRIM_TRIANGLES:
+		for (int i = 0; i + 2 < n; i += 3) emitTriangle(v[i], v[i + 1], v[i + 2]);
+		break;
+	case PRIM_TRIANGLE_FAN:
+		for (int i = 1; i + 1 < n; i++) emitTriangle(v[0], v[i], v[i + 1]);
+		break;
+	case PRIM_QUADS:
+		for (int i = 0; i + 3 < n; i += 4) {
+			emitTriangle(v[i], v[i + 1], v[i + 2]);
+			emitTriangle(v[i], v[i + 2], v[i + 3]);
+		}
+		break;
+	case PRIM_QUAD_STRIP:
+		for (int i = 0; i + 3 < n; i += 2) {
+			emitTriangle(v[i], v[i + 1], v[i + 3]);
+			emitTriangle(v[i], v[i + 3], v[i + 2]);
+		}
+		break;
+	}
+	primitiveVertices.clear();
+}
+
+void SoftRenderer::text(float, float, const char*) {
+}
+
+// Signed distance to clip plane k: w+x, w-x, w+y, w-y, w+z, w-z.
+static float planeDistance(const float* v, int k) {
+	float d = v[k / 2];
+	return k & 1 ? v[3] - d : v[3] + d;
+}
+
+static void lerpVertex(const float* a, const float* b, float t, float* out) {
+	for (int i = 0; i < 8; i++) out[i] = a[i] + (b[i] - a[i]) * t;
+}
+
+void SoftRenderer::emitTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c) {
+	// Sutherland-Hodgman against all six planes; a triangle grows to at most nine vertices.
+	ClipVertex buffers[2][9];
+	int count = 3;
+	buffers[0][0] = a;
+	buffers[0][1] = b;
+	buffers[0][2] = c;
+	int in = 0;
+	for (int k = 0; k < 6 && count >= 3; k++) {
+		ClipVertex* src = buffers[in];
+		ClipVertex* dst = buffers[in ^ 1];
+		int out = 0;
+		for (int i = 0; i < count; i++) {
+			const float* p = &src[i].x;
+			const float* q = &src[(i + 1) % count].x;
+			float dp = planeDistance(p, k), dq = planeDistance(q, k);
+			if (dp >= 0) dst[out++] = src[i];
+			if ((dp >= 0) != (dq >= 0)) {
+				lerpVertex(p, q, dp / (dp - dq), &dst[out++].x);
+			}
+		}
+		count = out;
+		in ^= 1;
+	}
+	for (int i = 1; i + 1 < count; i++) {
+		ClipVertex v[3] = { buffers[in][0], buffers[in][i], buffers[in][i + 1] };
+		setupTriangle(v);
+	}
+}
+
+void SoftRenderer::setupTriangle(const ClipVertex* v) {
+	float x[3], y[3];
+	Triangle t;
+	for (int i = 0; i < 3; i++) {
+		float invW = 1.0f / v[i].w;
+		x[i] = (v[i].x * invW + 1.0f) * 0.5f * width;
+		y[i] = (v[i].y * invW + 1.0f) * 0.5f * height;
+		t.z[i] = v[i].reverseZ * invW * 0.5f;
+		t.invW[i] = invW;
+		t.r[i] = v[i].r;
+		t.g[i] = v[i].g;
+		t.b[i] = v[i].b;
+	}
+
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area == 0 || area != area) return;
+	// Nothing is culled, so clockwise triangles are turned around.
+	if (area < 0) {
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+		std::swap(t.z[1], t.z[2]);
+		std::swap(t.invW[1], t.invW[2]);
+		std::swap(t.r[1], t.r[2]);
+		std::swap(t.g[1], t.g[2]);
+		std::swap(t.b[1], t.b[2]);
+		area = -area;
+	}
+	t.invArea = 1.0f / area;
+
+	// Edge i runs from vertex i+1 to i+2. The coefficients are written so a
+	// neighbour sharing the edge gets exactly their negation, and
+	// exactly one of the two owns a pixel center lying on it.
+	for (int i = 0; i < 3; i++) {
+		int p = (i + 1) % 3, q = (i + 2) % 3;
+		t.ea[i] = y[p] - y[q];
+		t.eb[i] = x[q] - x[p];
+		t.ec[i] = x[p] * y[q] - x[q] * y[p];
+		t.topLeft[i] = t.ea[i] > 0 || (t.ea[i] == 0 && t.eb[i] < 0);
+	}
+
+	float minX = std::min(x[0], std::min(x[1], x[2])), maxX = std::max(x[0], std::max(x[1], x[2]));
+	float minY = std::min(y[0], std::min(y[1], y[2])), maxY = std::max(y[0], std::max(y[1], y[2]));
+	t.minX = std::max((int)floorf(minX), 0);
+	t.minY = std::max((int)floorf(minY), 0);
+	t.maxX = std::min((int)ceilf(maxX), width);
+	t.maxY = std::min((int)ceilf(maxY), height);
+	if (t.minX >= t.maxX || t.minY >= t.maxY) return;
+
+	triangles.push_back(t);
+	binPrimitive((unsigned int)triangles.size() - 1, (float)t.minX, (float)t.minY, (float)t.maxX, (float)t.maxY);
+}
+
+void SoftRenderer::emitLine(const ClipVertex& a, const ClipVertex& b) {
+	float p[8], q[8];
+	memcpy(p, &a.x, sizeof(p));
+	memcpy(q, &b.x, sizeof(q));
+	float t0 = 0, t1 = 1;
+	for (int k = 0; k < 6; k++) {
+		float dp = planeDistance(p, k), dq = planeDistance(q, k);
+		if (dp < 0 && dq < 0) return;
+		if (dp < 0) t0 = std::max(t0, dp / (dp - dq));
+		else if (dq < 0) t1 = std::min(t1, dp / (dp - dq));
+	}
+	if (t0 > t1) return;
+	float clipped[2][8];
+	lerpVertex(p, q, t0, clipped[0]);
+	lerpVertex(p, q, t1, clipped[1]);
+
+	Line l;
+	for (int i = 0; i < 2; i++) {
+		const float* v = clipped[i];
+		l.x[i] = (v[0] / v[3] + 1.0f) * 0.5f * width;
+		l.y[i] = (v[1] / v[3] + 1.0f) * 0.5f * height;
+		l.z[i] = v[7] / v[3] * 0.5f;
+		l.r[i] = v[4];
+		l.g[i] = v[5];
+		l.b[i] = v[6];
+	}
+	l.width = std::max(1, (int)(currentLineWidth + 0.5f));
+	lines.push_back(l);
+	float pad = (float)l.width;
+	binPrimitive(((unsigned int)lines.size() - 1) | LINE_PRIMITIVE,
+		std::min(l.x[0], l.x[1]) - pad, std::min(l.y[0], l.y[1]) - pad,
+		std::max(l.x[0], l.x[1]) + pad, std::max(l.y[0], l.y[1]) + pad);
+}
+
+void SoftRenderer::binPrimitive(unsigned int id, float minX, float minY, float maxX, float maxY) {
+	int tx0 = std::max((int)minX / TILE_SIZE, 0), tx1 = std::min((int)maxX / TILE_SIZE, tilesX - 1);
+	int ty0 = std::max((int)minY / TILE_SIZE, 0), ty1 = std::min((int)maxY / TILE_SIZE, tilesY - 1);
+	for (int ty = ty0; ty <= ty1; ty++) {
+		for (int tx = tx0; tx <= tx1; tx++) {
+			bins[ty * tilesX + tx].push_back(id);
+		}
+	}
+}
+
+// Hands the binned frame to the pool, works on it too, and returns once every tile is done.
+void SoftRenderer::runTiles() {
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		nextTile = 0;
+		busyWorkers = (int)workers.size();
+		generation++;
+	}
+	poolWake.notify_all();
+	rasterizeTiles();
+	{
+		std::unique_lock<std::mutex> lock(poolMutex);
+		poolDone.wait(lock, [this] { return busyWorkers == 0; });
+	}
+
+	clearPending = false;
+	triangles.clear();
+	lines.clear();
+	for (std::vector<unsigned int>& bin : bins) bin.clear();
+}
+
+void SoftRenderer::rasterizeTiles() {
+	PROFILE_ZONE("raster tiles");
+	int tileCount = tilesX * tilesY;
+	for (int tile = nextTile++; tile < tileCount; tile = nextTile++) {
+		rasterizeTile(tile);
+	}
+}
+
+void SoftRenderer::workerMain() {
+	setProfileThreadName("raster worker");
+	int seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(poolMutex);
+			poolWake.wait(lock, [this, seen] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+		}
+		rasterizeTiles();
+		{
+			std::lock_guard<std::mutex> lock(poolMutex);
+			if (--busyWorkers == 0) poolDone.notify_one();
+		}
+	}
+}
+
+void SoftRenderer::rasterizeTile(int tile) {
+	int x0 = (tile % tilesX) * TILE_SIZE, y0 = (tile / tilesX) * TILE_SIZE;
+	int x1 = x0 + TILE_SIZE, y1 = y0 + TILE_SIZE;
+	if (clearPending) {
+		for (int y = y0; y < y1; y++) {
+			std::fill(colorBuffer.begin() + y * stride + x0, colorBuffer.begin() + y * stride + x1, CLEAR_COLOR);
+			std::fill(depthBuffer.begin() + y * stride + x0, depthBuffer.begin() + y * stride + x1, CLEAR_DEPTH);
+		}
+	}
+	for (unsigned int id : bins[tile]) {
+		if (id & LINE_PRIMITIVE) {
+			rasterizeLine(lines[id & ~LINE_PRIMITIVE], x0, y0, x1, y1);
+			continue;
+		}
+		const Triangle& t = triangles[id];
+		int tx0 = std::max(t.minX, x0) & ~3, tx1 = std::min(t.maxX, x1);
+		int ty0 = std::max(t.minY, y0), ty1 = std::min(t.maxY, y1);
+		if (tx0 < tx1 && ty0 < ty1) rasterizeTriangle(t, tx0, ty0, tx1, ty1);
+	}
+}
+
+// Walks the box four pixels at a time. Pixel centers sit at +0.5; x0 is a multiple of 4.
+void SoftRenderer::rasterizeTriangle(const Triangle& t, int x0, int y0, int x1, int y1) {
+#ifdef SOFT_RASTER_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 maxChannel = _mm_set1_ps(255.0f);
+	const __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+	const __m128 invArea = _mm_set1_ps(t.invArea);
+	__m128 a[3], topLeft[3], z[3], invW[3], r[3], g[3], b[3];
+	for (int i = 0; i < 3; i++) {
+		a[i] = _mm_set1_ps(t.ea[i]);
+		topLeft[i] = _mm_castsi128_ps(_mm_set1_epi32(t.topLeft[i] ? -1 : 0));
+		z[i] = _mm_set1_ps(t.z[i]);
+		invW[i] = _mm_set1_ps(t.invW[i]);
+		r[i] = _mm_set1_ps(t.r[i]);
+		g[i] = _mm_set1_ps(t.g[i]);
+		b[i] = _mm_set1_ps(t.b[i]);
+	}
+
+	for (int y = y0; y < y1; y++) {
+		float py = (float)y + 0.5f;
+		__m128 row[3];
+		for (int i = 0; i < 3; i++) row[i] = _mm_set1_ps(t.eb[i] * py + t.ec[i]);
+		float* depthRow = &depthBuffer[y * stride];
+		unsigned int* colorRow = &colorBuffer[y * stride];
+
+		for (int x = x0; x < x1; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+			__m128 e[3], mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int i = 0; i < 3; i++) {
+				e[i] = _mm_add_ps(_mm_mul_ps(a[i], px), row[i]);
+				__m128 inside = _mm_or_ps(_mm_cmpgt_ps(e[i], zero), _mm_and_ps(_mm_cmpeq_ps(e[i], zero), topLeft[i]));
+				mask = _mm_and_ps(mask, inside);
+			}
+			if (!_mm_movemask_ps(mask)) continue;
+
+			__m128 l0 = _mm_mul_ps(e[0], invArea), l1 = _mm_mul_ps(e[1], invArea), l2 = _mm_mul_ps(e[2], invArea);
+			__m128 depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(z[0], l0), _mm_mul_ps(z[1], l1)), _mm_mul_ps(z[2], l2));
+			__m128 oldDepth = _mm_loadu_ps(depthRow + x);
+			mask = _mm_and_ps(mask, _mm_cmpgt_ps(depth, oldDepth));
+			if (!_mm_movemask_ps(mask)) continue;
+			_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(mask, depth), _mm_andnot_ps(mask, oldDepth)));
+
+			// Perspective-correct color.
+			__m128 w0 = _mm_mul_ps(l0, invW[0]), w1 = _mm_mul_ps(l1, invW[1]), w2 = _mm_mul_ps(l2, invW[2]);
+			__m128 norm = _mm_div_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_add_ps(w0, w1), w2));
+			__m128 cr = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, r[0]), _mm_mul_ps(w1, r[1])), _mm_mul_ps(w2, r[2])), norm);
+			__m128 cg = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, g[0]), _mm_mul_ps(w1, g[1])), _mm_mul_ps(w2, g[2])), norm);
+			__m128 cb = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, b[0]), _mm_mul_ps(w1, b[1])), _mm_mul_ps(w2, b[2])), norm);
+			__m128i ir = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(cr, maxChannel), zero));
+			__m128i ig = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(cg, maxChannel), zero));
+			__m128i ib = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(cb, maxChannel), zero));
+			__m128i pixel = _mm_or_si128(_mm_or_si128(ir, _mm_slli_epi32(ig, 8)), _mm_or_si128(_mm_slli_epi32(ib, 16), alpha));
+
+			__m128i keep = _mm_castps_si128(mask);
+			__m128i oldColor = _mm_loadu_si128((const __m128i*)(colorRow + x));
+			_mm_storeu_si128((__m128i*)(colorRow + x), _mm_or_si128(_mm_and_si128(keep, pixel), _mm_andnot_si128(keep, oldColor)));
+		}
+	}
+#else
+	for (int y = y0; y < y1; y++) {
+		float py = (float)y + 0.5f;
+		float row[3];
+		for (int i = 0; i < 3; i++) row[i] = t.eb[i] * py + t.ec[i];
+		for (int x = x0; x < x1; x++) {
+			float px = (float)x + 0.5f;
+			float e[3];
+			bool inside = true;
+			for (int i = 0; i < 3 && inside; i++) {
+				e[i] = t.ea[i] * px + row[i];
+				inside = e[i] > 0 || (e[i] == 0 && t.topLeft[i]);
+			}
+			if (!inside) continue;
+
+			float l0 = e[0] * t.invArea, l1 = e[1] * t.invArea, l2 = e[2] * t.invArea;
+			float depth = t.z[0] * l0 + t.z[1] * l1 + t.z[2] * l2;
+			float& oldDepth = depthBuffer[y * stride + x];
+			if (!(depth > oldDepth)) continue;
+			oldDepth = depth;
+
+			float w0 = l0 * t.invW[0], w1 = l1 * t.invW[1], w2 = l2 * t.invW[2];
+			float norm = 1.0f / (w0 + w1 + w2);
+			float c[3] = {
+				(w0 * t.r[0] + w1 * t.r[1] + w2 * t.r[2]) * norm,
+				(w0 * t.g[0] + w1 * t.g[1] + w2 * t.g[2]) * norm,
+				(w0 * t.b[0] + w1 * t.b[1] + w2 * t.b[2]) * norm
+			};
+			for (int i = 0; i < 3; i++) c[i] = c[i] < 0 ? 0 : c[i] > 255 ? 255 : c[i];
+			colorBuffer[y * stride + x] = packColor(c[0], c[1], c[2]);
+		}
+	}
+#endif
+}
+
+// Aliased wide line like GL's: one step per pixel along the major axis,
+// width pixels across the minor one. Only pixels inside the tile are touched.
+void SoftRenderer::rasterizeLine(const Line& l, int x0, int y0, int x1, int y1) {
+	float dx = l.x[1] - l.x[0], dy = l.y[1] - l.y[0];
+	bool xMajor = fabsf(dx) >= fabsf(dy);
+	int steps = (int)ceilf(xMajor ? fabsf(dx) : fabsf(dy));
+	if (steps < 1) steps = 1;
+	int first = -(l.width - 1) / 2;
+	for (int s = 0; s < steps; s++) {
+		float t = (s + 0.5f) / steps;
+		int px = (int)floorf(l.x[0] + dx * t), py = (int)floorf(l.y[0] + dy * t);
+		float depth = l.z[0] + (l.z[1] - l.z[0]) * t;
+		unsigned int pixel = packColor(l.r[0] + (l.r[1] - l.r[0]) * t,
+			l.g[0] + (l.g[1] - l.g[0]) * t, l.b[0] + (l.b[1] - l.b[0]) * t);
+		for (int k = first; k < first + l.width; k++) {
+			int x = xMajor ? px : px + k, y = xMajor ? py + k : py;
+			if (x < x0 || x >= x1 || y < y0 || y >= y1 || x >= width || y >= height) continue;
+			float& oldDepth = depthBuffer[y * stride + x];
+			if (!(depth > oldDepth)) continue;
+			oldDepth = depth;
+			colorBuffer[y * stride + x] = pixel;
+		}
+	}
+}
+
+BoxTest SoftRenderer::testBox(const float boxMin[3], const float boxMax[3]) const {
+	float toClip[16];
+	multiplyMatrices(projection.top(), modelview.top(), toClip);
+	float corners[3][8], clips[4][8];
+	for (int corner = 0; corner < 8; corner++) {
+		corners[0][corner] = corner & 1 ? boxMax[0] : boxMin[0];
+		corners[1][corner] = corner & 2 ? boxMax[1] : boxMin[1];
+		corners[2][corner] = corner & 4 ? boxMax[2] : boxMin[2];
+	}
+	Vector3Array in = { corners[0], corners[1], corners[2] };
+	Vector4Array out = { clips[0], clips[1], clips[2], clips[3] };
+	transformPoints(toClip, in, out, 8);
+
+	float minX = (float)width, minY = (float)height, maxX = 0, maxY = 0, nearest = 0;
+	int outside[6] = {};
+	for (int corner = 0; corner < 8; corner++) {
+		float clip[4] = { clips[0][corner], clips[1][corner], clips[2][corner], clips[3][corner] };
+		for (int k = 0; k < 6; k++) {
+			if (planeDistance(clip, k) < 0) outside[k]++;
+		}
+		if (clip[2] < -clip[3] || clip[3] <= 0) return BOX_VISIBLE; // In front of the near plane
+		float reverseZ = clip[3] - clip[2];
+		float x = (clip[0] / clip[3] + 1.0f) * 0.5f * width;
+		float y = (clip[1] / clip[3] + 1.0f) * 0.5f * height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearest = std::max(nearest, reverseZ / clip[3] * 0.5f);
+	}
+	for (int k = 0; k < 6; k++) {
+		if (outside[k] == 8) return BOX_OUTSIDE_VIEW;
+	}
+
+	// One pixel of margin: occluders were sampled at pixel centers only.
+	int x0 = std::max((int)floorf(minX) - 1, 0), x1 = std::min((int)ceilf(maxX) + 1, width);
+	int y0 = std::max((int)floorf(minY) - 1, 0), y1 = std::min((int)ceilf(maxY) + 1, height);
+	for (int y = y0; y < y1; y++) {
+		const float* row = &depthBuffer[y * stride];
+		for (int x = x0; x < x1; x++) {
+			if (!(row[x] > nearest)) return BOX_VISIBLE;
+		}
+	}
+	return BOX_OCCLUDED;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "MatrixStack.h"
+#include "Renderer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// CPU rasterizer for machines without a usable GL driver. Vertices are
+// transformed and lit as they arrive (Gouraud, GL's fixed-function model for
+// light 0 as setupLights() configures it), clipped, and binned into screen
+// tiles. flush() rasterizes the tiles on a pool of worker threads. A tile
+// draws its primitives in submission order, so the image doesn't depend on
+// the thread count. Text is not drawn.
+
+enum BoxTest {
+	BOX_VISIBLE,
+	BOX_OUTSIDE_VIEW,
+	BOX_OCCLUDED
+};
+
+class SoftRenderer : public Renderer {
+public:
+	// threads counts the calling thread; 0 means one per core.
+	SoftRenderer(int width, int height, int threads = 0);
+	~SoftRenderer();
+
+	void resize(int width, int height);
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int getThreadCount() const { return (int)workers.size() + 1; }
+
+	// RGBA8, bottom row first like glReadPixels, getStride() pixels per row.
+	const unsigned int* getPixels() const { return colorBuffer.data(); }
+	int getStride() const { return stride; }
+
+	// Tests an axis-aligned box, given in the coordinates of the current
+	// modelview matrix, against the depth buffer as of the last flush(). A
+	// box is occluded only if everything drawn covers its whole screen
+	// rectangle and lies nearer than its nearest corner; a box reaching past
+	// the near plane is always visible.
+	BoxTest testBox(const float boxMin[3], const float boxMax[3]) const;
+
+	void init();
+	void clear();
+	void flush();
+	void setTime(float time);
+
+	void matrixMode(MatrixMode mode);
+	void loadIdentity();
+	void pushMatrix();
+	void popMatrix();
+	void translate(float x, float y, float z);
+	void rotate(float angle, float x, float y, float z);
+	void scale(float x, float y, float z);
+	void scaleWave(const TimeWave& s);
+	void multMatrix(const float m[16]);
+	void perspective(float fovy, float aspect, float zNear, float zFar);
+	void ortho2D(float left, float right, float bottom, float top);
+	void lookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ,
+		float upX, float upY, float upZ);
+
+	void pushAttrib();
+	void popAttrib();
+	void setMaterial(const float ambient[4], const float diffuse[4], const float specular[4], float shininess);
+	void setLight(const float position[4], const float diffuse[4]);
+
+	void color(float r, float g, float b);
+	void colorWave(const TimeWave& r, const TimeWave& g, const TimeWave& b);
+	void normal(float x, float y, float z);
+	void lineWidth(float width);
+	void begin(PrimitiveType type);
+	void vertex(float x, float y, float z);
+	void end();
+
+	void text(float x, float y, const char* s);
+
+private:
+	// After transform and lighting; color is 0..255.
+	struct ClipVertex {
+		float x, y, z, w;
+		float r, g, b;
+		float reverseZ; // w - z, taken straight from eye space
+	};
+
+	struct Triangle {
+		float z[3];                // 1 - window depth: 1 at the near plane, 0 at the far one
+		float invW[3];
+		float r[3], g[3], b[3];
+		float ea[3], eb[3], ec[3]; // Edge functions, each zero on the edge opposite its vertex
+		bool topLeft[3];           // Edge owns the pixel centers lying exactly on it
+		float invArea;
+		int minX, minY, maxX, maxY;
+	};
+
+	struct Line {
+		float x[2], y[2], z[2];
+		float r[2], g[2], b[2];
+		int width;
+	};
+
+	struct Lighting {
+		float specular[3];
+		float shininess;
+		float lightPosition[4]; // Eye space
+		float lightDiffuse[3];
+	};
+
+	struct Attrib {
+		float color[3];
+		float normal[3];
+		Lighting lighting;
+	};
+
+	MatrixStack& stack(); // The one matrixMode() selects
+
+	void emitTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c);
+	void emitLine(const ClipVertex& a, const ClipVertex& b);
+	void setupTriangle(const ClipVertex* v);
+	void binPrimitive(unsigned int id, float minX, float minY, float maxX, float maxY);
+
+	void runTiles();
+	void rasterizeTiles();
+	void rasterizeTile(int tile);
+	void rasterizeTriangle(const Triangle& t, int x0, int y0, int x1, int y1);
+	void rasterizeLine(const Line& l, int x0, int y0, int x1, int y1);
+	void workerMain();
+
+	int width, height;
+	int tilesX, tilesY, stride;
+	std::vector<unsigned int> colorBuffer;
+	std::vector<float> depthBuffer;
+	bool clearPending;
+
+	MatrixStack modelview, projection;
+	MatrixMode mode;
+	float normalMatrix[9];
+	bool normalMatrixDirty;
+
+	Attrib current;
+	std::vector<Attrib> attribStack;
+	float currentLineWidth;
+	float time;
+
+	PrimitiveType primitiveType;
+	std::vector<ClipVertex> primitiveVertices;
+
+	std::vector<Triangle> triangles;
+	std::vector<Line> lines;
+	std::vector<std::vector<unsigned int> > bins; // Primitive ids per tile, in submission order
+
+	std::vector<std::thread> workers;
+	std::mutex poolMutex;
+	std::condition_variable poolWake;
+	std::condition_variable poolDone;
+	int generation;
+	int busyWorkers;
+	bool stopping;
+	std::atomic<int> nextTile;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <math.h>
+
+// A 3D vector as a plain value type. Everything short of a square root is
+// constexpr, so constant vectors like the camera presets are built by the
+// compiler. Work on many vectors at once belongs in the kernels of
+// VectorBatch.h, which run four at a time.
+class Vector3f {
+public:
+	float x, y, z;
+
+	constexpr Vector3f(float _x = 0.0f, float _y = 0.0f, float _z = 0.0f) : x(_x), y(_y), z(_z) {
+	}
+
+	constexpr Vector3f operator+(const Vector3f& v) const {
+		return Vector3f(x + v.x, y + v.y, z + v.z);
+	}
+
+	constexpr Vector3f operator-(const Vector3f& v) const {
+		return Vector3f(x - v.x, y - v.y, z - v.z);
+	}
+
+	constexpr Vector3f operator-() const {
+		return Vector3f(-x, -y, -z);
+	}
+
+	constexpr Vector3f operator*(float n) const {
+		return Vector3f(x * n, y * n, z * n);
+	}
+
+	constexpr Vector3f operator/(float n) const {
+		return Vector3f(x / n, y / n, z / n);
+	}
+
+	Vector3f& operator+=(const Vector3f& v) {
+		x += v.x;
+		y += v.y;
+		z += v.z;
+		return *this;
+	}
+
+	Vector3f& operator-=(const Vector3f& v) {
+		x -= v.x;
+		y -= v.y;
+		z -= v.z;
+		return *this;
+	}
+
+	constexpr float dot(const Vector3f& v) const {
+		return x * v.x + y * v.y + z * v.z;
+	}
+
+	constexpr Vector3f cross(const Vector3f& v) const {
+		return Vector3f(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x);
+	}
+
+	float length() const {
+		return sqrtf(dot(*this));
+	}
+
+	// A zero vector has no direction and stays zero rather than becoming NaNs.
+	Vector3f unit() const {
+		float l = length();
+		return l > 0.0f ? *this / l : Vector3f();
+	}
+};
@@ -0,0 +1,201 @@
+#include "VectorBatch.h"
+#include "Vector3f.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+// Four lanes of floats, and the handful of operations the kernels need.
+// Multiplies and adds stay separate (no fused multiply-add), so every lane
+// rounds exactly as the scalar tail loops do.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define VECTOR_LANES 4
+typedef __m128 Lanes;
+static inline Lanes load(const float* p) { return _mm_loadu_ps(p); }
+static inline void store(float* p, Lanes v) { _mm_storeu_ps(p, v); }
+static inline Lanes splat(float f) { return _mm_set1_ps(f); }
+static inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes squareRoot(Lanes a) { return _mm_sqrt_ps(a); }
+// a / b where b is positive, otherwise zero
+static inline Lanes divideOrZero(Lanes a, Lanes b) {
+	return _mm_and_ps(_mm_cmpgt_ps(b, _mm_setzero_ps()), _mm_div_ps(a, b));
+}
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define VECTOR_LANES 4
+typedef float32x4_t Lanes;
+static inline Lanes load(const float* p) { return vld1q_f32(p); }
+static inline void store(float* p, Lanes v) { vst1q_f32(p, v); }
+static inline Lanes splat(float f) { return vdupq_n_f32(f); }
+static inline Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+static inline Lanes sub(Lanes a, Lanes b) { return vsubq_f32(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+static inline Lanes squareRoot(Lanes a) { return vsqrtq_f32(a); }
+static inline Lanes divideOrZero(Lanes a, Lanes b) {
+	uint32x4_t positive = vcgtq_f32(b, vdupq_n_f32(0.0f));
+	return vreinterpretq_f32_u32(vandq_u32(positive, vreinterpretq_u32_f32(vdivq_f32(a, b))));
+}
+#endif
+
+#define VECTOR_BENCH_WORK 20000000 // Vectors per timed kernel, split into passes over the arrays
+
+void transformPoints(const float m[16], const Vector3Array& in, const Vector4Array& out, int count) {
+	int n = 0;
+#ifdef VECTOR_LANES
+	Lanes c[16];
+	for (int i = 0; i < 16; i++) c[i] = splat(m[i]);
+	for (; n + VECTOR_LANES <= count; n += VECTOR_LANES) {
+		Lanes x = load(in.x + n), y = load(in.y + n), z = load(in.z + n);
+		store(out.x + n, add(add(add(mul(c[0], x), mul(c[4], y)), mul(c[8], z)), c[12]));
+		store(out.y + n, add(add(add(mul(c[1], x), mul(c[5], y)), mul(c[9], z)), c[13]));
+		store(out.z + n, add(add(add(mul(c[2], x), mul(c[6], y)), mul(c[10], z)), c[14]));
+		store(out.w + n, add(add(add(mul(c[3], x), mul(c[7], y)), mul(c[11], z)), c[15]));
+	}
+#endif
+	for (; n < count; n++) {
+		float x = in.x[n], y = in.y[n], z = in.z[n];
+		out.x[n] = m[0] * x + m[4] * y + m[8] * z + m[12];
+		out.y[n] = m[1] * x + m[5] * y + m[9] * z + m[13];
+		out.z[n] = m[2] * x + m[6] * y + m[10] * z + m[14];
+		out.w[n] = m[3] * x + m[7] * y + m[11] * z + m[15];
+	}
+}
+
+void normalizeVectors(const Vector3Array& in, const Vector3Array& out, int count) {
+	int n = 0;
+#ifdef VECTOR_LANES
+	for (; n + VECTOR_LANES <= count; n += VECTOR_LANES) {
+		Lanes x = load(in.x + n), y = load(in.y + n), z = load(in.z + n);
+		Lanes length = squareRoot(add(add(mul(x, x), mul(y, y)), mul(z, z)));
+		store(out.x + n, divideOrZero(x, length));
+		store(out.y + n, divideOrZero(y, length));
+		store(out.z + n, divideOrZero(z, length));
+	}
+#endif
+	for (; n < count; n++) {
+		float x = in.x[n], y = in.y[n], z = in.z[n];
+		float length = sqrtf(x * x + y * y + z * z);
+		out.x[n] = length > 0.0f ? x / length : 0.0f;
+		out.y[n] = length > 0.0f ? y / length : 0.0f;
+		out.z[n] = length > 0.0f ? z / length : 0.0f;
+	}
+}
+
+void dotVectors(const Vector3Array& a, const Vector3Array& b, float* out, int count) {
+	int n = 0;
+#ifdef VECTOR_LANES
+	for (; n + VECTOR_LANES <= count; n += VECTOR_LANES) {
+		store(out + n, add(add(mul(load(a.x + n), load(b.x + n)), mul(load(a.y + n), load(b.y + n))),
+			mul(load(a.z + n), load(b.z + n))));
+	}
+#endif
+	for (; n < count; n++) out[n] = a.x[n] * b.x[n] + a.y[n] * b.y[n] + a.z[n] * b.z[n];
+}
+
+void crossVectors(const Vector3Array& a, const Vector3Array& b, const Vector3Array& out, int count) {
+	int n = 0;
+#ifdef VECTOR_LANES
+	for (; n + VECTOR_LANES <= count; n += VECTOR_LANES) {
+		Lanes ax = load(a.x + n), ay = load(a.y + n), az = load(a.z + n);
+		Lanes bx = load(b.x + n), by = load(b.y + n), bz = load(b.z + n);
+		store(out.x + n, sub(mul(ay, bz), mul(az, by)));
+		store(out.y + n, sub(mul(az, bx), mul(ax, bz)));
+		store(out.z + n, sub(mul(ax, by), mul(ay, bx)));
+	}
+#endif
+	for (; n < count; n++) {
+		out.x[n] = a.y[n] * b.z[n] - a.z[n] * b.y[n];
+		out.y[n] = a.z[n] * b.x[n] - a.x[n] * b.z[n];
+		out.z[n] = a.x[n] * b.y[n] - a.y[n] * b.x[n];
+	}
+}
+
+// Nanoseconds per vector for passes of run over count vectors.
+template <class Kernel>
+static double nsPerVector(int count, Kernel run) {
+	int passes = VECTOR_BENCH_WORK / count > 0 ? VECTOR_BENCH_WORK / count : 1;
+	run(); // Warm the caches
+	auto start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; pass++) run();
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / ((double)passes * count);
+}
+
+static void printKernel(const char* name, double classNs, double batchNs, float difference) {
+	printf("[vector] %-9s Vector3f %.2f ns per vector, batch %.2f ns (%.1fx), largest difference %g\n",
+		name, classNs, batchNs, batchNs > 0 ? classNs / batchNs : 0.0, difference);
+}
+
+void benchmarkVectorBatch(int count) {
+	// The class works on arrays of vectors, the kernels on arrays of components.
+	std::vector<Vector3f> a(count), b(count), classOut(count);
+	std::vector<float> classW(count), classDot(count);
+	std::vector<float> soa(count * 10);
+	Vector3Array sa = { &soa[0], &soa[count], &soa[count * 2] };
+	Vector3Array sb = { &soa[count * 3], &soa[count * 4], &soa[count * 5] };
+	Vector4Array so = { &soa[count * 6], &soa[count * 7], &soa[count * 8], &soa[count * 9] };
+	Vector3Array so3 = { so.x, so.y, so.z };
+	srand(1);
+	for (int i = 0; i < count; i++) {
+		a[i] = Vector3f((float)(rand() % 2001 - 1000) * 0.01f, (float)(rand() % 2001 - 1000) * 0.01f, (float)(rand() % 2001 - 1000) * 0.01f);
+		b[i] = Vector3f((float)(rand() % 2001 - 1000) * 0.01f, (float)(rand() % 2001 - 1000) * 0.01f, (float)(rand() % 2001 - 1000) * 0.01f);
+		sa.x[i] = a[i].x; sa.y[i] = a[i].y; sa.z[i] = a[i].z;
+		sb.x[i] = b[i].x; sb.y[i] = b[i].y; sb.z[i] = b[i].z;
+	}
+	const float m[16] = { 0.8f, 0.1f, -0.6f, 0.0f, 0.0f, 0.98f, 0.17f, 0.0f, 0.6f, -0.15f, 0.79f, 0.0f, 3.0f, -1.0f, 12.0f, 1.0f };
+	const Vector3f column0(m[0], m[1], m[2]), column1(m[4], m[5], m[6]), column2(m[8], m[9], m[10]), column3(m[12], m[13], m[14]);
+	printf("[vector] %d vectors, %s\n", count,
+#if defined(VECTOR_LANES) && (defined(__aarch64__) || defined(_M_ARM64))
+		"NEON"
+#elif defined(VECTOR_LANES)
+		"SSE"
+#else
+		"no SIMD"
+#endif
+	);
+
+	// Largest difference between the class's results and the kernel's.
+	auto differenceFrom = [&](const Vector3f* expected, const Vector3Array& got) {
+		float largest = 0;
+		for (int i = 0; i < count; i++) {
+			largest = fmaxf(largest, fabsf(expected[i].x - got.x[i]));
+			largest = fmaxf(largest, fabsf(expected[i].y - got.y[i]));
+			largest = fmaxf(largest, fabsf(expected[i].z - got.z[i]));
+		}
+		return largest;
+	};
+
+	double classNs = nsPerVector(count, [&]() {
+		for (int i = 0; i < count; i++) {
+			classOut[i] = column0 * a[i].x + column1 * a[i].y + column2 * a[i].z + column3;
+			classW[i] = m[3] * a[i].x + m[7] * a[i].y + m[11] * a[i].z + m[15];
+		}
+	});
+	double batchNs = nsPerVector(count, [&]() { transformPoints(m, sa, so, count); });
+	printKernel("transform", classNs, batchNs, differenceFrom(&classOut[0], so3));
+
+	classNs = nsPerVector(count, [&]() {
+		for (int i = 0; i < count; i++) classOut[i] = a[i].unit();
+	});
+	batchNs = nsPerVector(count, [&]() { normalizeVectors(sa, so3, count); });
+	printKernel("normalize", classNs, batchNs, differenceFrom(&classOut[0], so3));
+
+	classNs = nsPerVector(count, [&]() {
+		for (int i = 0; i < count; i++) classDot[i] = a[i].dot(b[i]);
+	});
+	batchNs = nsPerVector(count, [&]() { dotVectors(sa, sb, so.w, count); });
+	float dotDifference = 0;
+	for (int i = 0; i < count; i++) dotDifference = fmaxf(dotDifference, fabsf(classDot[i] - so.w[i]));
+	printKernel("dot", classNs, batchNs, dotDifference);
+
+	classNs = nsPerVector(count, [&]() {
+		for (int i = 0; i < count; i++) classOut[i] = a[i].cross(b[i]);
+	});
+	batchNs = nsPerVector(count, [&]() { crossVectors(sa, sb, so3, count); });
+	printKernel("cross", classNs, batchNs, differenceFrom(&classOut[0], so3));
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// Kernels over many vectors at once, kept as structure-of-arrays so that four
+// neighbours fill one SSE or NEON register. Each array needs count elements;
+// no alignment is required. Machines with neither run the same loops one
+// element at a time.
+
+// Element n is (x[n], y[n], z[n]).
+struct Vector3Array {
+	float* x;
+	float* y;
+	float* z;
+};
+
+struct Vector4Array {
+	float* x;
+	float* y;
+	float* z;
+	float* w;
+};
+
+// out = m * (in, 1), m column-major as in MatrixStack.
+void transformPoints(const float m[16], const Vector3Array& in, const Vector4Array& out, int count);
+// out = in / |in|; zero vectors come out zero. out may be in.
+void normalizeVectors(const Vector3Array& in, const Vector3Array& out, int count);
+void dotVectors(const Vector3Array& a, const Vector3Array& b, float* out, int count);
+// out may not be a or b.
+void crossVectors(const Vector3Array& a, const Vector3Array& b, const Vector3Array& out, int count);
+
+// Times each kernel against a loop of Vector3f over count vectors and prints
+// both.
+void benchmarkVectorBatch(int count);